@@ -20,7 +20,7 @@ Viewer3D_Panel::Viewer3D_Panel(FlexKit::GameFramework& framework, FlexKit::Textu
     camera          { CameraComponent::GetComponent().CreateCamera()                                        },
     gbuffer         { framework.ActiveWindow->WH, framework.core.RenderSystem                               },
     depthBuffer     { framework.core.RenderSystem.CreateDepthBuffer(framework.ActiveWindow->WH / 3,	true)   },
-    render{ framework.core.GetTempMemory(),
+    render{ framework.core.GetBlockMemory(),
             framework.core.RenderSystem,
             streamingEngine,
             framework.ActiveWindow->WH }
@@ -53,11 +53,13 @@ void Viewer3D_Panel::Draw(
     auto& transforms        = QueueTransformUpdateTask(dispatcher);
     auto& cameras           = CameraComponent::GetComponent().QueueCameraUpdate(dispatcher);
     auto& cameraConstants   = MakeHeapCopy(Camera::ConstantBuffer{}, core.GetTempMemory());
-    auto& PVS               = GatherScene(dispatcher, scene, camera, core.GetTempMemory());
+    auto& PVS               = GatherScene(dispatcher, scene, camera, core.GetTempMemory(), render.GetActiveOcclusionCuller());
     auto& Skinned           = GatherSkinned(dispatcher, scene, camera, core.GetTempMemory());
 
+    auto& sceneUpdate       = scene.sceneManagement.Update(dispatcher, scene, transforms);
+
     PVS.AddInput(cameras);
-    PVS.AddInput(transforms);
+    PVS.AddInput(sceneUpdate);
 
     const SceneDescription sceneDesc = {
         camera,
@@ -20,6 +20,7 @@
 #include "..\graphicsutilities\Geometry.cpp"
 #include "..\graphicsutilities\TextureUtilities.cpp"
 #include "..\coreutilities\memoryutilities.cpp"
+#include "..\coreutilities\LZCompression.cpp"
 #include "..\coreutilities\Logging.cpp"
 #include "..\coreutilities\MathUtils.cpp"
 #include "..\coreutilities\ThreadUtilities.h"
@@ -51,6 +52,8 @@ public:
 int main(int argc, char* argv[])
 {
 	bool FileChosen = false;
+	bool Compress	= false;
+	char* Layout	= nullptr;
 
 	static_vector<char*, 24> Inputs;
 	static_vector<char*, 24> MetaDataFiles;
@@ -90,6 +93,17 @@ int main(int argc, char* argv[])
 
 			I++;
 		}
+		else if (!strcmp(argv[I], "compress") || !strcmp(argv[I], "-z"))
+		{
+			Compress = true;
+		}
+		else if (!strcmp(argv[I], "layout") || !strcmp(argv[I], "-l"))
+		{
+			if (argc + 1 > I)
+				Layout = argv[I + 1];
+
+			I++;
+		}
 		else if (!strcmp(argv[I], "list") || !strcmp(argv[I], "-ls"))
 		{
 			Mode = TOOL_MODE::ETOOLMODE_LISTCONTENTS;
@@ -276,11 +290,51 @@ int main(int argc, char* argv[])
 			for (auto resource : resources)
 				blobs.push_back(resource->CreateBlob());
 
+			if (Compress)
+			{
+				for (auto& blob : blobs)
+					CompressResourceBlob(blob);
+			}
+
+			// Resources listed in a recorded asset manifest are written first, in the order they were used,
+			// so a load that follows the same path reads the package front to back
+			std::map<GUID_t, size_t> layoutOrder;
+
+			if (Layout)
+			{
+				FILE* F = nullptr;
+				if (fopen_s(&F, Layout, "rb") == 0 && F)
+				{
+					EXITSCOPE(fclose(F));
+
+					std::vector<AssetManifestEntry> manifest(ReadAssetManifestSize(F));
+
+					if (manifest.size() && ReadAssetManifest(F, manifest.data(), manifest.size()))
+					{
+						for (auto& entry : manifest)
+							layoutOrder.insert({ entry.GUID, layoutOrder.size() });
+					}
+					else
+						std::cout << "Failed to Read Asset Manifest: " << Layout << "\n";
+				}
+				else
+					std::cout << "Failed to Open Asset Manifest: " << Layout << "\n";
+			}
+
+			auto GetLayoutOrder = [&](const GUID_t guid)
+			{
+				auto res = layoutOrder.find(guid);
+				return res != layoutOrder.end() ? res->second : layoutOrder.size();
+			};
+
 			sort(blobs.begin(),
 				blobs.end(),
-				[](auto& lhs, auto& rhs) 
+				[&](auto& lhs, auto& rhs) 
 				{
-					return lhs.GUID < rhs.GUID;
+					const size_t lhsOrder = GetLayoutOrder(lhs.GUID);
+					const size_t rhsOrder = GetLayoutOrder(rhs.GUID);
+
+					return lhsOrder != rhsOrder ? lhsOrder < rhsOrder : lhs.GUID < rhs.GUID;
 				});
 
 
@@ -297,7 +351,10 @@ int main(int argc, char* argv[])
 
 			std::cout << "Resources Found: " << resources.size() << "\n";
 
-			size_t Position = TableSize;
+			// Blobs start on 16 byte boundaries so the runtime can use them straight out of the mapped package
+			auto AlignPosition = [](size_t position) { return (position + 15) & ~size_t(15); };
+
+			size_t Position = AlignPosition(TableSize);
 
 			for(size_t I = 0; I < blobs.size(); ++I)
 			{
@@ -307,7 +364,7 @@ int main(int argc, char* argv[])
 					
 				memcpy(Table.Entries[I].ID, blobs[I].ID.c_str(), ID_LENGTH);
 
-				Position += blobs[I].bufferSize;
+				Position = AlignPosition(Position + blobs[I].bufferSize);
 				std::cout << "Resource Found: " << blobs[I].ID << " ID: " << Table.Entries[I].GUID << "\n";
 			}
 
@@ -321,8 +378,14 @@ int main(int argc, char* argv[])
 
 			std::cout << "writing resource " << Out << '\n';
 
+			const char padding[16] = { 0 };
+			fwrite(padding, sizeof(char), AlignPosition(TableSize) - TableSize, F);
+
 			for (auto& blob : blobs)
+			{
 				fwrite(blob.buffer, sizeof(char), blob.bufferSize, F);
+				fwrite(padding, sizeof(char), AlignPosition(blob.bufferSize) - blob.bufferSize, F);
+			}
 	}	break;
 	case TOOL_MODE::ETOOLMODE_LISTCONTENTS:
 	{	if (FileChosen)
@@ -383,6 +446,8 @@ int main(int argc, char* argv[])
 	{	std::cout << "COMPILES RESOURCE FILES FOR RUNTIME ENGINE\n"
 			"compile or -c to set it to compile mode\n"
 			"target or -f Species a FBX file for COMPILING\n"
+			"compress or -z stores resources block compressed\n"
+			"layout or -l Orders resources by a recorded asset manifest\n"
 			"list or -ls will Print the Targeted Resource File\n";
 	}	break;
 	default:
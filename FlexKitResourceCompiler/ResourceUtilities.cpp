@@ -4,6 +4,7 @@
 
 #include "..\buildsettings.h"
 #include "..\coreutilities\memoryutilities.h"
+#include "..\coreutilities\LZCompression.h"
 #include "..\graphicsutilities\AnimationUtilities.h"
 
 #include "Scenes.h"
@@ -522,6 +523,53 @@ FileDir SelectFile()
 /************************************************************************************************/
 
 
+void CompressResourceBlob(ResourceBlob& blob, const size_t blockSize)
+{
+	using FlexKit::CompressedResourceHeader;
+
+	const size_t blockCount	= (blob.bufferSize + blockSize - 1) / blockSize;
+	const size_t headerSize	= sizeof(CompressedResourceHeader) + sizeof(uint64_t) * (blockCount + 1);
+	const size_t capacity	= headerSize + FlexKit::LZCompressBound(blockSize) * blockCount;
+
+	char* buffer = (char*)malloc(capacity);
+	FK_ASSERT(buffer != nullptr, "Allocation Error!");
+
+	auto& header			= *(CompressedResourceHeader*)buffer;
+	header.magic			= CompressedResourceHeader::Magic;
+	header.uncompressedSize	= blob.bufferSize;
+	header.blockSize		= (uint32_t)blockSize;
+	header.blockCount		= (uint32_t)blockCount;
+
+	size_t offset = headerSize;
+	for (size_t I = 0; I < blockCount; ++I)
+	{
+		const size_t begin	= I * blockSize;
+		const size_t size	= std::min(blockSize, blob.bufferSize - begin);
+
+		size_t compressedSize = FlexKit::LZCompress(blob.buffer + begin, size, buffer + offset, capacity - offset);
+
+		if (!compressedSize || compressedSize >= size)
+		{
+			memcpy(buffer + offset, blob.buffer + begin, size);
+			compressedSize = size;
+		}
+
+		header.blockOffsets[I]	= offset;
+		offset					+= compressedSize;
+	}
+
+	header.blockOffsets[blockCount]	= offset;
+	header.compressedSize			= offset;
+
+	free(blob.buffer);
+	blob.buffer		= buffer;
+	blob.bufferSize	= offset;
+}
+
+
+/************************************************************************************************/
+
+
 /**********************************************************************
 
 Copyright (c) 2015 - 2019 Robert May
@@ -78,6 +78,9 @@ struct FileDir
 size_t CreateRandomID();
 FileDir SelectFile();
 
+// Replaces the blob with block compressed storage, blocks that don't shrink are stored raw
+void CompressResourceBlob(ResourceBlob& blob, const size_t blockSize = FlexKit::CompressedResourceHeader::DefaultBlockSize);
+
 
 /************************************************************************************************/
 
@@ -24,14 +24,52 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "stdafx.h"
 #include <iostream>
+#include <random>
+#include <vector>
 #include "CppUnitTest.h"
 
 #include "..\coreutilities\ThreadUtilities.cpp"
+#include "..\coreutilities\LZCompression.cpp"
+#include "..\coreutilities\ClusteredLighting.cpp"
+#include "..\coreutilities\OcclusionCulling.cpp"
+#include "..\coreutilities\Intersection.cpp"
+#include "..\coreutilities\AssetIndex.cpp"
+#include "..\coreutilities\Transforms.cpp"
+#include "..\coreutilities\DynamicBVH.h"
+#include "..\graphicsutilities\CoreSceneObjects.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {	
+	// Frees everything it handed out when it goes out of scope, for code that only allocates from temp memory
+	class TestScratchAllocator : public FlexKit::iAllocator
+	{
+	public:
+		~TestScratchAllocator()
+		{
+			for (auto* allocation : allocations)
+				::_aligned_free(allocation);
+		}
+
+		void* malloc(size_t size) override							{ return _aligned_malloc(size, 0x10); }
+		void  free(void*) override									{}
+		void  _aligned_free(void*) override							{}
+		void* malloc_Debug(size_t size, const char*, size_t) override	{ return malloc(size); }
+
+		void* _aligned_malloc(size_t size, size_t alignment) override
+		{
+			allocations.push_back(::_aligned_malloc(size ? size : 1, alignment));
+			return allocations.back();
+		}
+
+		std::vector<void*> allocations;
+	};
+
+
+	/************************************************************************************************/
+
+
 	static std::atomic_int readyCount = 0;
 
 	TEST_CLASS(MultiThreadUnitTests)
@@ -459,4 +497,1166 @@ namespace UnitTests
 		}
 
 	};
-}
\ No newline at end of file
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(LZCompressionUnitTests)
+	{
+	public:
+
+		static bool RoundTrip(const std::vector<char>& src)
+		{
+			std::vector<char> compressed(FlexKit::LZCompressBound(src.size()));
+			std::vector<char> decompressed(src.size());
+
+			const size_t compressedSize = FlexKit::LZCompress(src.data(), src.size(), compressed.data(), compressed.size());
+			if (!compressedSize)
+				return false;
+
+			if (!FlexKit::LZDecompress(compressed.data(), compressedSize, decompressed.data(), decompressed.size()))
+				return false;
+
+			return decompressed == src;
+		}
+
+
+		TEST_METHOD(LZ_RoundTrip)
+		{
+			std::mt19937 rng{ 1234 };
+
+			std::vector<char> empty;
+			Assert::IsTrue(RoundTrip(empty), L"Empty block failed to round trip\n");
+
+			std::vector<char> tiny{ 'a', 'b', 'c' };
+			Assert::IsTrue(RoundTrip(tiny), L"Block shorter than a match failed to round trip\n");
+
+			std::vector<char> repeated(128 * 1024, 'x');
+			Assert::IsTrue(RoundTrip(repeated), L"Run of one byte failed to round trip\n");
+
+			// Text-like data, mostly short repeats inside the 64KB window
+			std::vector<char> structured(128 * 1024);
+			for (size_t I = 0; I < structured.size(); ++I)
+				structured[I] = "FlexKit asset block "[(I + rng() % 3) % 20];
+
+			Assert::IsTrue(RoundTrip(structured), L"Structured block failed to round trip\n");
+
+			// Incompressible, the output ends up larger than the input but must still fit the bound
+			std::vector<char> noise(128 * 1024);
+			for (auto& c : noise)
+				c = (char)rng();
+
+			Assert::IsTrue(RoundTrip(noise), L"Incompressible block failed to round trip\n");
+
+			// Matches further back than the window can reach
+			std::vector<char> farRepeat(200 * 1024);
+			for (size_t I = 0; I < 70 * 1024; ++I)
+				farRepeat[I] = (char)rng();
+
+			for (size_t I = 70 * 1024; I < farRepeat.size(); ++I)
+				farRepeat[I] = farRepeat[I - 70 * 1024];
+
+			Assert::IsTrue(RoundTrip(farRepeat), L"Block with out of window repeats failed to round trip\n");
+		}
+
+
+		TEST_METHOD(LZ_RejectsMalformedInput)
+		{
+			std::vector<char> src(4096);
+			for (size_t I = 0; I < src.size(); ++I)
+				src[I] = (char)(I % 61);
+
+			std::vector<char> compressed(FlexKit::LZCompressBound(src.size()));
+			const size_t compressedSize = FlexKit::LZCompress(src.data(), src.size(), compressed.data(), compressed.size());
+
+			Assert::IsTrue(compressedSize > 0 && compressedSize < src.size(), L"Repeating block failed to compress\n");
+
+			std::vector<char> dst(src.size());
+
+			Assert::IsFalse(FlexKit::LZDecompress(compressed.data(), compressedSize, dst.data(), dst.size() - 1),
+				L"Output larger than the destination was accepted\n");
+
+			Assert::IsFalse(FlexKit::LZDecompress(compressed.data(), compressedSize - 1, dst.data(), dst.size()),
+				L"Truncated block was accepted\n");
+
+			Assert::IsTrue(FlexKit::LZCompress(src.data(), src.size(), compressed.data(), 8) == 0,
+				L"Compressor wrote past the output capacity\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(LightClusterUnitTests)
+	{
+	public:
+
+		// View space point inside cluster (X, Y, S) at fractions u, v, w across it
+		static FlexKit::float3 ClusterPoint(
+			const FlexKit::LightClusterGrid&	grid,
+			const FlexKit::LightClusterView&	view,
+			const uint32_t X, const uint32_t Y, const uint32_t S,
+			const float u, const float v, const float w)
+		{
+			const float tanY	= std::tan(view.FOV / 2.0f);
+			const float tanX	= tanY * view.aspectRatio;
+			const float d0		= view.nearPlane * std::pow(view.farPlane / view.nearPlane, float(S) / grid.dimensions[2]);
+			const float d1		= view.nearPlane * std::pow(view.farPlane / view.nearPlane, float(S + 1) / grid.dimensions[2]);
+			const float depth	= d0 + (d1 - d0) * w;
+			const float ndcX	= -1.0f + 2.0f * (X + u) / grid.dimensions[0];
+			const float ndcY	=  1.0f - 2.0f * (Y + v) / grid.dimensions[1];
+
+			return { ndcX * tanX * depth, ndcY * tanY * depth, -depth };
+		}
+
+
+		// Checks every cluster against every light. A light overlapping any sample point of a cluster must be listed,
+		// a listed light must at least overlap the cluster's view space bounds.
+		static void CheckAgainstBruteForce(
+			const FlexKit::LightClusterGrid&	grid,
+			const FlexKit::LightClusterView&	view,
+			const std::vector<FlexKit::ClusterLight>& lights)
+		{
+			const size_t sampleSteps = 5;
+
+			for (uint32_t S = 0; S < grid.dimensions[2]; ++S)
+			{
+				for (uint32_t Y = 0; Y < grid.dimensions[1]; ++Y)
+				{
+					for (uint32_t X = 0; X < grid.dimensions[0]; ++X)
+					{
+						const auto&		cluster	= grid.clusters[grid.GetClusterID(X, Y, S)];
+						const uint32_t*	begin	= grid.lightIndices.begin() + cluster[0];
+						const uint32_t*	end		= begin + cluster[1];
+
+						for (const uint32_t* itr = begin; itr + 1 < end; ++itr)
+							Assert::IsTrue(itr[0] < itr[1], L"Cluster lights aren't sorted or contain duplicates\n");
+
+						// Bounds of the cluster, the corners of its near and far faces
+						float lo[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+						float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+						for (float u : { 0.0f, 1.0f })
+							for (float v : { 0.0f, 1.0f })
+								for (float w : { 0.0f, 1.0f })
+								{
+									const auto p = ClusterPoint(grid, view, X, Y, S, u, v, w);
+									for (size_t axis = 0; axis < 3; ++axis)
+									{
+										lo[axis] = std::min(lo[axis], p[axis]);
+										hi[axis] = std::max(hi[axis], p[axis]);
+									}
+								}
+
+						for (uint32_t L = 0; L < lights.size(); ++L)
+						{
+							const auto& light	= lights[L];
+							const bool	listed	= std::binary_search(begin, end, L);
+
+							float boundsDistance = 0.0f;
+							for (size_t axis = 0; axis < 3; ++axis)
+							{
+								const float d = std::max(std::max(lo[axis] - light.position[axis], light.position[axis] - hi[axis]), 0.0f);
+								boundsDistance += d * d;
+							}
+
+							if (listed)
+								Assert::IsTrue(boundsDistance <= light.radius * light.radius * 1.001f, L"Light listed in a cluster it can't touch\n");
+
+							if (listed || cluster[1] == FlexKit::LightClusterGrid::MaxLightsPerCluster)
+								continue;
+
+							for (size_t I = 0; I < sampleSteps * sampleSteps * sampleSteps; ++I)
+							{
+								const float u = float(I % sampleSteps) / (sampleSteps - 1);
+								const float v = float(I / sampleSteps % sampleSteps) / (sampleSteps - 1);
+								const float w = float(I / sampleSteps / sampleSteps) / (sampleSteps - 1);
+
+								const auto	p	= ClusterPoint(grid, view, X, Y, S, u, v, w);
+								const auto	d	= p - light.position;
+
+								Assert::IsFalse(d.dot(d) < light.radius * light.radius * 0.999f, L"Light missing from a cluster it overlaps\n");
+							}
+						}
+					}
+				}
+			}
+		}
+
+
+		TEST_METHOD(LightClusters_MatchBruteForce)
+		{
+			TestScratchAllocator temp;
+
+			const FlexKit::LightClusterView view{ 3.14159f / 3.0f, 16.0f / 9.0f, 0.1f, 100.0f };
+
+			FlexKit::LightClusterGrid grid{ &temp };
+			grid.dimensions = { 16, 9, 12 };
+
+			const float tanY = std::tan(view.FOV / 2.0f);
+			const float tanX = tanY * view.aspectRatio;
+
+			auto sliceDepth = [&](const uint32_t S) { return view.nearPlane * std::pow(view.farPlane / view.nearPlane, float(S) / grid.dimensions[2]); };
+			auto tileEdgeX	= [&](const uint32_t X, const float depth) { return (-1.0f + 2.0f * X / grid.dimensions[0]) * tanX * depth; };
+			auto tileEdgeY	= [&](const uint32_t Y, const float depth) { return (1.0f - 2.0f * Y / grid.dimensions[1]) * tanY * depth; };
+
+			std::vector<FlexKit::ClusterLight> lights;
+
+			// Centered on slice boundaries
+			for (uint32_t S = 1; S < grid.dimensions[2]; S += 2)
+				lights.push_back({ { 0.0f, 0.0f, -sliceDepth(S) }, sliceDepth(S) * 0.05f });
+
+			// Centered on tile edges and on tile corners
+			for (uint32_t X = 1; X < grid.dimensions[0]; X += 3)
+			{
+				const float depth = 5.0f;
+				lights.push_back({ { tileEdgeX(X, depth), 0.1f, -depth }, 0.2f });
+				lights.push_back({ { tileEdgeX(X, depth), tileEdgeY(X % grid.dimensions[1], depth), -depth }, 0.15f });
+			}
+
+			// Exactly touching a slice boundary from the near side
+			lights.push_back({ { 0.3f, -0.2f, -(sliceDepth(6) - 0.25f) }, 0.25f });
+
+			// Behind the camera, past the far plane, outside the frustum and straddling the near plane
+			lights.push_back({ { 0.0f, 0.0f,  5.0f }, 1.0f });
+			lights.push_back({ { 0.0f, 0.0f, -150.0f }, 10.0f });
+			lights.push_back({ { 50.0f, 0.0f, -5.0f }, 1.0f });
+			lights.push_back({ { 0.0f, 0.0f, 0.0f }, 0.5f });
+
+			// Random lights of all sizes
+			std::mt19937 rng{ 37 };
+			std::uniform_real_distribution<float> unit{ 0.0f, 1.0f };
+
+			for (size_t I = 0; I < 200; ++I)
+			{
+				const float depth = view.nearPlane + unit(rng) * 60.0f;
+				lights.push_back({
+					{	(unit(rng) * 2.0f - 1.0f) * tanX * depth * 1.2f,
+						(unit(rng) * 2.0f - 1.0f) * tanY * depth * 1.2f,
+						-depth },
+					0.05f + unit(rng) * unit(rng) * 8.0f });
+			}
+
+			FlexKit::BuildLightClusters(grid, view, lights.data(), lights.size(), nullptr, &temp);
+
+			Assert::IsTrue(grid.clusters.size() == grid.GetClusterCount(), L"Grid has the wrong cluster count\n");
+
+			CheckAgainstBruteForce(grid, view, lights);
+		}
+
+
+		TEST_METHOD(LightClusters_PackTrimsToCapacity)
+		{
+			TestScratchAllocator temp;
+
+			const FlexKit::LightClusterView view{ 3.14159f / 3.0f, 1.0f, 0.1f, 100.0f };
+
+			FlexKit::LightClusterGrid grid{ &temp };
+			grid.dimensions = { 4, 4, 4 };
+
+			std::vector<FlexKit::ClusterLight> lights;
+			for (size_t I = 0; I < 8; ++I)
+				lights.push_back({ { 0.0f, 0.0f, -10.0f }, 1000.0f }); // Covers every cluster
+
+			FlexKit::BuildLightClusters(grid, view, lights.data(), lights.size(), nullptr, &temp);
+
+			const size_t clusterCount = grid.GetClusterCount();
+			std::vector<uint32_t> packed(FlexKit::GetPackedLightClusterSize(grid.dimensions) / sizeof(uint32_t));
+
+			const size_t fullSize = FlexKit::PackLightClusters(grid, packed.data(), packed.size() * sizeof(uint32_t));
+			Assert::IsTrue(fullSize == (clusterCount * 2 + clusterCount * lights.size()) * sizeof(uint32_t), L"Packed grid has the wrong size\n");
+
+			for (size_t I = 0; I < clusterCount; ++I)
+			{
+				Assert::IsTrue(packed[I * 2] == I * lights.size() && packed[I * 2 + 1] == lights.size(), L"Packed cluster has the wrong range\n");
+
+				for (uint32_t L = 0; L < lights.size(); ++L)
+					Assert::IsTrue(packed[clusterCount * 2 + packed[I * 2] + L] == L, L"Packed cluster has the wrong lights\n");
+			}
+
+			// Room for the table and three clusters worth of lights
+			const size_t trimmedCapacity	= (clusterCount * 2 + lights.size() * 3) * sizeof(uint32_t);
+			const size_t trimmedSize		= FlexKit::PackLightClusters(grid, packed.data(), trimmedCapacity);
+
+			Assert::IsTrue(trimmedSize == trimmedCapacity, L"Trimmed grid doesn't fill the buffer\n");
+			Assert::IsTrue(packed[3 * 2 + 1] == 0, L"Cluster past the capacity kept its lights\n");
+			Assert::IsTrue(FlexKit::PackLightClusters(grid, packed.data(), clusterCount) == 0, L"Grid packed into a buffer too small for its table\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(OcclusionCullingUnitTests)
+	{
+	public:
+
+		static FlexKit::AABB Box(const FlexKit::float3 center, const float halfSize)
+		{
+			return {
+				{ center.x - halfSize, center.y - halfSize, center.z - halfSize },
+				{ center.x + halfSize, center.y + halfSize, center.z + halfSize } };
+		}
+
+
+		static FlexKit::float4x4 Translation(const FlexKit::float3 position)
+		{
+			auto WT = FlexKit::float4x4::Identity();
+			WT[0][3] = position.x;
+			WT[1][3] = position.y;
+			WT[2][3] = position.z;
+
+			return WT;
+		}
+
+
+		// Camera at the origin looking down -Z at a 20x20 quad 10 units away
+		TEST_METHOD(Occlusion_QuadHidesWhatIsBehindIt)
+		{
+			TestScratchAllocator allocator;
+
+			const FlexKit::float3	vertices[]	= { { -10, -10, 0 }, { 10, -10, 0 }, { 10, 10, 0 }, { -10, 10, 0 } };
+			const uint32_t			indices[]	= { 0, 1, 2, 0, 2, 3 };
+
+			FlexKit::OccluderMesh quad;
+			quad.vertices		= vertices;
+			quad.indices		= indices;
+			quad.vertexCount	= 4;
+			quad.indexCount		= 6;
+
+			FlexKit::SoftwareOcclusionCuller culler{ &allocator };
+			culler.RegisterOccluder(FlexKit::TriMeshHandle{ 1 }, quad);
+
+			Assert::IsTrue(culler.FindOccluder(FlexKit::TriMeshHandle{ 1 }) != nullptr, L"Registered occluder not found\n");
+			Assert::IsTrue(culler.FindOccluder(FlexKit::TriMeshHandle{ 2 }) == nullptr, L"Found an occluder that was never registered\n");
+
+			culler.SetView({ 0, 0, 0 }, FlexKit::Quaternion::Identity(), 1.2f, 16.0f / 9.0f, 0.1f);
+			culler.Clear();
+
+			const FlexKit::OccluderInstance instance{ culler.FindOccluder(FlexKit::TriMeshHandle{ 1 }), Translation({ 0, 0, -10 }) };
+			culler.RasterizeOccluders(&instance, 1, nullptr, &allocator);
+
+			Assert::IsTrue(culler.GetCoveredPixelCount() > 0,					L"Occluder didn't cover any pixels\n");
+			Assert::IsFalse(culler.TestAABB(Box({ 0, 0, -20 }, 1.0f)),			L"Box behind the occluder is visible\n");
+			Assert::IsFalse(culler.TestBox(Box({ 0, 0, 0 }, 2.0f), Translation({ 2, 0, -30 })), L"Transformed box behind the occluder is visible\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 0, 0, -5 }, 1.0f)),			L"Box in front of the occluder is hidden\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 0, 0, -10 }, 1.0f)),			L"Box intersecting the occluder is hidden\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 40, 0, -20 }, 1.0f)),			L"Box beside the occluder is hidden\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 19, 0, -20 }, 1.5f)),			L"Box straddling the occluder's edge is hidden\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 0, 0, 0 }, 1.0f)),				L"Box crossing the near plane is hidden\n");
+		}
+
+
+		TEST_METHOD(Occlusion_BoxOccluder)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::SoftwareOcclusionCuller culler{ &allocator };
+			culler.RegisterBoxOccluder(FlexKit::TriMeshHandle{ 3 }, Box({ 0, 0, 0 }, 0.5f));
+
+			const FlexKit::OccluderMesh* box = culler.FindOccluder(FlexKit::TriMeshHandle{ 3 });
+			Assert::IsTrue(box && box->vertexCount == 8 && box->indexCount == 36, L"Box occluder has the wrong geometry\n");
+
+			// A unit cube scaled into a 20x20x1 slab, like the test scene's floor stood on end
+			auto WT = Translation({ 0, 0, -10 });
+			WT[0][0] = 20.0f;
+			WT[1][1] = 20.0f;
+
+			culler.SetView({ 0, 0, 0 }, FlexKit::Quaternion::Identity(), 1.2f, 16.0f / 9.0f, 0.1f);
+			culler.Clear();
+
+			const FlexKit::OccluderInstance instance{ box, WT };
+			culler.RasterizeOccluders(&instance, 1, nullptr, &allocator);
+
+			Assert::IsFalse(culler.TestAABB(Box({ 0, 0, -20 }, 1.0f)),	L"Box behind the box occluder is visible\n");
+			Assert::IsTrue(culler.TestAABB(Box({ 0, 0, -5 }, 1.0f)),	L"Box in front of the box occluder is hidden\n");
+
+			// Replacing and removing the occluder releases the culler's copy of the geometry
+			culler.RegisterBoxOccluder(FlexKit::TriMeshHandle{ 3 }, Box({ 0, 0, 0 }, 1.0f));
+			culler.UnregisterOccluder(FlexKit::TriMeshHandle{ 3 });
+
+			Assert::IsTrue(culler.FindOccluder(FlexKit::TriMeshHandle{ 3 }) == nullptr, L"Unregistered occluder still found\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(InstanceBatchingUnitTests)
+	{
+	public:
+
+		static void Push(FlexKit::Drawable& drawable, FlexKit::PVS& pvs)
+		{
+			pvs.push_back(FlexKit::PVEntry{ drawable, pvs.size(), 0u, drawable.MeshHandle });
+		}
+
+
+		TEST_METHOD(Batching_SplitsOnMeshAndMaterial)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::Drawable rock;
+			rock.MeshHandle = FlexKit::TriMeshHandle{ 1 };
+
+			FlexKit::Drawable redRock = rock;
+			redRock.MatProperties.albedo = { 1, 0, 0 };
+
+			FlexKit::Drawable tree;
+			tree.MeshHandle = FlexKit::TriMeshHandle{ 2 };
+
+			FlexKit::Drawable skinnedTree = tree;
+			skinnedTree.Skinned = true;
+
+			FlexKit::PVS pvs{ &allocator };
+			Push(rock,			pvs);
+			Push(rock,			pvs);
+			Push(rock,			pvs);
+			Push(redRock,		pvs);
+			Push(redRock,		pvs);
+			Push(tree,			pvs);
+			Push(skinnedTree,	pvs);
+			Push(skinnedTree,	pvs);
+			Push(rock,			pvs);
+
+			// Same drawable, but gathered at a lower LOD
+			pvs.push_back(FlexKit::PVEntry{ rock, pvs.size(), 0u, FlexKit::TriMeshHandle{ 3 } });
+
+			Assert::IsTrue(FlexKit::CanInstanceTogether(pvs[0], pvs[1]),	L"Equal entries can't be instanced\n");
+			Assert::IsFalse(FlexKit::CanInstanceTogether(pvs[2], pvs[3]),	L"Entries with different materials instanced together\n");
+			Assert::IsFalse(FlexKit::CanInstanceTogether(pvs[0], pvs[5]),	L"Entries with different meshes instanced together\n");
+			Assert::IsFalse(FlexKit::CanInstanceTogether(pvs[6], pvs[7]),	L"Skinned entries instanced together\n");
+			Assert::IsFalse(FlexKit::CanInstanceTogether(pvs[8], pvs[9]),	L"Entries with different LODs instanced together\n");
+
+			FlexKit::DrawInstanceBatchList batches{ &allocator };
+			FlexKit::BuildInstanceBatches(pvs.begin(), pvs.end(), batches);
+
+			const uint32_t expectedBegin[] = { 0, 3, 5, 6, 7, 8, 9 };
+			const uint32_t expectedCount[] = { 3, 2, 1, 1, 1, 1, 1 };
+
+			Assert::IsTrue(batches.size() == 7, L"Wrong number of batches\n");
+
+			for (size_t I = 0; I < batches.size(); ++I)
+			{
+				Assert::IsTrue(batches[I].begin == expectedBegin[I] && batches[I].count == expectedCount[I], L"Batch covers the wrong entries\n");
+				Assert::IsTrue(batches[I].mesh == pvs[batches[I].begin].Mesh, L"Batch draws the wrong mesh\n");
+			}
+		}
+
+
+		TEST_METHOD(Batching_SplitsAtMaxInstances)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::Drawable rock;
+			rock.MeshHandle = FlexKit::TriMeshHandle{ 1 };
+
+			FlexKit::PVS pvs{ &allocator };
+			for (size_t I = 0; I < 2 * FlexKit::MaxInstancesPerBatch + 3; ++I)
+				Push(rock, pvs);
+
+			FlexKit::DrawInstanceBatchList batches{ &allocator };
+			FlexKit::BuildInstanceBatches(pvs.begin(), pvs.end(), batches);
+
+			Assert::IsTrue(batches.size() == 3, L"Long run not split at MaxInstancesPerBatch\n");
+			Assert::IsTrue(batches[0].count == FlexKit::MaxInstancesPerBatch && batches[1].count == FlexKit::MaxInstancesPerBatch && batches[2].count == 3, L"Split batches have the wrong sizes\n");
+			Assert::IsTrue(batches[1].begin == FlexKit::MaxInstancesPerBatch && batches[2].begin == 2 * FlexKit::MaxInstancesPerBatch, L"Split batches start at the wrong entries\n");
+
+			batches.clear();
+			FlexKit::BuildInstanceBatches(pvs.begin(), pvs.begin() + 10, batches, 4);
+
+			Assert::IsTrue(batches.size() == 3 && batches[0].count == 4 && batches[1].count == 4 && batches[2].count == 2, L"Run not split at a custom limit\n");
+		}
+
+
+		TEST_METHOD(Batching_InstanceOffsetsAreAligned)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::DrawInstanceBatchList batches{ &allocator };
+			batches.push_back({ FlexKit::TriMeshHandle{ 1 }, 0,  3, 0 });		// 192 bytes, padded to 256
+			batches.push_back({ FlexKit::TriMeshHandle{ 2 }, 3,  1, 0 });		// Drawn without instance data
+			batches.push_back({ FlexKit::TriMeshHandle{ 3 }, 4,  4, 0 });		// Exactly 256
+			batches.push_back({ FlexKit::TriMeshHandle{ 4 }, 8,  5, 0 });		// 320 bytes, padded to 512
+			batches.push_back({ FlexKit::TriMeshHandle{ 5 }, 13, 2, 0 });
+
+			const size_t size = FlexKit::LayoutInstanceBuffer(batches);
+
+			Assert::IsTrue(batches[0].instanceOffset == 0,		L"First batch doesn't start the buffer\n");
+			Assert::IsTrue(batches[2].instanceOffset == 256,	L"Batch of one took instance buffer space\n");
+			Assert::IsTrue(batches[3].instanceOffset == 512,	L"Wrong offset after an exactly aligned batch\n");
+			Assert::IsTrue(batches[4].instanceOffset == 1024,	L"Wrong offset after a padded batch\n");
+			Assert::IsTrue(size == 1280,						L"Wrong instance buffer size\n");
+
+			for (const auto& batch : batches)
+				Assert::IsTrue(batch.instanceOffset % FlexKit::InstanceBufferAlignment == 0, L"Instance offset isn't 256 byte aligned\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(TransformUnitTests)
+	{
+	public:
+
+		// Mirror of the scene graph, nodes only get translations so world positions are sums of ancestor translations
+		struct TestNode
+		{
+			FlexKit::NodeHandle	handle;
+			size_t				parent;	// Index into the test's node list, -1 for root
+			FlexKit::float3		local;
+			bool				live;
+		};
+
+
+		static FlexKit::float3 ExpectedPositionW(const std::vector<TestNode>& nodes, size_t node)
+		{
+			FlexKit::float3 position = { 0, 0, 0 };
+
+			for (; node != size_t(-1); node = nodes[node].parent)
+			{
+				position.x += nodes[node].local.x;
+				position.y += nodes[node].local.y;
+				position.z += nodes[node].local.z;
+			}
+
+			return position;
+		}
+
+
+		static bool MatchesHierarchy(const std::vector<TestNode>& nodes)
+		{
+			for (size_t I = 0; I < nodes.size(); ++I)
+			{
+				if (!nodes[I].live)
+					continue;
+
+				const FlexKit::float3 expected	= ExpectedPositionW(nodes, I);
+				const FlexKit::float3 position	= FlexKit::GetPositionW(nodes[I].handle);
+
+				if (std::abs(position.x - expected.x) > 0.001f ||
+					std::abs(position.y - expected.y) > 0.001f ||
+					std::abs(position.z - expected.z) > 0.001f)
+					return false;
+			}
+
+			return true;
+		}
+
+
+		// Every node is stored after its parent once sorted, and free slots are compacted out
+		static bool IsSortedAndCompact(const std::vector<TestNode>& nodes)
+		{
+			size_t liveCount = 1; // Root
+
+			for (const auto& node : nodes)
+			{
+				if (!node.live)
+					continue;
+
+				const FlexKit::NodeHandle parent = FlexKit::GetParentNode(node.handle);
+				if (FlexKit::_SNHandleToIndex(parent) >= FlexKit::_SNHandleToIndex(node.handle))
+					return false;
+
+				liveCount++;
+			}
+
+			return FlexKit::SceneNodeTable.used == liveCount && !FlexKit::SceneNodeTable.FreeNodes.size();
+		}
+
+
+		static TestNode CreateNode(const FlexKit::float3 local)
+		{
+			TestNode node = { FlexKit::GetZeroedNode(), size_t(-1), local, true };
+			FlexKit::SetPositionL(node.handle, local);
+
+			return node;
+		}
+
+
+		static void SetParent(std::vector<TestNode>& nodes, const size_t node, const size_t parent)
+		{
+			nodes[node].parent = parent;
+			FlexKit::SetParentNode(nodes[parent].handle, nodes[node].handle);
+		}
+
+
+		TEST_METHOD(Transforms_UpdateMatchesHierarchy)
+		{
+			TestScratchAllocator allocator;
+			FlexKit::InitiateSceneNodeTable(&allocator, 64);
+
+			std::default_random_engine			generator{ 1234 };
+			std::uniform_int_distribution<int>	offset{ -8, 8 };
+			std::vector<TestNode>				nodes;
+
+			for (size_t I = 0; I < 2000; ++I)
+				nodes.push_back(CreateNode({ float(offset(generator)), float(offset(generator)), float(offset(generator)) }));
+
+			// Parents are picked from the next few nodes created, giving a deep hierarchy with every child stored before its parent
+			for (size_t I = 0; I + 4 < nodes.size(); ++I)
+				SetParent(nodes, I, std::min(I + 1 + generator() % 16, nodes.size() - 1));
+
+			FlexKit::UpdateTransforms();
+			Assert::IsTrue(MatchesHierarchy(nodes), L"World positions don't match the hierarchy\n");
+
+			// Moved nodes have to carry their children along, reparenting keeps the hierarchy acyclic by only picking later nodes
+			for (size_t I = 0; I < nodes.size(); I += 7)
+			{
+				nodes[I].local = { float(offset(generator)), 0, float(offset(generator)) };
+				FlexKit::SetPositionL(nodes[I].handle, nodes[I].local);
+			}
+
+			for (size_t I = 0; I + 16 < nodes.size(); I += 13)
+				SetParent(nodes, I, I + 1 + generator() % 15);
+
+			FlexKit::UpdateTransforms();
+			Assert::IsTrue(MatchesHierarchy(nodes), L"World positions don't match after moving and reparenting\n");
+
+			// Release leaves only, then sort
+			std::vector<bool> hasChildren(nodes.size(), false);
+			for (const auto& node : nodes)
+				if (node.parent != size_t(-1))
+					hasChildren[node.parent] = true;
+
+			for (size_t I = 0; I < nodes.size(); I += 3)
+			{
+				if (hasChildren[I])
+					continue;
+
+				FlexKit::ReleaseNode(nodes[I].handle);
+				nodes[I].live = false;
+			}
+
+			FlexKit::SortNodes();
+			Assert::IsTrue(IsSortedAndCompact(nodes), L"SortNodes didn't order parents first or left free slots\n");
+
+			FlexKit::UpdateTransforms();
+			Assert::IsTrue(MatchesHierarchy(nodes), L"World positions don't match after sorting\n");
+
+			FlexKit::ReleaseSceneNodeTable();
+		}
+
+
+		TEST_METHOD(Transforms_ThreadedUpdateAndIncrementalSort)
+		{
+			TestScratchAllocator	allocator;
+			FlexKit::ThreadManager	threads{ 4 };
+
+			FlexKit::InitiateSceneNodeTable(&allocator, 64);
+
+			std::vector<TestNode> nodes;
+
+			// Eight parents under root, so the level below is wide enough to be split across workers
+			const size_t childCount = 4 * FlexKit::TransformUpdateChunkSize;
+
+			for (size_t I = 0; I < childCount + 8; ++I)
+				nodes.push_back(CreateNode({ float(I % 5), float(I % 3), -float(I % 7) }));
+
+			for (size_t I = 0; I < childCount; ++I)
+				SetParent(nodes, I, childCount + I % 8);
+
+			FlexKit::UpdateTransforms(&threads, &allocator);
+			Assert::IsTrue(MatchesHierarchy(nodes), L"Threaded update doesn't match the hierarchy\n");
+
+			// Release half the leaves, the table is then fragmented enough to ask for a sort
+			for (size_t I = 0; I < childCount; I += 2)
+			{
+				FlexKit::ReleaseNode(nodes[I].handle);
+				nodes[I].live = false;
+			}
+
+			Assert::IsTrue(FlexKit::UpdateTransforms(&threads, &allocator), L"Fragmented table didn't ask for a sort\n");
+
+			// Nodes created while the sort is in progress end up in the tail
+			bool createdDuringSort = false;
+			while (!FlexKit::SortNodesIncremental(0.0))
+			{
+				if (!createdDuringSort)
+				{
+					nodes.push_back(CreateNode({ 1, 2, 3 }));
+					SetParent(nodes, nodes.size() - 1, nodes.size() - 2);
+
+					createdDuringSort = true;
+				}
+			}
+
+			Assert::IsTrue(createdDuringSort, L"Incremental sort finished in one step\n");
+			Assert::IsTrue(IsSortedAndCompact(nodes), L"Incremental sort didn't order parents first or left free slots\n");
+
+			FlexKit::UpdateTransforms(&threads, &allocator);
+			Assert::IsTrue(MatchesHierarchy(nodes), L"World positions don't match after the incremental sort\n");
+
+			FlexKit::ReleaseSceneNodeTable();
+			threads.Release();
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(DynamicBVHUnitTests)
+	{
+	public:
+
+		using TestBVH = FlexKit::DynamicBVH<uint32_t>;
+
+		// Mirror of the tree's leaves, fattened the same way the tree does so queries match exactly
+		struct TestLeaf
+		{
+			FlexKit::AABB	bounds;
+			FlexKit::AABB	fattened;
+			uint32_t		leaf;
+			bool			live;
+		};
+
+
+		static FlexKit::AABB RandomBox(std::default_random_engine& generator)
+		{
+			std::uniform_real_distribution<float> position{ -100.0f, 100.0f };
+			std::uniform_real_distribution<float> size{ 0.1f, 5.0f };
+
+			const FlexKit::float3 min = { position(generator), position(generator), position(generator) };
+			return { min, min + FlexKit::float3{ size(generator), size(generator), size(generator) } };
+		}
+
+
+		static FlexKit::AABB Fatten(const FlexKit::AABB& bounds, const float margin)
+		{
+			return { bounds.min - FlexKit::float3{ margin, margin, margin }, bounds.max + FlexKit::float3{ margin, margin, margin } };
+		}
+
+
+		static bool Overlaps(const FlexKit::AABB& lhs, const FlexKit::AABB& rhs)
+		{
+			return
+				lhs.min.x <= rhs.max.x && lhs.max.x >= rhs.min.x &&
+				lhs.min.y <= rhs.max.y && lhs.max.y >= rhs.min.y &&
+				lhs.min.z <= rhs.max.z && lhs.max.z >= rhs.min.z;
+		}
+
+
+		static bool QueriesMatchBruteForce(const TestBVH& bvh, const std::vector<TestLeaf>& leaves, std::default_random_engine& generator)
+		{
+			for (size_t I = 0; I < 64; ++I)
+			{
+				FlexKit::AABB query = RandomBox(generator);
+				query.max = query.max + FlexKit::float3{ 20, 20, 20 };
+
+				std::vector<uint32_t> found;
+				bvh.Query(query, [&](const uint32_t item) { found.push_back(item); });
+
+				std::vector<uint32_t> expected;
+				for (uint32_t J = 0; J < leaves.size(); ++J)
+					if (leaves[J].live && Overlaps(leaves[J].fattened, query))
+						expected.push_back(J);
+
+				std::sort(found.begin(), found.end());
+
+				if (found != expected)
+					return false;
+			}
+
+			return true;
+		}
+
+
+		// Parents contain their children and carry correct heights and leaf counts, every live leaf is reachable once
+		static bool IsValidTree(const TestBVH& bvh, const std::vector<TestLeaf>& leaves)
+		{
+			size_t				liveCount = 0;
+			std::vector<bool>	reached(leaves.size(), false);
+
+			for (const auto& leaf : leaves)
+				liveCount += leaf.live;
+
+			if (bvh.size() != liveCount)
+				return false;
+
+			if (bvh.GetRoot() == TestBVH::InvalidNode)
+				return liveCount == 0;
+
+			std::vector<uint32_t> stack = { bvh.GetRoot() };
+			while (stack.size())
+			{
+				const uint32_t		idx		= stack.back();
+				const TestBVH::Node	node	= bvh[idx];
+				stack.pop_back();
+
+				if (node.IsLeaf())
+				{
+					if (node.item >= leaves.size() || !leaves[node.item].live || reached[node.item] ||
+						leaves[node.item].leaf != idx || node.height != 0 || node.leaves != 1)
+						return false;
+
+					reached[node.item] = true;
+					continue;
+				}
+
+				const TestBVH::Node& left	= bvh[node.left];
+				const TestBVH::Node& right	= bvh[node.right];
+
+				if (left.parent != idx || right.parent != idx ||
+					!node.bounds.Contains(left.bounds) || !node.bounds.Contains(right.bounds) ||
+					node.height != 1 + std::max(left.height, right.height) ||
+					node.leaves != left.leaves + right.leaves)
+					return false;
+
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+
+			return bvh[bvh.GetRoot()].leaves == liveCount;
+		}
+
+
+		TEST_METHOD(BVH_InsertRemoveQueryMatchBruteForce)
+		{
+			TestScratchAllocator allocator;
+
+			const float margin = 0.25f;
+
+			std::default_random_engine	generator{ 5678 };
+			std::vector<TestLeaf>		leaves;
+			TestBVH						bvh{ &allocator, margin };
+
+			auto Insert = [&](const FlexKit::AABB& bounds)
+			{
+				const uint32_t leaf = bvh.Insert(bounds, uint32_t(leaves.size()));
+				leaves.push_back({ bounds, Fatten(bounds, margin), leaf, true });
+			};
+
+			for (size_t I = 0; I < 2000; ++I)
+				Insert(RandomBox(generator));
+
+			Assert::IsTrue(IsValidTree(bvh, leaves),						L"Tree invalid after inserting\n");
+			Assert::IsTrue(QueriesMatchBruteForce(bvh, leaves, generator),	L"Query doesn't match brute force after inserting\n");
+
+			for (size_t I = 0; I < leaves.size(); I += 3)
+			{
+				bvh.Remove(leaves[I].leaf);
+				leaves[I].live = false;
+			}
+
+			Assert::IsTrue(IsValidTree(bvh, leaves),						L"Tree invalid after removing\n");
+			Assert::IsTrue(QueriesMatchBruteForce(bvh, leaves, generator),	L"Query doesn't match brute force after removing\n");
+
+			// Small moves stay inside the fattened bounds and leave the tree alone, large ones reinsert
+			for (size_t I = 1; I < leaves.size(); I += 3)
+			{
+				const bool				smallMove	= I % 2;
+				const FlexKit::float3	offset		= smallMove ? FlexKit::float3{ 0.1f, 0, 0 } : FlexKit::float3{ 30.0f, 0, 0 };
+				const FlexKit::AABB		moved		= { leaves[I].bounds.min + offset, leaves[I].bounds.max + offset };
+
+				if (bvh.Move(leaves[I].leaf, moved) == smallMove)
+					Assert::Fail(L"Move reinserted a leaf still inside its fattened bounds, or kept one that left them\n");
+
+				leaves[I].bounds = moved;
+
+				if (!smallMove)
+					leaves[I].fattened = Fatten(moved, margin);
+			}
+
+			Assert::IsTrue(IsValidTree(bvh, leaves),						L"Tree invalid after moving\n");
+			Assert::IsTrue(QueriesMatchBruteForce(bvh, leaves, generator),	L"Query doesn't match brute force after moving\n");
+
+			// Reuses the nodes freed above
+			for (size_t I = 0; I < 500; ++I)
+				Insert(RandomBox(generator));
+
+			bvh.Optimize(1000);
+
+			Assert::IsTrue(IsValidTree(bvh, leaves),						L"Tree invalid after reinserting and optimizing\n");
+			Assert::IsTrue(QueriesMatchBruteForce(bvh, leaves, generator),	L"Query doesn't match brute force after reinserting and optimizing\n");
+			Assert::IsTrue(bvh.GetHeight() < 64,							L"Tree is badly unbalanced\n");
+
+			for (auto& leaf : leaves)
+			{
+				if (leaf.live)
+					bvh.Remove(leaf.leaf);
+
+				leaf.live = false;
+			}
+
+			Assert::IsTrue(bvh.size() == 0 && bvh.GetRoot() == TestBVH::InvalidNode, L"Tree not empty after removing everything\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(SphereCullingUnitTests)
+	{
+	public:
+
+		using CullKernel = void(*)(const FlexKit::Frustum&, const float*, const float*, const float*, const float*, const size_t, uint32_t*);
+
+		struct TestSpheres
+		{
+			std::vector<float> x, y, z, r;
+		};
+
+
+		// Spheres within rounding distance of a plane are skipped, the kernels and the reference order their math differently
+		static TestSpheres CreateSpheres(const FlexKit::Frustum* frusta, const size_t frustumCount, const size_t count)
+		{
+			std::default_random_engine				generator{ 9876 };
+			std::uniform_real_distribution<float>	position{ -60.0f, 60.0f };
+			std::uniform_real_distribution<float>	radius{ 0.1f, 5.0f };
+
+			TestSpheres spheres;
+
+			while (spheres.x.size() < count)
+			{
+				const FlexKit::float3	center	= { position(generator), position(generator), position(generator) };
+				const float				r		= radius(generator);
+
+				bool borderline = false;
+				for (size_t I = 0; I < frustumCount; ++I)
+					for (const auto& plane : frusta[I].Planes)
+						borderline |= std::abs(plane.Normal.dot(center - plane.Orgin) - r) < 0.001f;
+
+				if (borderline)
+					continue;
+
+				spheres.x.push_back(center.x);
+				spheres.y.push_back(center.y);
+				spheres.z.push_back(center.z);
+				spheres.r.push_back(r);
+			}
+
+			return spheres;
+		}
+
+
+		// Runs the kernel over the first count spheres, mask bits have to match the per sphere test
+		static bool MatchesPerSphereTest(CullKernel kernel, const FlexKit::Frustum& frustum, const TestSpheres& spheres, const size_t count)
+		{
+			std::vector<uint32_t> mask((count + 31) / 32 + 1, 0xFFFFFFFF);
+
+			kernel(frustum, spheres.x.data(), spheres.y.data(), spheres.z.data(), spheres.r.data(), count, mask.data());
+
+			for (size_t I = 0; I < count; ++I)
+			{
+				const bool visible	= (mask[I / 32] >> (I % 32)) & 0x01;
+				const bool expected	= FlexKit::CompareBSAgainstFrustum(&frustum, { spheres.x[I], spheres.y[I], spheres.z[I], spheres.r[I] });
+
+				if (visible != expected)
+					return false;
+			}
+
+			// Bits past count in the last word are cleared, words past the mask are left alone
+			const size_t lastWord = (count + 31) / 32;
+			if (count % 32 && (mask[lastWord - 1] >> (count % 32)))
+				return false;
+
+			return mask[lastWord] == 0xFFFFFFFF;
+		}
+
+
+		TEST_METHOD(SphereCulling_KernelsMatchPerSphereTest)
+		{
+			FlexKit::Frustum frusta[6];
+			for (uint32_t face = 0; face < 6; ++face)
+				frusta[face] = FlexKit::GetCubeFaceFrustum({ 1, 2, 3 }, 50.0f, face);
+
+			const TestSpheres spheres = CreateSpheres(frusta, 6, 1003);
+
+			const CullKernel	kernels[]		= {
+				FlexKit::CullSpheres_Scalar,
+				FlexKit::CullSpheres_SSE,
+#if USING(AVX2)
+				FlexKit::CullSpheres_AVX2,
+#endif
+				FlexKit::CullSpheres };
+
+			const size_t		counts[]		= { 0, 1, 7, 8, 31, 32, 33, 1003 }; // Empty, partial vectors and tails
+
+			for (const auto& frustum : frusta)
+			{
+				size_t visibleCount = 0;
+				for (size_t I = 0; I < spheres.x.size(); ++I)
+					visibleCount += FlexKit::CompareBSAgainstFrustum(&frustum, { spheres.x[I], spheres.y[I], spheres.z[I], spheres.r[I] });
+
+				Assert::IsTrue(visibleCount > 0 && visibleCount < spheres.x.size(), L"Test frustum doesn't split the spheres\n");
+
+				for (auto kernel : kernels)
+					for (auto count : counts)
+						Assert::IsTrue(MatchesPerSphereTest(kernel, frustum, spheres, count), L"Sphere culling kernel doesn't match CompareBSAgainstFrustum\n");
+			}
+		}
+
+
+		TEST_METHOD(SphereCulling_BatchReportsVisibleItems)
+		{
+			const FlexKit::Frustum	frustum = FlexKit::GetCubeFaceFrustum({ 0, 0, 0 }, 40.0f, 2);
+			const TestSpheres		spheres = CreateSpheres(&frustum, 1, 300);
+
+			std::vector<uint32_t> expected;
+			for (uint32_t I = 0; I < spheres.x.size(); ++I)
+				if (FlexKit::CompareBSAgainstFrustum(&frustum, { spheres.x[I], spheres.y[I], spheres.z[I], spheres.r[I] }))
+					expected.push_back(I);
+
+			// Smaller than the sphere count, so the batch flushes itself while pushing
+			std::vector<uint32_t>						found;
+			FlexKit::SphereCullBatch<uint32_t, 64>		batch{ frustum };
+
+			auto onVisible = [&](const uint32_t item) { found.push_back(item); };
+
+			for (uint32_t I = 0; I < spheres.x.size(); ++I)
+				batch.Push({ spheres.x[I], spheres.y[I], spheres.z[I], spheres.r[I] }, I, onVisible);
+
+			batch.Flush(onVisible);
+
+			Assert::IsTrue(found == expected, L"Sphere cull batch reported the wrong items\n");
+		}
+	};
+
+
+	/************************************************************************************************/
+
+
+	TEST_CLASS(AssetIndexUnitTests)
+	{
+	public:
+
+		// Every expected entry is found under its key and nothing else is left in the table
+		static bool Contains(const FlexKit::AssetIndex& index, const std::vector<std::pair<uint64_t, uint64_t>>& expected)
+		{
+			for (const auto& [key, value] : expected)
+				if (index.Find(key, [&](const uint64_t v) { return v == value; }) != value)
+					return false;
+
+			size_t slotsUsed = 0;
+			for (const auto& slot : index.slots)
+				slotsUsed += slot.value != INVALIDHANDLE;
+
+			return index.used == expected.size() && slotsUsed == expected.size();
+		}
+
+
+		TEST_METHOD(AssetIndex_RemoveShiftsBackAcrossWraparound)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::AssetIndex index;
+			index.slots = FlexKit::Vector<FlexKit::AssetIndex::Slot>{ &allocator };
+
+			// The first table has 64 slots, keys homed in the last two slots probe past the end into slots 0 and up
+			const uint64_t tableSize = 64;
+
+			std::vector<std::pair<uint64_t, uint64_t>> entries = {
+				{ 62,					1 },	// Slot 62
+				{ 62 + tableSize,		2 },	// Slot 63
+				{ 63,					3 },	// Wraps to slot 0
+				{ 62 + 2 * tableSize,	4 },	// Slot 1
+				{ 63 + tableSize,		5 },	// Slot 2
+				{ 0,					6 },	// Home is taken, slot 3
+				{ 1 + tableSize,		7 },	// Slot 4
+				{ 62,					8 },	// Same key as the first, slot 5
+			};
+
+			for (const auto& [key, value] : entries)
+				index.Insert(key, value);
+
+			Assert::IsTrue(index.slots.size() == tableSize,		L"Test assumes the first table has 64 slots\n");
+			Assert::IsTrue(index.slots[0].value == 3 && index.slots[5].value == 8, L"Entries didn't wrap around the end of the table\n");
+			Assert::IsTrue(Contains(index, entries),			L"Inserted entries not found\n");
+			Assert::IsTrue(index.Find(62) == 1,					L"Find without a match didn't return the first entry for the key\n");
+			Assert::IsTrue(index.Find(5) == INVALIDHANDLE,		L"Found a key that was never inserted\n");
+
+			// Each removal leaves a hole the entries behind it have to be shifted back over, including across the end
+			const uint64_t removeOrder[] = { 1, 3, 6, 4 };
+
+			for (const auto value : removeOrder)
+			{
+				auto entry = std::find_if(entries.begin(), entries.end(), [&](auto& e) { return e.second == value; });
+
+				index.Remove(entry->first, entry->second);
+				entries.erase(entry);
+
+				Assert::IsTrue(Contains(index, entries), L"Entries lost after removing an entry before them\n");
+			}
+
+			// Removing something absent changes nothing
+			index.Remove(62, 1);
+			index.Remove(17, 1);
+
+			Assert::IsTrue(Contains(index, entries),	L"Removing a missing entry changed the table\n");
+			Assert::IsTrue(index.slots[62].value == 2 && index.slots[63].value == 5 && index.slots[0].value == 8 && index.slots[1].value == 7,
+				L"Entries weren't shifted back into the slots they probe first\n");
+
+			index.Release();
+
+			// A hole in the last slot, an entry at home in slot 0 stays put while the one after it wraps back
+			FlexKit::AssetIndex wrapped;
+			wrapped.slots = FlexKit::Vector<FlexKit::AssetIndex::Slot>{ &allocator };
+
+			std::vector<std::pair<uint64_t, uint64_t>> wrappedEntries = {
+				{ 63,				9 },	// Slot 63
+				{ tableSize,		10 },	// Slot 0
+				{ 63 + tableSize,	11 },	// Wraps to slot 1
+			};
+
+			for (const auto& [key, value] : wrappedEntries)
+				wrapped.Insert(key, value);
+
+			wrapped.Remove(63, 9);
+			wrappedEntries.erase(wrappedEntries.begin());
+
+			Assert::IsTrue(Contains(wrapped, wrappedEntries), L"Entries lost after removing the last slot\n");
+			Assert::IsTrue(wrapped.slots[63].value == 11 && wrapped.slots[0].value == 10, L"Shift back across the end moved an entry out of its home\n");
+
+			wrapped.Release();
+		}
+
+
+		TEST_METHOD(AssetIndex_MatchesReferenceThroughGrowth)
+		{
+			TestScratchAllocator allocator;
+
+			FlexKit::AssetIndex index;
+			index.slots = FlexKit::Vector<FlexKit::AssetIndex::Slot>{ &allocator };
+
+			std::default_random_engine						generator{ 2468 };
+			std::vector<std::pair<uint64_t, uint64_t>>		entries;
+
+			// Few distinct keys, so there are long probe chains and repeated keys, growth rehashes everything
+			for (uint64_t value = 0; value < 2000; ++value)
+			{
+				const uint64_t key = (generator() % 300) * 0x9E3779B97F4A7C15ull;
+
+				index.Insert(key, value);
+				entries.push_back({ key, value });
+
+				if (value % 3 == 2)
+				{
+					const size_t removed = generator() % entries.size();
+
+					index.Remove(entries[removed].first, entries[removed].second);
+					entries.erase(entries.begin() + removed);
+				}
+			}
+
+			Assert::IsTrue(Contains(index, entries), L"Index doesn't match the reference after inserts, removes and growth\n");
+
+			while (entries.size())
+			{
+				index.Remove(entries.back().first, entries.back().second);
+				entries.pop_back();
+			}
+
+			Assert::IsTrue(Contains(index, entries), L"Index not empty after removing everything\n");
+
+			index.Release();
+		}
+	};
+}
@@ -53,6 +53,9 @@ namespace FlexKit
     {
         auto _updateColliders = [&](auto itr, const auto end)
         {
+            NodePose    poses[512];
+            size_t      poseCount = 0;
+
             for (; itr < end; itr++)
             {
                 auto& collider = *itr;
@@ -60,12 +63,19 @@ namespace FlexKit
                     continue;
 
                 physx::PxTransform  pose = collider.actor->getGlobalPose();
-                Quaternion	        orientation = Quaternion{ pose.q.x, pose.q.y, pose.q.z, pose.q.w };
-                float3		        position = float3{ pose.p.x, pose.p.y, pose.p.z };
-
-                SetPositionW(collider.node, position);
-                SetOrientation(collider.node, orientation);
+                poses[poseCount++] = {
+                    collider.node,
+                    float3{ pose.p.x, pose.p.y, pose.p.z },
+                    Quaternion{ pose.q.x, pose.q.y, pose.q.z, pose.q.w } };
+
+                if (poseCount == 512)
+                {
+                    SetPosesW(poses, poseCount);
+                    poseCount = 0;
+                }
             }
+
+            SetPosesW(poses, poseCount);
         };
 
 
@@ -181,7 +181,7 @@ public:
 			streamingEngine	{ IN_Framework.core.RenderSystem,   IN_Framework.core.GetBlockMemory()				            },
             sounds          { IN_Framework.core.Threads,        IN_Framework.core.GetBlockMemory()                          },
 
-			render	{	IN_Framework.core.GetTempMemory(),
+			render	{	IN_Framework.core.GetBlockMemory(),
 						IN_Framework.core.RenderSystem,
 						streamingEngine,
 						IN_Framework.ActiveWindow->WH
@@ -130,7 +130,7 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
     auto& transforms		= QueueTransformUpdateTask	(dispatcher);
     auto& cameras			= CameraComponent::GetComponent().QueueCameraUpdate(dispatcher);
     auto& cameraConstants	= MakeHeapCopy				(Camera::ConstantBuffer{}, core.GetTempMemory());
-    auto& PVS				= GatherScene               (dispatcher, scene, activeCamera, core.GetTempMemory());
+    auto& PVS				= GatherScene               (dispatcher, scene, activeCamera, core.GetTempMemory(), base.render.GetActiveOcclusionCuller());
     auto& skinnedObjects    = GatherSkinned             (dispatcher, scene, activeCamera, core.GetTempMemory());
     auto& updatedPoses      = UpdatePoses               (dispatcher, skinnedObjects, core.GetTempMemory());
     auto& cameraControllers = UpdateThirdPersonCameraControllers(dispatcher, framework.MouseState.Normalized_dPos, dT);
@@ -140,7 +140,9 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
     cameras.AddInput(cameraControllers);
     cameras.AddInput(transforms);
 
-    PVS.AddInput(transforms);
+    auto& sceneUpdate       = scene.sceneManagement.Update(dispatcher, scene, transforms);
+
+    PVS.AddInput(sceneUpdate);
     PVS.AddInput(cameras);
 
     skinnedObjects.AddInput(cameras);
@@ -204,6 +206,7 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
                 base.gbuffer,
                 base.depthBuffer,
                 reserveCB,
+                reserveVB,
                 core.GetTempMemory(), base.virtualResource);
 
             base.render.RenderPBR_IBL_Deferred(
@@ -241,6 +244,8 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
         }   break;
         case RenderMode::ComputeTiledDeferred:
         {
+            auto& lightClusters = GatherLightClusters(dispatcher, activeCamera, pointLightGather, cameras, { 16, 9, 24 }, core.GetTempMemory());
+
             ComputeTiledDeferredShadeDesc desc =
             {
                 pointLightGather,
@@ -248,6 +253,8 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
                 base.depthBuffer,
                 targets.RenderTarget,
                 activeCamera,
+                core.GetTempMemory(),
+                &lightClusters,
             };
 
 
@@ -263,6 +270,7 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
                 base.gbuffer,
                 base.depthBuffer,
                 reserveCB,
+                reserveVB,
                 core.GetTempMemory(),
                 base.virtualResource);
 
@@ -274,7 +282,8 @@ void LocalPlayerState::Draw(EngineCore& core, UpdateDispatcher& dispatcher, doub
                 sceneDesc,
                 reserveCB,
                 core.GetTempMemory(),
-                &debugDraw);
+                &debugDraw,
+                &lightClusters);
 
             base.render.RenderPBR_ComputeDeferredTiledShade(
                 dispatcher,
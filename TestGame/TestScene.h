@@ -61,14 +61,19 @@ enum class TestScenes
 };
 
 
-inline void StartTestState(FlexKit::FKApplication& app, BaseState& base, TestScenes scene = TestScenes::ShadowTestScene)
+// Added before the test state is started so a preload manifest can reach them
+inline void AddTestAssetFiles()
 {
     AddAssetFile("assets\\TestScenes.gameres");
     AddAssetFile("assets\\ZeldaScene.gameres");
     AddAssetFile("assets\\aRealDemon.gameres");
     AddAssetFile("assets\\CubeMapResource.gameres");
     AddAssetFile("assets\\skull.gameres");
+}
+
 
+inline void StartTestState(FlexKit::FKApplication& app, BaseState& base, TestScenes scene = TestScenes::ShadowTestScene)
+{
 	auto& gameState     = app.PushState<GameState>(base);
 	auto& renderSystem  = app.GetFramework().GetRenderSystem();
 
@@ -183,6 +188,10 @@ inline void StartTestState(FlexKit::FKApplication& app, BaseState& base, TestSce
         if (!loaded)
             triMesh = LoadTriMeshIntoTable(renderSystem, renderSystem.GetImmediateUploadQueue(), "Cube1x1x1");
 
+        // The floor and the boxes fill the cube's bounds, so its box stands in for it in the occlusion buffer
+        base.render.GetOcclusionCuller().RegisterBoxOccluder(triMesh, GetMeshResource(triMesh)->AABB);
+        base.render.EnableOcclusionCulling(true);
+
         auto    floorShape = base.physics.CreateCubeShape({ 300, 1, 300 });
         auto    cubeShape  = base.physics.CreateCubeShape({ 0.5f, 0.5f, 0.5f });
 
@@ -54,6 +54,8 @@ int main(int argc, char* argv[])
 
     std::string name;
     std::string server;
+    std::string recordManifest;
+    std::string preloadManifest;
 
     FlexKit::InitLog(argc, argv);
     FlexKit::SetShellVerbocity(FlexKit::Verbosity_1);
@@ -116,6 +118,16 @@ int main(int argc, char* argv[])
         }
         else if (!strncmp(TextureStreamingTestStr, argv[I], strlen(TextureStreamingTestStr))) // 
             applicationMode = ApplicationMode::GraphicsTestMode;
+        else if (!strcmp("-RecordAssets", argv[I]) && I + 1 < argc)
+        {
+            recordManifest = argv[I + 1];
+            I += 1;
+        }
+        else if (!strcmp("-PreloadAssets", argv[I]) && I + 1 < argc)
+        {
+            preloadManifest = argv[I + 1];
+            I += 1;
+        }
 
         //app.PushArgument(argv[I]);
     }
@@ -126,6 +138,27 @@ int main(int argc, char* argv[])
 
     FlexKit::FKApplication app{ WH, allocator, max(std::thread::hardware_concurrency(), 1u) - 1 };
 
+    if (recordManifest.size())
+        FlexKit::BeginAssetTrace();
+
+    switch (applicationMode)
+    {
+        case ApplicationMode::Client:
+        case ApplicationMode::Host:
+            AddAssetFile("assets\\TestScenes.gameres");
+            break;
+        case ApplicationMode::GraphicsTestMode:
+            AddAssetFile("assets\\DemonGirl.gameres");
+            AddTestAssetFiles();
+            break;
+    default:
+        return -1;
+    }
+
+    // Queued before any state is constructed so the loader is already streaming when they start requesting assets
+    if (preloadManifest.size())
+        app.GetFramework().assetLoader.PreloadManifest(preloadManifest.c_str());
+
     FK_LOG_INFO("Set initial PlayState state.");
     auto& base = app.PushState<BaseState>(app);
 
@@ -133,26 +166,20 @@ int main(int argc, char* argv[])
     {
         case ApplicationMode::Client:
         {
-            AddAssetFile("assets\\TestScenes.gameres");
-
             auto& NetState      = app.PushState<NetworkState>(base);
             auto& clientState   = app.PushState<GameClientState>(base, NetState, ClientGameDescription{ 1337, server.c_str(), name.c_str() });
         }   break;
         case ApplicationMode::Host:
         {
-            AddAssetFile("assets\\TestScenes.gameres");
-
             auto& NetState  = app.PushState<NetworkState>(base);
             auto& hostState = app.PushState<GameHostState>(base, NetState);
         }   break;
         case ApplicationMode::GraphicsTestMode:
         {
-            AddAssetFile("assets\\DemonGirl.gameres");
-
             StartTestState(app, base, TestScenes::GlobalIllumination);
         }   break;
     default:
-        return -1;
+        break;
     }
 
     try
@@ -161,6 +188,9 @@ int main(int argc, char* argv[])
         app.Run();
         FK_LOG_2("Application shutting down.");
 
+        if (recordManifest.size())
+            FlexKit::EndAssetTrace(recordManifest.c_str());
+
         FK_LOG_2("Cleanup Startup.");
         app.Release();
         FK_LOG_2("Cleanup Finished.");
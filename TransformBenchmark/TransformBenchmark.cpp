@@ -0,0 +1,434 @@
+/**********************************************************************
+
+Copyright (c) 2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\Logging.cpp"
+#include "..\coreutilities\Components.cpp"
+#include "..\coreutilities\MathUtils.cpp"
+#include "..\coreutilities\memoryutilities.cpp"
+#include "..\coreutilities\ThreadUtilities.cpp"
+#include "..\coreutilities\Transforms.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+
+using namespace FlexKit;
+
+
+/************************************************************************************************/
+
+
+// Usage: TransformBenchmark [-nodes N] [-threads N] [-iterations N] [-format csv|json] [-out file]
+// Without -nodes every node count from 1k to 1M is run, without -threads thread counts go up to the hardware thread count
+
+
+/************************************************************************************************/
+
+
+template<typename FN>
+double Measure(FN&& fn)
+{
+	const auto begin = std::chrono::high_resolution_clock::now();
+	fn();
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+
+/************************************************************************************************/
+
+
+struct BenchmarkResult
+{
+	const char*	hierarchy;
+	const char*	operation;
+	size_t		nodeCount;
+	uint32_t	threadCount;
+	size_t		iterations;
+	double		minMS;
+	double		meanMS;
+};
+
+
+struct BenchmarkContext
+{
+	const char*					hierarchy;
+	size_t						nodeCount;
+	size_t						iterations;
+	Vector<BenchmarkResult>&	results;
+	std::default_random_engine&	generator;
+};
+
+
+/************************************************************************************************/
+
+
+template<typename FN_SETUP, typename FN>
+void Run(BenchmarkContext& ctx, const char* operation, uint32_t threadCount, size_t iterations, FN_SETUP&& setup, FN&& fn)
+{
+	double minMS	= 1e20;
+	double totalMS	= 0;
+
+	for (size_t I = 0; I < iterations; ++I)
+	{
+		setup();
+
+		const double ms = Measure(fn);
+		minMS	 = ms < minMS ? ms : minMS;
+		totalMS	+= ms;
+	}
+
+	ctx.results.push_back({ ctx.hierarchy, operation, ctx.nodeCount, threadCount, iterations, minMS, totalMS / iterations });
+}
+
+
+/************************************************************************************************/
+
+
+NodeHandle CreateNode(NodeHandle parent, std::default_random_engine& generator)
+{
+	std::uniform_real_distribution<float> offset{ -10.0f, 10.0f };
+
+	auto node = GetZeroedNode();
+	SetPositionL(node, { offset(generator), offset(generator), offset(generator) });
+	SetParentNode(parent, node);
+
+	return node;
+}
+
+
+/************************************************************************************************/
+
+
+// Every node is a child of root
+void BuildFlat(Vector<NodeHandle>& nodes, size_t nodeCount, std::default_random_engine& generator)
+{
+	for (size_t I = 0; I < nodeCount; ++I)
+		nodes.push_back(CreateNode(NodeHandle(0), generator));
+}
+
+
+// Chains of 512 nodes, each node is the only child of the previous one
+void BuildDeep(Vector<NodeHandle>& nodes, size_t nodeCount, std::default_random_engine& generator)
+{
+	const size_t chainLength = 512;
+
+	for (size_t I = 0; I < nodeCount; ++I)
+		nodes.push_back(CreateNode((I % chainLength) ? nodes.back() : NodeHandle(0), generator));
+}
+
+
+// Breadth first tree with a fan-out of 16
+void BuildWide(Vector<NodeHandle>& nodes, size_t nodeCount, std::default_random_engine& generator)
+{
+	const size_t fanOut = 16;
+
+	for (size_t I = 0; I < nodeCount; ++I)
+		nodes.push_back(CreateNode(I ? nodes[(I - 1) / fanOut] : NodeHandle(0), generator));
+}
+
+
+// Characters of 64 bones, an 8 bone spine with 4 limbs of 14 bones
+void BuildSkinned(Vector<NodeHandle>& nodes, size_t nodeCount, std::default_random_engine& generator)
+{
+	const size_t boneCount		= 64;
+	const size_t spineLength	= 8;
+	const size_t limbLength		= 14;
+	const size_t limbRoots[]	= { 6, 6, 1, 1 }; // Arms off the upper spine, legs off the pelvis
+
+	for (size_t I = 0; I < nodeCount; ++I)
+	{
+		const size_t bone		= I % boneCount;
+		const size_t skeleton	= I - bone;
+
+		NodeHandle parent = NodeHandle(0);
+
+		if (bone && bone < spineLength)
+			parent = nodes[skeleton + bone - 1];
+		else if (bone >= spineLength)
+		{
+			const size_t limbBone = (bone - spineLength) % limbLength;
+			parent = limbBone ? nodes[I - 1] : nodes[skeleton + limbRoots[(bone - spineLength) / limbLength]];
+		}
+
+		nodes.push_back(CreateNode(parent, generator));
+	}
+}
+
+
+/************************************************************************************************/
+
+
+void MarkDirty(Vector<NodeHandle>& nodes, size_t stride)
+{
+	for (size_t I = 0; I < nodes.size(); I += stride)
+		SetFlag(nodes[I], SceneNodes::DIRTY);
+}
+
+
+/************************************************************************************************/
+
+
+template<typename FN_BUILD>
+void RunHierarchy(BenchmarkContext& ctx, FN_BUILD&& build, const uint32_t* threadCounts, size_t threadCountCount, StackAllocator& temp)
+{
+	InitiateSceneNodeTable(SystemAllocator, ctx.nodeCount + 1);
+
+	Vector<NodeHandle> nodes{ SystemAllocator, ctx.nodeCount };
+
+	Run(ctx, "build", 1, 1, [] {}, [&] { build(nodes, ctx.nodeCount, ctx.generator); });
+	UpdateTransforms(); // Builds levels, so update timings only include the update
+
+	for (size_t I = 0; I < threadCountCount; ++I)
+	{
+		const uint32_t threadCount = threadCounts[I];
+
+		// Worker count excludes the calling thread, a single thread runs without a thread manager
+		ThreadManager	threads		{ threadCount > 1 ? threadCount - 1 : 1, SystemAllocator };
+		ThreadManager*	manager		= threadCount > 1 ? &threads : nullptr;
+
+		Run(ctx, "update_all", threadCount, ctx.iterations,
+			[&] { MarkDirty(nodes, 1); temp.clear(); },
+			[&] { UpdateTransforms(manager, temp); });
+
+		Run(ctx, "update_1_percent", threadCount, ctx.iterations,
+			[&] { MarkDirty(nodes, 100); temp.clear(); },
+			[&] { UpdateTransforms(manager, temp); });
+
+		threads.Release();
+	}
+
+	// Lookups in random order
+	Vector<NodeHandle> shuffled{ SystemAllocator, ctx.nodeCount };
+	for (auto node : nodes)
+		shuffled.push_back(node);
+
+	std::shuffle(shuffled.begin(), shuffled.end(), ctx.generator);
+
+	volatile float sink = 0;
+
+	Run(ctx, "get_position_w", 1, ctx.iterations, [] {},
+		[&]
+		{
+			float sum = 0;
+			for (auto node : shuffled)
+				sum += GetPositionW(node).x;
+
+			sink = sum;
+		});
+
+	Run(ctx, "get_wt", 1, ctx.iterations, [] {},
+		[&]
+		{
+			float sum = 0;
+			for (auto node : shuffled)
+				sum += GetWT(node)[0][3];
+
+			sink = sum;
+		});
+
+	// Mutation, single node calls against the batched setters
+	std::uniform_real_distribution<float> position{ -100.0f, 100.0f };
+
+	NodePose* source	= (NodePose*)SystemAllocator._aligned_malloc(sizeof(NodePose)		* ctx.nodeCount);
+	NodePose* poses		= (NodePose*)SystemAllocator._aligned_malloc(sizeof(NodePose)		* ctx.nodeCount);
+	auto positions		= (NodePosition*)SystemAllocator._aligned_malloc(sizeof(NodePosition)	* ctx.nodeCount);
+
+	for (size_t I = 0; I < ctx.nodeCount; ++I)
+	{
+		source[I].node			= shuffled[I];
+		source[I].position		= float3{ position(ctx.generator), position(ctx.generator), position(ctx.generator) };
+		source[I].orientation	= Quaternion{ 0, 0, 0, 1 };
+	}
+
+	Run(ctx, "set_position_l", 1, ctx.iterations, [] {},
+		[&]
+		{
+			for (size_t I = 0; I < ctx.nodeCount; ++I)
+				SetPositionL(source[I].node, source[I].position);
+		});
+
+	Run(ctx, "set_positions_l_batch", 1, ctx.iterations,
+		[&]
+		{
+			for (size_t I = 0; I < ctx.nodeCount; ++I)
+				positions[I] = { source[I].node, source[I].position };
+		},
+		[&] { SetPositionsL(positions, ctx.nodeCount); });
+
+	Run(ctx, "set_pose_w", 1, ctx.iterations, [] {},
+		[&]
+		{
+			for (size_t I = 0; I < ctx.nodeCount; ++I)
+			{
+				SetPositionW	(source[I].node, source[I].position);
+				SetOrientation	(source[I].node, source[I].orientation);
+			}
+		});
+
+	Run(ctx, "set_poses_w_batch", 1, ctx.iterations,
+		[&] { memcpy(poses, source, sizeof(NodePose) * ctx.nodeCount); },
+		[&] { SetPosesW(poses, ctx.nodeCount); });
+
+	SystemAllocator._aligned_free(source);
+	SystemAllocator._aligned_free(poses);
+	SystemAllocator._aligned_free(positions);
+
+	// Release a quarter of the nodes at random, then sort and compact what's left
+	for (size_t I = 0; I < ctx.nodeCount / 4; ++I)
+		ReleaseNode(shuffled[I]);
+
+	Run(ctx, "sort_nodes", 1, 1, [] {}, [&] { SortNodes(); });
+
+	shuffled.Release();
+	nodes.Release();
+	ReleaseSceneNodeTable();
+}
+
+
+/************************************************************************************************/
+
+
+void WriteCSV(std::ostream& out, Vector<BenchmarkResult>& results)
+{
+	out << "hierarchy,operation,nodes,threads,iterations,min_ms,mean_ms,min_ns_per_node\n";
+
+	for (auto& result : results)
+		out <<
+			result.hierarchy	<< "," <<
+			result.operation	<< "," <<
+			result.nodeCount	<< "," <<
+			result.threadCount	<< "," <<
+			result.iterations	<< "," <<
+			result.minMS		<< "," <<
+			result.meanMS		<< "," <<
+			(result.minMS * 1000000.0 / result.nodeCount) << "\n";
+}
+
+
+void WriteJSON(std::ostream& out, Vector<BenchmarkResult>& results)
+{
+	out << "[\n";
+
+	for (size_t I = 0; I < results.size(); ++I)
+	{
+		auto& result = results[I];
+
+		out <<
+			"\t{ " <<
+			"\"hierarchy\": \""		<< result.hierarchy		<< "\", " <<
+			"\"operation\": \""		<< result.operation		<< "\", " <<
+			"\"nodes\": "			<< result.nodeCount		<< ", " <<
+			"\"threads\": "			<< result.threadCount	<< ", " <<
+			"\"iterations\": "		<< result.iterations	<< ", " <<
+			"\"min_ms\": "			<< result.minMS			<< ", " <<
+			"\"mean_ms\": "			<< result.meanMS		<< ", " <<
+			"\"min_ns_per_node\": "	<< (result.minMS * 1000000.0 / result.nodeCount) <<
+			(I + 1 < results.size() ? " },\n" : " }\n");
+	}
+
+	out << "]\n";
+}
+
+
+/************************************************************************************************/
+
+
+int main(int argc, char* argv[])
+{
+	InitLog(argc, argv);
+
+	size_t		nodeCounts[]		= { 1000, 10000, 100000, 1000000 };
+	size_t		nodeCountCount		= sizeof(nodeCounts) / sizeof(nodeCounts[0]);
+	uint32_t	maxThreads			= std::max(std::thread::hardware_concurrency(), 1u);
+	size_t		iterations			= 5;
+	bool		json				= false;
+	const char*	outputPath			= nullptr;
+
+	for (int I = 1; I + 1 < argc; ++I)
+	{
+		if (!strcmp("-nodes", argv[I]))
+		{
+			nodeCounts[0]	= (size_t)atoll(argv[++I]);
+			nodeCountCount	= 1;
+		}
+		else if (!strcmp("-threads", argv[I]))
+			maxThreads = std::max((uint32_t)atoi(argv[++I]), 1u);
+		else if (!strcmp("-iterations", argv[I]))
+			iterations = std::max((size_t)atoll(argv[++I]), (size_t)1);
+		else if (!strcmp("-format", argv[I]))
+			json = !strcmp("json", argv[++I]);
+		else if (!strcmp("-out", argv[I]))
+			outputPath = argv[++I];
+	}
+
+	// 1, 2, 4 ... and the max thread count
+	uint32_t	threadCounts[32];
+	size_t		threadCountCount = 0;
+
+	for (uint32_t I = 1; I < maxThreads && threadCountCount < 31; I *= 2)
+		threadCounts[threadCountCount++] = I;
+
+	threadCounts[threadCountCount++] = maxThreads;
+
+	StackAllocator				temp		{ SystemAllocator, MEGABYTE * 64 };
+	Vector<BenchmarkResult>		results		{ SystemAllocator };
+	std::default_random_engine	generator	{ 1337 };
+
+	for (size_t I = 0; I < nodeCountCount; ++I)
+	{
+		const size_t nodeCount = nodeCounts[I];
+
+		BenchmarkContext flat		{ "flat",		nodeCount, iterations, results, generator };
+		BenchmarkContext deep		{ "deep",		nodeCount, iterations, results, generator };
+		BenchmarkContext wide		{ "wide",		nodeCount, iterations, results, generator };
+		BenchmarkContext skinned	{ "skinned",	nodeCount, iterations, results, generator };
+
+		RunHierarchy(flat,		BuildFlat,		threadCounts, threadCountCount, temp);
+		RunHierarchy(deep,		BuildDeep,		threadCounts, threadCountCount, temp);
+		RunHierarchy(wide,		BuildWide,		threadCounts, threadCountCount, temp);
+		RunHierarchy(skinned,	BuildSkinned,	threadCounts, threadCountCount, temp);
+
+		std::cerr << "finished " << nodeCount << " nodes\n";
+	}
+
+	if (outputPath)
+	{
+		std::ofstream file{ outputPath };
+		json ? WriteJSON(file, results) : WriteCSV(file, results);
+	}
+	else
+		json ? WriteJSON(std::cout, results) : WriteCSV(std::cout, results);
+
+	results.Release();
+
+	return 0;
+}
@@ -31,6 +31,13 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #define FASTMATH ON
 
+// 8 wide culling kernels, requires building with /arch:AVX2. FASTMATH selects the SSE kernels otherwise
+#ifdef __AVX2__
+#define AVX2 ON
+#else
+#define AVX2 OFF
+#endif
+
 #ifdef COMPILE64 
 #define X64EXE ON
 #define X86EXE OFF
@@ -38,10 +38,15 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\coreutilities\GraphicScene.cpp"
 #include "..\coreutilities\Handle.cpp"
 #include "..\coreutilities\intersection.cpp"
+#include "..\coreutilities\LZCompression.cpp"
 #include "..\coreutilities\MathUtils.cpp"
+#include "..\coreutilities\OcclusionCulling.cpp"
+#include "..\coreutilities\ClusteredLighting.cpp"
 #include "..\coreutilities\memoryutilities.cpp"
 #include "..\coreutilities\ProfilingUtilities.cpp"
+#include "..\coreutilities\AssetIndex.cpp"
 #include "..\coreutilities\assets.cpp"
+#include "..\coreutilities\AssetLoader.cpp"
 #include "..\coreutilities\ThreadUtilities.cpp"
 #include "..\coreutilities\Transforms.cpp"
 #include "..\coreutilities\timeutilities.cpp"
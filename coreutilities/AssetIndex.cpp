@@ -0,0 +1,110 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#include "..\coreutilities\AssetIndex.h"
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	void AssetIndex::Insert(const uint64_t key, const uint64_t value)
+	{
+		if ((used + 1) * 2 > slots.size())
+		{	// Keep the load factor under one half, probe chains stay short
+			Vector<Slot> previous{ std::move(slots) };
+
+			slots = Vector<Slot>{ previous.Allocator };
+			slots.resize(previous.size() ? previous.size() * 2 : 64);
+			used  = 0;
+
+			for (auto& slot : slots)
+				slot.value = INVALIDHANDLE;
+
+			for (auto& slot : previous)
+				if (slot.value != INVALIDHANDLE)
+					Insert(slot.key, slot.value);
+
+			previous.Release();
+		}
+
+		const size_t mask = slots.size() - 1;
+
+		size_t I = key & mask;
+		while (slots[I].value != INVALIDHANDLE)
+			I = (I + 1) & mask;
+
+		slots[I] = { key, value };
+		used++;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetIndex::Remove(const uint64_t key, const uint64_t value)
+	{
+		if (!slots.size())
+			return;
+
+		const size_t mask = slots.size() - 1;
+
+		size_t I = key & mask;
+		while (slots[I].value != INVALIDHANDLE && !(slots[I].key == key && slots[I].value == value))
+			I = (I + 1) & mask;
+
+		if (slots[I].value == INVALIDHANDLE)
+			return;
+
+		slots[I].value = INVALIDHANDLE;
+		used--;
+
+		// Shift back any entries that probed past the hole
+		for (size_t J = (I + 1) & mask; slots[J].value != INVALIDHANDLE; J = (J + 1) & mask)
+		{
+			const size_t home		= slots[J].key & mask;
+			const bool	 reachable	= (I <= J) ? (I < home && home <= J) : (I < home || home <= J);
+
+			if (!reachable)
+			{
+				slots[I]		= slots[J];
+				slots[J].value	= INVALIDHANDLE;
+				I				= J;
+			}
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetIndex::Release()
+	{
+		slots.Release();
+		used = 0;
+	}
+
+
+}	/************************************************************************************************/
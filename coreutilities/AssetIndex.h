@@ -0,0 +1,79 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#ifndef ASSETINDEX_H
+#define ASSETINDEX_H
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\containers.h"
+
+#include <cstdint>
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	// Open addressing hash map from a pre-hashed 64 bit key to a 64 bit value, linear probing.
+	// Different keys may hash the same, Find keeps probing until match accepts a value.
+	struct AssetIndex
+	{
+		struct Slot
+		{
+			uint64_t key;
+			uint64_t value; // INVALIDHANDLE marks an empty slot
+		};
+
+		void Insert	(const uint64_t key, const uint64_t value);
+		void Remove	(const uint64_t key, const uint64_t value);
+		void Release();
+
+		template<typename FN_Match>
+		uint64_t Find(const uint64_t key, FN_Match match) const
+		{
+			if (!slots.size())
+				return INVALIDHANDLE;
+
+			const size_t mask = slots.size() - 1;
+			for (size_t I = key & mask; slots[I].value != INVALIDHANDLE; I = (I + 1) & mask)
+				if (slots[I].key == key && match(slots[I].value))
+					return slots[I].value;
+
+			return INVALIDHANDLE;
+		}
+
+		uint64_t Find(const uint64_t key) const
+		{
+			return Find(key, [](const uint64_t) { return true; });
+		}
+
+		Vector<Slot>	slots;
+		size_t			used = 0;
+	};
+
+
+}	/************************************************************************************************/
+
+#endif
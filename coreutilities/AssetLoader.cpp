@@ -0,0 +1,510 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#include "..\coreutilities\AssetLoader.h"
+
+#include <algorithm>
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	AssetLoader::AssetLoader(ThreadManager& IN_threads, iAllocator* IN_allocator, const uint32_t IOThreadCount) :
+		threads		{ IN_threads	},
+		allocator	{ IN_allocator	},
+		running		{ true			},
+		inFlight	{ 0				},
+		requests	{ IN_allocator	},
+		freeList	{ IN_allocator	},
+		pending		{ IN_allocator	},
+		finished	{ IN_allocator	},
+		finalizing	{ IN_allocator	},
+		IOThreads	{ IN_allocator	}
+	{
+		for (uint32_t I = 0; I < IOThreadCount; ++I)
+			IOThreads.push_back(&allocator->allocate<std::thread>([this] { _IOThread(); }));
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetLoader::~AssetLoader()
+	{
+		Shutdown();
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::Shutdown()
+	{
+		if (!IOThreads.size())
+			return;
+
+		{
+			std::scoped_lock localLock{ lock };
+			running = false;
+		}
+
+		cv.notify_all();
+
+		for (auto thread : IOThreads)
+		{
+			thread->join();
+			allocator->release_allocation(*thread);
+		}
+
+		IOThreads.Release();
+
+		// Decodes already handed to the ThreadManager still reference the requests
+		while (inFlight)
+			std::this_thread::yield();
+
+		Update();
+
+		for (uint32_t I = 0; I < requests.size(); ++I)
+			if (requests[I])
+				_FreeRequest(I);
+
+		requests.Release();
+		freeList.Release();
+		pending.Release();
+		finished.Release();
+		finalizing.Release();
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetRequestHandle AssetLoader::RequestAsset(const GUID_t guid, const int32_t priority, AssetCompletionCallback onComplete, AssetDecodeCallback onDecode)
+	{
+		// Resolved here on the owning thread, the IO threads never look at the resource table
+		const AssetHandle	loaded		= FindLoadedAsset(guid);
+		const bool			resident	= IsAssetResident(loaded);
+
+		AssetReadInfo	info;
+		const bool		available	= resident || FindAssetReadInfo(guid, info);
+
+		std::scoped_lock localLock{ lock };
+
+		uint32_t idx;
+		if (freeList.size())
+			idx = freeList.pop_back();
+		else
+		{
+			idx = (uint32_t)requests.size();
+			requests.push_back(nullptr);
+		}
+
+		Request& request	= allocator->allocate<Request>();
+		request.guid		= guid;
+		request.priority	= priority;
+		request.cancelled	= false;
+		request.released	= false;
+		request.resource	= nullptr;
+		request.mapped		= false;
+		request.asset		= resident ? loaded : INVALIDHANDLE;
+		request.onComplete	= std::move(onComplete);
+		request.onDecode	= std::move(onDecode);
+
+		if (available && !resident)
+			request.info = info;
+
+		requests[idx] = &request;
+
+		if (resident || !available)
+		{	// Already resident or nothing to read, report it on the next Update
+			request.state = AssetRequestState::Finalizing;
+			finished.push_back(idx);
+		}
+		else
+		{
+			request.state = AssetRequestState::Queued;
+			pending.push_back(idx);
+
+			cv.notify_one();
+		}
+
+		return AssetRequestHandle{ idx };
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool AssetLoader::Cancel(const AssetRequestHandle handle)
+	{
+		std::scoped_lock localLock{ lock };
+
+		Request& request = _GetRequest(handle);
+
+		switch (request.state)
+		{
+		case AssetRequestState::Queued:
+		{
+			pending.remove_unstable(std::find(pending.begin(), pending.end(), handle.to_uint()));
+			request.state = AssetRequestState::Cancelled;
+		}	return true;
+		case AssetRequestState::Complete:
+		case AssetRequestState::Failed:
+		case AssetRequestState::Cancelled:
+			return false;
+		default:
+			request.cancelled = true;
+			return true;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t AssetLoader::PreloadManifest(const char* manifestFile)
+	{
+		FILE* F = 0;
+		int S   = fopen_s(&F, manifestFile, "rb");
+
+		if (!F)
+			return 0;
+
+		const size_t entryCount = ReadAssetManifestSize(F);
+
+		Vector<AssetManifestEntry> manifest{ allocator };
+		manifest.resize(entryCount);
+
+		const bool success = entryCount && ReadAssetManifest(F, manifest.begin(), entryCount);
+		::fclose(F);
+
+		if (!success)
+			return 0;
+
+		size_t queued = 0;
+
+		for (size_t I = 0; I < entryCount; ++I)
+		{
+			const GUID_t guid = manifest[I].GUID;
+
+			if (IsAssetResident(FindLoadedAsset(guid)) || !isAssetAvailable(guid))
+				continue;
+
+			const int32_t priority = (int32_t)std::max<int64_t>(-1 - (int64_t)I, INT32_MIN);
+
+			const AssetRequestHandle request = RequestAsset(guid, priority);
+
+			{	// Releasing through ReleaseRequest would drop it from the queue, let it run to completion instead
+				std::scoped_lock localLock{ lock };
+				_GetRequest(request).released = true;
+			}
+
+			queued++;
+		}
+
+		FK_LOG_INFO("Preloading %zu assets from %s", queued, manifestFile);
+
+		return queued;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::SetPriority(const AssetRequestHandle handle, const int32_t priority)
+	{
+		std::scoped_lock localLock{ lock };
+
+		_GetRequest(handle).priority = priority;
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetRequestState AssetLoader::GetState(const AssetRequestHandle handle) const
+	{
+		return _GetRequest(handle).state;
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetHandle AssetLoader::GetAsset(const AssetRequestHandle handle) const
+	{
+		const Request& request = _GetRequest(handle);
+
+		return request.state == AssetRequestState::Complete ? request.asset : INVALIDHANDLE;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool AssetLoader::IsDone(const AssetRequestHandle handle) const
+	{
+		switch (GetState(handle))
+		{
+		case AssetRequestState::Complete:
+		case AssetRequestState::Failed:
+		case AssetRequestState::Cancelled:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::ReleaseRequest(const AssetRequestHandle handle)
+	{
+		std::scoped_lock localLock{ lock };
+
+		Request& request = _GetRequest(handle);
+
+		switch (request.state)
+		{
+		case AssetRequestState::Queued:
+			pending.remove_unstable(std::find(pending.begin(), pending.end(), handle.to_uint()));
+			[[fallthrough]];
+		case AssetRequestState::Complete:
+		case AssetRequestState::Failed:
+		case AssetRequestState::Cancelled:
+			_FreeRequest(handle.to_uint());
+			break;
+		default:
+			request.released = true;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t AssetLoader::Update()
+	{
+		{
+			std::scoped_lock localLock{ lock };
+
+			finalizing.clear();
+			finalizing += finished;
+			finished.clear();
+		}
+
+		for (const uint32_t idx : finalizing)
+		{
+			Request& request = *requests[idx];
+
+			if (request.cancelled)
+			{
+				if (request.resource)
+					ReleaseAssetMemory(request.resource, request.mapped);
+
+				request.state = AssetRequestState::Cancelled;
+			}
+			else if (request.resource)
+			{
+				request.asset	= AddLoadedAsset(request.resource, request.mapped);
+				request.state	= AssetRequestState::Complete;
+			}
+			else
+				request.state = request.asset != INVALIDHANDLE ? AssetRequestState::Complete : AssetRequestState::Failed;
+
+			request.resource = nullptr;
+
+			if (request.released)
+			{
+				std::scoped_lock localLock{ lock };
+				_FreeRequest(idx);
+			}
+			else if (request.state != AssetRequestState::Cancelled)
+				request.onComplete(AssetRequestHandle{ idx }, request.asset);
+		}
+
+		return finalizing.size();
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetHandle AssetLoader::WaitFor(const AssetRequestHandle handle)
+	{
+		while (!IsDone(handle))
+		{
+			if (!Update())
+				std::this_thread::yield();
+		}
+
+		return GetAsset(handle);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::_IOThread()
+	{
+		uint32_t		batch[IOBatchSize];
+		Request*		batchRequests[IOBatchSize];
+		AssetReadInfo	infos[IOBatchSize];
+
+		while (true)
+		{
+			size_t batchSize = 0;
+
+			{
+				std::unique_lock ul{ lock };
+				cv.wait(ul, [&] { return !running || pending.size(); });
+
+				if (!running)
+					return;
+
+				// Take the highest priority requests, priorities can change while queued so no heap
+				while (batchSize < IOBatchSize && pending.size())
+				{
+					auto itr = std::max_element(
+						pending.begin(), pending.end(),
+						[&](const uint32_t lhs, const uint32_t rhs)
+						{
+							return requests[lhs]->priority < requests[rhs]->priority;
+						});
+
+					const uint32_t idx = *itr;
+					pending.remove_unstable(itr);
+
+					requests[idx]->state = AssetRequestState::Reading;
+
+					infos[batchSize]			= requests[idx]->info;
+					batch[batchSize]			= idx;
+					batchRequests[batchSize]	= requests[idx];
+					batchSize++;
+				}
+
+				inFlight += (int)batchSize;
+			}
+
+			// Get the whole batch moving before blocking on the first one
+			PrefetchGameAssets(infos, batchSize);
+
+			// Priority picks the batch, within it read in package order so the disk sweeps forward
+			uint64_t	readOrder[IOBatchSize];
+			uint32_t	reads[IOBatchSize];
+
+			for (uint32_t I = 0; I < batchSize; ++I)
+			{
+				readOrder[I]	= infos[I].order;
+				reads[I]		= I;
+			}
+
+			std::sort(reads, reads + batchSize,
+				[&](const uint32_t lhs, const uint32_t rhs)
+				{
+					return readOrder[lhs] < readOrder[rhs];
+				});
+
+			for (size_t I = 0; I < batchSize; ++I)
+			{
+				const uint32_t	idx		= batch[reads[I]];
+				Request*		request	= batchRequests[reads[I]];
+
+				if (!request->cancelled)
+					_Read(*request);
+
+				request->state = AssetRequestState::Decoding;
+
+				auto& decode = CreateWorkItem(
+					[this, idx, request]
+					{
+						if (request->resource && !request->cancelled && IsCompressedAsset(request->resource))
+							request->resource = DecompressGameAsset(request->resource, request->mapped, &threads);
+
+						if (request->resource && !request->cancelled)
+							request->onDecode(request->resource);
+
+						_PushFinished(idx);
+					}, allocator);
+
+				threads.AddBackgroundWork(decode);
+			}
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::_Read(Request& request)
+	{
+		request.resource = ReadGameAsset(request.info, request.mapped);
+
+		if (request.resource && request.mapped)
+		{	// Fault in the mapped pages here so workers and the owning thread don't block on the disk
+			const volatile char*	bytes	= (const volatile char*)request.resource;
+			const size_t			size	= GetStoredAssetSize(request.resource);
+
+			char sink = 0;
+			for (size_t offset = 0; offset < size; offset += 4096)
+				sink ^= bytes[offset];
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::_PushFinished(const uint32_t idx)
+	{
+		std::scoped_lock localLock{ lock };
+
+		requests[idx]->state = AssetRequestState::Finalizing;
+		finished.push_back(idx);
+
+		inFlight--;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AssetLoader::_FreeRequest(const uint32_t idx)
+	{
+		Request* request = requests[idx];
+
+		if (request->resource)
+			ReleaseAssetMemory(request->resource, request->mapped);
+
+		allocator->release_allocation(*request);
+
+		requests[idx] = nullptr;
+		freeList.push_back(idx);
+	}
+
+
+}	/************************************************************************************************/
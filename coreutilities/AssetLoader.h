@@ -0,0 +1,162 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\Assets.h"
+#include "..\coreutilities\containers.h"
+#include "..\coreutilities\Handle.h"
+#include "..\coreutilities\memoryutilities.h"
+#include "..\coreutilities\ThreadUtilities.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	typedef Handle_t<32, GetTypeGUID(AssetRequest)> AssetRequestHandle;
+
+	enum class AssetRequestState : uint32_t
+	{
+		Queued,
+		Reading,
+		Decoding,
+		Finalizing,
+		Complete,
+		Failed,
+		Cancelled,
+	};
+
+	// Decode runs on a ThreadManager worker after the read, before the resource is registered
+	typedef TypeErasedCallable<48, void, Resource*>							AssetDecodeCallback;
+
+	// Completion runs on the thread calling AssetLoader::Update, asset is INVALIDHANDLE if the load failed
+	typedef TypeErasedCallable<48, void, AssetRequestHandle, AssetHandle>	AssetCompletionCallback;
+
+
+	/************************************************************************************************/
+
+
+	// Asynchronous asset loads. Requests are read by dedicated IO threads, highest priority first and
+	// a batch at a time, decompressed and decoded on the ThreadManager's background queue, and registered with the
+	// global resource table and reported back from Update on the owning thread.
+	//
+	// Requests are resolved against the resource table when they're made, IO threads only read packages.
+	// Asset files must not be added while requests are in flight. The allocator is used from worker
+	// threads and needs to be thread safe.
+	class FLEXKITAPI AssetLoader
+	{
+	public:
+		static const size_t IOBatchSize = 16;
+
+		AssetLoader(ThreadManager& IN_threads, iAllocator* IN_allocator, const uint32_t IOThreadCount = 1);
+		~AssetLoader();
+
+		AssetLoader(const AssetLoader&)					= delete;
+		AssetLoader& operator = (const AssetLoader&)	= delete;
+
+		AssetRequestHandle	RequestAsset	(
+								const GUID_t			guid,
+								const int32_t			priority	= 0,
+								AssetCompletionCallback	onComplete	= [](AssetRequestHandle, AssetHandle) {},
+								AssetDecodeCallback		onDecode	= [](Resource*) {});
+
+		// Returns false if the request had already completed
+		bool				Cancel			(const AssetRequestHandle request);
+		void				SetPriority		(const AssetRequestHandle request, const int32_t priority);
+
+		AssetRequestState	GetState		(const AssetRequestHandle request) const;
+		AssetHandle			GetAsset		(const AssetRequestHandle request) const;
+		bool				IsDone			(const AssetRequestHandle request) const;
+
+		// Handles stay valid until released, releasing an in flight request lets it finish without reporting
+		void				ReleaseRequest	(const AssetRequestHandle request);
+
+		// Queues the assets of a recorded manifest in the order they were first used, below default priority so
+		// requests made in the meantime go first. Nothing is reported back, returns the number of assets queued.
+		size_t				PreloadManifest	(const char* manifestFile);
+
+		// Registers finished loads and runs completion callbacks, returns the number of requests finalized
+		size_t				Update			();
+
+		// Blocks until the request is done, finalizing on the calling thread
+		AssetHandle			WaitFor			(const AssetRequestHandle request);
+
+		void				Shutdown		();
+
+	private:
+		struct Request
+		{
+			GUID_t							guid;
+			AssetReadInfo					info;
+			int32_t							priority;
+			std::atomic<AssetRequestState>	state;
+			std::atomic_bool				cancelled;
+			bool							released;
+
+			Resource*						resource;
+			bool							mapped;
+			AssetHandle						asset;
+
+			AssetCompletionCallback			onComplete;
+			AssetDecodeCallback				onDecode;
+		};
+
+		void		_IOThread		();
+		void		_Read			(Request& request);
+		void		_PushFinished	(const uint32_t requestIdx);
+		void		_FreeRequest	(const uint32_t requestIdx);
+
+		Request&		_GetRequest	(const AssetRequestHandle request)			{ return *requests[request.to_uint()]; }
+		const Request&	_GetRequest	(const AssetRequestHandle request) const	{ return *requests[request.to_uint()]; }
+
+		ThreadManager&				threads;
+		iAllocator*					allocator;
+
+		mutable std::mutex			lock;
+		std::condition_variable		cv;
+		std::atomic_bool			running;
+		std::atomic_int				inFlight;
+
+		Vector<Request*>			requests;	// Indexed by request handle
+		Vector<uint32_t>			freeList;
+		Vector<uint32_t>			pending;	// Queued, unordered, IO threads pick the highest priority
+		Vector<uint32_t>			finished;	// Waiting on Update
+		Vector<uint32_t>			finalizing;	// Owned by Update
+
+		Vector<std::thread*>		IOThreads;
+	};
+
+
+}	/************************************************************************************************/
+
+#endif
@@ -23,6 +23,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 **********************************************************************/
 
 #include "Assets.h"
+#include "..\coreutilities\LZCompression.h"
+#include "..\coreutilities\ThreadUtilities.h"
 #include "..\graphicsutilities\graphics.h"
 
 namespace FlexKit
@@ -30,232 +32,1198 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
+	bool MapAssetPackage(const char* fileLoc, AssetPackageView& out)
+	{
+		HANDLE file = CreateFileA(fileLoc, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || !fileSize.QuadPart)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		char* view = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (!view)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		out.file	= file;
+		out.mapping	= mapping;
+		out.view	= view;
+		out.size	= (size_t)fileSize.QuadPart;
+
+		return true;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void UnmapAssetPackage(AssetPackageView& package)
+	{
+		if (package.view)
+			UnmapViewOfFile(package.view);
+
+		if (package.mapping)
+			CloseHandle(package.mapping);
+
+		if (package.file != INVALID_HANDLE_VALUE)
+			CloseHandle(package.file);
+
+		package = AssetPackageView{};
+	}
+
+
+	/************************************************************************************************/
+
+
 	void InitiateAssetTable(iAllocator* Memory)
 	{
-		Resources.Tables			= Vector<ResourceTable*>(Memory);
-		Resources.ResourceFiles		= Vector<ResourceDirectory>(Memory);
-		Resources.ResourcesLoaded	= Vector<Resource*>(Memory);
-		Resources.ResourceGUIDs		= Vector<GUID_t>(Memory);
-		Resources.ResourceMemory	= Memory;
+		Resources.Tables			= Vector<ResourceTable*>(Memory);
+		Resources.EntryExtents		= Vector<size_t*>(Memory);
+		Resources.ResourceFiles		= Vector<ResourceDirectory>(Memory);
+		Resources.ResourcesLoaded	= Vector<Resource*>(Memory);
+		Resources.ResourceGUIDs		= Vector<GUID_t>(Memory);
+		Resources.ResourceMemory	= Memory;
+
+		Resources.GUIDIndex.slots	= Vector<AssetIndex::Slot>(Memory);
+		Resources.IDIndex.slots		= Vector<AssetIndex::Slot>(Memory);
+		Resources.LoadedIndex.slots	= Vector<AssetIndex::Slot>(Memory);
+
+		Resources.PackageViews		= Vector<AssetPackageView>(Memory);
+		Resources.Residency			= Vector<ResourceResidency>(Memory);
+		Resources.LRUFirst			= ResourceResidency::InvalidLink;
+		Resources.LRULast			= ResourceResidency::InvalidLink;
+		Resources.MemoryStats		= AssetMemoryStats{};
+
+		Resources.Trace				= Vector<AssetManifestEntry>(Memory);
+		Resources.Tracing			= false;
+	}
+
+	
+	/************************************************************************************************/
+
+
+	void ReleaseAssetTable()
+	{
+		for (auto* Table : Resources.Tables)
+			Resources.ResourceMemory->free(Table);
+
+		for (auto* extents : Resources.EntryExtents)
+			Resources.ResourceMemory->free(extents);
+
+		for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
+			if (Resources.Residency[I].resident && !Resources.Residency[I].mapped)
+				Resources.ResourceMemory->free(Resources.ResourcesLoaded[I]);
+
+		for (auto& package : Resources.PackageViews)
+			UnmapAssetPackage(package);
+
+		Resources.Tables.Release();
+		Resources.EntryExtents.Release();
+		Resources.ResourceFiles.Release();
+		Resources.ResourcesLoaded.Release();
+		Resources.ResourceGUIDs.Release();
+
+		Resources.GUIDIndex.Release();
+		Resources.IDIndex.Release();
+		Resources.LoadedIndex.Release();
+
+		Resources.PackageViews.Release();
+		Resources.Residency.Release();
+		Resources.Trace.Release();
+	}
+
+
+	/************************************************************************************************/
+
+
+	inline uint64_t		PackTableEntry	(const size_t table, const size_t entry)	{ return (uint64_t(table) << 32) | uint64_t(entry); }
+	inline size_t		EntryTable		(const uint64_t packed)						{ return size_t(packed >> 32); }
+	inline size_t		EntryIndex		(const uint64_t packed)						{ return size_t(packed & 0xffffffff); }
+
+	inline ResourceEntry& GetTableEntry(const uint64_t packed)
+	{
+		return Resources.Tables[EntryTable(packed)]->Entries[EntryIndex(packed)];
+	}
+
+
+	/************************************************************************************************/
+
+
+	uint64_t FindTableEntry(const GUID_t guid)
+	{
+		return Resources.GUIDIndex.Find(AssetIndexHash(guid),
+			[&](const uint64_t packed)
+			{
+				return GetTableEntry(packed).GUID == guid;
+			});
+	}
+
+
+	uint64_t FindTableEntry(const char* ID)
+	{
+		return Resources.IDIndex.Find(AssetIndexHash(ID),
+			[&](const uint64_t packed)
+			{
+				return !strncmp(GetTableEntry(packed).ID, ID, ID_LENGTH);
+			});
+	}
+
+
+	AssetHandle FindLoadedHandle(const GUID_t guid)
+	{
+		return Resources.LoadedIndex.Find(AssetIndexHash(guid),
+			[&](const uint64_t handle)
+			{
+				return Resources.ResourceGUIDs[handle] == guid;
+			});
+	}
+
+
+	AssetHandle FindLoadedAsset(const GUID_t guid)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+		return FindLoadedHandle(guid);
+	}
+
+
+	/************************************************************************************************/
+
+
+	ResourceTable* ReadMappedAssetTable(const AssetPackageView& package)
+	{
+		if (package.size < sizeof(ResourceTable))
+			return nullptr;
+
+		const ResourceTable* header	= (const ResourceTable*)package.view;
+		const size_t TableSize		= header->ResourceCount * sizeof(ResourceEntry) + sizeof(ResourceTable);
+
+		if (TableSize > package.size)
+			return nullptr;
+
+		ResourceTable* Table = (ResourceTable*)Resources.ResourceMemory->_aligned_malloc(TableSize);
+		memcpy(Table, package.view, TableSize);
+
+		return Table;
+	}
+
+
+	/************************************************************************************************/
+
+
+	ResourceTable* ReadFileAssetTable(const char* fileLoc, size_t& fileSize)
+	{
+		FILE* F = 0;
+		int S   = fopen_s(&F, fileLoc, "rb");
+
+		if (!F)
+			return nullptr;
+
+		size_t TableSize	 = ReadAssetTableSize(F);
+		ResourceTable* Table = (ResourceTable*)Resources.ResourceMemory->_aligned_malloc(TableSize);
+
+		if (!ReadAssetTable(F, Table, TableSize))
+		{
+			Resources.ResourceMemory->_aligned_free(Table);
+			Table = nullptr;
+		}
+
+		_fseeki64(F, 0, SEEK_END);
+		fileSize = (size_t)_ftelli64(F);
+
+		::fclose(F);
+		return Table;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Resources are written back to back, each entry's stored bytes end where the next one in the package starts
+	size_t* BuildEntryExtents(const ResourceTable* table, const size_t packageSize)
+	{
+		const size_t count		= table->ResourceCount;
+		size_t* extents			= (size_t*)Resources.ResourceMemory->malloc(sizeof(size_t) * std::max<size_t>(count, 1));
+		Vector<uint32_t> sorted	{ Resources.ResourceMemory };
+
+		FK_ASSERT(extents, "OUT OF MEMORY!");
+
+		sorted.reserve(count);
+		for (size_t I = 0; I < count; ++I)
+			sorted.push_back((uint32_t)I);
+
+		std::sort(sorted.begin(), sorted.end(),
+			[&](const uint32_t lhs, const uint32_t rhs)
+			{
+				return table->Entries[lhs].ResourcePosition < table->Entries[rhs].ResourcePosition;
+			});
+
+		// Walks back from the end of the package, entries sharing a position share the next one's start
+		size_t next = packageSize;
+		for (size_t I = count; I-- > 0;)
+		{
+			const size_t position = table->Entries[sorted[I]].ResourcePosition;
+
+			if (I + 1 < count && table->Entries[sorted[I + 1]].ResourcePosition > position)
+				next = std::min<size_t>(table->Entries[sorted[I + 1]].ResourcePosition, packageSize);
+
+			extents[sorted[I]] = next;
+		}
+
+		sorted.Release();
+
+		return extents;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AddAssetFile(char* FILELOC)
+	{
+		ResourceDirectory Dir;
+		strcpy_s(Dir.str, FILELOC);
+
+		// Packages are mapped once and stay mapped, loads fall back to reading the file if that fails
+		AssetPackageView package;
+		ResourceTable* Table	= nullptr;
+		size_t packageSize		= 0;
+
+		if (MapAssetPackage(FILELOC, package))
+		{
+			Table		= ReadMappedAssetTable(package);
+			packageSize	= package.size;
+
+			if (!Table)
+				UnmapAssetPackage(package);
+		}
+		else
+			Table = ReadFileAssetTable(FILELOC, packageSize);
+
+		if (Table)
+		{
+			size_t* extents = BuildEntryExtents(Table, packageSize);
+
+			std::scoped_lock lock{ Resources.Lock };
+
+			const size_t TableIdx = Resources.Tables.size();
+
+			Resources.ResourceFiles.push_back(Dir);
+			Resources.Tables.push_back(Table);
+			Resources.EntryExtents.push_back(extents);
+			Resources.PackageViews.push_back(package);
+
+			// Earlier packages take precedence, only index entries not already present
+			for (size_t I = 0; I < Table->ResourceCount; ++I)
+			{
+				auto& entry = Table->Entries[I];
+
+				if (FindTableEntry(entry.GUID) == INVALIDHANDLE)
+					Resources.GUIDIndex.Insert(AssetIndexHash(entry.GUID), PackTableEntry(TableIdx, I));
+
+				if (entry.ID[0] && FindTableEntry(entry.ID) == INVALIDHANDLE)
+					Resources.IDIndex.Insert(AssetIndexHash(entry.ID), PackTableEntry(TableIdx, I));
+			}
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	Pair<GUID_t, bool>	FindAssetGUID(char* Str)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		const uint64_t packed = FindTableEntry(Str);
+
+		if (packed == INVALIDHANDLE)
+			return{ INVALIDHANDLE, false };
+
+		return{ GetTableEntry(packed).GUID, true };
+	}
+
+
+	/************************************************************************************************/
+
+
+	void FreeAllAssets()
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
+			if(Resources.ResourceMemory && Resources.Residency[I].resident && !Resources.Residency[I].mapped) Resources.ResourceMemory->_aligned_free(Resources.ResourcesLoaded[I]);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void FreeAllAssetFiles()
+	{
+		for (auto T : Resources.Tables)
+			Resources.ResourceMemory->_aligned_free(T);
+
+		for (auto extents : Resources.EntryExtents)
+			Resources.ResourceMemory->free(extents);
+
+		for (auto& package : Resources.PackageViews)
+			UnmapAssetPackage(package);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void LRUPushBack(const uint32_t idx)
+	{
+		auto& residency = Resources.Residency[idx];
+
+		residency.prev		= Resources.LRULast;
+		residency.next		= ResourceResidency::InvalidLink;
+		residency.evictable	= true;
+
+		if (Resources.LRULast != ResourceResidency::InvalidLink)
+			Resources.Residency[Resources.LRULast].next = idx;
+		else
+			Resources.LRUFirst = idx;
+
+		Resources.LRULast = idx;
+
+		Resources.MemoryStats.evictableBytes += residency.size;
+		Resources.MemoryStats.evictableCount++;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void LRURemove(const uint32_t idx)
+	{
+		auto& residency = Resources.Residency[idx];
+
+		if (residency.prev != ResourceResidency::InvalidLink)
+			Resources.Residency[residency.prev].next = residency.next;
+		else
+			Resources.LRUFirst = residency.next;
+
+		if (residency.next != ResourceResidency::InvalidLink)
+			Resources.Residency[residency.next].prev = residency.prev;
+		else
+			Resources.LRULast = residency.prev;
+
+		residency.prev		= ResourceResidency::InvalidLink;
+		residency.next		= ResourceResidency::InvalidLink;
+		residency.evictable	= false;
+
+		Resources.MemoryStats.evictableBytes -= residency.size;
+		Resources.MemoryStats.evictableCount--;
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t EvictResource(const uint32_t idx)
+	{
+		auto&		residency	= Resources.Residency[idx];
+		Resource*	resource	= Resources.ResourcesLoaded[idx];
+
+		LRURemove(idx);
+
+		// Mapped resources stay valid in the view, dropping them from the working set is all there is to free
+		if (residency.mapped)
+			VirtualUnlock(resource, residency.size);
+		else
+			Resources.ResourceMemory->_aligned_free(resource);
+
+		Resources.ResourcesLoaded[idx]	= nullptr;
+		residency.resident				= false;
+
+		Resources.MemoryStats.residentBytes -= residency.size;
+		Resources.MemoryStats.residentCount--;
+		Resources.MemoryStats.evictionCount++;
+
+		return residency.size;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void EnforceAssetBudget(const size_t incomingBytes)
+	{
+		const size_t budget = Resources.MemoryBudget;
+
+		while (Resources.LRUFirst != ResourceResidency::InvalidLink &&
+				(incomingBytes > budget || Resources.MemoryStats.residentBytes > budget - incomingBytes))
+			EvictResource(Resources.LRUFirst);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void AttachResource(const AssetHandle RHandle, Resource* resource, const bool mapped)
+	{
+		EnforceAssetBudget(resource->ResourceSize);
+
+		resource->State		= Resource::EResourceState_LOADED;
+		resource->RefCount	= 0;
+
+		auto& residency		= Resources.Residency[RHandle];
+		residency.size		= resource->ResourceSize;
+		residency.refCount	= 0;
+		residency.mapped	= mapped;
+		residency.resident	= true;
+
+		Resources.ResourcesLoaded[RHandle] = resource;
+
+		auto& stats = Resources.MemoryStats;
+		stats.residentBytes		+= residency.size;
+		stats.residentCount		+= 1;
+		stats.peakResidentBytes	 = std::max(stats.peakResidentBytes, stats.residentBytes);
+
+		LRUPushBack((uint32_t)RHandle);
+	}
+
+
+	/************************************************************************************************/
+
+
+	Resource* ReadMappedResource(const AssetReadInfo& info, bool& mapped)
+	{
+		const size_t position = info.position;
+
+		if (position + sizeof(CompressedResourceHeader) > info.viewSize)
+			return nullptr;
+
+		Resource* resource = (Resource*)(info.view + position);
+
+		if (GetStoredAssetSize(resource) > info.viewSize - position)
+			return nullptr;
+
+		// Blobs are written back to back, only hand out pointers to ones that happen to be aligned.
+		// Compressed resources are only read from, decompression makes the copy.
+		mapped = !(position % 16) || IsCompressedAsset(resource);
+		if (mapped)
+			return resource;
+
+		Resource* copy = (Resource*)Resources.ResourceMemory->_aligned_malloc(resource->ResourceSize);
+		FK_ASSERT(copy, "OUT OF MEMORY!");
+
+		memcpy(copy, resource, resource->ResourceSize);
+		return copy;
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetHandle PushLoadedResource(Resource* resource, const bool mapped)
+	{
+		const AssetHandle RHandle = Resources.ResourcesLoaded.size();
+		Resources.ResourcesLoaded.push_back(nullptr);
+		Resources.ResourceGUIDs.push_back(resource->GUID);
+		Resources.Residency.push_back(ResourceResidency{});
+		Resources.LoadedIndex.Insert(AssetIndexHash(resource->GUID), RHandle);
+
+		AttachResource(RHandle, resource, mapped);
+
+		return RHandle;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Resource* ReadFileResource(const AssetReadInfo& info)
+	{
+		FILE* F = 0;
+		int S   = fopen_s(&F, info.file.str, "rb");
+
+		if (!F)
+			return nullptr;
+
+		Resource*	resource = nullptr;
+		byte		header[sizeof(CompressedResourceHeader)];
+
+		if (!_fseeki64(F, info.position, SEEK_SET) && fread(header, 1, sizeof(header), F) == sizeof(header))
+		{
+			const size_t storedSize = GetStoredAssetSize(header);
+
+			if (storedSize >= sizeof(header))
+			{
+				// Unreferenced resources are evicted to stay under the memory budget before new ones are
+				// attached, running out here means the budget is larger than the allocator
+				resource = (Resource*)Resources.ResourceMemory->_aligned_malloc(storedSize);
+				FK_ASSERT(resource, "OUT OF MEMORY!");
+
+				memcpy(resource, header, sizeof(header));
+
+				const size_t remaining = storedSize - sizeof(header);
+				if (fread((byte*)resource + sizeof(header), 1, remaining, F) != remaining)
+				{
+					Resources.ResourceMemory->_aligned_free(resource);
+					resource = nullptr;
+				}
+			}
+		}
+
+		::fclose(F);
+		return resource;
+	}
+
+
+	/************************************************************************************************/
+
+
+	inline uint64_t AssetReadOrder(const uint64_t packed)
+	{	// Package in the top bits, position within the package below
+		return (uint64_t(EntryTable(packed)) << 48) | uint64_t(GetTableEntry(packed).ResourcePosition);
+	}
+
+
+	AssetReadInfo GetAssetReadInfo(const uint64_t packed)
+	{
+		const size_t	TI		= EntryTable(packed);
+		const auto&		entry	= GetTableEntry(packed);
+		const auto&		package	= Resources.PackageViews[TI];
+
+		AssetReadInfo info;
+		info.GUID		= entry.GUID;
+		info.order		= AssetReadOrder(packed);
+		info.position	= entry.ResourcePosition;
+		info.end		= Resources.EntryExtents[TI][EntryIndex(packed)];
+		info.view		= package.view;
+		info.viewSize	= package.size;
+		info.file		= Resources.ResourceFiles[TI];
+
+		return info;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Resource* ReadStoredAsset(const AssetReadInfo& info, bool& mapped)
+	{
+		mapped = false;
+
+		if (info.view)
+			return ReadMappedResource(info, mapped);
+
+		return ReadFileResource(info);
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Packages can be truncated or corrupt, nothing is written until the block table is known to be in bounds
+	bool ValidateCompressedHeader(const CompressedResourceHeader* header)
+	{
+		if (header->blockSize == 0 || header->uncompressedSize < sizeof(Resource))
+			return false;
+
+		const uint64_t expectedBlocks = (header->uncompressedSize + header->blockSize - 1) / header->blockSize;
+		if (header->blockCount != expectedBlocks)
+			return false;
+
+		const uint64_t tableEnd = sizeof(CompressedResourceHeader) + (uint64_t(header->blockCount) + 1) * sizeof(uint64_t);
+		if (tableEnd > header->compressedSize || header->blockOffsets[0] < tableEnd)
+			return false;
+
+		for (size_t I = 0; I < header->blockCount; ++I)
+			if (header->blockOffsets[I + 1] < header->blockOffsets[I])
+				return false;
+
+		return header->blockOffsets[header->blockCount] <= header->compressedSize;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Resource* DecompressGameAsset(Resource* stored, bool& mapped, ThreadManager* threads)
+	{
+		const CompressedResourceHeader* header = (const CompressedResourceHeader*)stored;
+
+		if (!ValidateCompressedHeader(header))
+		{
+			FK_LOG_ERROR("Compressed asset has an invalid block table!");
+
+			ReleaseAssetMemory(stored, mapped);
+			mapped = false;
+
+			return nullptr;
+		}
+
+		const size_t uncompressedSize = header->uncompressedSize;
+
+		Resource* resource = (Resource*)Resources.ResourceMemory->_aligned_malloc(uncompressedSize);
+		FK_ASSERT(resource, "OUT OF MEMORY!");
+
+		std::atomic_bool failed = false;
+
+		auto decompressBlock = [&](const size_t idx)
+		{
+			const size_t	begin		= idx * header->blockSize;
+			const size_t	size		= std::min<size_t>(header->blockSize, header->uncompressedSize - begin);
+			char*			dst			= (char*)resource + begin;
+
+			if (header->GetBlockSize(idx) == size)
+				memcpy(dst, header->GetBlock(idx), size);
+			else if (!LZDecompress(header->GetBlock(idx), header->GetBlockSize(idx), dst, size))
+				failed = true;
+		};
+
+		if (threads && localWorkQueue && header->blockCount > 1)
+		{
+			WorkBarrier barrier{ *threads, SystemAllocator };
+
+			for (size_t I = 1; I < header->blockCount; ++I)
+			{
+				auto& workItem = CreateWorkItem([&decompressBlock, I] { decompressBlock(I); }, SystemAllocator);
+
+				barrier.AddWork(workItem);
+				PushToLocalQueue(workItem);
+			}
+
+			decompressBlock(0);
+			barrier.JoinLocal();
+		}
+		else
+		{
+			for (size_t I = 0; I < header->blockCount; ++I)
+				decompressBlock(I);
+		}
+
+		ReleaseAssetMemory(stored, mapped);
+		mapped = false;
+
+		if (failed || resource->ResourceSize != uncompressedSize)
+		{
+			Resources.ResourceMemory->_aligned_free(resource);
+			return nullptr;
+		}
+
+		return resource;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetAssetDecompressionThreads(ThreadManager* threads)
+	{
+		Resources.DecompressionThreads = threads;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Called without the table locked, loads on one thread don't hold up GetAsset and FreeAsset on the others
+	Resource* ReadAsset(const AssetReadInfo& info, bool& mapped)
+	{
+		Resource* stored = ReadStoredAsset(info, mapped);
+
+		if (stored && IsCompressedAsset(stored))
+			return DecompressGameAsset(stored, mapped, Resources.DecompressionThreads);
+
+		return stored;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Called with the table locked
+	AssetHandle RegisterLoadedResource(Resource* resource, const bool mapped)
+	{
+		const AssetHandle loaded = FindLoadedHandle(resource->GUID);
+		if (loaded != INVALIDHANDLE)
+		{
+			if (!Resources.Residency[loaded].resident)
+			{	// Evicted, the new copy takes over the old handle
+				AttachResource(loaded, resource, mapped);
+				Resources.MemoryStats.reloadCount++;
+			}
+			else // Loaded by someone else while this copy was in flight
+				ReleaseAssetMemory(resource, mapped);
+
+			return loaded;
+		}
+
+		return PushLoadedResource(resource, mapped);
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Called with the table locked, the lock is dropped while the package is read
+	AssetHandle LoadTableEntry(const uint64_t packed, std::unique_lock<std::mutex>& lock)
+	{
+		const AssetReadInfo info = GetAssetReadInfo(packed);
+
+		lock.unlock();
+
+		bool mapped			= false;
+		Resource* resource	= ReadAsset(info, mapped);
+
+		lock.lock();
+
+		if (!resource)
+		{
+			FK_ASSERT(false, "FAILED TO LOAD RESOURCE!");
+			return INVALIDHANDLE;
+		}
+
+		return RegisterLoadedResource(resource, mapped);
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool FindAssetReadInfo(GUID_t guid, AssetReadInfo& out)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		const uint64_t packed = FindTableEntry(guid);
+		if (packed == INVALIDHANDLE)
+			return false;
+
+		out = GetAssetReadInfo(packed);
+		return true;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Resource* ReadGameAsset(const AssetReadInfo& info, bool& mapped)
+	{
+		return ReadStoredAsset(info, mapped);
+	}
+
+
+	/************************************************************************************************/
+
+
+	AssetHandle AddLoadedAsset(Resource* resource, bool mapped)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+		return RegisterLoadedResource(resource, mapped);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void ReleaseAssetMemory(Resource* resource, bool mapped)
+	{
+		if (!mapped)
+			Resources.ResourceMemory->_aligned_free(resource);
 	}
 
-	
+
 	/************************************************************************************************/
 
 
-	void ReleaseAssetTable()
+	// Called with the table locked, the lock is dropped while the package is read. Another thread
+	// may reload the same resource in the meantime, whichever copy lands second is freed.
+	bool ReloadResource(const AssetHandle RHandle, std::unique_lock<std::mutex>& lock)
 	{
-		for (auto* Table : Resources.Tables)
-			Resources.ResourceMemory->free(Table);
+		const uint64_t packed = FindTableEntry(Resources.ResourceGUIDs[RHandle]);
+		if (packed == INVALIDHANDLE)
+			return false;
 
-		for (auto* Resource : Resources.ResourcesLoaded)
-			Resources.ResourceMemory->free(Resource);
+		const AssetReadInfo info = GetAssetReadInfo(packed);
 
-		Resources.Tables.Release();
-		Resources.ResourceFiles.Release();
-		Resources.ResourcesLoaded.Release();
-		Resources.ResourceGUIDs.Release();
+		lock.unlock();
+
+		bool mapped			= false;
+		Resource* resource	= ReadAsset(info, mapped);
+
+		lock.lock();
+
+		if (!resource)
+			return false;
+
+		RegisterLoadedResource(resource, mapped);
+
+		return true;
 	}
 
 
+	/************************************************************************************************/
 
-	void AddAssetFile(char* FILELOC)
+
+	void RecordAssetAccess(const AssetHandle RHandle)
 	{
-		ResourceDirectory Dir;
-		strcpy_s(Dir.str, FILELOC);
+		auto& residency		= Resources.Residency[RHandle];
+		residency.traced	= true;
 
-		FILE* F = 0;
-		int S   = fopen_s(&F, FILELOC, "rb");
+		const auto elapsed = std::chrono::steady_clock::now() - Resources.TraceBegin;
+
+		Resources.Trace.push_back({
+			Resources.ResourceGUIDs[RHandle],
+			(uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(),
+			residency.size });
+	}
 
-		size_t TableSize	 = ReadAssetTableSize(F);
-		ResourceTable* Table = (ResourceTable*)Resources.ResourceMemory->_aligned_malloc(TableSize);
 
-		if (ReadAssetTable(F, Table, TableSize))
+	/************************************************************************************************/
+
+
+	Resource* GetAsset(AssetHandle RHandle)
+	{
+		if (RHandle == INVALIDHANDLE)
+			return nullptr;
+
+		std::unique_lock lock{ Resources.Lock };
+
+		if (!Resources.Residency[RHandle].resident && !ReloadResource(RHandle, lock))
 		{
-			Resources.ResourceFiles.push_back(Dir);
-			Resources.Tables.push_back(Table);
+			FK_ASSERT(false, "FAILED TO RELOAD RESOURCE!");
+			return nullptr;
 		}
-		else
-			Resources.ResourceMemory->_aligned_free(Table);
+
+		auto& residency = Resources.Residency[RHandle];
+
+		if (residency.evictable)
+			LRURemove((uint32_t)RHandle);
+
+		if (Resources.Tracing && !residency.traced)
+			RecordAssetAccess(RHandle);
+
+		residency.refCount++;
+
+		Resource* resource	= Resources.ResourcesLoaded[RHandle];
+		resource->RefCount	= residency.refCount;
+
+		return resource;
 	}
 
 
-	Pair<GUID_t, bool>	FindAssetGUID(char* Str)
+	/************************************************************************************************/
+
+
+	void FreeAsset(AssetHandle RHandle)
 	{
-		bool Found = false;
-		GUID_t Guid = INVALIDHANDLE;
+		if (RHandle == INVALIDHANDLE)
+			return;
 
-		for (auto T : Resources.Tables)
+		std::scoped_lock lock{ Resources.Lock };
+
+		auto& residency = Resources.Residency[RHandle];
+
+		FK_ASSERT(residency.refCount > 0, "Asset released more times than it was acquired!");
+		if (!residency.refCount)
+			return;
+
+		residency.refCount--;
+		Resources.ResourcesLoaded[RHandle]->RefCount = residency.refCount;
+
+		if (!residency.refCount)
 		{
-			auto end = T->ResourceCount;
-			for (size_t I = 0; I < end; ++I)
-			{
-				if (!strncmp(T->Entries[I].ID, Str, 64))
-				{
-					Found = true;
-					Guid = T->Entries[I].GUID;
-					return{ Guid, Found };
-				}
-			}
+			LRUPushBack((uint32_t)RHandle);
+			EnforceAssetBudget(0);
 		}
+	}
+
+
+	/************************************************************************************************/
+
 
-		return{ Guid, Found };
+	void SetAssetMemoryBudget(const size_t budgetInBytes)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		Resources.MemoryBudget = budgetInBytes;
+		EnforceAssetBudget(0);
 	}
 
 
 	/************************************************************************************************/
 
 
-	Resource* GetAsset(AssetHandle RHandle)
+	size_t EvictAssets(const size_t bytesNeeded)
 	{
-		if (RHandle == INVALIDHANDLE)
-			return nullptr;
+		std::scoped_lock lock{ Resources.Lock };
+
+		size_t freed = 0;
+		while (freed < bytesNeeded && Resources.LRUFirst != ResourceResidency::InvalidLink)
+			freed += EvictResource(Resources.LRUFirst);
 
-		Resources.ResourcesLoaded[RHandle]->RefCount++;
-		return Resources.ResourcesLoaded[RHandle];
+		return freed;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void FreeAllAssets()
+	bool IsAssetResident(AssetHandle RHandle)
 	{
-		for (auto R : Resources.ResourcesLoaded)
-			if(Resources.ResourceMemory) Resources.ResourceMemory->_aligned_free(R);
+		std::scoped_lock lock{ Resources.Lock };
+		return RHandle != INVALIDHANDLE && Resources.Residency[RHandle].resident;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void FreeAllAssetFiles()
+	AssetMemoryStats GetAssetMemoryStats()
 	{
-		for (auto T : Resources.Tables)
-			Resources.ResourceMemory->_aligned_free(T);
+		std::scoped_lock lock{ Resources.Lock };
+
+		AssetMemoryStats stats	= Resources.MemoryStats;
+		stats.budget			= Resources.MemoryBudget;
+
+		return stats;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void FreeAsset(AssetHandle RHandle)
+	AssetHandle LoadGameAsset(GUID_t guid)
+	{
+		std::unique_lock lock{ Resources.Lock };
+
+		const AssetHandle loaded = FindLoadedHandle(guid);
+		if (loaded != INVALIDHANDLE)
+			return loaded;
+
+		const uint64_t packed = FindTableEntry(guid);
+		if (packed == INVALIDHANDLE)
+			return INVALIDHANDLE;
+
+		return LoadTableEntry(packed, lock);
+	}
+
+
+	/************************************************************************************************/
+
+
+    AssetHandle LoadGameAsset(const char* ID)
+	{
+		std::unique_lock lock{ Resources.Lock };
+
+		const uint64_t packed = FindTableEntry(ID);
+		if (packed == INVALIDHANDLE)
+			return INVALIDHANDLE;
+
+		const AssetHandle loaded = FindLoadedHandle(GetTableEntry(packed).GUID);
+		if (loaded != INVALIDHANDLE)
+			return loaded;
+
+		return LoadTableEntry(packed, lock);
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Number of reads starting at reads that can be serviced by one sequential read
+	size_t CoalesceBatchReads(const AssetReadInfo* reads, const size_t count)
 	{
-		Resources.ResourcesLoaded[RHandle]->RefCount--;
-		if (Resources.ResourcesLoaded[RHandle]->RefCount == 0)
+		static const size_t maxGap		= 64 * KILOBYTE;
+		static const size_t maxRunSize	= 16 * MEGABYTE;
+
+		size_t runEnd	= reads[0].end;
+		size_t I		= 1;
+
+		for (; I < count; ++I)
 		{
-			// Evict
-			// TODO: Resource Eviction
+			if (reads[I].position > runEnd + maxGap || reads[I].end - reads[0].position > maxRunSize)
+				break;
+
+			runEnd = std::max(runEnd, reads[I].end);
 		}
+
+		return I;
 	}
 
 
 	/************************************************************************************************/
 
 
-	AssetHandle LoadGameAsset(GUID_t guid)
+	void ReadMappedAssetBatch(const AssetReadInfo* reads, const size_t count, iAllocator* temp)
 	{
-		for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
-			if (Resources.ResourceGUIDs[I] == guid)
-				return I;
+		const char* view = reads->view;
+
+		// One prefetch range per run gets the whole batch streaming before the first fault
+		Vector<WIN32_MEMORY_RANGE_ENTRY> ranges{ temp };
+
+		for (size_t I = 0; I < count;)
+		{
+			const size_t runLength	= CoalesceBatchReads(reads + I, count - I);
+			const size_t runEnd		= reads[I + runLength - 1].end;
+
+			if (reads[I].position < runEnd)
+				ranges.push_back({ (void*)(view + reads[I].position), runEnd - reads[I].position });
+
+			I += runLength;
+		}
+
+		if (ranges.size())
+			PrefetchVirtualMemory(GetCurrentProcess(), ranges.size(), ranges.begin(), 0);
+
+		ranges.Release();
+
+		for (size_t I = 0; I < count; ++I)
+		{
+			bool mapped			= false;
+			Resource* resource	= ReadAsset(reads[I], mapped);
+
+			if (resource)
+				AddLoadedAsset(resource, mapped);
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void ReadFileAssetBatch(const AssetReadInfo* reads, const size_t count, iAllocator* temp)
+	{
+		FILE* F = 0;
+		int S   = fopen_s(&F, reads->file.str, "rb");
+
+		if (!F)
+			return;
 
-        AssetHandle RHandle = INVALIDHANDLE;
-		for (size_t TI = 0; TI < Resources.Tables.size(); ++TI)
+		for (size_t I = 0; I < count;)
 		{
-			auto& t = Resources.Tables[TI];
-			for (size_t I = 0; I < t->ResourceCount; ++I)
+			const size_t runLength	= CoalesceBatchReads(reads + I, count - I);
+			const size_t runBegin	= reads[I].position;
+			const size_t runEnd		= reads[I + runLength - 1].end;
+
+			char* buffer = runBegin < runEnd ? (char*)Resources.ResourceMemory->_aligned_malloc(runEnd - runBegin) : nullptr;
+
+			const int		seek_res	= buffer ? _fseeki64(F, runBegin, SEEK_SET) : -1;
+			const size_t	read_res	= seek_res == 0 ? fread(buffer, 1, runEnd - runBegin, F) : 0;
+
+			for (size_t J = I; J < I + runLength; ++J)
 			{
-				if (t->Entries[I].GUID == guid)
-				{
+				const size_t offset		= reads[J].position - runBegin;
+				const size_t available	= std::min(reads[J].end - runBegin, read_res);
 
-					FILE* F             = 0;
-					int S               = fopen_s(&F, Resources.ResourceFiles[TI].str, "rb");
-					size_t ResourceSize = ReadAssetSize(F, t, I);
+				if (offset + sizeof(CompressedResourceHeader) > available)
+					continue;
 
-					Resource* NewResource = (Resource*)Resources.ResourceMemory->_aligned_malloc(ResourceSize);
-					if (!NewResource)
-					{
-						// Memory Full
-						// Evict A Unused Resource
-						// TODO: Handle running out of memory
-						FK_ASSERT(false, "OUT OF MEMORY!");
-					}
+				char*			stored		= buffer + offset;
+				const size_t	storedSize	= GetStoredAssetSize(stored);
 
-					if (!ReadResource(F, t, I, NewResource))
-					{
-						Resources.ResourceMemory->_aligned_free(NewResource);
+				if (storedSize < sizeof(CompressedResourceHeader) || storedSize > available - offset)
+					continue;
 
-						FK_ASSERT(false, "FAILED TO LOAD RESOURCE!");
-					}
-					else
-					{
-						NewResource->State		= Resource::EResourceState_LOADED;
-						NewResource->RefCount	= 0;
-						RHandle					= Resources.ResourcesLoaded.size();
-						Resources.ResourcesLoaded.push_back(NewResource);
-						Resources.ResourceGUIDs.push_back(NewResource->GUID);
-					}
+				bool		mapped		= false;
+				Resource*	resource	= nullptr;
 
-					::fclose(F);
-					return RHandle;
+				if (IsCompressedAsset(stored))
+				{	// Decompresses straight out of the run, marked mapped so the run isn't freed from under it
+					mapped		= true;
+					resource	= DecompressGameAsset((Resource*)stored, mapped, Resources.DecompressionThreads);
 				}
+				else
+				{
+					resource = (Resource*)Resources.ResourceMemory->_aligned_malloc(storedSize);
+					FK_ASSERT(resource, "OUT OF MEMORY!");
+
+					memcpy(resource, stored, storedSize);
+				}
+
+				if (resource)
+					AddLoadedAsset(resource, mapped);
 			}
+
+			if (buffer)
+				Resources.ResourceMemory->_aligned_free(buffer);
+
+			I += runLength;
 		}
 
-		return RHandle;
+		::fclose(F);
 	}
 
 
 	/************************************************************************************************/
 
 
-    AssetHandle LoadGameAsset(const char* ID)
+	void LoadGameAssets(const GUID_t* IDs, const size_t count, AssetHandle* out, iAllocator* temp)
 	{
-		for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
-			if (!strcmp(Resources.ResourcesLoaded[I]->ID, ID))
-				return I;
+		Vector<AssetReadInfo>	reads{ temp };
+		size_t					unique = 0;
 
-        AssetHandle RHandle = 0xFFFFFFFFFFFFFFFF;
-		for (size_t TI = 0; TI < Resources.Tables.size(); ++TI)
-		{
-			auto& t = Resources.Tables[TI];
-			for (size_t I = 0; I < t->ResourceCount; ++I)
-			{
-				if (!strcmp(t->Entries[I].ID, ID))
-				{
-					FILE* F             = 0;
-					int S               = fopen_s(&F, Resources.ResourceFiles[TI].str, "rb");
-					size_t ResourceSize = FlexKit::ReadAssetSize(F, t, I);
+		reads.reserve(count);
 
-					Resource* NewResource = (Resource*)Resources.ResourceMemory->_aligned_malloc(ResourceSize);
-					if (!NewResource)
-					{
-						// Memory Full
-						// Evict A Unused Resource
-						// TODO: THIS
-						FK_ASSERT(false, "OUT OF MEMORY!");
-					}
+		{	// Everything the reads need is resolved up front, the table isn't locked while reading
+			std::scoped_lock lock{ Resources.Lock };
 
-					if (!FlexKit::ReadResource(F, t, I, NewResource))
-					{
-						FK_ASSERT(false, "FAILED TO LOAD RESOURCE!");
-					}
-					else
-					{
-						NewResource->State		= Resource::EResourceState_LOADED;
-						NewResource->RefCount	= 0;
-						RHandle					= Resources.ResourcesLoaded.size();
-						Resources.ResourcesLoaded.push_back(NewResource);
-						Resources.ResourceGUIDs.push_back(NewResource->GUID);
-					}
+			for (size_t I = 0; I < count; ++I)
+			{
+				const AssetHandle loaded = FindLoadedHandle(IDs[I]);
+				if (loaded != INVALIDHANDLE && Resources.Residency[loaded].resident)
+					continue;
 
-					::fclose(F);
-					return RHandle;
-				}
+				const uint64_t packed = FindTableEntry(IDs[I]);
+				if (packed == INVALIDHANDLE)
+					continue;
+
+				reads.push_back(GetAssetReadInfo(packed));
 			}
 		}
 
-		return RHandle;
+		std::sort(reads.begin(), reads.end(),
+			[](const AssetReadInfo& lhs, const AssetReadInfo& rhs)
+			{
+				return lhs.order < rhs.order;
+			});
+
+		// Drop duplicates, they're next to each other once sorted
+		for (size_t I = 0; I < reads.size(); ++I)
+			if (!unique || reads[I].order != reads[unique - 1].order)
+				reads[unique++] = reads[I];
+
+		for (size_t I = 0; I < unique;)
+		{
+			size_t end = I;
+			while (end < unique && (reads[end].order >> 48) == (reads[I].order >> 48))
+				end++;
+
+			if (reads[I].view)
+				ReadMappedAssetBatch(reads.begin() + I, end - I, temp);
+			else
+				ReadFileAssetBatch(reads.begin() + I, end - I, temp);
+
+			I = end;
+		}
+
+		reads.Release();
+
+		std::scoped_lock lock{ Resources.Lock };
+
+		for (size_t I = 0; I < count; ++I)
+			out[I] = FindLoadedHandle(IDs[I]);
 	}
 
 
@@ -264,43 +1232,151 @@ namespace FlexKit
 
 	bool isAssetAvailable(GUID_t ID)
 	{
-		for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
-			if (Resources.ResourcesLoaded[I]->GUID == ID)
-				return true;
+		std::scoped_lock lock{ Resources.Lock };
+
+		return	FindLoadedHandle(ID)	!= INVALIDHANDLE ||
+				FindTableEntry(ID)		!= INVALIDHANDLE;
+	}
+
+
+	bool isAssetAvailable(const char* ID)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+		return FindTableEntry(ID) != INVALIDHANDLE;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void PrefetchGameAssets(const GUID_t* IDs, const size_t count)
+	{
+		static const size_t batchSize = 64;
+		WIN32_MEMORY_RANGE_ENTRY ranges[batchSize];
+		size_t rangeCount = 0;
+
+		std::scoped_lock lock{ Resources.Lock };
 
-        AssetHandle RHandle = 0xFFFFFFFFFFFFFFFF;
-		for (size_t TI = 0; TI < Resources.Tables.size(); ++TI)
+		for (size_t I = 0; I < count; ++I)
 		{
-			auto& t = Resources.Tables[TI];
-			for (size_t I = 0; I < t->ResourceCount; ++I)
+			if (FindLoadedHandle(IDs[I]) != INVALIDHANDLE)
+				continue;
+
+			const uint64_t packed = FindTableEntry(IDs[I]);
+			if (packed == INVALIDHANDLE)
+				continue;
+
+			const auto&		package		= Resources.PackageViews[EntryTable(packed)];
+			const size_t	position	= GetTableEntry(packed).ResourcePosition;
+			const size_t	end			= Resources.EntryExtents[EntryTable(packed)][EntryIndex(packed)];
+
+			if (!package.view || position >= end)
+				continue;
+
+			ranges[rangeCount++] = { package.view + position, end - position };
+
+			if (rangeCount == batchSize)
 			{
-				if (t->Entries[I].GUID == ID)
-					return true;
+				PrefetchVirtualMemory(GetCurrentProcess(), rangeCount, ranges, 0);
+				rangeCount = 0;
 			}
 		}
 
-		return false;
+		if (rangeCount)
+			PrefetchVirtualMemory(GetCurrentProcess(), rangeCount, ranges, 0);
 	}
 
 
-	bool isAssetAvailable(const char* ID)
+	void PrefetchGameAssets(const AssetReadInfo* infos, const size_t count)
 	{
-			for (size_t I = 0; I < Resources.ResourcesLoaded.size(); ++I)
-			if (!strcmp(Resources.ResourcesLoaded[I]->ID, ID))
-				return true;
+		static const size_t batchSize = 64;
+		WIN32_MEMORY_RANGE_ENTRY ranges[batchSize];
+		size_t rangeCount = 0;
 
-        AssetHandle RHandle = 0xFFFFFFFFFFFFFFFF;
-		for (size_t TI = 0; TI < Resources.Tables.size(); ++TI)
+		for (size_t I = 0; I < count; ++I)
 		{
-			auto& t = Resources.Tables[TI];
-			for (size_t I = 0; I < t->ResourceCount; ++I)
+			const auto& info = infos[I];
+
+			if (!info.view || info.position >= info.end)
+				continue;
+
+			ranges[rangeCount++] = { (void*)(info.view + info.position), info.end - info.position };
+
+			if (rangeCount == batchSize)
 			{
-				if (!strcmp(t->Entries[I].ID, ID))
-					return true;
+				PrefetchVirtualMemory(GetCurrentProcess(), rangeCount, ranges, 0);
+				rangeCount = 0;
 			}
 		}
 
-		return false;
+		if (rangeCount)
+			PrefetchVirtualMemory(GetCurrentProcess(), rangeCount, ranges, 0);
+	}
+
+
+	void PrefetchGameAsset(GUID_t ID)
+	{
+		PrefetchGameAssets(&ID, 1);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void BeginAssetTrace()
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		for (auto& residency : Resources.Residency)
+			residency.traced = false;
+
+		Resources.Trace.clear();
+		Resources.TraceBegin	= std::chrono::steady_clock::now();
+		Resources.Tracing		= true;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool EndAssetTrace(const char* manifestFile)
+	{
+		std::scoped_lock lock{ Resources.Lock };
+
+		Resources.Tracing = false;
+
+		FILE* F = 0;
+		int S   = fopen_s(&F, manifestFile, "wb");
+
+		if (!F)
+			return false;
+
+		AssetManifestHeader header;
+		header.magic		= AssetManifestHeader::Magic;
+		header.version		= AssetManifestHeader::Version;
+		header.entryCount	= (uint32_t)Resources.Trace.size();
+
+		bool success = fwrite(&header, sizeof(header), 1, F) == 1;
+
+		if (Resources.Trace.size())
+			success &= fwrite(Resources.Trace.begin(), sizeof(AssetManifestEntry), Resources.Trace.size(), F) == Resources.Trace.size();
+
+		::fclose(F);
+
+		FK_LOG_INFO("Wrote asset manifest %s with %zu entries", manifestFile, Resources.Trace.size());
+
+		Resources.Trace.clear();
+		return success;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool IsTracingAssets()
+	{
+		std::scoped_lock lock{ Resources.Lock };
+		return Resources.Tracing;
 	}
 
 
@@ -329,6 +1405,7 @@ namespace FlexKit
 			Out->Memory		  = Memory;
 			Out->VertexBuffer.clear();
 
+			Out->TriMeshID	  = R->GUID;
 			Out->BS			  = { { Blob->BS[0], Blob->BS[1], Blob->BS[2] },Blob->BS[3] };
 			Out->AABB		 = 
 			{ 
@@ -371,7 +1448,6 @@ namespace FlexKit
 				FreeAsset(RHandle);
 			}
 		
-			Out->TriMeshID = R->GUID;
 			return true;
 		}
 		return false;
@@ -489,12 +1565,12 @@ namespace FlexKit
 			auto GameRes = GetAsset(RHandle);
 			if( Asset2TriMesh(RS, handle, RHandle, GeometryTable.Memory, &GeometryTable.Geometry[Index]))
 			{
-				FreeAsset(RHandle);
-
 				GeometryTable.Handles[Handle]			= (index_t)Index;
-				GeometryTable.GeometryIDs[Index]		= GameRes->ID;
+				GeometryTable.GeometryIDs[Index]		= GeometryTable.Geometry[Index].ID; // The blob may be evicted once released
 				GeometryTable.Guids[Index]				= GUID;
 				GeometryTable.ReferenceCounts[Index]	= 1;
+
+				FreeAsset(RHandle);
 			}
 			else
 			{
@@ -516,13 +1592,13 @@ namespace FlexKit
 			
 			if(Asset2TriMesh(RS, handle, RHandle, GeometryTable.Memory, &GeometryTable.Geometry[Index]))
 			{
-				FreeAsset(RHandle);
-
 				GeometryTable.Handles			[Handle]	= Index;
-				GeometryTable.GeometryIDs		[Index]		= GameRes->ID;
+				GeometryTable.GeometryIDs		[Index]		= GeometryTable.Geometry[Index].ID;
 				GeometryTable.Guids				[Index]		= GUID;
 				GeometryTable.ReferenceCounts	[Index]		= 1;
 				GeometryTable.Handle			[Index]		= Handle;
+
+				FreeAsset(RHandle);
 			}
 			else
 			{
@@ -559,12 +1635,12 @@ namespace FlexKit
 			
 			if(Asset2TriMesh(RS, handle, RHandle, GeometryTable.Memory, &GeometryTable.Geometry[Index]))
 			{
-				FreeAsset(RHandle);
-
 				GeometryTable.Handles[Handle]			= (index_t)Index;
 				GeometryTable.GeometryIDs[Index]		= ID;
 				GeometryTable.Guids[Index]				= GameRes->GUID;
 				GeometryTable.ReferenceCounts[Index]	= 1;
+
+				FreeAsset(RHandle);
 			}
 			else
 			{
@@ -586,12 +1662,12 @@ namespace FlexKit
 
 			if(Asset2TriMesh(RS, handle, RHandle, GeometryTable.Memory, &GeometryTable.Geometry[Index]))
 			{
-				FreeAsset(RHandle);
-
 				GeometryTable.Handles[Handle]			= Index;
-				GeometryTable.GeometryIDs[Index]		= GameRes->ID;
+				GeometryTable.GeometryIDs[Index]		= GeometryTable.Geometry[Index].ID;
 				GeometryTable.Guids[Index]				= GameRes->GUID;
 				GeometryTable.ReferenceCounts[Index]	= 1;
+
+				FreeAsset(RHandle);
 			}
 			else
 			{
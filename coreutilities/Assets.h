@@ -30,9 +30,11 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\coreutilities\memoryutilities.h"
 #include "..\graphicsutilities\Fonts.h"
 #include "..\coreutilities\ResourceHandles.h"
+#include "..\coreutilities\AssetIndex.h"
 #include "TextureUtilities.h"
 
 #include <iostream>
+#include <mutex>
 
 
 /************************************************************************************************/
@@ -43,6 +45,7 @@ namespace FlexKit
 	static const size_t ID_LENGTH = 64;
 
 	class RenderSystem;
+	class ThreadManager;
 	struct TriMesh;
 	struct TriMesh;
 	struct TextureSet;
@@ -108,6 +111,67 @@ namespace FlexKit
 		ResourceEntry	Entries[];
 	};
 
+
+	// Optional block compressed storage for a resource. Written in place of the blob, blocks are
+	// compressed independently so they can be decoded in parallel. A block stored at its full size is raw.
+	struct CompressedResourceHeader
+	{
+		static const uint64_t	Magic				= 0x315A4C4B53455246; // Can't be mistaken for a ResourceSize
+		static const uint32_t	DefaultBlockSize	= 128 * KILOBYTE;
+
+		uint64_t	magic;
+		uint64_t	uncompressedSize;
+		uint64_t	compressedSize;		// Everything stored, header and block table included
+		uint32_t	blockSize;
+		uint32_t	blockCount;
+		uint64_t	blockOffsets[];		// blockCount + 1 offsets from the start of the header
+
+		const char*	GetBlock	(const size_t idx) const { return ((const char*)this) + blockOffsets[idx]; }
+		size_t		GetBlockSize(const size_t idx) const { return blockOffsets[idx + 1] - blockOffsets[idx]; }
+	};
+
+
+	inline bool IsCompressedAsset(const void* stored)
+	{
+		uint64_t magic;
+		memcpy(&magic, stored, sizeof(magic));
+
+		return magic == CompressedResourceHeader::Magic;
+	}
+
+
+	// Bytes the resource takes up in the package
+	inline size_t GetStoredAssetSize(const void* stored)
+	{
+		return IsCompressedAsset(stored) ?
+			((const CompressedResourceHeader*)stored)->compressedSize :
+			((const Resource*)stored)->ResourceSize;
+	}
+
+	/************************************************************************************************/
+
+
+	// Recorded asset accesses. While tracing, the first GetAsset of each resource is appended in order
+	// with when it happened and how big it was. Later runs prefetch in the same order, and the resource
+	// compiler can lay packages out to match.
+	struct AssetManifestHeader
+	{
+		static const uint64_t Magic		= 0x54534546494E414D; // Reads "MANIFEST" in a hex dump
+		static const uint32_t Version	= 1;
+
+		uint64_t	magic;
+		uint32_t	version;
+		uint32_t	entryCount;
+	};
+
+	struct AssetManifestEntry
+	{
+		GUID_t		GUID;
+		uint64_t	time;	// Microseconds since the trace began
+		uint64_t	size;	// Bytes resident
+	};
+
+
 	/************************************************************************************************/
 
 
@@ -116,27 +180,150 @@ namespace FlexKit
 	{
 		char str[256];
 	};
-	
+
+
+	/************************************************************************************************/
+
+
+	inline uint64_t AssetIndexHash(const GUID_t guid)
+	{	// GUIDs are often sequential, mix the bits before masking
+		uint64_t x = guid;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+
+	inline uint64_t AssetIndexHash(const char* ID)
+	{	// FNV-1a, IDs are at most ID_LENGTH characters and may not be terminated
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t I = 0; I < ID_LENGTH && ID[I]; ++I)
+			hash = (hash ^ uint8_t(ID[I])) * 1099511628211ull;
+
+		return hash;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// A whole package file mapped copy-on-write. Resources are handed out as pointers into the view,
+	// only pages that get written to, usually just the header with the runtime members, are copied.
+	struct AssetPackageView
+	{
+		HANDLE	file	= INVALID_HANDLE_VALUE;
+		HANDLE	mapping	= nullptr;
+		char*	view	= nullptr;
+		size_t	size	= 0;
+	};
+
+
+	// Everything needed to read a resource out of its package, resolved on the thread that owns the
+	// resource table. Reading with it touches no shared state, packages stay mapped until the table is released.
+	struct AssetReadInfo
+	{
+		GUID_t				GUID;
+		uint64_t			order;		// Package in the top bits, position within the package below
+		size_t				position;
+		size_t				end;		// Start of the next resource in the package, or the end of the package
+		const char*			view;		// Null if the package isn't mapped
+		size_t				viewSize;
+		ResourceDirectory	file;
+	};
+
+
+	/************************************************************************************************/
+
+
+	// Per loaded resource bookkeeping, kept outside the blob so it survives eviction.
+	// Resident resources with no references are kept in an LRU list, oldest first.
+	struct ResourceResidency
+	{
+		static const uint32_t InvalidLink = 0xffffffff;
+
+		size_t		size		= 0;
+		uint32_t	refCount	= 0;
+		uint32_t	prev		= InvalidLink;
+		uint32_t	next		= InvalidLink;
+		bool		mapped		= false;
+		bool		resident	= false;
+		bool		evictable	= false;
+		bool		traced		= false;
+	};
+
+
+	struct AssetMemoryStats
+	{
+		size_t budget				= 0;
+		size_t residentBytes		= 0;
+		size_t peakResidentBytes	= 0;
+		size_t evictableBytes		= 0; // Resident with no references
+		size_t residentCount		= 0;
+		size_t evictableCount		= 0;
+		size_t evictionCount		= 0;
+		size_t reloadCount			= 0;
+	};
+
+
+	/************************************************************************************************/
+
+
 	struct GlobalResourceTable
 	{
 		~GlobalResourceTable()
 		{
 			Tables.A			= nullptr;
+			EntryExtents.A		= nullptr;
 			ResourceFiles.A		= nullptr;
 			ResourcesLoaded.A	= nullptr;
 			ResourceGUIDs.A		= nullptr;
+			GUIDIndex.slots.A	= nullptr;
+			IDIndex.slots.A		= nullptr;
+			LoadedIndex.slots.A	= nullptr;
+			PackageViews.A		= nullptr;
+			Residency.A			= nullptr;
+			Trace.A				= nullptr;
 
 			Tables.Allocator			= nullptr;
+			EntryExtents.Allocator		= nullptr;
 			ResourceFiles.Allocator		= nullptr;
 			ResourcesLoaded.Allocator	= nullptr;
 			ResourceGUIDs.Allocator		= nullptr;
+			GUIDIndex.slots.Allocator	= nullptr;
+			IDIndex.slots.Allocator		= nullptr;
+			LoadedIndex.slots.Allocator	= nullptr;
+			PackageViews.Allocator		= nullptr;
+			Residency.Allocator			= nullptr;
+			Trace.Allocator				= nullptr;
 		}
 
 		Vector<ResourceTable*>		Tables;
+		Vector<size_t*>				EntryExtents;	// One per table, where each entry's stored bytes end
 		Vector<ResourceDirectory>	ResourceFiles;
 		Vector<Resource*>			ResourcesLoaded;
 		Vector<GUID_t>				ResourceGUIDs;
 		iAllocator*					ResourceMemory;
+
+		AssetIndex					GUIDIndex;		// GUID		-> (table, entry)
+		AssetIndex					IDIndex;		// ID hash	-> (table, entry)
+		AssetIndex					LoadedIndex;	// GUID		-> AssetHandle
+
+		Vector<AssetPackageView>	PackageViews;	// One per table, view is null if the package couldn't be mapped
+		Vector<ResourceResidency>	Residency;		// One per loaded resource, evicted resources keep their handle
+		uint32_t					LRUFirst		= ResourceResidency::InvalidLink;
+		uint32_t					LRULast			= ResourceResidency::InvalidLink;
+		size_t						MemoryBudget	= (size_t)-1;
+		AssetMemoryStats			MemoryStats;
+
+		ThreadManager*				DecompressionThreads = nullptr;
+
+		Vector<AssetManifestEntry>				Trace;
+		std::chrono::steady_clock::time_point	TraceBegin;
+		bool									Tracing = false;
+
+		// Guards everything above, assets are acquired and released from worker threads.
+		// Package reads happen with it released.
+		std::mutex								Lock;
 	}inline Resources;
 
 
@@ -150,9 +337,12 @@ namespace FlexKit
 	FLEXKITAPI size_t		ReadAssetSize		    (FILE* F, ResourceTable* Table, size_t Index);
 
 	FLEXKITAPI void					AddAssetFile	(char* FILELOC);
-	FLEXKITAPI Resource*			GetAsset		(AssetHandle RHandle);
 	FLEXKITAPI Pair<GUID_t, bool>	FindAssetGUID	(char* Str);
 
+	// Acquires a reference, reloading the resource if it was evicted. Every GetAsset is paired with a FreeAsset,
+	// resources with no references stay resident until the memory budget forces them out, least recently used first.
+	FLEXKITAPI Resource*			GetAsset		(AssetHandle RHandle);
+
 
 	FLEXKITAPI bool			ReadAssetTable	(FILE* F, ResourceTable* Out, size_t TableSize);
 	FLEXKITAPI bool			ReadResource		(FILE* F, ResourceTable* Table, size_t Index, Resource* out);
@@ -160,13 +350,54 @@ namespace FlexKit
 	FLEXKITAPI AssetHandle LoadGameAsset (const char* ID);
 	FLEXKITAPI AssetHandle LoadGameAsset (GUID_t GUID);
 
+	// Loads a set of assets in package order rather than the order given. Neighbouring resources are
+	// coalesced into large sequential reads through one open file per package. Handles are written to
+	// out in the order of IDs, INVALIDHANDLE for assets that aren't available.
+	FLEXKITAPI void LoadGameAssets (const GUID_t* IDs, const size_t count, AssetHandle* out, iAllocator* temp);
+
+	// Split load for the async loader. FindAssetReadInfo resolves where the asset is stored, ReadGameAsset
+	// then only reads the package and touches no shared state. The result is registered with
+	// AddLoadedAsset, or handed back to ReleaseAssetMemory.
+	FLEXKITAPI AssetHandle	FindLoadedAsset		(GUID_t GUID);
+	FLEXKITAPI bool			FindAssetReadInfo	(GUID_t GUID, AssetReadInfo& out);
+	FLEXKITAPI Resource*	ReadGameAsset		(const AssetReadInfo& info, bool& mapped);
+	FLEXKITAPI AssetHandle	AddLoadedAsset		(Resource* resource, bool mapped);
+	FLEXKITAPI void			ReleaseAssetMemory	(Resource* resource, bool mapped);
+
+	// ReadGameAsset leaves compressed resources as stored, check with IsCompressedAsset and decompress before
+	// adding. Frees the stored copy if it isn't mapped. Blocks are spread over the thread manager when given one
+	// and called from one of its workers.
+	FLEXKITAPI Resource*	DecompressGameAsset	(Resource* stored, bool& mapped, ThreadManager* threads = nullptr);
+
+	// Used by synchronous loads
+	FLEXKITAPI void			SetAssetDecompressionThreads	(ThreadManager* threads);
+
 	FLEXKITAPI void FreeAsset			    (AssetHandle RHandle);
 	FLEXKITAPI void FreeAllAssets		();
 	FLEXKITAPI void FreeAllAssetFiles	();
 
+	FLEXKITAPI void				SetAssetMemoryBudget	(const size_t budgetInBytes);
+	FLEXKITAPI size_t			EvictAssets				(const size_t bytesNeeded); // Returns bytes freed
+	FLEXKITAPI bool				IsAssetResident			(AssetHandle RHandle);
+	FLEXKITAPI AssetMemoryStats	GetAssetMemoryStats		();
+
 	FLEXKITAPI bool isAssetAvailable		(GUID_t ID);
 	FLEXKITAPI bool isAssetAvailable		(const char* ID);
 
+	// Hints the OS to start reading the asset's pages in, returns immediately
+	FLEXKITAPI void PrefetchGameAsset		(GUID_t ID);
+	FLEXKITAPI void PrefetchGameAssets		(const GUID_t* IDs, const size_t count);
+	FLEXKITAPI void PrefetchGameAssets		(const AssetReadInfo* infos, const size_t count); // Safe from any thread
+
+	// Starts recording asset accesses, restarting any trace in progress
+	FLEXKITAPI void BeginAssetTrace			();
+	// Stops recording and writes the trace out as a manifest, returns false if it couldn't be written
+	FLEXKITAPI bool EndAssetTrace			(const char* manifestFile);
+	FLEXKITAPI bool IsTracingAssets			();
+
+	FLEXKITAPI size_t	ReadAssetManifestSize	(FILE* F);
+	FLEXKITAPI bool		ReadAssetManifest		(FILE* F, AssetManifestEntry* out, size_t entryCount);
+
 
 	/************************************************************************************************/
 
@@ -492,8 +723,36 @@ namespace FlexKit
 		const int seek_res      = fseek(F, (LONG)Table->Entries[Index].ResourcePosition, SEEK_SET);
 		const size_t read_res   = fread(Buffer, 1, 64, F);
 
-		Resource* resource = (Resource*)Buffer;
-		return resource->ResourceSize;
+		return GetStoredAssetSize(Buffer);
+	}
+
+
+	/************************************************************************************************/
+
+
+	inline size_t ReadAssetManifestSize(FILE* F)
+	{
+		AssetManifestHeader header;
+
+		const int		seek_res = fseek(F, 0, SEEK_SET);
+		const size_t	read_res = fread(&header, 1, sizeof(header), F);
+
+		if (read_res != sizeof(header) || header.magic != AssetManifestHeader::Magic || header.version != AssetManifestHeader::Version)
+			return 0;
+
+		return header.entryCount;
+	}
+
+
+	/************************************************************************************************/
+
+
+	inline bool ReadAssetManifest(FILE* F, AssetManifestEntry* out, size_t entryCount)
+	{
+		const int		seek_res = fseek(F, sizeof(AssetManifestHeader), SEEK_SET);
+		const size_t	read_res = fread(out, sizeof(AssetManifestEntry), entryCount, F);
+
+		return (read_res == entryCount);
 	}
 
 
@@ -523,8 +782,13 @@ namespace FlexKit
         const size_t position   = Table->Entries[Index].ResourcePosition;
 		int seek_res            = fseek(F, (LONG)position, SEEK_SET);
 
-        size_t resourceSize = 0;
-		size_t read_res     = fread(&resourceSize, 1, 8, F);
+        byte header[sizeof(CompressedResourceHeader)];
+		size_t read_res     = fread(header, 1, sizeof(header), F);
+
+        if (read_res != sizeof(header))
+            return false;
+
+        const size_t resourceSize = GetStoredAssetSize(header);
 
         if (!(resourceSize + position < resourceFileSize))
             return false;
@@ -532,7 +796,7 @@ namespace FlexKit
 		seek_res                = fseek(F, (LONG)position, SEEK_SET);
 		const size_t readSize   = fread(out, 1, resourceSize, F);
 
-		return (readSize == out->ResourceSize);
+		return (readSize == resourceSize);
 	}
 
 
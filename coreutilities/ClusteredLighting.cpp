@@ -0,0 +1,396 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#include "..\coreutilities\ClusteredLighting.h"
+#include "..\coreutilities\ThreadUtilities.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	uint32_t LightClusterGrid::GetSlice(const float depth) const
+	{
+		if (depth <= nearPlane)
+			return 0;
+
+		const float slice = std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * dimensions[2];
+
+		return std::min((uint32_t)slice, dimensions[2] - 1);
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Inclusive cluster range a light can touch, empty if x0 > x1
+	struct _LightClusterRange
+	{
+		uint32_t x0, x1;
+		uint32_t y0, y1;
+		uint32_t z0, z1;
+	};
+
+
+	// Runs fn(0) ... fn(count - 1), fn(0) on the calling thread
+	template<typename FN>
+	static void _RunLightClusterWork(ThreadManager* threads, iAllocator* temp, const size_t count, FN& fn)
+	{
+		if (!threads || count < 2)
+		{
+			for (size_t I = 0; I < count; ++I)
+				fn(I);
+
+			return;
+		}
+
+		WorkBarrier barrier{ *threads, temp };
+
+		for (size_t I = 1; I < count; ++I)
+		{
+			auto& workItem = CreateWorkItem([&fn, I] { fn(I); }, temp);
+
+			barrier.AddWork(workItem);
+			PushToLocalQueue(workItem);
+		}
+
+		fn(0);
+		barrier.JoinLocal();
+	}
+
+
+	/************************************************************************************************/
+
+
+	void BuildLightClusters(
+		LightClusterGrid&		grid,
+		const LightClusterView&	view,
+		const ClusterLight*		lights,
+		const size_t			lightCount,
+		ThreadManager*			threads,
+		iAllocator*				temp)
+	{
+		const uint32_t	tilesX			= grid.dimensions[0];
+		const uint32_t	tilesY			= grid.dimensions[1];
+		const uint32_t	slices			= grid.dimensions[2];
+		const size_t	clusterCount	= grid.GetClusterCount();
+
+		FK_ASSERT(clusterCount, "Invalid light cluster grid!");
+
+		grid.nearPlane	= view.nearPlane;
+		grid.farPlane	= view.farPlane;
+
+		grid.clusters.clear();
+		grid.lightIndices.clear();
+		grid.clusters.reserve(clusterCount);
+		grid.clusters.resize(clusterCount);
+
+		const float tanY = std::tan(view.FOV / 2.0f);
+		const float tanX = tanY * view.aspectRatio;
+
+		// Slice boundaries, depth[k] = near * (far / near) ^ (k / slices)
+		float* sliceDepth = (float*)temp->malloc(sizeof(float) * (slices + 1));
+
+		for (uint32_t S = 0; S <= slices; ++S)
+			sliceDepth[S] = view.nearPlane * std::pow(view.farPlane / view.nearPlane, float(S) / slices);
+
+		// View space extents of every tile column and row per slice. Columns are padded to a multiple of 8 with empty extents
+		const uint32_t rowStride = (tilesX + 7) & ~7u;
+
+		float* minX = (float*)temp->_aligned_malloc(sizeof(float) * rowStride * slices, 32);
+		float* maxX = (float*)temp->_aligned_malloc(sizeof(float) * rowStride * slices, 32);
+		float* minY = (float*)temp->malloc(sizeof(float) * tilesY * slices);
+		float* maxY = (float*)temp->malloc(sizeof(float) * tilesY * slices);
+
+		for (uint32_t S = 0; S < slices; ++S)
+		{
+			const float d0 = sliceDepth[S];
+			const float d1 = sliceDepth[S + 1];
+
+			for (uint32_t X = 0; X < rowStride; ++X)
+			{
+				if (X < tilesX)
+				{
+					const float left	= (-1.0f + 2.0f * X / tilesX) * tanX;
+					const float right	= (-1.0f + 2.0f * (X + 1) / tilesX) * tanX;
+
+					minX[S * rowStride + X] = std::min(left * d0, left * d1);
+					maxX[S * rowStride + X] = std::max(right * d0, right * d1);
+				}
+				else
+				{
+					minX[S * rowStride + X] = FLT_MAX;
+					maxX[S * rowStride + X] = -FLT_MAX;
+				}
+			}
+
+			for (uint32_t Y = 0; Y < tilesY; ++Y)
+			{
+				const float top		= (1.0f - 2.0f * Y / tilesY) * tanY;
+				const float bottom	= (1.0f - 2.0f * (Y + 1) / tilesY) * tanY;
+
+				minY[S * tilesY + Y] = std::min(bottom * d0, bottom * d1);
+				maxY[S * tilesY + Y] = std::max(top * d0, top * d1);
+			}
+		}
+
+		// Conservative tile and slice ranges from each light's view space bounds
+		auto* ranges = (_LightClusterRange*)temp->malloc(sizeof(_LightClusterRange) * lightCount);
+
+		auto tileOf = [](const float ndc, const uint32_t count) -> uint32_t
+		{
+			const float tile = std::floor((ndc + 1.0f) * 0.5f * count);
+			return (uint32_t)std::min(std::max(tile, 0.0f), float(count - 1));
+		};
+
+		for (size_t I = 0; I < lightCount; ++I)
+		{
+			const auto&	light	= lights[I];
+			auto&		range	= ranges[I];
+			const float	depth	= -light.position.z;
+			const float	dMin	= std::max(depth - light.radius, view.nearPlane);
+			const float	dMax	= depth + light.radius;
+
+			range = { 1, 0, 1, 0, 1, 0 };
+
+			if (dMax < view.nearPlane || dMin > view.farPlane)
+				continue;
+
+			const float xLo = light.position.x - light.radius;
+			const float xHi = light.position.x + light.radius;
+			const float yLo = light.position.y - light.radius;
+			const float yHi = light.position.y + light.radius;
+
+			const float ndcX0 = std::min(xLo / dMin, xLo / dMax) / tanX;
+			const float ndcX1 = std::max(xHi / dMin, xHi / dMax) / tanX;
+			const float ndcY0 = std::min(yLo / dMin, yLo / dMax) / tanY;
+			const float ndcY1 = std::max(yHi / dMin, yHi / dMax) / tanY;
+
+			if (ndcX0 > 1.0f || ndcX1 < -1.0f || ndcY0 > 1.0f || ndcY1 < -1.0f)
+				continue;
+
+			range.x0 = tileOf(ndcX0, tilesX);
+			range.x1 = tileOf(ndcX1, tilesX);
+			range.y0 = tileOf(-ndcY1, tilesY); // Row 0 is the top of the screen
+			range.y1 = tileOf(-ndcY0, tilesY);
+			range.z0 = grid.GetSlice(dMin);
+			range.z1 = grid.GetSlice(dMax);
+
+			// The extents above are computed differently than the cluster bounds and can round the other way
+			// for lights on a tile or slice edge. One extra cluster each side, the sphere tests below are exact.
+			range.x0 = range.x0 ? range.x0 - 1 : 0;
+			range.y0 = range.y0 ? range.y0 - 1 : 0;
+			range.z0 = range.z0 ? range.z0 - 1 : 0;
+			range.x1 = std::min(range.x1 + 1, tilesX - 1);
+			range.y1 = std::min(range.y1 + 1, tilesY - 1);
+			range.z1 = std::min(range.z1 + 1, slices - 1);
+		}
+
+		// onHit(clusterID, lightIdx) for every cluster in slice S a light's sphere overlaps,
+		// a cluster's lights are always visited in ascending order
+		auto binSlice = [&](const uint32_t S, auto& onHit)
+		{
+			const float		d0			= sliceDepth[S];
+			const float		d1			= sliceDepth[S + 1];
+			const float*	sliceMinX	= minX + S * rowStride;
+			const float*	sliceMaxX	= maxX + S * rowStride;
+			const float*	sliceMinY	= minY + S * tilesY;
+			const float*	sliceMaxY	= maxY + S * tilesY;
+
+			for (uint32_t L = 0; L < lightCount; ++L)
+			{
+				const auto& range = ranges[L];
+
+				if (range.x0 > range.x1 || S < range.z0 || S > range.z1)
+					continue;
+
+				const auto&	light	= lights[L];
+				const float	depth	= -light.position.z;
+				const float	dz		= std::max(std::max(d0 - depth, depth - d1), 0.0f);
+				const float	r2		= light.radius * light.radius - dz * dz;
+
+				if (r2 < 0.0f)
+					continue;
+
+				for (uint32_t Y = range.y0; Y <= range.y1; ++Y)
+				{
+					const float dy		= std::max(std::max(sliceMinY[Y] - light.position.y, light.position.y - sliceMaxY[Y]), 0.0f);
+					const float limit	= r2 - dy * dy;
+
+					if (limit < 0.0f)
+						continue;
+
+					const uint32_t rowBase = grid.GetClusterID(0, Y, S);
+
+#if USING(AVX2)
+					const __m256 cx		= _mm256_set1_ps(light.position.x);
+					const __m256 limit8	= _mm256_set1_ps(limit);
+
+					for (uint32_t X = range.x0 & ~7u; X <= range.x1; X += 8)
+					{
+						const __m256 dx = _mm256_max_ps(
+							_mm256_max_ps(
+								_mm256_sub_ps(_mm256_load_ps(sliceMinX + X), cx),
+								_mm256_sub_ps(cx, _mm256_load_ps(sliceMaxX + X))),
+							_mm256_setzero_ps());
+
+						uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_mul_ps(dx, dx), limit8, _CMP_LE_OQ));
+
+						// Trim lanes outside of [x0, x1]
+						const uint32_t first	= range.x0 > X ? range.x0 - X : 0;
+						const uint32_t last		= range.x1 - X;
+
+						mask &= (0xFFu << first) & (last >= 7 ? 0xFFu : (0xFFu >> (7 - last)));
+
+						for (uint32_t lane = 0; mask; ++lane, mask >>= 1)
+							if (mask & 1)
+								onHit(rowBase + X + lane, L);
+					}
+#else
+					for (uint32_t X = range.x0; X <= range.x1; ++X)
+					{
+						const float dx = std::max(std::max(sliceMinX[X] - light.position.x, light.position.x - sliceMaxX[X]), 0.0f);
+
+						if (dx * dx <= limit)
+							onHit(rowBase + X, L);
+					}
+#endif
+				}
+			}
+		};
+
+		// Slices are split into contiguous bands, a band's clusters are only written by the worker binning it.
+		// The first pass counts, the second fills the compacted lists.
+		const size_t	workerCount	= threads ? threads->GetThreadCount() + 1 : 1;
+		const size_t	bandCount	= std::min<size_t>(slices, workerCount * 2);
+		uint32_t*		cursors		= (uint32_t*)temp->malloc(sizeof(uint32_t) * clusterCount);
+
+		for (size_t I = 0; I < clusterCount; ++I)
+			cursors[I] = 0;
+
+		auto binBand = [&](const size_t band, auto& onHit)
+		{
+			const uint32_t begin	= uint32_t(band * slices / bandCount);
+			const uint32_t end		= uint32_t((band + 1) * slices / bandCount);
+
+			for (uint32_t S = begin; S < end; ++S)
+				binSlice(S, onHit);
+		};
+
+		auto countPass = [&](const size_t band)
+		{
+			auto onHit = [&](const uint32_t cluster, const uint32_t)
+			{
+				if (cursors[cluster] < LightClusterGrid::MaxLightsPerCluster)
+					cursors[cluster]++;
+			};
+
+			binBand(band, onHit);
+		};
+
+		_RunLightClusterWork(threads, temp, bandCount, countPass);
+
+		uint32_t indexCount = 0;
+
+		for (size_t I = 0; I < clusterCount; ++I)
+		{
+			grid.clusters[I] = uint2{ indexCount, cursors[I] };
+			indexCount += cursors[I];
+			cursors[I] = 0;
+		}
+
+		grid.lightIndices.reserve(indexCount);
+		grid.lightIndices.resize(indexCount);
+
+		auto fillPass = [&](const size_t band)
+		{
+			auto onHit = [&](const uint32_t cluster, const uint32_t light)
+			{
+				const auto& entry = grid.clusters[cluster];
+
+				if (cursors[cluster] < entry[1])
+					grid.lightIndices[entry[0] + cursors[cluster]++] = light;
+			};
+
+			binBand(band, onHit);
+		};
+
+		_RunLightClusterWork(threads, temp, bandCount, fillPass);
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t GetLightClusterWorkingSize(const uint3 dimensions, const size_t lightCount)
+	{	// Cursors, slice depths and the tile extents padded for AVX, then the light ranges
+		const size_t clusterCount = size_t(dimensions[0]) * dimensions[1] * dimensions[2];
+
+		return
+			clusterCount * sizeof(uint32_t) +
+			(dimensions[2] + 1) * sizeof(float) +
+			dimensions[2] * (((dimensions[0] + 7) & ~7u) + dimensions[1]) * 2 * sizeof(float) +
+			lightCount * sizeof(_LightClusterRange);
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t PackLightClusters(const LightClusterGrid& grid, uint32_t* out, const size_t capacity)
+	{
+		const size_t clusterCount	= grid.GetClusterCount();
+		const size_t tableSize		= clusterCount * 2;
+		const size_t capacityCount	= capacity / sizeof(uint32_t);
+
+		if (capacityCount < tableSize || grid.clusters.size() < clusterCount)
+			return 0;
+
+		uint32_t* indices	= out + tableSize;
+		size_t indexCount	= 0;
+
+		for (size_t I = 0; I < clusterCount; ++I)
+		{
+			const auto&		cluster	= grid.clusters[I];
+			const uint32_t	count	= (uint32_t)std::min<size_t>(cluster[1], capacityCount - tableSize - indexCount);
+
+			out[I * 2 + 0] = (uint32_t)indexCount;
+			out[I * 2 + 1] = count;
+
+			if (count)
+				memcpy(indices + indexCount, grid.lightIndices.begin() + cluster[0], count * sizeof(uint32_t));
+
+			indexCount += count;
+		}
+
+		return (tableSize + indexCount) * sizeof(uint32_t);
+	}
+
+
+}	/************************************************************************************************/
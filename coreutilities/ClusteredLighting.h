@@ -0,0 +1,113 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#ifndef CLUSTEREDLIGHTING_H
+#define CLUSTEREDLIGHTING_H
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\containers.h"
+#include "..\coreutilities\MathUtils.h"
+#include "..\coreutilities\memoryutilities.h"
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	class ThreadManager;
+
+
+	// View space sphere, the camera looks down -Z
+	struct ClusterLight
+	{
+		float3	position;
+		float	radius;
+	};
+
+
+	struct LightClusterView
+	{
+		float FOV; // Full vertical angle
+		float aspectRatio;
+		float nearPlane;
+		float farPlane;
+	};
+
+
+	// Froxel grid, screen tiles split into exponential depth slices between the near and far planes.
+	// clusters[GetClusterID(...)] is { offset, count } into lightIndices, lightIndices index the light list
+	// the grid was built from. Tile row 0 is the top of the screen.
+	struct LightClusterGrid
+	{
+		static const uint32_t MaxLightsPerCluster = 128;
+
+		LightClusterGrid(iAllocator* allocator = nullptr) :
+			clusters		{ allocator },
+			lightIndices	{ allocator } {}
+
+		uint32_t GetClusterID(const uint32_t x, const uint32_t y, const uint32_t slice) const
+		{
+			return x + y * dimensions[0] + slice * dimensions[0] * dimensions[1];
+		}
+
+		// Depth is the positive distance along the view direction
+		uint32_t GetSlice(const float depth) const;
+
+		size_t GetClusterCount() const { return size_t(dimensions[0]) * dimensions[1] * dimensions[2]; }
+
+		uint3				dimensions	= { 16, 9, 24 };
+		float				nearPlane	= 0.1f;
+		float				farPlane	= 1000.0f;
+		Vector<uint2>		clusters;
+		Vector<uint32_t>	lightIndices;
+	};
+
+
+	// Lights are binned by depth slice bands in parallel, each band's clusters are only written by one worker.
+	// Lights past MaxLightsPerCluster in a cluster are dropped. Memory is only allocated from temp on the calling thread.
+	FLEXKITAPI void BuildLightClusters(
+		LightClusterGrid&		grid,
+		const LightClusterView&	view,
+		const ClusterLight*		lights,
+		const size_t			lightCount,
+		ThreadManager*			threads,
+		iAllocator*				temp);
+
+
+	// GPU layout of a grid, GetClusterCount() { offset, count } pairs followed by the light indices
+	inline size_t GetPackedLightClusterSize(const uint3 dimensions)
+	{
+		return size_t(dimensions[0]) * dimensions[1] * dimensions[2] * sizeof(uint32_t) * (2 + LightClusterGrid::MaxLightsPerCluster);
+	}
+
+	// Temporary memory BuildLightClusters needs on top of the grid itself
+	FLEXKITAPI size_t GetLightClusterWorkingSize(const uint3 dimensions, const size_t lightCount);
+
+	// Returns the bytes written. Clusters whose lights don't fit in capacity are trimmed, returns 0 if not even the cluster table fits.
+	FLEXKITAPI size_t PackLightClusters(const LightClusterGrid& grid, uint32_t* out, const size_t capacity);
+
+
+}	/************************************************************************************************/
+
+#endif
@@ -0,0 +1,795 @@
+/**********************************************************************
+
+Copyright (c) 2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#ifndef DYNAMICBVH_H
+#define DYNAMICBVH_H
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\containers.h"
+#include "..\coreutilities\intersection.h"
+#include "..\coreutilities\memoryutilities.h"
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	// Incrementally built AABB tree, leaves store fattened bounds so small movements don't touch the tree.
+	// Insertion picks the sibling with the lowest surface area cost, and AVL style rotations keep it balanced.
+	// Nodes live in a single array and refer to each other by index.
+	template<typename TY_ITEM>
+	class DynamicBVH
+	{
+	public:
+		static const uint32_t	InvalidNode			= 0xffffffff;
+		static const size_t		MaxPartitionSize	= 64;
+
+		struct Node
+		{
+			AABB		bounds;
+			TY_ITEM		item;
+
+			uint32_t	parent;	// Next free node while on the free list
+			uint32_t	left;
+			uint32_t	right;
+			int32_t		height;	// Leaves are 0, free nodes are -1
+			uint32_t	leaves;	// Number of leaves in this subtree
+
+			bool IsLeaf() const { return left == InvalidNode; }
+		};
+
+
+		// Starting point for a frustum query, used to split a query across several workers
+		struct QueryRoot
+		{
+			uint32_t	node;
+			bool		fullyInside;
+		};
+
+
+		DynamicBVH(iAllocator* IN_allocator, const float IN_margin = 0.25f) :
+			nodes	{ IN_allocator	},
+			margin	{ IN_margin		} {}
+
+
+		~DynamicBVH()
+		{
+			Release();
+		}
+
+
+		/************************************************************************************************/
+
+
+		uint32_t Insert(const AABB& bounds, const TY_ITEM item)
+		{
+			const uint32_t leaf = AllocateNode();
+
+			nodes[leaf].bounds	= Fatten(bounds);
+			nodes[leaf].item	= item;
+			nodes[leaf].height	= 0;
+			nodes[leaf].leaves	= 1;
+
+			InsertLeaf(leaf);
+			leafCount++;
+
+			return leaf;
+		}
+
+
+		/************************************************************************************************/
+
+
+		void Remove(const uint32_t leaf)
+		{
+			FK_ASSERT(leaf < nodes.size() && nodes[leaf].IsLeaf(), "Invalid BVH leaf!");
+
+			RemoveLeaf(leaf);
+			FreeNode(leaf);
+			leafCount--;
+		}
+
+
+		/************************************************************************************************/
+
+
+		// Returns true if the leaf had to be reinserted, bounds still inside the fattened bounds are ignored
+		bool Move(const uint32_t leaf, const AABB& bounds)
+		{
+			FK_ASSERT(leaf < nodes.size() && nodes[leaf].IsLeaf(), "Invalid BVH leaf!");
+
+			if (nodes[leaf].bounds.Contains(bounds))
+				return false;
+
+			RemoveLeaf(leaf);
+			nodes[leaf].bounds = Fatten(bounds);
+			InsertLeaf(leaf);
+
+			return true;
+		}
+
+
+		/************************************************************************************************/
+
+
+		// Reinserts up to budget leaves, walking the node array round robin from where the last call stopped.
+		// Leaves inserted early or moved around a lot can end up under poor siblings, a few reinserts per frame
+		// keep the tree's quality up without ever rebuilding it. Leaf indices don't change, and nothing is allocated.
+		size_t Optimize(const size_t budget)
+		{
+			if (leafCount < 3)
+				return 0;
+
+			size_t reinserted	= 0;
+			size_t visited		= 0;
+
+			while (reinserted < budget && visited < nodes.size())
+			{
+				if (optimizeCursor >= nodes.size())
+					optimizeCursor = 0;
+
+				const uint32_t idx = optimizeCursor++;
+				visited++;
+
+				if (nodes[idx].height != 0) // Skip internal and free nodes
+					continue;
+
+				RemoveLeaf(idx);
+				InsertLeaf(idx);
+				reinserted++;
+			}
+
+			return reinserted;
+		}
+
+
+		/************************************************************************************************/
+
+
+		void Clear()
+		{
+			nodes.clear();
+
+			root			= InvalidNode;
+			freeList		= InvalidNode;
+			leafCount		= 0;
+			optimizeCursor	= 0;
+		}
+
+
+		void Release()
+		{
+			nodes.Release();
+
+			root			= InvalidNode;
+			freeList		= InvalidNode;
+			leafCount		= 0;
+			optimizeCursor	= 0;
+		}
+
+
+		/************************************************************************************************/
+
+
+		// fn(item)
+		template<typename FN>
+		void Query(const AABB& bounds, FN&& fn) const
+		{
+			Traverse(
+				[&](const Node& node) { return Overlaps(node.bounds, bounds); },
+				[&](const Node& node) { fn(node.item); });
+		}
+
+
+		/************************************************************************************************/
+
+
+		// fn(item, fullyInside), subtrees fully inside the frustum are reported without further tests
+		template<typename FN>
+		void Query(const Frustum& frustum, FN&& fn) const
+		{
+			if (root != InvalidNode)
+				Query(frustum, QueryRoot{ root, false }, fn);
+		}
+
+
+		// Same as above, restricted to the subtree under start
+		template<typename FN>
+		void Query(const Frustum& frustum, const QueryRoot start, FN&& fn) const
+		{
+			uint32_t	stack[MaxStackDepth];
+			bool		inside[MaxStackDepth];
+			size_t		stackSize = 0;
+
+			stack[stackSize]	= start.node;
+			inside[stackSize]	= start.fullyInside;
+			stackSize++;
+
+			while (stackSize)
+			{
+				stackSize--;
+
+				const Node&	node		= nodes[stack[stackSize]];
+				bool		fullyInside	= inside[stackSize];
+
+				if (!fullyInside)
+				{
+					const auto result = ClassifyAABBAgainstFrustum(frustum, node.bounds);
+
+					if (result == FrustumIntersection::Outside)
+						continue;
+
+					fullyInside = (result == FrustumIntersection::Inside);
+				}
+
+				if (node.IsLeaf())
+				{
+					fn(node.item, fullyInside);
+					continue;
+				}
+
+				FK_ASSERT(stackSize + 2 <= MaxStackDepth, "BVH too deep!");
+
+				stack[stackSize] = node.left;	inside[stackSize] = fullyInside; stackSize++;
+				stack[stackSize] = node.right;	inside[stackSize] = fullyInside; stackSize++;
+			}
+		}
+
+
+		/************************************************************************************************/
+
+
+		// fn(item, fullyInside) for leaves intersecting frustum, skipping subtrees fully inside previous.
+		// Used to find what entered the view since a query against previous.
+		template<typename FN>
+		void QueryDelta(const Frustum& frustum, const Frustum& previous, FN&& fn) const
+		{
+			uint32_t	stack[MaxStackDepth];
+			bool		inside[MaxStackDepth];
+			size_t		stackSize = 0;
+
+			if (root != InvalidNode)
+			{
+				stack[stackSize]	= root;
+				inside[stackSize]	= false;
+				stackSize++;
+			}
+
+			while (stackSize)
+			{
+				stackSize--;
+
+				const Node&	node		= nodes[stack[stackSize]];
+				bool		fullyInside	= inside[stackSize];
+
+				if (ClassifyAABBAgainstFrustum(previous, node.bounds) == FrustumIntersection::Inside)
+					continue;
+
+				if (!fullyInside)
+				{
+					const auto result = ClassifyAABBAgainstFrustum(frustum, node.bounds);
+
+					if (result == FrustumIntersection::Outside)
+						continue;
+
+					fullyInside = (result == FrustumIntersection::Inside);
+				}
+
+				if (node.IsLeaf())
+				{
+					fn(node.item, fullyInside);
+					continue;
+				}
+
+				FK_ASSERT(stackSize + 2 <= MaxStackDepth, "BVH too deep!");
+
+				stack[stackSize] = node.left;	inside[stackSize] = fullyInside; stackSize++;
+				stack[stackSize] = node.right;	inside[stackSize] = fullyInside; stackSize++;
+			}
+		}
+
+
+		/************************************************************************************************/
+
+
+		static const uint32_t MaxMultiQueryFrusta = 32;
+
+		// Tests up to 32 frusta in one walk, bit I of the masks is frusta[I]. fn(item, insideMask, partialMask) for leaves
+		// intersecting any of them, partial bits mean the leaf may intersect that frustum, inside bits that it is fully inside.
+		template<typename FN>
+		void QueryMulti(const Frustum* frusta, const uint32_t frustumCount, FN&& fn) const
+		{
+			FK_ASSERT(frustumCount <= MaxMultiQueryFrusta);
+
+			if (root == InvalidNode || !frustumCount)
+				return;
+
+			uint32_t	stack[MaxStackDepth];
+			uint32_t	partial[MaxStackDepth];
+			uint32_t	inside[MaxStackDepth];
+			size_t		stackSize = 0;
+
+			stack[stackSize]	= root;
+			partial[stackSize]	= (frustumCount == 32) ? 0xFFFFFFFF : ((1u << frustumCount) - 1);
+			inside[stackSize]	= 0;
+			stackSize++;
+
+			while (stackSize)
+			{
+				stackSize--;
+
+				const Node&	node			= nodes[stack[stackSize]];
+				uint32_t	partialMask		= partial[stackSize];
+				uint32_t	insideMask		= inside[stackSize];
+
+				for (uint32_t I = 0; I < frustumCount; ++I)
+				{
+					const uint32_t bit = 1u << I;
+
+					if (!(partialMask & bit))
+						continue;
+
+					const auto result = ClassifyAABBAgainstFrustum(frusta[I], node.bounds);
+
+					if (result == FrustumIntersection::Outside)
+						partialMask &= ~bit;
+					else if (result == FrustumIntersection::Inside)
+					{
+						partialMask &= ~bit;
+						insideMask	|= bit;
+					}
+				}
+
+				if (!(partialMask | insideMask))
+					continue;
+
+				if (node.IsLeaf())
+				{
+					fn(node.item, insideMask, partialMask);
+					continue;
+				}
+
+				FK_ASSERT(stackSize + 2 <= MaxStackDepth, "BVH too deep!");
+
+				stack[stackSize] = node.left;	partial[stackSize] = partialMask; inside[stackSize] = insideMask; stackSize++;
+				stack[stackSize] = node.right;	partial[stackSize] = partialMask; inside[stackSize] = insideMask; stackSize++;
+			}
+		}
+
+
+		/************************************************************************************************/
+
+
+		// Splits a frustum query into at most maxRoots disjoint subtrees, expanding the top of the tree breadth first.
+		// Subtrees outside the frustum are dropped, so the returned roots together cover every visible leaf.
+		size_t PartitionQuery(const Frustum& frustum, QueryRoot* out, size_t maxRoots) const
+		{
+			maxRoots = (maxRoots < MaxPartitionSize) ? maxRoots : MaxPartitionSize;
+
+			if (root == InvalidNode || !maxRoots)
+				return 0;
+
+			QueryRoot	queue[MaxPartitionSize];
+			size_t		queueBegin	= 0;
+			size_t		queueSize	= 0;
+			size_t		outCount	= 0;
+
+			queue[queueSize++] = { root, false };
+
+			while (queueSize && queueSize + outCount < maxRoots)
+			{
+				QueryRoot current = queue[queueBegin];
+				queueBegin = (queueBegin + 1) % MaxPartitionSize;
+				queueSize--;
+
+				const Node& node = nodes[current.node];
+
+				if (!current.fullyInside)
+				{
+					const auto result = ClassifyAABBAgainstFrustum(frustum, node.bounds);
+
+					if (result == FrustumIntersection::Outside)
+						continue;
+
+					current.fullyInside = (result == FrustumIntersection::Inside);
+				}
+
+				if (node.IsLeaf())
+				{
+					out[outCount++] = current;
+					continue;
+				}
+
+				queue[(queueBegin + queueSize++) % MaxPartitionSize] = { node.left,		current.fullyInside };
+				queue[(queueBegin + queueSize++) % MaxPartitionSize] = { node.right,	current.fullyInside };
+			}
+
+			while (queueSize--)
+			{
+				out[outCount++] = queue[queueBegin];
+				queueBegin = (queueBegin + 1) % MaxPartitionSize;
+			}
+
+			return outCount;
+		}
+
+
+		/************************************************************************************************/
+
+
+		// fn(item, t) for every leaf the ray enters within maxT, t is the distance to the leaf's fattened bounds
+		template<typename FN>
+		void RayCast(const Ray& ray, const float maxT, FN&& fn) const
+		{
+			Traverse(
+				[&](const Node& node)
+				{
+					float t = 0;
+					return Intersects(ray, node.bounds, t) && t <= maxT;
+				},
+				[&](const Node& node)
+				{
+					float t = 0;
+					Intersects(ray, node.bounds, t);
+					fn(node.item, t);
+				});
+		}
+
+
+		// fn(item, t) returns the distance to its hit on the item, or anything past maxT on a miss.
+		// Nodes further away than the closest hit so far are skipped. Returns the closest hit distance, or maxT.
+		template<typename FN>
+		float RayCastClosest(const Ray& ray, float maxT, FN&& fn) const
+		{
+			Traverse(
+				[&](const Node& node)
+				{
+					float t = 0;
+					return Intersects(ray, node.bounds, t) && t <= maxT;
+				},
+				[&](const Node& node)
+				{
+					float t = 0;
+					Intersects(ray, node.bounds, t);
+
+					const float hit = fn(node.item, t);
+					if (hit < maxT)
+						maxT = hit;
+				});
+
+			return maxT;
+		}
+
+
+		/************************************************************************************************/
+
+
+		const Node&	operator [](const uint32_t idx) const	{ return nodes[idx]; }
+		size_t		size() const							{ return leafCount; }
+		uint32_t	GetRoot() const							{ return root; }
+
+		int32_t GetHeight() const
+		{
+			return (root != InvalidNode) ? nodes[root].height : 0;
+		}
+
+
+	private:
+
+		static const size_t MaxStackDepth = 128;
+
+
+		/************************************************************************************************/
+
+
+		static bool Overlaps(const AABB& lhs, const AABB& rhs)
+		{
+			return
+				lhs.min.x <= rhs.max.x && lhs.max.x >= rhs.min.x &&
+				lhs.min.y <= rhs.max.y && lhs.max.y >= rhs.min.y &&
+				lhs.min.z <= rhs.max.z && lhs.max.z >= rhs.min.z;
+		}
+
+
+		AABB Fatten(const AABB& bounds) const
+		{
+			AABB out;
+			out.min = bounds.min - float3{ margin, margin, margin };
+			out.max = bounds.max + float3{ margin, margin, margin };
+
+			return out;
+		}
+
+
+		/************************************************************************************************/
+
+
+		template<typename FN_TEST, typename FN_LEAF>
+		void Traverse(FN_TEST&& test, FN_LEAF&& onLeaf) const
+		{
+			uint32_t	stack[MaxStackDepth];
+			size_t		stackSize = 0;
+
+			if (root != InvalidNode)
+				stack[stackSize++] = root;
+
+			while (stackSize)
+			{
+				const Node& node = nodes[stack[--stackSize]];
+
+				if (!test(node))
+					continue;
+
+				if (node.IsLeaf())
+					onLeaf(node);
+				else
+				{
+					FK_ASSERT(stackSize + 2 <= MaxStackDepth, "BVH too deep!");
+
+					stack[stackSize++] = node.left;
+					stack[stackSize++] = node.right;
+				}
+			}
+		}
+
+
+		/************************************************************************************************/
+
+
+		uint32_t AllocateNode()
+		{
+			uint32_t idx = freeList;
+
+			if (idx != InvalidNode)
+				freeList = nodes[idx].parent;
+			else
+			{
+				idx = (uint32_t)nodes.size();
+				nodes.push_back(Node{});
+			}
+
+			nodes[idx].parent	= InvalidNode;
+			nodes[idx].left		= InvalidNode;
+			nodes[idx].right	= InvalidNode;
+			nodes[idx].height	= 0;
+			nodes[idx].leaves	= 0;
+
+			return idx;
+		}
+
+
+		void FreeNode(const uint32_t idx)
+		{
+			nodes[idx].parent	= freeList;
+			nodes[idx].height	= -1;
+			freeList			= idx;
+		}
+
+
+		/************************************************************************************************/
+
+
+		void InsertLeaf(const uint32_t leaf)
+		{
+			if (root == InvalidNode)
+			{
+				root				= leaf;
+				nodes[leaf].parent	= InvalidNode;
+
+				return;
+			}
+
+			// Descend towards the sibling with the lowest surface area cost
+			const AABB	leafBounds	= nodes[leaf].bounds;
+			uint32_t	sibling		= root;
+
+			while (!nodes[sibling].IsLeaf())
+			{
+				const Node&	node		= nodes[sibling];
+				const float	area		= node.bounds.SurfaceArea();
+				const float	combined	= (node.bounds + leafBounds).SurfaceArea();
+
+				const float	cost			= 2.0f * combined;			// New parent here
+				const float	inheritedCost	= 2.0f * (combined - area);	// Pushed down into every ancestor
+
+				auto childCost = [&](const uint32_t child)
+				{
+					const float newArea = (nodes[child].bounds + leafBounds).SurfaceArea();
+					return nodes[child].IsLeaf() ?
+						newArea + inheritedCost :
+						newArea - nodes[child].bounds.SurfaceArea() + inheritedCost;
+				};
+
+				const float costLeft	= childCost(node.left);
+				const float costRight	= childCost(node.right);
+
+				if (cost < costLeft && cost < costRight)
+					break;
+
+				sibling = (costLeft < costRight) ? node.left : node.right;
+			}
+
+			const uint32_t oldParent = nodes[sibling].parent;
+			const uint32_t newParent = AllocateNode();
+
+			nodes[newParent].parent	= oldParent;
+			nodes[newParent].bounds	= leafBounds + nodes[sibling].bounds;
+			nodes[newParent].height	= nodes[sibling].height + 1;
+			nodes[newParent].leaves	= nodes[sibling].leaves + nodes[leaf].leaves;
+			nodes[newParent].left	= sibling;
+			nodes[newParent].right	= leaf;
+
+			nodes[sibling].parent	= newParent;
+			nodes[leaf].parent		= newParent;
+
+			if (oldParent == InvalidNode)
+				root = newParent;
+			else if (nodes[oldParent].left == sibling)
+				nodes[oldParent].left = newParent;
+			else
+				nodes[oldParent].right = newParent;
+
+			Refit(nodes[leaf].parent);
+		}
+
+
+		/************************************************************************************************/
+
+
+		void RemoveLeaf(const uint32_t leaf)
+		{
+			if (leaf == root)
+			{
+				root = InvalidNode;
+				return;
+			}
+
+			const uint32_t parent		= nodes[leaf].parent;
+			const uint32_t grandParent	= nodes[parent].parent;
+			const uint32_t sibling		= (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+			if (grandParent == InvalidNode)
+			{
+				root					= sibling;
+				nodes[sibling].parent	= InvalidNode;
+			}
+			else
+			{
+				if (nodes[grandParent].left == parent)
+					nodes[grandParent].left = sibling;
+				else
+					nodes[grandParent].right = sibling;
+
+				nodes[sibling].parent = grandParent;
+				Refit(grandParent);
+			}
+
+			FreeNode(parent);
+		}
+
+
+		/************************************************************************************************/
+
+
+		// Walks to the root fixing bounds, heights and leaf counts, rebalancing on the way
+		void Refit(uint32_t idx)
+		{
+			while (idx != InvalidNode)
+			{
+				idx = Balance(idx);
+
+				const uint32_t left		= nodes[idx].left;
+				const uint32_t right	= nodes[idx].right;
+
+				nodes[idx].height	= 1 + max(nodes[left].height, nodes[right].height);
+				nodes[idx].bounds	= nodes[left].bounds + nodes[right].bounds;
+				nodes[idx].leaves	= nodes[left].leaves + nodes[right].leaves;
+
+				idx = nodes[idx].parent;
+			}
+		}
+
+
+		/************************************************************************************************/
+
+
+		// Rotates the taller child up if the subtree at A is unbalanced, returns the new subtree root
+		uint32_t Balance(const uint32_t A)
+		{
+			if (nodes[A].IsLeaf() || nodes[A].height < 2)
+				return A;
+
+			const uint32_t	B		= nodes[A].left;
+			const uint32_t	C		= nodes[A].right;
+			const int32_t	balance	= nodes[C].height - nodes[B].height;
+
+			if (balance > 1)
+				return Rotate(A, C, B, false);
+
+			if (balance < -1)
+				return Rotate(A, B, C, true);
+
+			return A;
+		}
+
+
+		// Promotes child up over A, other stays under A and the shorter grandchild takes child's old slot
+		uint32_t Rotate(const uint32_t A, const uint32_t child, const uint32_t other, const bool childIsLeft)
+		{
+			const uint32_t F = nodes[child].left;
+			const uint32_t G = nodes[child].right;
+
+			nodes[child].left	= A;
+			nodes[child].parent	= nodes[A].parent;
+			nodes[A].parent		= child;
+
+			const uint32_t parent = nodes[child].parent;
+
+			if (parent == InvalidNode)
+				root = child;
+			else if (nodes[parent].left == A)
+				nodes[parent].left = child;
+			else
+				nodes[parent].right = child;
+
+			// The taller grandchild stays with child
+			const bool		keepF	= nodes[F].height > nodes[G].height;
+			const uint32_t	kept	= keepF ? F : G;
+			const uint32_t	moved	= keepF ? G : F;
+
+			nodes[child].right	= kept;
+			nodes[moved].parent	= A;
+
+			if (childIsLeft)
+				nodes[A].left = moved;
+			else
+				nodes[A].right = moved;
+
+			nodes[A].bounds		= nodes[other].bounds + nodes[moved].bounds;
+			nodes[A].height		= 1 + max(nodes[other].height, nodes[moved].height);
+			nodes[A].leaves		= nodes[other].leaves + nodes[moved].leaves;
+
+			nodes[child].bounds	= nodes[A].bounds + nodes[kept].bounds;
+			nodes[child].height	= 1 + max(nodes[A].height, nodes[kept].height);
+			nodes[child].leaves	= nodes[A].leaves + nodes[kept].leaves;
+
+			return child;
+		}
+
+
+		/************************************************************************************************/
+
+
+		Vector<Node>	nodes;
+		uint32_t		root			= InvalidNode;
+		uint32_t		freeList		= InvalidNode;
+		size_t			leafCount		= 0;
+		uint32_t		optimizeCursor	= 0;
+		const float		margin;
+	};
+
+
+}	/************************************************************************************************/
+
+#endif
@@ -137,6 +137,8 @@ namespace FlexKit
 
 		Threads.Release();
 
+		ReleaseSceneNodeTable();
+
 		Memory = nullptr;
 	}
 
@@ -110,7 +110,6 @@ namespace FlexKit
 
 	static const size_t PRE_ALLOC_SIZE = GIGABYTE * 1;
 	static const size_t LEVELBUFFERSIZE = MEGABYTE * 64;
-	static const size_t NODEBUFFERSIZE = MEGABYTE * 64;
 	static const size_t TEMPBUFFERSIZE = MEGABYTE * 256;
 	static const size_t BLOCKALLOCSIZE = MEGABYTE * 512;
 
@@ -134,7 +133,6 @@ namespace FlexKit
 
 
 		// Memory Pools
-		byte	NodeMem[NODEBUFFERSIZE];
 		byte	BlockMem[BLOCKALLOCSIZE];
 		byte	LevelMem[LEVELBUFFERSIZE];
 		byte	TempMem[TEMPBUFFERSIZE];
@@ -154,7 +152,7 @@ namespace FlexKit
 			Threads			{ threadCount, memory->BlockAllocator	        },// TODO: Get System Thread Count.
 			RenderSystem	{ memory->BlockAllocator, &Threads				}
 		{
-			InitiateSceneNodeBuffer(memory->NodeMem, sizeof(EngineMemory::NodeMem));
+			InitiateSceneNodeTable(SystemAllocator);
 			Initiate(memory, WH);
 		}
 
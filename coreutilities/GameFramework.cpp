@@ -179,7 +179,8 @@ namespace FlexKit
 	GameFramework::GameFramework(EngineCore& IN_core) :
 		console				{ DefaultAssets.Font, IN_core.RenderSystem, IN_core.GetBlockMemory() },
 		core				{ IN_core	},
-		fixStepAccumulator	{ 0.0		}
+		fixStepAccumulator	{ 0.0		},
+		assetLoader			{ IN_core.Threads, SystemAllocator }
 
 	{
 		Initiate();
@@ -193,6 +194,7 @@ namespace FlexKit
 	{
 		SetDebugMemory			(core.GetDebugMemory());
 		InitiateAssetTable	    (core.GetBlockMemory());
+		SetAssetDecompressionThreads(&core.Threads);
 		InitiateGeometryTable	(core.GetBlockMemory());
 
 		clearColor					= { 0.0f, 0.2f, 0.4f, 1.0f };
@@ -251,6 +253,8 @@ namespace FlexKit
 		UpdateInput();
 		UpdateMouseInput(&MouseState, &core.Window);
 
+		assetLoader.Update();
+
 		if (!subStates.size()) {
 			quit = true;
 			return;
@@ -376,6 +380,8 @@ namespace FlexKit
 
 	void GameFramework::Release()
 	{
+		assetLoader.Shutdown();
+
 		core.Threads.SendShutdown();
 		core.Threads.WaitForWorkersToComplete();
 
@@ -415,14 +421,19 @@ namespace FlexKit
 		uint32_t VRamUsage	= (uint32_t)(core.RenderSystem._GetVidMemUsage() / MEGABYTE);
 		char* TempBuffer	= (char*)core.GetTempMemory().malloc(512);
 		auto DrawTiming		= float(GetDuration(PROFILE_SUBMISSION)) / 1000.0f;
+		auto AssetStats		= GetAssetMemoryStats();
 
 		sprintf_s(TempBuffer, 512, 
 			"Current VRam Usage: %u MB\n"
+			"Asset Memory: %u MB resident, %u MB evictable, %u evictions\n"
 			"FPS: %u\n"
 			"Update/Draw Dispatch Time: %fms\n"
 			"Objects Drawn: %u\n"
 			"Build Date: " __DATE__ "\n",
 			VRamUsage, 
+			(uint32_t)(AssetStats.residentBytes / MEGABYTE),
+			(uint32_t)(AssetStats.evictableBytes / MEGABYTE),
+			(uint32_t)AssetStats.evictionCount,
 			(uint32_t)stats.fps,
 			DrawTiming, 
 			(uint32_t)stats.objectsDrawnLastFrame);
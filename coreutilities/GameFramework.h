@@ -37,6 +37,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\coreutilities\GraphicsComponents.h"
 #include "..\coreutilities\Logging.h"
 #include "..\coreutilities\Assets.h"
+#include "..\coreutilities\AssetLoader.h"
 
 #include "..\graphicsutilities\FrameGraph.h"
 #include "..\graphicsutilities\Graphics.h"
@@ -161,6 +162,7 @@ namespace FlexKit
 		};
 
 		Console					console;
+		AssetLoader				assetLoader;
 	};
 
 
@@ -29,6 +29,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\coreutilities\Components.h"
 #include "..\coreutilities\componentBlobs.h"
 #include "..\graphicsutilities\AnimationRuntimeUtilities.H"
+#include "..\coreutilities\OcclusionCulling.h"
+
+#include <algorithm>
 
 namespace FlexKit
 {
@@ -146,9 +149,8 @@ namespace FlexKit
 			[&](SceneVisibilityView& visibility)
 			{
 				sceneEntities.push_back(visibility);
+				sceneManagement.AddEntity(visibility);
 			});
-
-		//sceneManagement.AddEntity(vis);
 	}
 
 
@@ -162,6 +164,7 @@ namespace FlexKit
 		[&, allocator = this->allocator](SceneVisibilityView& vis) 
 		{
 			const auto handle = vis.visibility;
+			sceneManagement.RemoveEntity(handle);
 			go.RemoveView(vis);
 
 			sceneEntities.remove_unstable(
@@ -354,275 +357,151 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	void UpdateQuadTree(QuadTreeNode* Node, GraphicScene* Scene)
+	SceneBVH::~SceneBVH()
 	{
-		/*
-		for (const auto D : Scene->Drawables) {
-			if (GetFlag(D.Node, SceneNodes::StateFlags::UPDATED))
-			{
-				if()
-				{	// Moved Branch
-					if()
-					{	// Space in Node Available
-					}
-					else
-					{	// Node Split Needed
-					}
-				}
-			}
-		}
-		*/
+		for (auto cache : visibilityCaches)
+			allocator->release(cache);
+
+		for (auto cache : shadowCaches)
+			allocator->release(cache);
 	}
 
 
 	/************************************************************************************************/
 
 
-	void QuadTreeNode::ExpandNode(iAllocator* allocator)
+	void SceneBVH::clear()
 	{
-		ChildNodes.push_back(&allocator->allocate_aligned<QuadTreeNode>(allocator));
-		ChildNodes.push_back(&allocator->allocate_aligned<QuadTreeNode>(allocator));
-		ChildNodes.push_back(&allocator->allocate_aligned<QuadTreeNode>(allocator));
-		ChildNodes.push_back(&allocator->allocate_aligned<QuadTreeNode>(allocator));
-
-		const auto SpanVector	= upperRight - lowerLeft;
-		const auto CenterPoint	= (lowerLeft + upperRight) / 2;
-
-		ChildNodes[(int)QuadTreeNodeLocation::UpperRight]->upperRight	= CenterPoint + SpanVector / 2;
-		ChildNodes[(int)QuadTreeNodeLocation::UpperRight]->lowerLeft	= CenterPoint;
-
-		ChildNodes[(int)QuadTreeNodeLocation::UpperLeft]->upperRight	= CenterPoint + (SpanVector / 2) * float2( 0.0f,  1.0f);
-		ChildNodes[(int)QuadTreeNodeLocation::UpperLeft]->lowerLeft		= CenterPoint + (SpanVector / 2) * float2(-1.0f,  0.0f);
-
-		ChildNodes[(int)QuadTreeNodeLocation::LowerLeft]->upperRight	= CenterPoint;
-		ChildNodes[(int)QuadTreeNodeLocation::LowerLeft]->lowerLeft		= CenterPoint - (SpanVector / 2);
-
-		ChildNodes[(int)QuadTreeNodeLocation::LowerRight]->upperRight	= CenterPoint + (SpanVector / 2) * float2( 1.0f,  0.0f);
-		ChildNodes[(int)QuadTreeNodeLocation::LowerRight]->lowerLeft	= CenterPoint + (SpanVector / 2) * float2( 0.0f, -1.0f);
-
-		for (auto& node : ChildNodes)
-			node->centerPoint = (node->upperRight + node->lowerLeft) / 2;
+		tree.Clear();
+		moved.clear();
+		version++;
 	}
 
 
 	/************************************************************************************************/
 
 
-	float4 QuadTreeNode::GetArea() const
+	void SceneBVH::AddEntity(VisibilityHandle handle)
 	{
-		const auto areaLL = (lowerLeft.y <  upperRight.y) ? lowerLeft : upperRight;
-		const auto areaUR = (lowerLeft.y >= upperRight.y) ? lowerLeft : upperRight;
+		auto& visibility = SceneVisibilityComponent::GetComponent()[handle];
+		visibility.bvhLeaf = tree.Insert(GetWorldAABB(visibility), handle);
 
-		return { areaLL, areaUR };
+		// Refit runs on a worker and must not allocate
+		moved.reserve(tree.size());
+		version++;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void QuadTree::clear()
+	void SceneBVH::RemoveEntity(VisibilityHandle handle)
 	{
-		root.Clear();
+		auto& visibility = SceneVisibilityComponent::GetComponent()[handle];
+
+		if (visibility.bvhLeaf == DynamicBVH<VisibilityHandle>::InvalidNode)
+			return;
+
+		tree.Remove(visibility.bvhLeaf);
+		visibility.bvhLeaf = DynamicBVH<VisibilityHandle>::InvalidNode;
+		version++;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void QuadTreeNode::AddEntity(VisibilityHandle visable)
-	{
-		if (ChildNodes.empty() && !Contents.full())
-		{
-			Contents.push_back(visable);
-		}
-		else
-		{
-			if (ChildNodes.empty()) 
-			{
-				ExpandNode(allocator);
-
-				for (auto C : Contents)
-					AddEntity(visable);
+	// Leaves reinserted every refit to keep the tree's quality up, see DynamicBVH::Optimize
+	const size_t SceneBVHOptimizeBudget = 16;
 
-				Contents.clear();
-			}
 
-			// Get Nearest Node
-			auto visableEntity	= SceneVisibilityComponent::GetComponent()[visable];
-			auto node			= visableEntity.node;
-			auto position		= GetPositionW(node);
+	void SceneBVH::Refit(GraphicScene& parentScene)
+	{
+		auto& visibility = SceneVisibilityComponent::GetComponent();
 
-			float2 pos_f2{position.x, position.z};
+		moved.clear();
+		refitCount++;
 
-			float			l = 1000000000.0f;
-			QuadTreeNode*	nearestNode = ChildNodes.front();
+		for (auto handle : parentScene.sceneEntities)
+		{
+			auto& entity = visibility[handle];
 
-			for (auto child : ChildNodes)
+			// UPDATED is only set on nodes UpdateTransforms recomputed this frame
+			if (GetFlag(entity.node, SceneNodes::UPDATED))
 			{
-				float d = (child->centerPoint - pos_f2).Magnitude();
-				if (d < l)
-				{
-					l = d;
-					nearestNode = child;
-				}
+				tree.Move(entity.bvhLeaf, GetWorldAABB(entity));
+				moved.push_back(handle);
 			}
-
-			nearestNode->AddEntity(visable);
 		}
+
+		tree.Optimize(SceneBVHOptimizeBudget);
 	}
 
 
 	/************************************************************************************************/
 
 
-	QuadTreeNode::SphereTestRes QuadTreeNode::IsSphereInside(float r, float3 pos)
-	{
-		float nodeSpan			= (lowerLeft - upperRight).Magnitude();
-		float l					= (float2(pos.x, pos.z) - centerPoint).Magnitude();
-
-		bool OutSideNode		= (l > (nodeSpan / 2));
-
-		return OutSideNode ? Failed : Fully;
-	}
-
-	/************************************************************************************************/
-
-	void QuadTreeNode::UpdateBounds()
+	SceneVisibilityCache& SceneBVH::GetVisibilityCache(CameraHandle camera)
 	{
-		for (auto child : ChildNodes) 
-		{
-			child->UpdateBounds();
-
-			upperRight.x = (child->upperRight.x > upperRight.x) ? child->upperRight.x : upperRight.x;
-			upperRight.y = (child->upperRight.y > upperRight.y) ? child->upperRight.y : upperRight.y;
-
-			lowerLeft.x = (child->lowerLeft.x > lowerLeft.x) ? child->lowerLeft.x : lowerLeft.x;
-			lowerLeft.y = (child->lowerLeft.y > lowerLeft.y) ? child->lowerLeft.y : lowerLeft.y;
-		}
-
-		auto& visibility = SceneVisibilityComponent::GetComponent();
-
-		for(auto visable : Contents)
+		for (auto cache : visibilityCaches)
 		{
-			auto& visableInfo	= visibility[visable];
-			auto node			= visableInfo.node;
-			auto boundingSphere	= visableInfo.boundingSphere;
-			auto r				= boundingSphere.w;
-			auto offset			= boundingSphere.xyz();
-			auto position		= GetPositionW(node);
-
-			float2 vectorToNode				= centerPoint - float2{position.x + offset.x, position.z + offset.x };
-			
-			float2 vectorToNodeNormalized	= vectorToNode / vectorToNode.Magnitude();
-			
-			if ((vectorToNode * vectorToNode).Sum() < 0.00001f)
-				vectorToNodeNormalized = float2{ 0, 0 };
-
-			float2 newUR					= centerPoint + vectorToNodeNormalized * -r;
-
-			upperRight.x = (newUR.y > upperRight.y) ? newUR.x : upperRight.x;
-			upperRight.y = (newUR.y > upperRight.y) ? newUR.y : upperRight.y;
-
-			lowerLeft.x = (newUR.y < lowerLeft.y) ? newUR.x : lowerLeft.x;
-			lowerLeft.y = (newUR.y < lowerLeft.y) ? newUR.y : lowerLeft.y;
+			if (cache->camera == camera)
+				return *cache;
 		}
-	}
-
-	/************************************************************************************************/
-
-
-	void QuadTree::AddEntity(VisibilityHandle entityHandle)
-	{
-		root.AddEntity(entityHandle);
-		//UpdateBounds();
-	}
 
+		auto& cache		= allocator->allocate<SceneVisibilityCache>(allocator);
+		cache.camera	= camera;
+		visibilityCaches.push_back(&cache);
 
-	/************************************************************************************************/
-
-
-	void QuadTree::RemoveEntity(VisibilityHandle handle)
-	{
-
+		return cache;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void QuadTree::Rebuild(GraphicScene& parentScene) 
+	PointLightShadowCache& SceneBVH::GetShadowCache(PointLightHandle pointLight)
 	{
-		RebuildCounter = 0;
-		root.Clear();
-
-		float2 lowerLeft	{ 0, 0 };
-		float2 upperRight	{ 0, 0 };
-			
-		//for (auto item : allEntities)
+		for (auto cache : shadowCaches)
 		{
-			//auto boundingSphere = parentScene.GetBoundingSphere(item);
-			//float r = boundingSphere.w;
-
-			//upperRight.x = boundingSphere.x + r > upperRight.x ? boundingSphere.x + r : upperRight.x;
-			//upperRight.y = boundingSphere.z + r > upperRight.y ? boundingSphere.z + r : upperRight.y;
-
-			//lowerLeft.x = boundingSphere.x - r < lowerLeft.x ? boundingSphere.x - r : lowerLeft.x;
-			//lowerLeft.y = boundingSphere.z - r < lowerLeft.y ? boundingSphere.z - r : lowerLeft.y;
+			if (cache->pointLight == pointLight)
+				return *cache;
 		}
 
-		auto centerPoint	= (upperRight - lowerLeft) / 2;
-		root.centerPoint	= centerPoint;
-		root.lowerLeft		= lowerLeft;
-		root.upperRight		= upperRight;
+		auto& cache			= allocator->allocate<PointLightShadowCache>(allocator);
+		cache.pointLight	= pointLight;
+		shadowCaches.push_back(&cache);
 
-		//for (auto item : allEntities)
-		//	root.AddChild(item, allocator);
+		return cache;
 	}
 
 
 	/************************************************************************************************/
 
 
-	float4	QuadTree::GetArea()
+	UpdateTask& SceneBVH::Update(FlexKit::UpdateDispatcher& dispatcher, GraphicScene* parentScene, UpdateTask& transformDependency)
 	{
-		return root.GetArea();
-	}
-
-
-	/************************************************************************************************/
-
-
-	UpdateTask& QuadTree::Update(FlexKit::UpdateDispatcher& dispatcher, GraphicScene* parentScene, UpdateTask& transformDependency)
-	{
-		struct QuadTreeUpdate
+		struct SceneBVHUpdate
 		{
-			QuadTree*		QTree;
+			SceneBVH*		BVH;
 			GraphicScene*	parentScene;
 		};
 
-		auto& task = dispatcher.Add<QuadTreeUpdate>(
-			[&](DependencyBuilder& builder, auto& QuadTreeUpdate)
+		auto& task = dispatcher.Add<SceneBVHUpdate>(
+			[&](DependencyBuilder& builder, auto& BVHUpdate)
 			{
 				builder.AddInput(transformDependency);
-				builder.SetDebugString("QuadTree Update!");
+				builder.SetDebugString("Scene BVH Update");
 
-				QuadTreeUpdate.QTree		= this;
-				QuadTreeUpdate.parentScene	= parentScene;
+				BVHUpdate.BVH			= this;
+				BVHUpdate.parentScene	= parentScene;
 
 			},
-			[](auto& QuadTreeUpdate)
+			[](auto& BVHUpdate)
 			{
-				FK_LOG_9("QuadTree::Update");
-
-				const auto period  = QuadTreeUpdate.QTree->RebuildPeriod;
-				const auto counter = QuadTreeUpdate.QTree->RebuildCounter;
+				FK_LOG_9("SceneBVH::Update");
 
-				//if (period <= counter)
-				//	QuadTreeUpdate.QTree->Rebuild(*QuadTreeUpdate.parentScene);
-				//else
-				//	QuadTreeUpdate.QTree->root.UpdateBounds(*QuadTreeUpdate.parentScene);
-
-				//QuadTreeUpdate.QTree->RebuildCounter++;
+				BVHUpdate.BVH->Refit(*BVHUpdate.parentScene);
 			});
 
 		return task;
@@ -662,211 +541,1190 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	void GatherScene(GraphicScene* SM, CameraHandle Camera, PVS& out, PVS& T_out)
+	BoundingSphere GetWorldBoundingSphere(const VisibilityFields& visibility)
 	{
-		FK_ASSERT(&out		!= &T_out);
-		FK_ASSERT(Camera	!= CameraHandle{(unsigned int)INVALIDHANDLE});
-		FK_ASSERT(SM		!= nullptr);
-		FK_ASSERT(&out		!= nullptr);
-		FK_ASSERT(&T_out	!= nullptr);
+		const auto Ls	= GetLocalScale		(visibility.node).x;
+		const auto Pw	= GetPositionW		(visibility.node);
+		const auto Lq	= GetOrientation	(visibility.node);
 
+		return BoundingSphere{
+			Lq * visibility.boundingSphere.xyz() + Pw,
+			Ls * visibility.boundingSphere.w };
+	}
 
-		auto& cameraComponent = CameraComponent::GetComponent();
 
-		const auto CameraNode	= cameraComponent.GetCameraNode(Camera);
-		const float3	POS		= GetPositionW(CameraNode);
-		const Quaternion Q		= GetOrientation(CameraNode);
-		const auto F			= GetFrustum(Camera);
-		const auto& Visibles	= SceneVisibilityComponent::GetComponent();
+	AABB GetWorldAABB(const VisibilityFields& visibility)
+	{
+		const auto	boundingSphere	= GetWorldBoundingSphere(visibility);
+		const float	r				= boundingSphere.w;
 
-		for(auto handle : SM->sceneEntities)
-		{
-			const auto potentialVisible = Visibles[handle];
+		AABB out;
+		out.min = boundingSphere.xyz() - float3{ r, r, r };
+		out.max = boundingSphere.xyz() + float3{ r, r, r };
 
-			if(	potentialVisible.visable && 
-				potentialVisible.entity->hasView(DrawableComponent::GetComponentID()))
-			{
-				auto Ls	= GetLocalScale		(potentialVisible.node).x;
-				auto Pw	= GetPositionW		(potentialVisible.node);
-				auto Lq	= GetOrientation	(potentialVisible.node);
-				auto BS = BoundingSphere{ 
-					Lq * potentialVisible.boundingSphere.xyz() + Pw, 
-					Ls * potentialVisible.boundingSphere.w };
-
-				Apply(*potentialVisible.entity,
-					[&](DrawableView& drawable)
-					{
-						if (!drawable.GetDrawable().Skinned && CompareBSAgainstFrustum(&F, BS))
-						{
-							float distance = 0;
-							if (potentialVisible.transparent)
-								PushPV(drawable, T_out);
-							else
-								PushPV(drawable, out);
-						}
-					});
-			}
-		}
+		return out;
 	}
 
 
 	/************************************************************************************************/
 
 
-    UpdateTaskTyped<GetPVSTaskData>& GatherScene(UpdateDispatcher& dispatcher, GraphicScene* scene, CameraHandle C, iAllocator* allocator)
+	using SceneBVHRoot = DynamicBVH<VisibilityHandle>::QueryRoot;
+
+	// What the gather needs from the camera to key entries and pick LODs
+	struct SceneGatherView
 	{
-		auto& task = dispatcher.Add<GetPVSTaskData>(
-			[&](auto& builder, auto& data)
-			{
-				size_t taskMemorySize = KILOBYTE * 2048;
-				data.taskMemory.Init((byte*)allocator->malloc(taskMemorySize), taskMemorySize);
-				data.scene			= scene;
-				data.solid			= PVS{ data.taskMemory };
-				data.transparent	= PVS{ data.taskMemory };
-				data.camera			= C;
+		float3	position;
+		float	lodScale; // 1 / tan(FOV / 2)
+	};
 
-                builder.SetDebugString("Gather Scene");
-			},
-			[](GetPVSTaskData& data)
+
+	static SceneGatherView _GetGatherView(const Camera& camera)
+	{
+		return { GetPositionW(camera.Node), 1.0f / std::tan(camera.FOV / 2.0f) };
+	}
+
+
+	// Pushes the entity's drawable if it is visible and not skinned, keyed for SortPVSByKeys
+	static void _PushVisibleEntity(const VisibilityHandle handle, PVS& out, PVS& T_out, const SceneGatherView& view)
+	{
+		const auto& potentialVisible = SceneVisibilityComponent::GetComponent()[handle];
+
+		if(	!potentialVisible.visable || 
+			!potentialVisible.entity->hasView(DrawableComponent::GetComponentID()))
+			return;
+
+		Apply(*potentialVisible.entity,
+			[&](DrawableView& drawable)
 			{
-                FK_LOG_9("Start PVS gather\n");
+				auto& D = drawable.GetDrawable();
 
-                GatherScene(data.scene, data.camera, data.solid, data.transparent);
-				SortPVS(&data.solid, &CameraComponent::GetComponent().GetCamera(data.camera));
+				if (D.Skinned)
+					return;
 
-                FK_LOG_9("End PVS gather\n");
+				const float		distanceSquared	= (GetPositionW(D.Node) - view.position).magnitudesquared();
+				TriMeshHandle	mesh			= D.MeshHandle;
+
+				// The picked mesh goes into the entry, other gathers can be reading the drawable.
+				// CurrentLOD is only read here, by the one view picking LODs
+				if (D.LODCount && view.lodScale > 0.0f)
+				{
+					const auto		BS			= GetWorldBoundingSphere(potentialVisible);
+					const float		distance	= std::max((BS.xyz() - view.position).magnitude(), 0.0001f);
+					const uint32_t	lod			= SelectDrawableLOD(D, BS.w * view.lodScale / distance);
+
+					D.CurrentLOD	= uint8_t(lod);
+					mesh			= D.LODs[lod].mesh;
+				}
+
+				if (potentialVisible.transparent)
+					PushPV(D, T_out, mesh, CreateTransparentSortingKey(D, distanceSquared));
+				else
+					PushPV(D, out, mesh, CreateSortingKey(D, mesh, distanceSquared));
 			});
+	}
 
-		return task;
+
+	// Entities have at most one drawable, so a subtree can never produce more entries than it has leaves.
+	// visibleOut, if set, receives every entity inside the frustum before the visibility flags are checked.
+	static void _GatherSceneSubtree(const DynamicBVH<VisibilityHandle>& tree, const Frustum& F, const SceneGatherView& view, const SceneBVHRoot root, PVS& out, PVS& T_out, Vector<VisibilityHandle>* visibleOut = nullptr)
+	{
+		const auto& Visibles = SceneVisibilityComponent::GetComponent();
+
+		auto pushVisible = [&](const VisibilityHandle handle)
+		{
+			if (visibleOut)
+				visibleOut->push_back(handle);
+
+			_PushVisibleEntity(handle, out, T_out, view);
+		};
+
+		// Entities in leaves only partially inside the frustum get their spheres tested in batches
+		SphereCullBatch<VisibilityHandle> cullBatch{ F };
+
+		auto gatherEntity = [&](const VisibilityHandle handle, const bool fullyInside)
+		{
+			if (fullyInside)
+				pushVisible(handle);
+			else
+				cullBatch.Push(GetWorldBoundingSphere(Visibles[handle]), handle, pushVisible);
+		};
+
+		// Subtrees fully inside the frustum are accepted without testing their contents, subtrees outside are skipped
+		tree.Query(F, root, gatherEntity);
+		cullBatch.Flush(pushVisible);
 	}
 
 
 	/************************************************************************************************/
 
 
-	void ReleaseSceneAnimation(AnimationClip* AC, iAllocator* Memory)
+	void GatherScene(GraphicScene* SM, CameraHandle Camera, PVS& out, PVS& T_out)
 	{
-		for (size_t II = 0; II < AC->FrameCount; ++II) 
+		FK_ASSERT(&out		!= &T_out);
+		FK_ASSERT(Camera	!= CameraHandle{(unsigned int)INVALIDHANDLE});
+		FK_ASSERT(SM		!= nullptr);
+		FK_ASSERT(&out		!= nullptr);
+		FK_ASSERT(&T_out	!= nullptr);
+
+		const auto&	tree = SM->sceneManagement.tree;
+
+		if (tree.GetRoot() != tree.InvalidNode)
 		{
-			Memory->free(AC->Frames[II].Joints);
-			Memory->free(AC->Frames[II].Poses);
+			const auto view = _GetGatherView(CameraComponent::GetComponent().GetCamera(Camera));
+			_GatherSceneSubtree(tree, GetFrustum(Camera), view, { tree.GetRoot(), false }, out, T_out);
 		}
-
-		Memory->free(AC->Frames);
-		Memory->free(AC->mID);
 	}
 
 
 	/************************************************************************************************/
 
 
-	void BindJoint(GraphicScene* SM, JointHandle Joint, SceneEntityHandle Entity, NodeHandle TargetNode)
+	// fn(handle, viewMask) for every entity whose bounds intersect at least one of the frusta, bit I is frusta[I]
+	template<typename FN>
+	static void _GatherSceneViewMasks(const DynamicBVH<VisibilityHandle>& tree, const Frustum* frusta, const uint32_t frustumCount, FN&& fn)
 	{
-		//SM->TaggedJoints.push_back({ Entity, Joint, TargetNode });
-	}
+		const auto& Visibles = SceneVisibilityComponent::GetComponent();
 
+		tree.QueryMulti(frusta, frustumCount,
+			[&](const VisibilityHandle handle, const uint32_t insideMask, const uint32_t partialMask)
+			{
+				uint32_t viewMask = insideMask;
 
-	/************************************************************************************************/
+				if (partialMask)
+				{
+					const auto BS = GetWorldBoundingSphere(Visibles[handle]);
 
+					for (uint32_t I = 0; I < frustumCount; ++I)
+					{
+						if ((partialMask & (1u << I)) && CompareBSAgainstFrustum(&frusta[I], BS))
+							viewMask |= 1u << I;
+					}
+				}
 
-	bool LoadScene(RenderSystem* RS, GUID_t Guid, GraphicScene& GS_out, iAllocator* allocator, iAllocator* temp)
+				if (viewMask)
+					fn(handle, viewMask);
+			});
+	}
+
+
+	// Lists are left unsorted, like GatherScene
+	void GatherSceneViews(GraphicScene* scene, const SceneViewDesc* views, const size_t viewCount, PVS* solidOut, PVS* transparentOut)
 	{
-		bool Available = isAssetAvailable(Guid);
-		if (Available)
+		const size_t MaxViews = DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta;
+
+		FK_ASSERT(scene != nullptr);
+		FK_ASSERT(viewCount <= MaxViews);
+
+		Frustum			frusta[MaxViews];
+		SceneGatherView	gatherViews[MaxViews];
+
+		for (size_t I = 0; I < viewCount; ++I)
 		{
-			auto RHandle = LoadGameAsset(Guid);
-			auto R		 = GetAsset(RHandle);
+			frusta[I]		= views[I].frustum;
+			gatherViews[I]	= { views[I].position, views[I].lodScale };
+		}
 
-			EXITSCOPE(FreeAsset(RHandle));
+		_GatherSceneViewMasks(scene->sceneManagement.tree, frusta, uint32_t(viewCount),
+			[&](const VisibilityHandle handle, const uint32_t viewMask)
+			{
+				for (size_t I = 0; I < viewCount; ++I)
+				{
+					if (viewMask & (1u << I))
+						_PushVisibleEntity(handle, solidOut[I], transparentOut[I], gatherViews[I]);
+				}
+			});
+	}
 
-			if (R != nullptr) {
-				SceneResourceBlob* sceneBlob = (SceneResourceBlob*)R;
 
-				const auto blockCount = sceneBlob->blockCount;
-				
-				size_t						offset                  = 0;
-				size_t						currentBlock            = 0;
-				SceneNodeBlock*				nodeBlock               = nullptr;
-				ComponentRequirementBlock*	componentRequirement    = nullptr;
-				Vector<NodeHandle>			nodes{ temp };
+	/************************************************************************************************/
 
 
-				while (offset < sceneBlob->ResourceSize && currentBlock < blockCount)
-				{
-					SceneBlock* block = reinterpret_cast<SceneBlock*>(sceneBlob->Buffer + offset);
-					switch (block->blockType)
-					{
-						case SceneBlockType::NodeTable:
-						{
-							// TODO: CRC Check
-							// TODO: more error checking
-							FK_ASSERT(nodeBlock == nullptr, "Multiple Node Blocks Defined!");
-							nodeBlock = reinterpret_cast<SceneNodeBlock*>(block);
+	// Scenes smaller than this are gathered on the task's own thread
+	const size_t GatherParallelThreshold = 2048;
 
-							const auto nodeCount = nodeBlock->header.nodeCount;
-							nodes.reserve(nodeCount);
 
+	// Runs fn(0) ... fn(count - 1), fn(0) on the calling thread. Work items are allocated from temp on the calling thread
+	template<typename FN>
+	static void _RunGatherWork(ThreadManager& threads, iAllocator* temp, const size_t count, FN& fn)
+	{
+		WorkBarrier barrier{ threads, temp };
 
-							for (size_t itr = 0; itr < nodeCount; ++itr)
-							{
-								float3		position;
-								Quaternion	orientation;
-								float3		scale;
+		for (size_t I = 1; I < count; ++I)
+		{
+			auto& workItem = CreateWorkItem([&fn, I] { fn(I); }, temp);
 
-								auto sceneNode = &nodeBlock->nodes[itr];
-								memcpy(&position,		&sceneNode->position, sizeof(float3));
-								memcpy(&orientation,	&sceneNode->orientation, sizeof(orientation));
-								memcpy(&scale,			&sceneNode->scale, sizeof(float3));
+			barrier.AddWork(workItem);
+			PushToLocalQueue(workItem);
+		}
 
-								if (sceneNode->parent == INVALIDHANDLE) // remove root scaling
-									scale = scale / 100;
+		fn(0);
+		barrier.JoinLocal();
+	}
 
-								auto newNode = GetNewNode();
-								SetOrientationL	(newNode, orientation);
-								SetPositionL	(newNode, position);
-								SetScale		(newNode, { scale[0], scale[0], scale[0] }); // Engine only supports uniform scaling, still stores all 3 for future stuff
-								SetFlag			(newNode, SceneNodes::StateFlags::SCALE);
 
-								if (sceneNode->parent != INVALIDHANDLE)
-									SetParentNode(nodes[sceneNode->parent], newNode);
+	// Splits the BVH into subtrees gathered into worker local PVS's. Each worker keys and sorts its own solid list,
+	// the lists are then copied into the task's PVS's in parallel and the sorted runs merged pairwise.
+	static void _GatherSceneParallel(GetPVSTaskData& data, Camera& camera)
+	{
+		const auto&		tree			= data.scene->sceneManagement.tree;
+		const auto		F				= GetFrustum(data.camera);
+		const auto		view			= _GetGatherView(camera);
+		const size_t	workerCount		= data.threads->GetThreadCount() + 1;
 
-								nodes.push_back(newNode);
-							}
-						}	break;
-						case SceneBlockType::ComponentRequirementTable:
-						case SceneBlockType::Entity:
-						{
-							FK_ASSERT(nodeBlock != nullptr, "No Node Block defined!");
-							//FK_ASSERT(componentRequirement != nullptr, "No Component Requirement Block defined!");
+		SceneBVHRoot	roots[DynamicBVH<VisibilityHandle>::MaxPartitionSize];
+		const size_t	rootCount = tree.PartitionQuery(F, roots, workerCount * 4);
 
-                            EntityBlock::Header entityBlock;
-                            memcpy(&entityBlock, block, sizeof(entityBlock));
-							auto& gameObject = allocator->allocate<GameObject>(allocator);
+		if (data.cache)
+			data.cache->visible.clear();
 
-                            size_t itr                  = 0;
-                            size_t componentOffset      = 0;
-                            const size_t componentCount = entityBlock.componentCount;
+		if (!rootCount)
+			return;
 
-                            while(true)
-                            {
-                                if (block->buffer + componentOffset >= reinterpret_cast<byte*>(block) + entityBlock.blockSize)
-                                    break;
+		struct GatherChunk
+		{
+			SceneBVHRoot	root;
+			PVS				solid;
+			PVS				transparent;
+			Vector<VisibilityHandle>	visible;
+			uint64_t*		keyScratch;
+			PVEntry*		entryScratch;
+			size_t			solidOffset;
+			size_t			transparentOffset;
+		};
 
-                                ComponentBlock::Header component;
-                                memcpy(&component, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(component));
+		auto sortOrder = [](const PVEntry& R, const PVEntry& L) -> bool
+		{
+			return ((size_t)R.SortID < (size_t)L.SortID);
+		};
 
-                                const ComponentID ID = component.componentID;
-                                if (component.blockType != EntityComponent) // malformed blob?
-                                    break;
-                                else if (ID == SceneNodeView<>::GetComponentID())
-                                {
-                                    SceneNodeComponentBlob blob;
-                                    memcpy(&blob, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(blob));
+		// Worker local buffers are sized up front, workers never allocate
+		GatherChunk chunks[DynamicBVH<VisibilityHandle>::MaxPartitionSize];
 
-                                    auto node = nodes[blob.nodeIdx];
-                                    gameObject.AddView<SceneNodeView<>>(node);
+		for (size_t I = 0; I < rootCount; ++I)
+		{
+			const size_t leaves = tree[roots[I].node].leaves;
+
+			chunks[I].root			= roots[I];
+			chunks[I].solid			= PVS{ data.taskMemory, leaves };
+			chunks[I].transparent	= PVS{ data.taskMemory, leaves };
+			chunks[I].visible		= Vector<VisibilityHandle>{ data.taskMemory, data.cache ? leaves : 0 };
+			chunks[I].keyScratch	= (uint64_t*)data.taskMemory._aligned_malloc(sizeof(uint64_t) * leaves);
+			chunks[I].entryScratch	= (PVEntry*)data.taskMemory._aligned_malloc(sizeof(PVEntry) * leaves);
+		}
 
-                                    if (!blob.excludeFromScene)
+		auto gatherChunk = [&](GatherChunk& chunk)
+		{
+			_GatherSceneSubtree(tree, F, view, chunk.root, chunk.solid, chunk.transparent, data.cache ? &chunk.visible : nullptr);
+
+			SortPVSByKeys(chunk.solid.begin(), chunk.solid.end(), chunk.keyScratch, chunk.entryScratch);
+		};
+
+		auto runParallel = [&](auto& fn, const size_t count)
+		{
+			_RunGatherWork(*data.threads, data.taskMemory, count, fn);
+		};
+
+		auto gatherPass = [&](const size_t I) { gatherChunk(chunks[I]); };
+		runParallel(gatherPass, rootCount);
+
+		size_t solidCount		= 0;
+		size_t transparentCount	= 0;
+
+		for (size_t I = 0; I < rootCount; ++I)
+		{
+			chunks[I].solidOffset		= solidCount;
+			chunks[I].transparentOffset	= transparentCount;
+
+			solidCount			+= chunks[I].solid.size();
+			transparentCount	+= chunks[I].transparent.size();
+		}
+
+		data.solid.reserve(solidCount);
+		data.solid.resize(solidCount);
+		data.transparent.reserve(transparentCount);
+		data.transparent.resize(transparentCount);
+
+		auto copyPass = [&](const size_t I)
+		{
+			std::copy(chunks[I].solid.begin(),			chunks[I].solid.end(),			data.solid.begin() + chunks[I].solidOffset);
+			std::copy(chunks[I].transparent.begin(),	chunks[I].transparent.end(),	data.transparent.begin() + chunks[I].transparentOffset);
+		};
+		runParallel(copyPass, rootCount);
+
+		if (data.cache)
+		{
+			for (size_t I = 0; I < rootCount; ++I)
+				for (auto handle : chunks[I].visible)
+					data.cache->visible.push_back(handle);
+		}
+
+		// Merge the sorted runs pairwise, ping-ponging between the PVS and a scratch buffer
+		size_t runOffsets[DynamicBVH<VisibilityHandle>::MaxPartitionSize + 1];
+		size_t runCount = rootCount;
+
+		for (size_t I = 0; I < rootCount; ++I)
+			runOffsets[I] = chunks[I].solidOffset;
+
+		runOffsets[runCount] = solidCount;
+
+		if (runCount < 2)
+			return;
+
+		PVS scratch{ data.taskMemory, solidCount };
+		scratch.resize(solidCount);
+
+		PVEntry* source	= data.solid.begin();
+		PVEntry* dest	= scratch.begin();
+
+		while (runCount > 1)
+		{
+			auto mergePass = [&](const size_t I)
+			{
+				const size_t begin	= runOffsets[2 * I];
+				const size_t middle	= runOffsets[std::min(2 * I + 1, runCount)];
+				const size_t end	= runOffsets[std::min(2 * I + 2, runCount)];
+
+				std::merge(
+					source + begin,		source + middle,
+					source + middle,	source + end,
+					dest + begin, sortOrder);
+			};
+			const size_t mergedCount = (runCount + 1) / 2;
+			runParallel(mergePass, mergedCount);
+
+			for (size_t I = 0; I <= mergedCount; ++I)
+				runOffsets[I] = runOffsets[std::min(2 * I, runCount)];
+
+			runCount = mergedCount;
+			std::swap(source, dest);
+		}
+
+		if (source != data.solid.begin())
+			std::copy(source, source + solidCount, data.solid.begin());
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Camera moves larger than these since the cache was built fall back to a full gather
+	const float VisibilityCacheMaxTranslation	= 1.0f;
+	const float VisibilityCacheMinAlignment		= 0.996f; // ~5 degrees
+
+
+	struct _CameraPose
+	{
+		float3 position;
+		float3 forward;
+		float3 up;
+	};
+
+
+	static _CameraPose _GetCameraPose(const Camera& camera)
+	{
+		const auto orientation = GetOrientation(camera.Node);
+
+		return {
+			GetPositionW(camera.Node),
+			orientation * float3{ 0, 0, -1 },
+			orientation * float3{ 0, 1, 0 } };
+	}
+
+
+	static bool _VisibilityCacheUsable(const SceneVisibilityCache& cache, const SceneBVH& bvh, const Camera& camera, const _CameraPose& pose)
+	{
+		if (!cache.valid || cache.version != bvh.version)
+			return false;
+
+		// Moved entities are only known for the last refit
+		if (cache.refitCount != bvh.refitCount && cache.refitCount + 1 != bvh.refitCount)
+			return false;
+
+		if (cache.FOV			!= camera.FOV	|| 
+			cache.aspectRatio	!= camera.AspectRatio ||
+			cache.nearPlane		!= camera.Near	||
+			cache.farPlane		!= camera.Far)
+			return false;
+
+		return
+			(pose.position - cache.position).magnitudesquared() <= VisibilityCacheMaxTranslation * VisibilityCacheMaxTranslation &&
+			pose.forward.dot(cache.forward)	>= VisibilityCacheMinAlignment &&
+			pose.up.dot(cache.up)			>= VisibilityCacheMinAlignment;
+	}
+
+
+	static void _StoreVisibilityCachePose(SceneVisibilityCache& cache, const SceneBVH& bvh, const Frustum& F, const Camera& camera, const _CameraPose& pose)
+	{
+		cache.frustum		= F;
+		cache.position		= pose.position;
+		cache.forward		= pose.forward;
+		cache.up			= pose.up;
+		cache.FOV			= camera.FOV;
+		cache.aspectRatio	= camera.AspectRatio;
+		cache.nearPlane		= camera.Near;
+		cache.farPlane		= camera.Far;
+		cache.refitCount	= bvh.refitCount;
+		cache.version		= bvh.version;
+		cache.valid			= true;
+	}
+
+
+	// Updates last frame's results instead of gathering the whole scene. Cached entities that didn't move are kept,
+	// and retested only if the camera moved. Moved entities are retested. If the camera moved, the BVH is queried for
+	// entities that came into view, skipping subtrees that were fully inside last frame's frustum.
+	static void _GatherSceneCached(GetPVSTaskData& data, const Frustum& F, const SceneGatherView& view, const bool cameraMoved)
+	{
+		auto&		cache		= *data.cache;
+		auto&		visible		= cache.visible;
+		const auto&	bvh			= data.scene->sceneManagement;
+		const auto&	Visibles	= SceneVisibilityComponent::GetComponent();
+
+		// A cache built after this frame's refit has already seen the moved entities
+		const bool checkMoved = cache.refitCount != bvh.refitCount;
+
+		auto hasMoved = [&](const VisibilityHandle handle) -> bool
+		{
+			return checkMoved && GetFlag(Visibles[handle].node, SceneNodes::UPDATED);
+		};
+
+		// Last frame's entities, to skip them in the delta query. Open addressing, at most half full
+		const uint32_t	emptySlot	= 0xFFFFFFFF;
+		uint32_t*		cached		= nullptr;
+		size_t			cachedMask	= 0;
+
+		if (cameraMoved)
+		{
+			size_t tableSize = 64;
+			while (tableSize < visible.size() * 2)
+				tableSize *= 2;
+
+			cached		= (uint32_t*)data.taskMemory.malloc(tableSize * sizeof(uint32_t));
+			cachedMask	= tableSize - 1;
+
+			for (size_t I = 0; I < tableSize; ++I)
+				cached[I] = emptySlot;
+
+			for (auto handle : visible)
+			{
+				size_t slot = (handle.to_uint() * 2654435761u) & cachedMask;
+				while (cached[slot] != emptySlot)
+					slot = (slot + 1) & cachedMask;
+
+				cached[slot] = handle.to_uint();
+			}
+		}
+
+		auto wasCached = [&](const VisibilityHandle handle) -> bool
+		{
+			for (size_t slot = (handle.to_uint() * 2654435761u) & cachedMask; cached[slot] != emptySlot; slot = (slot + 1) & cachedMask)
+				if (cached[slot] == handle.to_uint())
+					return true;
+
+			return false;
+		};
+
+		// Compact the kept entries in place, the batch never writes past the entry being read
+		size_t	kept = 0;
+		auto	keep = [&](const VisibilityHandle handle) { visible[kept++] = handle; };
+
+		SphereCullBatch<VisibilityHandle> cullBatch{ F };
+
+		for (size_t I = 0; I < visible.size(); ++I)
+		{
+			const auto handle = visible[I];
+
+			if (hasMoved(handle))
+				continue;
+
+			if (cameraMoved)
+				cullBatch.Push(GetWorldBoundingSphere(Visibles[handle]), handle, keep);
+			else
+				keep(handle);
+		}
+
+		cullBatch.Flush(keep);
+		visible.resize(kept);
+
+		auto append = [&](const VisibilityHandle handle) { visible.push_back(handle); };
+
+		if (checkMoved)
+		{
+			for (auto handle : bvh.moved)
+				cullBatch.Push(GetWorldBoundingSphere(Visibles[handle]), handle, append);
+		}
+
+		if (cameraMoved)
+		{
+			bvh.tree.QueryDelta(F, cache.frustum,
+				[&](const VisibilityHandle handle, const bool fullyInside)
+				{
+					if (hasMoved(handle) || wasCached(handle))
+						return;
+
+					if (fullyInside)
+						append(handle);
+					else
+						cullBatch.Push(GetWorldBoundingSphere(Visibles[handle]), handle, append);
+				});
+		}
+
+		cullBatch.Flush(append);
+
+		for (auto handle : visible)
+			_PushVisibleEntity(handle, data.solid, data.transparent, view);
+	}
+
+
+	/************************************************************************************************/
+
+
+	struct OccluderCandidate
+	{
+		const OccluderMesh*	mesh;
+		float4x4			WT;
+		float				score;
+	};
+
+
+	// Entries are tested in chunks of this many when the task has worker threads
+	const size_t OcclusionTestChunkSize = 256;
+
+
+	// Task memory _OcclusionCullPVS needs for a scene of capacity entities
+	static size_t _GetOcclusionCullMemorySize(const SoftwareOcclusionCuller& culler, const size_t capacity, const ThreadManager* threads)
+	{
+		const size_t occluderBudget	= culler.GetOccluderBudget();
+		const size_t workItemSize	= sizeof(LambdaWork<void(*)()>) + 32; // Work lambdas capture a reference and an index
+		const size_t bandCount		= threads ? threads->GetThreadCount() + 1 : 1;
+		const size_t chunkCount		= capacity / OcclusionTestChunkSize + 2; // Solid and transparent lists round up separately
+
+		// Every entity can be an occluder candidate, and gets one visibility flag in whichever list it is in
+		const size_t candidateSize	= sizeof(OccluderCandidate) * capacity + 16;
+		const size_t occluderSize	= sizeof(OccluderInstance) * occluderBudget + 16;
+		const size_t visibleSize	= sizeof(bool) * capacity + 32;
+		const size_t workSize		= threads ? workItemSize * (occluderBudget + bandCount + chunkCount) : 0;
+
+		return candidateSize + occluderSize + visibleSize + culler.GetRasterizeTempSize(occluderBudget) + workSize;
+	}
+
+
+	// Rasterizes the largest on screen occluders found in the PVS, then drops every entry whose bounds are hidden.
+	// Removal keeps the order of the remaining entries so sorted lists stay sorted.
+	static void _OcclusionCullPVS(GetPVSTaskData& data, Camera& camera)
+	{
+		auto&			culler			= *data.occlusion;
+		const float3	cameraPosition	= GetPositionW(camera.Node);
+
+		culler.SetView(cameraPosition, GetOrientation(camera.Node), camera.FOV, camera.AspectRatio, camera.Near);
+		culler.Clear();
+
+		// Reserved up front, growing would leave every outgrown buffer behind in the task's stack allocator
+		Vector<OccluderCandidate> candidates{ data.taskMemory, data.solid.size() };
+
+		auto findOccluders = [&](PVS& pvs)
+		{
+			for (auto& entry : pvs)
+			{
+				const TriMeshHandle	mesh		= (entry.D->Occluder != InvalidHandle_t) ? entry.D->Occluder : entry.D->MeshHandle;
+				const OccluderMesh*	occluder	= culler.FindOccluder(mesh);
+
+				if (!occluder)
+					continue;
+
+				const float4x4	WT			= GetWT(entry.D->Node);
+				const float3	position	= { WT[0][3], WT[1][3], WT[2][3] };
+				const float		scale		= std::max({
+					float3{ WT[0][0], WT[1][0], WT[2][0] }.magnitude(),
+					float3{ WT[0][1], WT[1][1], WT[2][1] }.magnitude(),
+					float3{ WT[0][2], WT[1][2], WT[2][2] }.magnitude() });
+
+				// Approximate projected size
+				const float distance	= (position - cameraPosition).magnitude();
+				const float radius		= culler.GetOccluderRadius(mesh) * scale;
+
+				candidates.push_back({ occluder, WT, radius / std::max(distance, camera.Near) });
+			}
+		};
+
+		findOccluders(data.solid);
+
+		if (!candidates.size())
+			return;
+
+		const size_t occluderCount = std::min(candidates.size(), culler.GetOccluderBudget());
+
+		std::partial_sort(candidates.begin(), candidates.begin() + occluderCount, candidates.end(),
+			[](const OccluderCandidate& lhs, const OccluderCandidate& rhs) { return lhs.score > rhs.score; });
+
+		Vector<OccluderInstance> occluders{ data.taskMemory, occluderCount };
+		for (size_t I = 0; I < occluderCount; ++I)
+			occluders.push_back({ candidates[I].mesh, candidates[I].WT });
+
+		culler.RasterizeOccluders(occluders.begin(), occluders.size(), data.threads, data.taskMemory);
+
+		auto cullPVS = [&](PVS& pvs)
+		{
+			if (!pvs.size())
+				return;
+
+			Vector<bool> visible{ data.taskMemory, pvs.size() };
+			visible.resize(pvs.size());
+
+			auto testRange = [&](const size_t begin, const size_t end)
+			{
+				for (size_t I = begin; I < end; ++I)
+				{
+					const Drawable* drawable = pvs[I].D;
+					visible[I] = culler.TestBox(GetMeshResource(drawable->MeshHandle)->AABB, GetWT(drawable->Node));
+				}
+			};
+
+			const size_t chunkSize	= OcclusionTestChunkSize;
+			const size_t chunkCount	= (pvs.size() + chunkSize - 1) / chunkSize;
+
+			if (data.threads && chunkCount > 1)
+			{
+				auto testChunk = [&](const size_t I) { testRange(I * chunkSize, std::min((I + 1) * chunkSize, pvs.size())); };
+				_RunGatherWork(*data.threads, data.taskMemory, chunkCount, testChunk);
+			}
+			else
+				testRange(0, pvs.size());
+
+			size_t kept = 0;
+			for (size_t I = 0; I < pvs.size(); ++I)
+			{
+				if (visible[I])
+					pvs[kept++] = pvs[I];
+			}
+
+			pvs.resize(kept);
+		};
+
+		cullPVS(data.solid);
+		cullPVS(data.transparent);
+	}
+
+
+	/************************************************************************************************/
+
+
+    UpdateTaskTyped<GetPVSTaskData>& GatherScene(UpdateDispatcher& dispatcher, GraphicScene* scene, CameraHandle C, iAllocator* allocator, SoftwareOcclusionCuller* occlusion)
+	{
+		auto& task = dispatcher.Add<GetPVSTaskData>(
+			[&](auto& builder, auto& data)
+			{
+				// Worker local lists plus the merged lists can need up to four entries per entity,
+				// the visibility cache up to five words per entity for worker lists and its lookup table.
+				// Key sorting needs a key and an entry of scratch per entity, once for the workers and once for the task
+				const size_t capacity		= scene->sceneManagement.tree.size();
+				const size_t occlusionSize	= occlusion ? _GetOcclusionCullMemorySize(*occlusion, capacity, dispatcher.threads) : 0;
+				const size_t cacheSize		= capacity * sizeof(uint32_t) * 5;
+				const size_t sortSize		= capacity * (sizeof(uint64_t) + sizeof(PVEntry)) * 2;
+				const size_t taskMemorySize	= std::max<size_t>(KILOBYTE * 2048, capacity * sizeof(PVEntry) * 4 + occlusionSize + cacheSize + sortSize + KILOBYTE * 64);
+
+				auto& cache = scene->sceneManagement.GetVisibilityCache(C);
+				cache.visible.reserve(capacity);
+
+				data.taskMemory.Init((byte*)allocator->malloc(taskMemorySize), taskMemorySize);
+				data.scene			= scene;
+				data.threads		= dispatcher.threads;
+				data.capacity		= capacity;
+				data.occlusion		= occlusion;
+				data.cache			= &cache;
+				data.solid			= PVS{ data.taskMemory };
+				data.transparent	= PVS{ data.taskMemory };
+				data.camera			= C;
+
+                builder.SetDebugString("Gather Scene");
+			},
+			[](GetPVSTaskData& data)
+			{
+                FK_LOG_9("Start PVS gather\n");
+
+				auto&			camera		= CameraComponent::GetComponent().GetCamera(data.camera);
+				const auto&		bvh			= data.scene->sceneManagement;
+				const size_t	entityCount	= bvh.tree.size();
+				const auto		F			= GetFrustum(data.camera);
+				const auto		pose		= _GetCameraPose(camera);
+				const auto		view		= _GetGatherView(camera);
+
+				if (_VisibilityCacheUsable(*data.cache, bvh, camera, pose))
+				{
+					const bool cameraMoved =
+						(pose.position	- data.cache->position).magnitudesquared()	!= 0.0f ||
+						(pose.forward	- data.cache->forward).magnitudesquared()	!= 0.0f ||
+						(pose.up		- data.cache->up).magnitudesquared()		!= 0.0f;
+
+					_GatherSceneCached(data, F, view, cameraMoved);
+					SortPVSByKeys(data.solid, data.taskMemory);
+				}
+				else if (data.threads && entityCount >= GatherParallelThreshold && entityCount <= data.capacity)
+					_GatherSceneParallel(data, camera);
+				else
+				{
+					data.cache->visible.clear();
+
+					if (bvh.tree.GetRoot() != bvh.tree.InvalidNode)
+						_GatherSceneSubtree(bvh.tree, F, view, { bvh.tree.GetRoot(), false }, data.solid, data.transparent, &data.cache->visible);
+
+					SortPVSByKeys(data.solid, data.taskMemory);
+				}
+
+				SortPVSByKeys(data.transparent, data.taskMemory);
+
+				_StoreVisibilityCachePose(*data.cache, bvh, F, camera, pose);
+
+				if (data.occlusion)
+					_OcclusionCullPVS(data, camera);
+
+                FK_LOG_9("End PVS gather\n");
+			});
+
+		return task;
+	}
+
+
+	/************************************************************************************************/
+
+
+	static bool _HandleLess(const VisibilityHandle lhs, const VisibilityHandle rhs)
+	{
+		return lhs.to_uint() < rhs.to_uint();
+	}
+
+
+	static bool _ShadowCastersChanged(const PointLightShadowCache& cache, const SceneBVH& bvh, const float3 position, const float radius)
+	{
+		if (!cache.valid || cache.version != bvh.version || cache.radius != radius ||
+			(cache.position - position).magnitudesquared() != 0.0f)
+			return true;
+
+		if (cache.refitCount == bvh.refitCount)
+			return false;
+
+		// Only the last refit's moved list is kept
+		if (cache.refitCount + 1 != bvh.refitCount)
+			return true;
+
+		const auto& Visibles = SceneVisibilityComponent::GetComponent();
+
+		for (auto handle : bvh.moved)
+		{
+			const auto	BS		= GetWorldBoundingSphere(Visibles[handle]);
+			const float	radii	= BS.w + radius;
+
+			if ((BS.xyz() - position).magnitudesquared() <= radii * radii ||
+				std::binary_search(cache.casters.begin(), cache.casters.end(), handle, _HandleLess))
+				return true;
+		}
+
+		return false;
+	}
+
+
+	PointLightShadowGatherTask& GatherPointLightShadowCasters(UpdateDispatcher& dispatcher, GraphicScene* scene, PointLightGatherTask& pointLights, iAllocator* allocator)
+	{
+		return dispatcher.Add<PointLightShadowGatherData>(
+			[&](UpdateDispatcher::UpdateBuilder& builder, PointLightShadowGatherData& data)
+			{
+				builder.AddInput(pointLights);
+				builder.SetDebugString("Point Light Shadow Gather");
+
+				// Caches can't be created from the task, make sure every light in the scene has one
+				auto& bvh = scene->sceneManagement;
+				if (bvh.shadowCacheVersion != bvh.version)
+				{
+					auto& visables = SceneVisibilityComponent::GetComponent();
+
+					for (auto entity : scene->sceneEntities)
+						Apply(*visables[entity].entity, [&](PointLightView& pointLight) { bvh.GetShadowCache(pointLight); });
+
+					bvh.shadowCacheVersion = bvh.version;
+				}
+
+				// Every light in the scene has a cache, so at most that many lights are gathered. Faces get room for
+				// entryBudget entries in total, lights past that wait for the next frame.
+				// An entity is in a face at most once, so sort scratch for one face is bounded by the entity count
+				const size_t capacity		= scene->sceneManagement.tree.size();
+				const size_t lightCapacity	= std::max<size_t>(bvh.shadowCaches.size(), 1);
+				const size_t entryBudget	= std::max<size_t>(capacity * 6, 4096);
+				const size_t lightsSize		= sizeof(PointLightShadowViews) * lightCapacity + 16;
+				const size_t facesSize		= sizeof(PVEntry) * entryBudget + lightCapacity * 6 * 16;
+				const size_t sortSize		= (sizeof(uint64_t) + sizeof(PVEntry)) * capacity + 32;
+				const size_t taskMemorySize	= lightsSize + facesSize + sortSize + KILOBYTE * 4;
+
+				data.taskMemory.Init((byte*)allocator->malloc(taskMemorySize), taskMemorySize);
+				data.scene			= scene;
+				data.pointLights	= &pointLights.GetData().pointLights;
+				data.capacity		= capacity;
+				data.lightCapacity	= lightCapacity;
+				data.entryBudget	= entryBudget;
+				data.lights			= nullptr;
+				data.lightCount		= 0;
+			},
+			[](PointLightShadowGatherData& data)
+			{
+				FK_LOG_9("Start point light shadow gather\n");
+
+				auto&			bvh			= data.scene->sceneManagement;
+				auto&			lights		= PointLightComponent::GetComponent();
+				const size_t	lightCount	= std::min(data.pointLights->size(), data.lightCapacity);
+				const size_t	capacity	= data.capacity;
+				size_t			entryBudget	= data.entryBudget;
+
+				FK_ASSERT(data.pointLights->size() <= data.lightCapacity, "Point light without a shadow cache!");
+
+				data.lights		= (PointLightShadowViews*)data.taskMemory._aligned_malloc(sizeof(PointLightShadowViews) * data.lightCapacity);
+				data.lightCount	= lightCount;
+
+				uint64_t*	keyScratch		= capacity ? (uint64_t*)data.taskMemory._aligned_malloc(sizeof(uint64_t) * capacity) : nullptr;
+				PVEntry*	entryScratch	= capacity ? (PVEntry*)data.taskMemory._aligned_malloc(sizeof(PVEntry) * capacity) : nullptr;
+
+				// Several lights' faces are tested in each walk of the BVH
+				const uint32_t			LightsPerWalk	= DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta / 6;
+				size_t					dirty[DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta / 6];
+				PointLightShadowCache*	dirtyCaches[DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta / 6];
+				size_t					dirtyCount		= 0;
+
+				PVS transparent{ data.taskMemory };	// Transparent entities don't cast shadows, cleared after every push
+
+				// Walks the BVH twice, once to size the faces and once to fill them, so the task memory holds exactly
+				// what was gathered. Lights that don't fit in what is left of the budget are retried next frame.
+				auto gatherDirty = [&]()
+				{
+					if (!dirtyCount)
+						return;
+
+					Frustum			frusta[DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta];
+					SceneGatherView	views[DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta];
+					uint32_t		viewSizes[DynamicBVH<VisibilityHandle>::MaxMultiQueryFrusta] = {};
+					const uint32_t	viewCount = uint32_t(dirtyCount * 6);
+
+					for (size_t I = 0; I < dirtyCount; ++I)
+					{
+						auto&			light		= data.lights[dirty[I]];
+						const auto&		pointLight	= lights[light.pointLight];
+						const float3	position	= GetPositionW(pointLight.Position);
+
+						for (uint32_t face = 0; face < 6; ++face)
+						{
+							frusta[I * 6 + face]	= GetCubeFaceFrustum(position, pointLight.R, face);
+							views[I * 6 + face]		= { position, 0.0f };
+						}
+					}
+
+					_GatherSceneViewMasks(bvh.tree, frusta, viewCount,
+						[&](const VisibilityHandle handle, uint32_t viewMask)
+						{
+							for (uint32_t view = 0; view < viewCount; ++view)
+							{
+								if (viewMask & (1u << view))
+									viewSizes[view]++;
+							}
+						});
+
+					uint32_t acceptedMask = 0;
+
+					for (size_t I = 0; I < dirtyCount; ++I)
+					{
+						auto&	light		= data.lights[dirty[I]];
+						auto&	cache		= *dirtyCaches[I];
+						size_t	lightSize	= 0;
+
+						for (uint32_t face = 0; face < 6; ++face)
+							lightSize += viewSizes[I * 6 + face];
+
+						if (lightSize > entryBudget)
+						{
+							light.dirty	= false;
+							cache.valid	= false;
+							continue;
+						}
+
+						entryBudget		-= lightSize;
+						acceptedMask	|= 0x3Fu << (I * 6);
+
+						cache.casters.clear();
+						cache.casters.reserve(lightSize);
+
+						for (uint32_t face = 0; face < 6; ++face)
+							light.faces[face].reserve(viewSizes[I * 6 + face]);
+					}
+
+					if (acceptedMask)
+					{
+						_GatherSceneViewMasks(bvh.tree, frusta, viewCount,
+							[&](const VisibilityHandle handle, uint32_t viewMask)
+							{
+								viewMask &= acceptedMask;
+
+								for (uint32_t view = 0; view < viewCount; ++view)
+								{
+									if (!(viewMask & (1u << view)))
+										continue;
+
+									auto& light = data.lights[dirty[view / 6]];
+
+									dirtyCaches[view / 6]->casters.push_back(handle);
+									_PushVisibleEntity(handle, light.faces[view % 6], transparent, views[view]);
+									transparent.clear();
+								}
+							});
+					}
+
+					for (size_t I = 0; I < dirtyCount; ++I)
+					{
+						auto& light = data.lights[dirty[I]];
+						auto& cache = *dirtyCaches[I];
+
+						if (!light.dirty)
+							continue;
+
+						std::sort(cache.casters.begin(), cache.casters.end(), _HandleLess);
+						cache.casters.resize(std::unique(cache.casters.begin(), cache.casters.end()) - cache.casters.begin());
+
+						for (auto& face : light.faces)
+						{
+							FK_ASSERT(face.size() <= capacity);
+
+							if (face.size() > 1)
+								SortPVSByKeys(face.begin(), face.end(), keyScratch, entryScratch);
+						}
+					}
+
+					dirtyCount = 0;
+				};
+
+				for (size_t I = 0; I < lightCount; ++I)
+				{
+					const auto		handle		= (*data.pointLights)[I];
+					const auto&		pointLight	= lights[handle];
+					const float3	position	= GetPositionW(pointLight.Position);
+					auto&			cache		= bvh.GetShadowCache(handle);
+					auto&			light		= *new(data.lights + I) PointLightShadowViews{ handle, false };
+
+					for (auto& face : light.faces)
+						face = PVS{ data.taskMemory };
+
+					if (!_ShadowCastersChanged(cache, bvh, position, pointLight.R))
+					{
+						cache.refitCount = bvh.refitCount;
+						continue;
+					}
+
+					light.dirty			= true;
+					cache.position		= position;
+					cache.radius		= pointLight.R;
+					cache.refitCount	= bvh.refitCount;
+					cache.version		= bvh.version;
+					cache.valid			= true;
+
+					dirty[dirtyCount]		= I;
+					dirtyCaches[dirtyCount]	= &cache;
+					dirtyCount++;
+
+					if (dirtyCount == LightsPerWalk)
+						gatherDirty();
+				}
+
+				gatherDirty();
+
+				FK_LOG_9("End point light shadow gather\n");
+			});
+	}
+
+
+	/************************************************************************************************/
+
+
+	void ReleaseSceneAnimation(AnimationClip* AC, iAllocator* Memory)
+	{
+		for (size_t II = 0; II < AC->FrameCount; ++II) 
+		{
+			Memory->free(AC->Frames[II].Joints);
+			Memory->free(AC->Frames[II].Poses);
+		}
+
+		Memory->free(AC->Frames);
+		Memory->free(AC->mID);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void BindJoint(GraphicScene* SM, JointHandle Joint, SceneEntityHandle Entity, NodeHandle TargetNode)
+	{
+		//SM->TaggedJoints.push_back({ Entity, Joint, TargetNode });
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Loads every mesh the scene's drawables reference in one batch, read in package order rather than
+	// scene order. The drawables then find their blobs already loaded when their views are created.
+	void PreloadSceneMeshes(SceneResourceBlob* sceneBlob, iAllocator* temp)
+	{
+		Vector<GUID_t> meshes{ temp };
+
+		size_t offset		= 0;
+		size_t currentBlock	= 0;
+
+		while (offset < sceneBlob->ResourceSize && currentBlock < sceneBlob->blockCount)
+		{
+			SceneBlock* block = reinterpret_cast<SceneBlock*>(sceneBlob->Buffer + offset);
+
+			if (block->blockType == SceneBlockType::Entity)
+			{
+				EntityBlock::Header entityBlock;
+				memcpy(&entityBlock, block, sizeof(entityBlock));
+
+				size_t componentOffset = 0;
+
+				for (size_t itr = 0; itr < entityBlock.componentCount; ++itr)
+				{
+					if (sizeof(entityBlock) + componentOffset + sizeof(ComponentBlock::Header) > entityBlock.blockSize)
+						break;
+
+					ComponentBlock::Header component;
+					memcpy(&component, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(component));
+
+					if (component.blockType != EntityComponent || !component.blockSize) // malformed blob?
+						break;
+
+					if (component.componentID == DrawableComponentID && component.blockSize >= sizeof(DrawableComponentBlob))
+					{
+						DrawableComponentBlob drawable;
+						memcpy(&drawable, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(drawable));
+
+						auto [triMesh, loaded] = FindMesh(drawable.resourceID);
+						if (!loaded)
+							meshes.push_back(drawable.resourceID);
+					}
+
+					componentOffset += component.blockSize;
+				}
+			}
+
+			currentBlock++;
+			offset += block->blockSize;
+		}
+
+		if (!meshes.size())
+			return;
+
+		Vector<AssetHandle> handles{ temp };
+		handles.resize(meshes.size());
+
+		LoadGameAssets(meshes.begin(), meshes.size(), handles.begin(), temp);
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool LoadScene(RenderSystem* RS, GUID_t Guid, GraphicScene& GS_out, iAllocator* allocator, iAllocator* temp)
+	{
+		bool Available = isAssetAvailable(Guid);
+		if (Available)
+		{
+			auto RHandle = LoadGameAsset(Guid);
+			auto R		 = GetAsset(RHandle);
+
+			EXITSCOPE(FreeAsset(RHandle));
+
+			if (R != nullptr) {
+				SceneResourceBlob* sceneBlob = (SceneResourceBlob*)R;
+
+				PreloadSceneMeshes(sceneBlob, temp);
+
+				const auto blockCount = sceneBlob->blockCount;
+				
+				size_t						offset                  = 0;
+				size_t						currentBlock            = 0;
+				SceneNodeBlock*				nodeBlock               = nullptr;
+				ComponentRequirementBlock*	componentRequirement    = nullptr;
+				Vector<NodeHandle>			nodes{ temp };
+
+
+				while (offset < sceneBlob->ResourceSize && currentBlock < blockCount)
+				{
+					SceneBlock* block = reinterpret_cast<SceneBlock*>(sceneBlob->Buffer + offset);
+					switch (block->blockType)
+					{
+						case SceneBlockType::NodeTable:
+						{
+							// TODO: CRC Check
+							// TODO: more error checking
+							FK_ASSERT(nodeBlock == nullptr, "Multiple Node Blocks Defined!");
+							nodeBlock = reinterpret_cast<SceneNodeBlock*>(block);
+
+							const auto nodeCount = nodeBlock->header.nodeCount;
+							nodes.reserve(nodeCount);
+
+
+							for (size_t itr = 0; itr < nodeCount; ++itr)
+							{
+								float3		position;
+								Quaternion	orientation;
+								float3		scale;
+
+								auto sceneNode = &nodeBlock->nodes[itr];
+								memcpy(&position,		&sceneNode->position, sizeof(float3));
+								memcpy(&orientation,	&sceneNode->orientation, sizeof(orientation));
+								memcpy(&scale,			&sceneNode->scale, sizeof(float3));
+
+								if (sceneNode->parent == INVALIDHANDLE) // remove root scaling
+									scale = scale / 100;
+
+								auto newNode = GetNewNode();
+								SetOrientationL	(newNode, orientation);
+								SetPositionL	(newNode, position);
+								SetScale		(newNode, { scale[0], scale[0], scale[0] }); // Engine only supports uniform scaling, still stores all 3 for future stuff
+								SetFlag			(newNode, SceneNodes::StateFlags::SCALE);
+
+								if (sceneNode->parent != INVALIDHANDLE)
+									SetParentNode(nodes[sceneNode->parent], newNode);
+
+								nodes.push_back(newNode);
+							}
+						}	break;
+						case SceneBlockType::ComponentRequirementTable:
+						case SceneBlockType::Entity:
+						{
+							FK_ASSERT(nodeBlock != nullptr, "No Node Block defined!");
+							//FK_ASSERT(componentRequirement != nullptr, "No Component Requirement Block defined!");
+
+                            EntityBlock::Header entityBlock;
+                            memcpy(&entityBlock, block, sizeof(entityBlock));
+							auto& gameObject = allocator->allocate<GameObject>(allocator);
+
+                            size_t itr                  = 0;
+                            size_t componentOffset      = 0;
+                            const size_t componentCount = entityBlock.componentCount;
+
+                            while(true)
+                            {
+                                if (block->buffer + componentOffset >= reinterpret_cast<byte*>(block) + entityBlock.blockSize)
+                                    break;
+
+                                ComponentBlock::Header component;
+                                memcpy(&component, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(component));
+
+                                const ComponentID ID = component.componentID;
+                                if (component.blockType != EntityComponent) // malformed blob?
+                                    break;
+                                else if (ID == SceneNodeView<>::GetComponentID())
+                                {
+                                    SceneNodeComponentBlob blob;
+                                    memcpy(&blob, (std::byte*)block + sizeof(entityBlock) + componentOffset, sizeof(blob));
+
+                                    auto node = nodes[blob.nodeIdx];
+                                    gameObject.AddView<SceneNodeView<>>(node);
+
+                                    if (!blob.excludeFromScene)
                                         GS_out.AddGameObject(gameObject, node);
                                 }
                                 else if (ComponentAvailability(ID) == true)
@@ -934,22 +1792,30 @@ namespace FlexKit
 
 		auto& visables = SceneVisibilityComponent::GetComponent();
 
-		for (auto entity : sceneEntities)
-			Apply(*visables[entity].entity,
-				[&](PointLightView&			pointLight,
-					SceneVisibilityView&	visibility,
-					SceneNodeView<>&		sceneNode)
-				{
-					auto position	= sceneNode.GetPosition();
-					auto scale		= sceneNode.GetScale();
-					auto radius		= pointLight.GetRadius();
+		auto pushLight = [&](const PointLightHandle light) { lights.emplace_back(light); };
 
-					if (CompareBSAgainstFrustum(&f, { position, radius * scale }))
-						lights.emplace_back(pointLight);
+		SphereCullBatch<PointLightHandle> cullBatch{ f };
 
-					//visibility->GetBoundingVolume();
-					//BoundingSphere BoundingVolume = float4(Pw, light.R * Ps);
-				});
+		sceneManagement.tree.Query(f,
+			[&](const VisibilityHandle entity, const bool fullyInside)
+			{
+				Apply(*visables[entity].entity,
+					[&](PointLightView&			pointLight,
+						SceneVisibilityView&	visibility,
+						SceneNodeView<>&		sceneNode)
+					{
+						auto position	= sceneNode.GetPosition();
+						auto scale		= sceneNode.GetScale();
+						auto radius		= pointLight.GetRadius();
+
+						if (fullyInside)
+							pushLight(pointLight);
+						else
+							cullBatch.Push({ position, radius * scale }, pointLight, pushLight);
+					});
+			});
+
+		cullBatch.Flush(pushLight);
 
 		return lights;
 	}
@@ -958,6 +1824,251 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
+	// Finds the closest triangle hit within maxDistance. Returns false if the ray misses, or the mesh can't be
+	// refined, in which case refined is false too. Skinned meshes are never refined, their CPU buffers are in bind pose.
+	static bool _RayCastMeshTriangles(const VisibilityFields& visibility, const Ray& ray, const float maxDistance, float& distance, bool& refined)
+	{
+		refined = false;
+
+		TriMesh*	triMesh = nullptr;
+		bool		skinned = false;
+
+		Apply(*visibility.entity,
+			[&](DrawableView& drawable)
+			{
+				const auto mesh = drawable.GetTriMesh();
+
+				triMesh = (mesh != InvalidHandle_t) ? GetMeshResource(mesh) : nullptr;
+				skinned = drawable.GetDrawable().Skinned;
+			});
+
+		if (!triMesh || skinned)
+			return false;
+
+		VertexBufferView* positions	= nullptr;
+		VertexBufferView* indices	= nullptr;
+
+		for (auto view : triMesh->Buffers)
+		{
+			if (!view)
+				continue;
+
+			if (view->GetBufferType() == VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_POSITION)
+				positions = view;
+			else if (view->GetBufferType() == VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_INDEX)
+				indices = view;
+		}
+
+		if (!positions || !indices ||
+			positions->GetBufferFormat() != VERTEXBUFFER_FORMAT::VERTEXBUFFER_FORMAT_R32G32B32)
+			return false;
+
+		const auto indexFormat = indices->GetBufferFormat();
+		if (indexFormat != VERTEXBUFFER_FORMAT::VERTEXBUFFER_FORMAT_R32 &&
+			indexFormat != VERTEXBUFFER_FORMAT::VERTEXBUFFER_FORMAT_R16)
+			return false;
+
+		refined = true;
+
+		// Same transform as GetWorldBoundingSphere. The direction is scaled too, so t stays in world units
+		const auto		Lq		= GetOrientation(visibility.node);
+		const auto		Lq_inv	= Lq.Inverse();
+		const float		Ls		= GetLocalScale(visibility.node).x;
+		const float3	Pw		= GetPositionW(visibility.node);
+		const float3	O		= (Lq_inv * (ray.O - Pw)) / Ls;
+		const float3	D		= (Lq_inv * ray.D) / Ls;
+
+		const float3*	vertices	= (const float3*)positions->GetBuffer();
+		const size_t	vertexCount	= positions->GetBufferSizeUsed();
+		const size_t	indexCount	= indices->GetBufferSizeUsed();
+		const bool		index32		= indexFormat == VERTEXBUFFER_FORMAT::VERTEXBUFFER_FORMAT_R32;
+
+		auto getIndex = [&](const size_t I) -> size_t
+		{
+			return index32 ? ((const uint32_t*)indices->GetBuffer())[I] : ((const uint16_t*)indices->GetBuffer())[I];
+		};
+
+		float closest = maxDistance;
+		bool  hit     = false;
+
+		for (size_t I = 0; I + 2 < indexCount; I += 3)
+		{
+			const size_t i0 = getIndex(I + 0);
+			const size_t i1 = getIndex(I + 1);
+			const size_t i2 = getIndex(I + 2);
+
+			if (i0 >= vertexCount || i1 >= vertexCount || i2 >= vertexCount)
+				continue;
+
+			float t = 0.0f;
+			if (IntersectsTriangle(O, D, vertices[i0], vertices[i1], vertices[i2], t) && t <= closest)
+			{
+				closest = t;
+				hit		= true;
+			}
+		}
+
+		distance = closest;
+		return hit;
+	}
+
+
+	static bool _RayCastEntity(const VisibilityHandle handle, const Ray& ray, const float maxDistance, const SceneRayCastMode mode, float& distance)
+	{
+		const auto& visibility = SceneVisibilityComponent::GetComponent()[handle];
+
+		if (!visibility.rayVisible)
+			return false;
+
+		float t = 0.0f;
+		if (!Intersects(ray, GetWorldBoundingSphere(visibility), t) || t > maxDistance)
+			return false;
+
+		if (mode == SceneRayCastMode::MeshTriangles)
+		{
+			bool refined = false;
+			const bool hit = _RayCastMeshTriangles(visibility, ray, maxDistance, distance, refined);
+
+			if (refined)
+				return hit;
+		}
+
+		distance = t;
+		return true;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Vector<SceneRayHit> GraphicScene::RayCast(const Ray& ray, const float maxDistance, iAllocator* tempMemory, const SceneRayCastMode mode) const
+	{
+		Vector<SceneRayHit> hits{ tempMemory };
+
+		const auto& visables = SceneVisibilityComponent::GetComponent();
+
+		sceneManagement.tree.RayCast(ray, maxDistance,
+			[&](const VisibilityHandle handle, const float)
+			{
+				float distance = 0.0f;
+				if (_RayCastEntity(handle, ray, maxDistance, mode, distance))
+					hits.push_back({ handle, visables[handle].entity, distance });
+			});
+
+		std::sort(hits.begin(), hits.end(),
+			[](const SceneRayHit& lhs, const SceneRayHit& rhs) { return lhs.distance < rhs.distance; });
+
+		return hits;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool GraphicScene::RayCastClosest(const Ray& ray, const float maxDistance, SceneRayHit& out, const SceneRayCastMode mode) const
+	{
+		const auto& visables = SceneVisibilityComponent::GetComponent();
+
+		SceneRayHit closest;
+
+		sceneManagement.tree.RayCastClosest(ray, maxDistance,
+			[&](const VisibilityHandle handle, const float) -> float
+			{
+				const float limit		= closest.entity ? closest.distance : maxDistance;
+				float		distance	= 0.0f;
+
+				if (!_RayCastEntity(handle, ray, limit, mode, distance))
+					return inf;
+
+				closest = { handle, visables[handle].entity, distance };
+				return distance;
+			});
+
+		out = closest;
+		return closest.entity != nullptr;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void GraphicScene::RayCastBatch(SceneRayQuery* queries, const size_t queryCount, ThreadManager* threads, iAllocator* tempMemory, const SceneRayCastMode mode) const
+	{
+		auto castRange = [&](const size_t begin, const size_t end)
+		{
+			for (size_t I = begin; I < end; ++I)
+				RayCastClosest(queries[I].ray, queries[I].maxDistance, queries[I].hit, mode);
+		};
+
+		const size_t chunkSize	= 32;
+		const size_t chunkCount	= (queryCount + chunkSize - 1) / chunkSize;
+
+		if (threads && chunkCount > 1)
+		{
+			auto castChunk = [&](const size_t I) { castRange(I * chunkSize, std::min((I + 1) * chunkSize, queryCount)); };
+			_RunGatherWork(*threads, tempMemory, chunkCount, castChunk);
+		}
+		else
+			castRange(0, queryCount);
+	}
+
+
+	/************************************************************************************************/
+
+
+	Vector<VisibilityHandle> GraphicScene::SphereOverlap(const BoundingSphere& sphere, iAllocator* tempMemory) const
+	{
+		Vector<VisibilityHandle> overlapping{ tempMemory };
+
+		const auto& visables	= SceneVisibilityComponent::GetComponent();
+		const float	r			= sphere.w;
+		const AABB	bounds		= { sphere.xyz() - float3{ r, r, r }, sphere.xyz() + float3{ r, r, r } };
+
+		sceneManagement.tree.Query(bounds,
+			[&](const VisibilityHandle handle)
+			{
+				const auto		entitySphere	= GetWorldBoundingSphere(visables[handle]);
+				const float		radii			= entitySphere.w + r;
+
+				if ((entitySphere.xyz() - sphere.xyz()).magnitudesquared() <= radii * radii)
+					overlapping.push_back(handle);
+			});
+
+		return overlapping;
+	}
+
+
+	/************************************************************************************************/
+
+
+	Vector<VisibilityHandle> GraphicScene::FrustumQuery(const Frustum& f, iAllocator* tempMemory) const
+	{
+		Vector<VisibilityHandle> inside{ tempMemory };
+
+		const auto& visables = SceneVisibilityComponent::GetComponent();
+
+		auto push = [&](const VisibilityHandle handle) { inside.push_back(handle); };
+
+		SphereCullBatch<VisibilityHandle> cullBatch{ f };
+
+		sceneManagement.tree.Query(f,
+			[&](const VisibilityHandle handle, const bool fullyInside)
+			{
+				if (fullyInside)
+					push(handle);
+				else
+					cullBatch.Push(GetWorldBoundingSphere(visables[handle]), handle, push);
+			});
+
+		cullBatch.Flush(push);
+
+		return inside;
+	}
+
+
+	/************************************************************************************************/
+
+
     PointLightGatherTask& GraphicScene::GetPointLights(UpdateDispatcher& dispatcher, iAllocator* tempMemory)
 	{
 		return dispatcher.Add<PointLightGather>(
@@ -27,6 +27,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "..\buildsettings.h"
 #include "..\coreutilities\Assets.h"
+#include "..\coreutilities\DynamicBVH.h"
 #include "..\coreutilities\GraphicsComponents.h"
 #include "..\graphicsutilities\AnimationUtilities.h" 
 #include "..\graphicsutilities\graphics.h"
@@ -43,19 +44,9 @@ namespace FlexKit
 	typedef Pair<bool, int64_t> GSPlayAnimation_RES;
 
 	class  GraphicScene;
+	class  SoftwareOcclusionCuller;
 	struct SceneNodeComponentSystem;
 
-	enum class QuadTreeNodeLocation: int
-	{
-		UpperRight,
-		UpperLeft,
-		LowerLeft,
-		LowerRight
-	};
-
-	const float MinNodeSize = 1;
-
-
 	/************************************************************************************************/
 
 
@@ -156,6 +147,30 @@ namespace FlexKit
     }
 
 
+    /************************************************************************************************/
+
+
+    // Sets the meshes picked from during scene gathers, highest detail first. An empty list keeps the current mesh.
+    void SetDrawableLODs(GameObject& go, const DrawableLOD* lods, const size_t lodCount)
+    {
+        FK_ASSERT(lodCount <= Drawable::MaxLODs);
+
+        return Apply(go,
+            [&](DrawableView& drawable)
+            {
+                auto& drawableData      = drawable.GetDrawable();
+                drawableData.LODCount   = uint8_t(std::min<size_t>(lodCount, Drawable::MaxLODs));
+                drawableData.CurrentLOD = 0;
+
+                for (size_t I = 0; I < drawableData.LODCount; ++I)
+                    drawableData.LODs[I] = lods[I];
+
+                if (drawableData.LODCount)
+                    drawableData.MeshHandle = lods[0].mesh;
+            });
+    }
+
+
 	/************************************************************************************************/
 
 
@@ -217,6 +232,7 @@ namespace FlexKit
 		bool			transparent = false;
 
 		BoundingSphere	boundingSphere = { 0, 0, 0, 0 }; // model space
+		uint32_t		bvhLeaf		= DynamicBVH<VisibilityHandle>::InvalidNode;
 	};
 
 	using SceneVisibilityComponent = BasicComponent_t<VisibilityFields, VisibilityHandle, SceneVisibilityComponentID>;
@@ -236,7 +252,11 @@ namespace FlexKit
 
 		void SetBoundingSphere(const BoundingSphere boundingSphere)
 		{
-			GetComponent()[visibility].boundingSphere = boundingSphere;
+			auto& vis_ref			= GetComponent()[visibility];
+			vis_ref.boundingSphere	= boundingSphere;
+
+			if (vis_ref.node != InvalidHandle_t)
+				SetFlag(vis_ref.node, SceneNodes::DIRTY); // Gets the scene BVH to refit this entity
 		}
 
 
@@ -299,96 +319,87 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	struct QuadTreeNode
+	// Entities whose bounds passed the last gather for one camera, before visibility flags are applied.
+	// Reused while the camera stays close to the pose it was built from, see GatherScene.
+	struct SceneVisibilityCache
 	{
-		QuadTreeNode(iAllocator* in_allocator) : 
-			allocator{ in_allocator } {}
-
-		~QuadTreeNode()
-		{
-
-		}
-
-		void Clear()
-		{
-			for (auto child : ChildNodes) 
-			{
-				child->Clear();
-				child->Contents.clear();
-				allocator->free(child);
-			}
-
-			ChildNodes.clear();
-			Contents.clear();
-		}
-
-		void AddEntity		(VisibilityHandle visable);
-		void RemoveEntity	(VisibilityHandle visable);
-		
-		enum SphereTestRes
-		{
-			Partially	= 2,
-			Fully		= 3, 
-			Failed		= 0
-		};
-
-		SphereTestRes IsSphereInside(float r, float3 pos);
-
-		// requires SceneVisibilityComponent
-		void UpdateBounds();
-		void ExpandNode(iAllocator* allocator);
+		SceneVisibilityCache(iAllocator* allocator) :
+			visible{ allocator } {}
+
+		CameraHandle				camera;
+		Frustum						frustum;
+		float3						position;
+		float3						forward;
+		float3						up;
+		float						FOV;
+		float						aspectRatio;
+		float						nearPlane;
+		float						farPlane;
+		size_t						refitCount;	// SceneBVH::refitCount when built
+		size_t						version;	// SceneBVH::version when built
+		bool						valid = false;
+
+		Vector<VisibilityHandle>	visible;
+	};
 
-		float4								GetArea() const;
 
-		float2								lowerLeft;
-		float2								upperRight;
-		float2								centerPoint;
+	// Entities in range of a point light when its shadow casters were last gathered, sorted.
+	// The light's shadow maps can be reused until the light or one of these, or something entering its range, moves.
+	struct PointLightShadowCache
+	{
+		PointLightShadowCache(iAllocator* allocator) :
+			casters{ allocator } {}
 
-		static_vector<VisibilityHandle, 4>	Contents;
-		static_vector<QuadTreeNode*,4>		ChildNodes;
+		PointLightHandle			pointLight;
+		float3						position;
+		float						radius;
+		size_t						refitCount;	// SceneBVH::refitCount when gathered
+		size_t						version;	// SceneBVH::version when gathered
+		bool						valid = false;
 
-		iAllocator*							allocator;
+		Vector<VisibilityHandle>	casters;
 	};
 
 
-	struct QuadTree
+	// Scene wide BVH of all visibility entities, leaves are refit when their scene node moves
+	struct SceneBVH
 	{
-		QuadTree(SceneHandle in_scene, float2 AreaDimensions, iAllocator* in_allocator) :
-			allocator	{ in_allocator	},
-			scene		{ in_scene		},
-			root		{ in_allocator	}
-		{
-			area					= float2{0, 0};
+		SceneBVH(iAllocator* in_allocator) :
+			tree				{ in_allocator },
+			moved				{ in_allocator },
+			visibilityCaches	{ in_allocator },
+			shadowCaches		{ in_allocator },
+			allocator			{ in_allocator } {}
 
-			root.upperRight = AreaDimensions;
-			root.lowerLeft	= AreaDimensions * -1;
-		}
+		~SceneBVH();
 
 		void clear();
-		
+
 		void AddEntity		(VisibilityHandle handle);
 		void RemoveEntity	(VisibilityHandle handle);
 
-		void Rebuild		(GraphicScene& parentScene);
-
-		float4		GetArea();
+		void Refit			(GraphicScene& parentScene);
 
 		UpdateTask& Update(FlexKit::UpdateDispatcher& dispatcher, GraphicScene* parentScene, UpdateTask& transformDependency);
 
-		const SceneHandle			scene;
-		const size_t				NodeSize = 16;
-
+		// Creates the camera's cache on first use, not thread safe. Call while building tasks
+		SceneVisibilityCache&	GetVisibilityCache(CameraHandle camera);
+		PointLightShadowCache&	GetShadowCache(PointLightHandle pointLight); // Same as above
 
-		size_t						RebuildPeriod	= 10;
-		size_t						RebuildCounter	= 10;
+		DynamicBVH<VisibilityHandle>	tree;
+		Vector<VisibilityHandle>		moved;				// Entities moved by the last Refit
+		size_t							refitCount	= 0;
+		size_t							version		= 0;	// Bumped whenever entities are added or removed
+		size_t							shadowCacheVersion = -1;	// version when every point light last had a shadow cache created
 
-		float2						area;
-		QuadTreeNode				root;
-		iAllocator*					allocator;
+		Vector<SceneVisibilityCache*>	visibilityCaches;
+		Vector<PointLightShadowCache*>	shadowCaches;
+		iAllocator*						allocator;
 	};
 
 
-	void UpdateQuadTree		( QuadTreeNode* Node, GraphicScene* Scene );
+	BoundingSphere	GetWorldBoundingSphere	(const VisibilityFields& visibility);
+	AABB			GetWorldAABB			(const VisibilityFields& visibility);
 
 	
 	/************************************************************************************************/
@@ -403,6 +414,33 @@ namespace FlexKit
 
     using PointLightGatherTask = UpdateTaskTyped<PointLightGather>;
 
+	struct SceneRayHit
+	{
+		VisibilityHandle	visibility	= InvalidHandle_t;
+		GameObject*			entity		= nullptr;
+		float				distance	= 0.0f;
+	};
+
+
+	enum class SceneRayCastMode
+	{
+		Bounds,			// Hits the world bounding sphere
+		MeshTriangles,	// Bounding sphere hits are refined against the mesh, if it was loaded with its CPU buffers kept
+	};
+
+
+	// One ray of a batch, hit.entity is null on a miss
+	struct SceneRayQuery
+	{
+		Ray			ray;
+		float		maxDistance	= 1000.0f;
+		SceneRayHit	hit;
+	};
+
+
+	/************************************************************************************************/
+
+
 	class GraphicScene
 	{
 	public:
@@ -410,7 +448,7 @@ namespace FlexKit
 				allocator					{ in_allocator							},
 				HandleTable					{ in_allocator							},
 				sceneID						{ rand()								},
-				sceneManagement				{ sceneID, {1024, 1024}, in_allocator	},
+				sceneManagement				{ in_allocator							},
 				sceneEntities				{ in_allocator							} {}
 				
 		~GraphicScene()
@@ -427,6 +465,14 @@ namespace FlexKit
 
 		Vector<PointLightHandle>    FindPointLights(const Frustum& f, iAllocator* tempMemory) const;
 
+		// Queries run against the visibility BVH and are read only, any number can run at once while the scene isn't updating.
+		// Only entities flagged rayVisible are hit by rays.
+		Vector<SceneRayHit>			RayCast			(const Ray& ray, const float maxDistance, iAllocator* tempMemory, const SceneRayCastMode mode = SceneRayCastMode::Bounds) const; // Sorted nearest first
+		bool						RayCastClosest	(const Ray& ray, const float maxDistance, SceneRayHit& out, const SceneRayCastMode mode = SceneRayCastMode::Bounds) const;
+		void						RayCastBatch	(SceneRayQuery* queries, const size_t queryCount, ThreadManager* threads, iAllocator* tempMemory, const SceneRayCastMode mode = SceneRayCastMode::Bounds) const;
+		Vector<VisibilityHandle>	SphereOverlap	(const BoundingSphere& sphere, iAllocator* tempMemory) const;
+		Vector<VisibilityHandle>	FrustumQuery	(const Frustum& f, iAllocator* tempMemory) const;
+
 
         PointLightGatherTask&	    GetPointLights(UpdateDispatcher& disatcher, iAllocator* tempMemory);
 		size_t					    GetPointLightCount();
@@ -439,7 +485,7 @@ namespace FlexKit
 		HandleUtilities::HandleTable<SceneEntityHandle, 16> HandleTable;
 			
 		Vector<VisibilityHandle>			sceneEntities;
-		QuadTree							sceneManagement;
+		SceneBVH							sceneManagement;
 		iAllocator*							allocator;
 
 		operator GraphicScene* () { return this; }
@@ -459,11 +505,15 @@ namespace FlexKit
 	{
 		CameraHandle	camera;
 		GraphicScene*	scene; // Source Scene
+		ThreadManager*	threads;
+		size_t			capacity; // Scene entities taskMemory was sized for
 		StackAllocator	taskMemory;
 		PVS				solid;
 		PVS				transparent;
 
-		UpdateTask*		task;
+		SoftwareOcclusionCuller*	occlusion; // Optional, entries hidden by occluders are removed after the gather
+		SceneVisibilityCache*		cache;
+		UpdateTask*					task;
 
 		operator UpdateTask*() { return task; }
 	};
@@ -474,6 +524,44 @@ namespace FlexKit
 
     using GatherTask = UpdateTaskTyped<GetPVSTaskData>;
 
+
+	// One view of a multi view gather, see GatherSceneViews
+	struct SceneViewDesc
+	{
+		Frustum	frustum;
+		float3	position;			// Entries are keyed by distance to this
+		float	lodScale	= 0.0f;	// 1 / tan(FOV / 2) to pick drawable LODs for this view, 0 draws the highest detail meshes. Only one view should pick
+	};
+
+
+	// Shadow casters of one point light, one PVS per cube face in GetCubeFaceFrustum order.
+	// If dirty is false nothing changed since the last gather, the faces are left empty and the old shadow maps can be reused.
+	struct PointLightShadowViews
+	{
+		PointLightHandle	pointLight;
+		bool				dirty;
+		PVS					faces[6];
+	};
+
+
+	struct PointLightShadowGatherData
+	{
+		GraphicScene*					scene;
+		const Vector<PointLightHandle>*	pointLights;
+		size_t							capacity;		// Scene entities taskMemory was sized for
+		size_t							lightCapacity;	// Lights taskMemory was sized for
+		size_t							entryBudget;	// Face entries taskMemory was sized for
+		StackAllocator					taskMemory;
+		PointLightShadowViews*			lights;
+		size_t							lightCount;
+		UpdateTask*						task;
+
+		operator UpdateTask*() { return task; }
+	};
+
+
+	using PointLightShadowGatherTask = UpdateTaskTyped<PointLightShadowGatherData>;
+
     FLEXKITAPI void DEBUG_ListSceneObjects(GraphicScene& scene);
 
 
@@ -483,7 +571,15 @@ namespace FlexKit
 	FLEXKITAPI void UpdateShadowCasters				(GraphicScene* SM);
 
     FLEXKITAPI void         GatherScene(GraphicScene* SM, CameraHandle Camera, PVS& solid, PVS& transparent);
-    FLEXKITAPI GatherTask&  GatherScene(UpdateDispatcher& dispatcher, GraphicScene* scene, CameraHandle C, iAllocator* allocator);
+    FLEXKITAPI GatherTask&  GatherScene(UpdateDispatcher& dispatcher, GraphicScene* scene, CameraHandle C, iAllocator* allocator, SoftwareOcclusionCuller* occlusion = nullptr);
+
+	// Walks the scene once for up to DynamicBVH::MaxMultiQueryFrusta views, producing a PVS pair per view
+	FLEXKITAPI void GatherSceneViews(GraphicScene* scene, const SceneViewDesc* views, const size_t viewCount, PVS* solidOut, PVS* transparentOut);
+
+	// Gathers the shadow casters of each point light's cube faces, several lights per scene walk. Lights with unchanged casters are skipped.
+	// Lights that don't fit in the task's memory budget aren't marked dirty, they are gathered on a later frame.
+	// Depend on the scene's BVH update before running.
+	FLEXKITAPI PointLightShadowGatherTask& GatherPointLightShadowCasters(UpdateDispatcher& dispatcher, GraphicScene* scene, PointLightGatherTask& pointLights, iAllocator* allocator);
 
 
 	FLEXKITAPI void ReleaseGraphicScene				(GraphicScene* SM);
@@ -510,7 +606,8 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	inline void DEBUG_DrawQuadTree(
+	// Draws the XZ footprint of every BVH node, coloured by depth
+	inline void DEBUG_DrawBVH(
 		GraphicScene&			scene, 
 		UpdateDispatcher&		dispatcher,
 		UpdateTask&				sceneUpdate,
@@ -531,21 +628,13 @@ namespace FlexKit
 			{1, 0, 0, 1}
 		};
 
-		const auto	area		= scene.sceneManagement.GetArea();
-		const auto	areaLL		= (area.y <  area.z) ? float2{ area.x, area.y } : float2{ area.z, area.w };
-		const auto	areaUR		= (area.y >= area.z) ? float2{ area.x, area.y } : float2{ area.z, area.w };
-		const auto	areaSpan	= (areaUR - areaLL);
-		int			itr			= 0;
+		const auto& tree = scene.sceneManagement.tree;
 
-		auto drawNode = [&](auto& self, const QuadTreeNode& Node, const int depth) -> void
+		auto drawNode = [&](auto& self, const uint32_t nodeIdx, const int depth) -> void
 		{
-			auto nodeArea = Node.GetArea();
-
-			//const auto ll = (float2{ nodeArea.x, nodeArea.y } - areaLL) / areaSpan;
-			//const auto ur = (float2{ nodeArea.z, nodeArea.w } - areaLL) / areaSpan;
-
-			const auto ll = float2{nodeArea.x, nodeArea.y};// lower left
-			const auto ur = float2{nodeArea.z, nodeArea.w};// upper right
+			const auto& node	= tree[nodeIdx];
+			const auto	ll		= float2{ node.bounds.min.x, node.bounds.min.z };// lower left
+			const auto	ur		= float2{ node.bounds.max.x, node.bounds.max.z };// upper right
 
 			FlexKit::Rectangle rect;
 			rect.Color		= colors[depth % 4];
@@ -553,11 +642,15 @@ namespace FlexKit
 			rect.WH			= ur - ll;
 			rects.push_back(rect);
 
-			for (auto& child : Node.ChildNodes)
-				self(self, *child, depth + 1 + itr++);
+			if (!node.IsLeaf())
+			{
+				self(self, node.left,	depth + 1);
+				self(self, node.right,	depth + 1);
+			}
 		};
 
-		drawNode(drawNode, scene.sceneManagement.root, 0);
+		if (tree.GetRoot() != DynamicBVH<VisibilityHandle>::InvalidNode)
+			drawNode(drawNode, tree.GetRoot(), 0);
 
 		DrawWireframeRectangle_Desc drawDesc =
 		{
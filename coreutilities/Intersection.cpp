@@ -1,5 +1,6 @@
 #include "..\coreutilities\intersection.h"
-#include "..\graphicsutilities\graphics.h"
+
+#include <immintrin.h>
 
 namespace FlexKit
 {	/************************************************************************************************/
@@ -74,6 +75,214 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
+	// Planes as N.P + d, a sphere is visible if N.C + d - r <= 0 for every plane
+	struct _SphereCullPlanes
+	{
+		float x[6], y[6], z[6], d[6];
+	};
+
+
+	_SphereCullPlanes _GetSphereCullPlanes(const Frustum& frustum, const size_t count, uint32_t* __restrict visibilityMask)
+	{
+		_SphereCullPlanes planes;
+
+		for (size_t I = 0; I < 6; ++I)
+		{
+			const auto& plane = frustum.Planes[I];
+
+			planes.x[I] = plane.Normal.x;
+			planes.y[I] = plane.Normal.y;
+			planes.z[I] = plane.Normal.z;
+			planes.d[I] = -plane.Normal.dot(plane.Orgin);
+		}
+
+		for (size_t I = 0; I < (count + 31) / 32; ++I)
+			visibilityMask[I] = 0;
+
+		return planes;
+	}
+
+
+	// Spheres [begin, count), the SIMD kernels finish their tails with this
+	void _CullSpheresScalar(
+		const _SphereCullPlanes&	planes,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				begin,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask)
+	{
+		for (size_t itr = begin; itr < count; ++itr)
+		{
+			bool visible = true;
+
+			for (size_t P = 0; P < 6; ++P)
+				visible &= (x[itr] * planes.x[P] + y[itr] * planes.y[P] + z[itr] * planes.z[P] + planes.d[P] - r[itr]) <= 0.0f;
+
+			visibilityMask[itr / 32] |= uint32_t(visible) << (itr % 32);
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void CullSpheres_Scalar(
+		const Frustum&				frustum,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask)
+	{
+		const auto planes = _GetSphereCullPlanes(frustum, count, visibilityMask);
+		_CullSpheresScalar(planes, x, y, z, r, 0, count, visibilityMask);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void CullSpheres_SSE(
+		const Frustum&				frustum,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask)
+	{
+		const auto planes = _GetSphereCullPlanes(frustum, count, visibilityMask);
+
+		size_t itr = 0;
+		for (; itr + 4 <= count; itr += 4)
+		{
+			const __m128 cx = _mm_loadu_ps(x + itr);
+			const __m128 cy = _mm_loadu_ps(y + itr);
+			const __m128 cz = _mm_loadu_ps(z + itr);
+			const __m128 cr = _mm_loadu_ps(r + itr);
+
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+			for (size_t P = 0; P < 6; ++P)
+			{
+				__m128 d = _mm_add_ps(_mm_mul_ps(cx, _mm_set_ps1(planes.x[P])), _mm_set_ps1(planes.d[P]));
+				d = _mm_add_ps(_mm_mul_ps(cy, _mm_set_ps1(planes.y[P])), d);
+				d = _mm_add_ps(_mm_mul_ps(cz, _mm_set_ps1(planes.z[P])), d);
+
+				visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_sub_ps(d, cr), _mm_setzero_ps()));
+			}
+
+			visibilityMask[itr / 32] |= uint32_t(_mm_movemask_ps(visible)) << (itr % 32);
+		}
+
+		_CullSpheresScalar(planes, x, y, z, r, itr, count, visibilityMask);
+	}
+
+
+	/************************************************************************************************/
+
+
+#if USING(AVX2)
+	void CullSpheres_AVX2(
+		const Frustum&				frustum,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask)
+	{
+		const auto planes = _GetSphereCullPlanes(frustum, count, visibilityMask);
+
+		size_t itr = 0;
+		for (; itr + 8 <= count; itr += 8)
+		{
+			const __m256 cx = _mm256_loadu_ps(x + itr);
+			const __m256 cy = _mm256_loadu_ps(y + itr);
+			const __m256 cz = _mm256_loadu_ps(z + itr);
+			const __m256 cr = _mm256_loadu_ps(r + itr);
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+			for (size_t P = 0; P < 6; ++P)
+			{
+				__m256 d = _mm256_fmadd_ps(cx, _mm256_set1_ps(planes.x[P]), _mm256_set1_ps(planes.d[P]));
+				d = _mm256_fmadd_ps(cy, _mm256_set1_ps(planes.y[P]), d);
+				d = _mm256_fmadd_ps(cz, _mm256_set1_ps(planes.z[P]), d);
+
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_sub_ps(d, cr), _mm256_setzero_ps(), _CMP_LE_OQ));
+			}
+
+			visibilityMask[itr / 32] |= uint32_t(_mm256_movemask_ps(visible)) << (itr % 32);
+		}
+
+		_CullSpheresScalar(planes, x, y, z, r, itr, count, visibilityMask);
+	}
+#endif
+
+
+	/************************************************************************************************/
+
+
+	void CullSpheres(
+		const Frustum&				frustum,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask)
+	{
+#if USING(AVX2)
+		CullSpheres_AVX2(frustum, x, y, z, r, count, visibilityMask);
+#elif USING(FASTMATH)
+		CullSpheres_SSE(frustum, x, y, z, r, count, visibilityMask);
+#else
+		CullSpheres_Scalar(frustum, x, y, z, r, count, visibilityMask);
+#endif
+	}
+
+
+	/************************************************************************************************/
+
+
+	FrustumIntersection ClassifyAABBAgainstFrustum(const Frustum& frustum, const AABB& aabb)
+	{
+		FrustumIntersection result = FrustumIntersection::Inside;
+
+		for (size_t I = 0; I < 6; ++I)
+		{
+			const auto& plane = frustum.Planes[I];
+
+			// Plane normals point out of the frustum, so the corner nearest along the normal decides rejection
+			const float3 nearest	= {
+				(plane.Normal.x >= 0.0f) ? aabb.min.x : aabb.max.x,
+				(plane.Normal.y >= 0.0f) ? aabb.min.y : aabb.max.y,
+				(plane.Normal.z >= 0.0f) ? aabb.min.z : aabb.max.z };
+
+			const float3 furthest	= {
+				(plane.Normal.x >= 0.0f) ? aabb.max.x : aabb.min.x,
+				(plane.Normal.y >= 0.0f) ? aabb.max.y : aabb.min.y,
+				(plane.Normal.z >= 0.0f) ? aabb.max.z : aabb.min.z };
+
+			if (plane.Normal.dot(nearest - plane.Orgin) > 0.0f)
+				return FrustumIntersection::Outside;
+
+			if (plane.Normal.dot(furthest - plane.Orgin) > 0.0f)
+				result = FrustumIntersection::Partial;
+		}
+
+		return result;
+	}
+
+
+	/************************************************************************************************/
+
+
 	Frustum GetFrustum(
 		const float AspectRatio, 
 		const float FOV, 
@@ -301,6 +510,39 @@ namespace FlexKit
 
 		return Out;
 	}
+
+
+	/************************************************************************************************/
+
+
+	Frustum GetCubeFaceFrustum(const float3 position, const float radius, const uint32_t face)
+	{
+		FK_ASSERT(face < 6);
+
+		const uint32_t	axis	= face / 2;
+		const float		sign	= (face % 2) ? -1.0f : 1.0f;
+
+		float3 forward	= { 0, 0, 0 };
+		float3 up		= { 0, 0, 0 };
+		float3 right	= { 0, 0, 0 };
+
+		forward[axis]			= sign;
+		up[(axis + 1) % 3]		= 1.0f;
+		right[(axis + 2) % 3]	= 1.0f;
+
+		// Side planes pass through the center at 45 degrees, normals point out
+		const float k = 1.0f / std::sqrt(2.0f);
+
+		Frustum Out;
+		Out.Planes[EPlane_FAR]		= { forward,				position + forward * radius };
+		Out.Planes[EPlane_NEAR]		= { -forward,				position };
+		Out.Planes[EPlane_TOP]		= { (up - forward) * k,		position };
+		Out.Planes[EPlane_BOTTOM]	= { (-up - forward) * k,	position };
+		Out.Planes[EPlane_LEFT]		= { (-right - forward) * k,	position };
+		Out.Planes[EPlane_RIGHT]	= { (right - forward) * k,	position };
+
+		return Out;
+	}
 }	
 
 
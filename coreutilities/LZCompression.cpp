@@ -0,0 +1,247 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#include "..\coreutilities\LZCompression.h"
+
+#include <cstring>
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	static const size_t		LZMinMatch		= 4;
+	static const size_t		LZMaxOffset		= 0xffff;
+	static const size_t		LZLastLiterals	= 5;	// Matches stop short of the end, the tail is always literals
+	static const uint32_t	LZHashBits		= 12;
+
+
+	/************************************************************************************************/
+
+
+	static uint32_t _LZRead32(const char* src)
+	{
+		uint32_t v;
+		memcpy(&v, src, sizeof(v));
+		return v;
+	}
+
+
+	static uint32_t _LZHash(const uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - LZHashBits);
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Writes the 255 run continuation bytes for lengths that don't fit in a token nibble
+	static bool _LZWriteLength(size_t length, char*& op, const char* end)
+	{
+		while (length >= 255)
+		{
+			if (op >= end)
+				return false;
+
+			*op++	= (char)255;
+			length	-= 255;
+		}
+
+		if (op >= end)
+			return false;
+
+		*op++ = (char)length;
+		return true;
+	}
+
+
+	static bool _LZWriteSequence(const char* literals, const size_t literalCount, const size_t offset, const size_t matchLength, char*& op, const char* end)
+	{
+		if (op >= end)
+			return false;
+
+		char* token = op++;
+
+		const size_t matchCode = matchLength ? matchLength - LZMinMatch : 0;
+		*token = (char)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+		if (literalCount >= 15 && !_LZWriteLength(literalCount - 15, op, end))
+			return false;
+
+		if (size_t(end - op) < literalCount)
+			return false;
+
+		if (literalCount)	// Empty blocks may come with null buffers
+			memcpy(op, literals, literalCount);
+
+		op += literalCount;
+
+		if (!matchLength)
+			return true;
+
+		if (end - op < 2)
+			return false;
+
+		*op++ = (char)(offset & 0xff);
+		*op++ = (char)(offset >> 8);
+
+		return matchCode < 15 || _LZWriteLength(matchCode - 15, op, end);
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t LZCompressBound(const size_t srcSize)
+	{
+		return srcSize + srcSize / 255 + 16;
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t LZCompress(const char* src, const size_t srcSize, char* dst, const size_t dstCapacity)
+	{
+		uint32_t table[1 << LZHashBits] = { 0 };
+
+		char*		op		= dst;
+		const char*	end		= dst + dstCapacity;
+		size_t		anchor	= 0;
+		size_t		ip		= 0;
+
+		const size_t matchLimit = srcSize > LZLastLiterals + LZMinMatch ? srcSize - LZLastLiterals - LZMinMatch : 0;
+
+		while (ip < matchLimit)
+		{
+			const uint32_t	sequence	= _LZRead32(src + ip);
+			const uint32_t	hash		= _LZHash(sequence);
+			const size_t	ref			= table[hash];
+
+			table[hash] = (uint32_t)ip;
+
+			if (ref >= ip || ip - ref > LZMaxOffset || _LZRead32(src + ref) != sequence)
+			{
+				ip++;
+				continue;
+			}
+
+			const size_t maxLength	= srcSize - LZLastLiterals - ip;
+			size_t length			= LZMinMatch;
+
+			while (length < maxLength && src[ref + length] == src[ip + length])
+				length++;
+
+			if (!_LZWriteSequence(src + anchor, ip - anchor, ip - ref, length, op, end))
+				return 0;
+
+			ip		+= length;
+			anchor	= ip;
+		}
+
+		if (!_LZWriteSequence(src + anchor, srcSize - anchor, 0, 0, op, end))
+			return 0;
+
+		return size_t(op - dst);
+	}
+
+
+	/************************************************************************************************/
+
+
+	static bool _LZReadLength(const uint8_t* src, size_t& ip, const size_t srcSize, size_t& length)
+	{
+		uint8_t b;
+		do
+		{
+			if (ip >= srcSize)
+				return false;
+
+			b		= src[ip++];
+			length	+= b;
+		} while (b == 255);
+
+		return true;
+	}
+
+
+	bool LZDecompress(const char* src_in, const size_t srcSize, char* dst, const size_t dstSize)
+	{
+		const uint8_t*	src	= (const uint8_t*)src_in;
+		size_t			ip	= 0;
+		size_t			op	= 0;
+
+		while (ip < srcSize)
+		{
+			const uint8_t token = src[ip++];
+
+			size_t literalCount = token >> 4;
+			if (literalCount == 15 && !_LZReadLength(src, ip, srcSize, literalCount))
+				return false;
+
+			if (literalCount > srcSize - ip || literalCount > dstSize - op)
+				return false;
+
+			if (literalCount)
+				memcpy(dst + op, src + ip, literalCount);
+
+			ip += literalCount;
+			op += literalCount;
+
+			if (ip == srcSize)
+				break; // Last sequence
+
+			if (srcSize - ip < 2)
+				return false;
+
+			const size_t offset = size_t(src[ip]) | (size_t(src[ip + 1]) << 8);
+			ip += 2;
+
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !_LZReadLength(src, ip, srcSize, matchLength))
+				return false;
+
+			matchLength += LZMinMatch;
+
+			if (!offset || offset > op || matchLength > dstSize - op)
+				return false;
+
+			const char* match = dst + op - offset;
+
+			if (offset >= matchLength)
+				memcpy(dst + op, match, matchLength);
+			else // Overlapping, repeats the last offset bytes
+				for (size_t I = 0; I < matchLength; ++I)
+					dst[op + I] = match[I];
+
+			op += matchLength;
+		}
+
+		return op == dstSize;
+	}
+
+
+}	/************************************************************************************************/
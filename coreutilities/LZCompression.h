@@ -0,0 +1,53 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+
+#ifndef LZCOMPRESSION_H
+#define LZCOMPRESSION_H
+
+#include "..\buildsettings.h"
+
+#include <cstdint>
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	// Byte oriented LZ77 block codec in the style of LZ4, favouring decode speed over ratio.
+	// Each sequence is a token (literal count, match length - 4), the literals, then a 16 bit match offset.
+	// The last sequence has literals only. Blocks are independent, the match window is 64KB.
+
+	FLEXKITAPI size_t	LZCompressBound	(const size_t srcSize);
+
+	// Returns the compressed size, or 0 if the output didn't fit in dstCapacity
+	FLEXKITAPI size_t	LZCompress		(const char* src, const size_t srcSize, char* dst, const size_t dstCapacity);
+
+	// Returns false on malformed input or if the output isn't exactly dstSize bytes
+	FLEXKITAPI bool		LZDecompress	(const char* src, const size_t srcSize, char* dst, const size_t dstSize);
+
+
+}	/************************************************************************************************/
+
+#endif
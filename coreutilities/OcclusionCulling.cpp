@@ -0,0 +1,746 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#include "..\coreutilities\OcclusionCulling.h"
+#include "..\coreutilities\ThreadUtilities.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	SoftwareOcclusionCuller::SoftwareOcclusionCuller(iAllocator* IN_allocator, const uint2 WH) :
+		tiles			{ nullptr															},
+		tilesX			{ (WH[0] + TileWidth - 1) / TileWidth								},
+		tilesY			{ (WH[1] + TileHeight - 1) / TileHeight								},
+		viewPosition	{ 0, 0, 0															},
+		nearPlane		{ 0.1f																},
+		scaleX			{ 1.0f																},
+		scaleY			{ 1.0f																},
+		registered		{ IN_allocator														},
+		allocator		{ IN_allocator														}
+	{
+		FK_ASSERT(tilesX && tilesY, "Invalid occlusion buffer size!");
+
+		tiles = (Tile*)allocator->_aligned_malloc(sizeof(Tile) * tilesX * tilesY, alignof(Tile));
+
+		for (size_t I = 0; I < 3; ++I)
+			for (size_t J = 0; J < 3; ++J)
+				viewRotation[I][J] = (I == J) ? 1.0f : 0.0f;
+
+		Clear();
+	}
+
+
+	SoftwareOcclusionCuller::~SoftwareOcclusionCuller()
+	{
+		allocator->_aligned_free(tiles);
+
+		for (auto& occluder : registered)
+		{
+			if (occluder.box)
+				allocator->release(occluder.box);
+		}
+
+		registered.Release();
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::SetView(const float3 position, const Quaternion orientation, const float FOV, const float aspectRatio, const float IN_near)
+	{
+		const Quaternion	inverse		= orientation.Inverse();
+		const float3		basis[3]	= { inverse * float3{ 1, 0, 0 }, inverse * float3{ 0, 1, 0 }, inverse * float3{ 0, 0, 1 } };
+
+		// Columns of the world to view rotation
+		for (size_t J = 0; J < 3; ++J)
+		{
+			viewRotation[0][J] = basis[J].x;
+			viewRotation[1][J] = basis[J].y;
+			viewRotation[2][J] = basis[J].z;
+		}
+
+		const uint2 WH			= GetWH();
+		const float tanHalfFOV	= std::tan(FOV / 2.0f);
+
+		viewPosition	= position;
+		nearPlane		= IN_near;
+		scaleX			= (WH[0] / 2.0f) / (tanHalfFOV * aspectRatio);
+		scaleY			= (WH[1] / 2.0f) / tanHalfFOV;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::Clear()
+	{
+		for (size_t I = 0; I < tilesX * tilesY; ++I)
+		{
+			for (auto& row : tiles[I].mask)
+				row = 0;
+
+			tiles[I].zMin[0] = 0.0f;	// Infinitely far away, hides nothing
+			tiles[I].zMin[1] = FLT_MAX;	// Empty working layer
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::RegisterOccluder(const TriMeshHandle mesh, const OccluderMesh& occluder)
+	{
+		float radiusSquared = 0.0f;
+		for (size_t I = 0; I < occluder.vertexCount; ++I)
+			radiusSquared = std::max(radiusSquared, occluder.vertices[I].magnitudesquared());
+
+		const RegisteredOccluder entry{ mesh.to_uint(), occluder, std::sqrt(radiusSquared) };
+
+		auto res = std::lower_bound(registered.begin(), registered.end(), entry.mesh,
+			[](const RegisteredOccluder& lhs, const uint32_t rhs) { return lhs.mesh < rhs; });
+
+		if (res != registered.end() && res->mesh == entry.mesh)
+		{
+			if (res->box)
+				allocator->release(res->box);
+
+			*res = entry;
+			return;
+		}
+
+		// Keep the table sorted, registration is rare compared to lookups
+		const size_t idx = res - registered.begin();
+		registered.push_back(entry);
+
+		for (size_t I = registered.size() - 1; I > idx; --I)
+			std::swap(registered[I], registered[I - 1]);
+	}
+
+
+	void SoftwareOcclusionCuller::RegisterBoxOccluder(const TriMeshHandle mesh, const AABB& bounds)
+	{
+		static const uint32_t faces[36] = {
+			0, 1, 3,	0, 3, 2,	// -X
+			4, 6, 7,	4, 7, 5,	// +X
+			0, 4, 5,	0, 5, 1,	// -Y
+			2, 3, 7,	2, 7, 6,	// +Y
+			0, 2, 6,	0, 6, 4,	// -Z
+			1, 5, 7,	1, 7, 3,	// +Z
+		};
+
+		auto& box = allocator->allocate<BoxOccluderGeometry>();
+
+		// Corner I takes max on X if bit 2 is set, Y for bit 1 and Z for bit 0
+		for (uint32_t I = 0; I < 8; ++I)
+		{
+			box.vertices[I] = {
+				(I & 4) ? bounds.max.x : bounds.min.x,
+				(I & 2) ? bounds.max.y : bounds.min.y,
+				(I & 1) ? bounds.max.z : bounds.min.z };
+		}
+
+		for (uint32_t I = 0; I < 36; ++I)
+			box.indices[I] = faces[I];
+
+		RegisterOccluder(mesh, { box.vertices, box.indices, 8, 36 });
+
+		auto res = std::lower_bound(registered.begin(), registered.end(), mesh.to_uint(),
+			[](const RegisteredOccluder& lhs, const uint32_t rhs) { return lhs.mesh < rhs; });
+
+		res->box = &box;
+	}
+
+
+	void SoftwareOcclusionCuller::UnregisterOccluder(const TriMeshHandle mesh)
+	{
+		auto res = std::lower_bound(registered.begin(), registered.end(), mesh.to_uint(),
+			[](const RegisteredOccluder& lhs, const uint32_t rhs) { return lhs.mesh < rhs; });
+
+		if (res == registered.end() || res->mesh != mesh.to_uint())
+			return;
+
+		if (res->box)
+			allocator->release(res->box);
+
+		for (size_t I = res - registered.begin(); I + 1 < registered.size(); ++I)
+			registered[I] = registered[I + 1];
+
+		registered.pop_back();
+	}
+
+
+	const OccluderMesh* SoftwareOcclusionCuller::FindOccluder(const TriMeshHandle mesh) const
+	{
+		auto res = std::lower_bound(registered.begin(), registered.end(), mesh.to_uint(),
+			[](const RegisteredOccluder& lhs, const uint32_t rhs) { return lhs.mesh < rhs; });
+
+		return (res != registered.end() && res->mesh == mesh.to_uint()) ? &res->occluder : nullptr;
+	}
+
+
+	float SoftwareOcclusionCuller::GetOccluderRadius(const TriMeshHandle mesh) const
+	{
+		auto res = std::lower_bound(registered.begin(), registered.end(), mesh.to_uint(),
+			[](const RegisteredOccluder& lhs, const uint32_t rhs) { return lhs.mesh < rhs; });
+
+		return (res != registered.end() && res->mesh == mesh.to_uint()) ? res->radius : 0.0f;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Local to view space, WT is column major with the translation in the last column
+	SoftwareOcclusionCuller::ViewSpaceTransform SoftwareOcclusionCuller::_GetViewTransform(const float4x4& WT) const
+	{
+		ViewSpaceTransform out;
+
+		for (size_t I = 0; I < 3; ++I)
+		{
+			for (size_t J = 0; J < 4; ++J)
+			{
+				out.m[I][J] =
+					viewRotation[I][0] * WT[0][J] +
+					viewRotation[I][1] * WT[1][J] +
+					viewRotation[I][2] * WT[2][J];
+			}
+
+			out.m[I][3] -=
+				viewRotation[I][0] * viewPosition.x +
+				viewRotation[I][1] * viewPosition.y +
+				viewRotation[I][2] * viewPosition.z;
+		}
+
+		return out;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Triangles crossing the near plane are dropped, leaving out occluder triangles is always safe
+	size_t SoftwareOcclusionCuller::_SetupTriangles(const OccluderInstance& occluder, ScreenTriangle* out) const
+	{
+		const auto	transform	= _GetViewTransform(occluder.WT);
+		const auto&	mesh		= *occluder.mesh;
+		const float	centerX		= (tilesX * TileWidth) / 2.0f;
+		const float	centerY		= (tilesY * TileHeight) / 2.0f;
+
+		size_t triangleCount = 0;
+
+		for (size_t I = 0; I + 2 < mesh.indexCount; I += 3)
+		{
+			ScreenTriangle	triangle;
+			bool			clipped = false;
+
+			for (size_t J = 0; J < 3; ++J)
+			{
+				const float3 v = transform * mesh.vertices[mesh.indices[I + J]];
+				const float  w = -v.z;
+
+				if (w < nearPlane)
+				{
+					clipped = true;
+					break;
+				}
+
+				const float iz = 1.0f / w;
+
+				triangle.x[J]	= centerX + v.x * scaleX * iz;
+				triangle.y[J]	= centerY - v.y * scaleY * iz;
+				triangle.iz[J]	= iz;
+			}
+
+			if (!clipped)
+				out[triangleCount++] = triangle;
+		}
+
+		return triangleCount;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::_UpdateTile(Tile& tile, const uint32_t* triangleMask, const float triangleZ)
+	{
+		if (triangleZ <= tile.zMin[0])
+			return; // Nothing closer than the reference layer
+
+		bool full		= true;
+		bool covering	= true;
+
+		for (size_t I = 0; I < TileHeight; ++I)
+		{
+			full		&= (triangleMask[I] == 0xffffffff);
+			covering	&= ((triangleMask[I] & tile.mask[I]) == tile.mask[I]);
+		}
+
+		auto clearWorkingLayer = [&]
+		{
+			for (auto& row : tile.mask)
+				row = 0;
+
+			tile.zMin[1] = FLT_MAX;
+		};
+
+		if (full)
+		{
+			tile.zMin[0] = triangleZ;
+
+			if (tile.zMin[1] <= tile.zMin[0])
+				clearWorkingLayer();
+
+			return;
+		}
+
+		if (covering && triangleZ > tile.zMin[1])
+		{	// Triangle is closer and covers every pixel of the working layer, replace it
+			for (size_t I = 0; I < TileHeight; ++I)
+				tile.mask[I] = triangleMask[I];
+
+			tile.zMin[1] = triangleZ;
+			return;
+		}
+
+		bool merged = true;
+		for (size_t I = 0; I < TileHeight; ++I)
+		{
+			tile.mask[I] |= triangleMask[I];
+			merged &= (tile.mask[I] == 0xffffffff);
+		}
+
+		tile.zMin[1] = std::min(tile.zMin[1], triangleZ);
+
+		if (merged)
+		{
+			tile.zMin[0] = std::max(tile.zMin[0], tile.zMin[1]);
+			clearWorkingLayer();
+		}
+		else if (tile.zMin[1] <= tile.zMin[0])
+			clearWorkingLayer();
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::_RasterizeTriangle(const ScreenTriangle& triangle, const uint32_t tileRowBegin, const uint32_t tileRowEnd)
+	{
+		float x[3] = { triangle.x[0],	triangle.x[1],	triangle.x[2]	};
+		float y[3] = { triangle.y[0],	triangle.y[1],	triangle.y[2]	};
+		float z[3] = { triangle.iz[0],	triangle.iz[1],	triangle.iz[2]	};
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+
+		if (std::abs(area) < 1.0e-6f)
+			return;
+
+		if (area < 0.0f)
+		{	// Occluders are drawn double sided, flip to get positive edge functions inside
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		const float minX = std::min({ x[0], x[1], x[2] });
+		const float maxX = std::max({ x[0], x[1], x[2] });
+		const float minY = std::min({ y[0], y[1], y[2] });
+		const float maxY = std::max({ y[0], y[1], y[2] });
+		const float minZ = std::min({ z[0], z[1], z[2] });
+
+		const int32_t bufferRight	= int32_t(tilesX * TileWidth) - 1;
+		const int32_t bandTop		= int32_t(tileRowBegin * TileHeight);
+		const int32_t bandBottom	= int32_t(tileRowEnd * TileHeight) - 1;
+
+		const int32_t pxMin = std::max(0,			int32_t(std::floor(minX)));
+		const int32_t pxMax = std::min(bufferRight,	int32_t(std::ceil(maxX)));
+		const int32_t pyMin = std::max(bandTop,		int32_t(std::floor(minY)));
+		const int32_t pyMax = std::min(bandBottom,	int32_t(std::ceil(maxY)));
+
+		if (pxMin > pxMax || pyMin > pyMax)
+			return;
+
+		// Edge functions A * x + B * y + C, positive inside
+		float A[3], B[3], C[3];
+		for (size_t I = 0; I < 3; ++I)
+		{
+			const size_t next = (I + 1) % 3;
+
+			A[I] = -(y[next] - y[I]);
+			B[I] = x[next] - x[I];
+			C[I] = -y[I] * (x[next] - x[I]) + x[I] * (y[next] - y[I]);
+		}
+
+		// Depth plane, 1/w is linear in screen space
+		const float dx1 = x[1] - x[0], dy1 = y[1] - y[0], dz1 = z[1] - z[0];
+		const float dx2 = x[2] - x[0], dy2 = y[2] - y[0], dz2 = z[2] - z[0];
+		const float zdx = (dz1 * dy2 - dz2 * dy1) / area;
+		const float zdy = (dz2 * dx1 - dz1 * dx2) / area;
+		const float z0	= z[0] - zdx * x[0] - zdy * y[0];
+
+		for (int32_t tileY = pyMin / TileHeight; tileY <= pyMax / int32_t(TileHeight); ++tileY)
+		{
+			const float rowTop = float(tileY * TileHeight);
+
+			// Pixel span covered on each row of this tile row
+			alignas(32) int32_t spanBegin[TileHeight];
+			alignas(32) int32_t spanEnd[TileHeight];
+
+#if USING(AVX2)
+			{
+				const __m256 rowCenters = _mm256_add_ps(_mm256_set1_ps(rowTop + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+
+				__m256 left		= _mm256_set1_ps(float(pxMin));
+				__m256 right	= _mm256_set1_ps(float(pxMax));
+
+				for (size_t I = 0; I < 3; ++I)
+				{
+					const __m256 offset = _mm256_fmadd_ps(_mm256_set1_ps(B[I]), rowCenters, _mm256_set1_ps(C[I]));
+
+					if (A[I] == 0.0f)
+					{	// Horizontal edge, rows outside of it are empty
+						const __m256 outside = _mm256_cmp_ps(offset, _mm256_setzero_ps(), _CMP_LT_OQ);
+						left = _mm256_blendv_ps(left, _mm256_set1_ps(FLT_MAX), outside);
+						continue;
+					}
+
+					const __m256 bound = _mm256_div_ps(_mm256_sub_ps(_mm256_setzero_ps(), offset), _mm256_set1_ps(A[I]));
+
+					if (A[I] > 0.0f)
+						left	= _mm256_max_ps(left, bound);
+					else
+						right	= _mm256_min_ps(right, bound);
+				}
+
+				// Pixel centers inside [left, right]
+				left	= _mm256_min_ps(_mm256_ceil_ps(_mm256_sub_ps(left, _mm256_set1_ps(0.5f))), _mm256_set1_ps(float(pxMax + 1)));
+				right	= _mm256_max_ps(_mm256_floor_ps(_mm256_sub_ps(right, _mm256_set1_ps(0.5f))), _mm256_set1_ps(float(pxMin - 1)));
+
+				_mm256_store_si256((__m256i*)spanBegin,	_mm256_cvttps_epi32(left));
+				_mm256_store_si256((__m256i*)spanEnd,	_mm256_cvttps_epi32(right));
+			}
+#else
+			for (size_t row = 0; row < TileHeight; ++row)
+			{
+				const float rowCenter = rowTop + row + 0.5f;
+
+				float left	= float(pxMin);
+				float right	= float(pxMax);
+
+				for (size_t I = 0; I < 3; ++I)
+				{
+					const float offset = B[I] * rowCenter + C[I];
+
+					if (A[I] == 0.0f)
+					{
+						if (offset < 0.0f)
+							left = FLT_MAX;
+					}
+					else if (A[I] > 0.0f)
+						left	= std::max(left, -offset / A[I]);
+					else
+						right	= std::min(right, -offset / A[I]);
+				}
+
+				spanBegin[row]	= int32_t(std::min(std::ceil(left - 0.5f), float(pxMax + 1)));
+				spanEnd[row]	= int32_t(std::max(std::floor(right - 0.5f), float(pxMin - 1)));
+			}
+#endif
+
+			for (int32_t tileX = pxMin / TileWidth; tileX <= pxMax / int32_t(TileWidth); ++tileX)
+			{
+				const int32_t tileLeft = tileX * TileWidth;
+
+				alignas(32) uint32_t triangleMask[TileHeight];
+
+#if USING(AVX2)
+				const __m256i begin	= _mm256_max_epi32(_mm256_sub_epi32(_mm256_load_si256((const __m256i*)spanBegin), _mm256_set1_epi32(tileLeft)), _mm256_setzero_si256());
+				const __m256i end	= _mm256_min_epi32(_mm256_sub_epi32(_mm256_load_si256((const __m256i*)spanEnd), _mm256_set1_epi32(tileLeft)), _mm256_set1_epi32(31));
+				const __m256i ones	= _mm256_set1_epi32(-1);
+
+				// Variable shifts of 32 or more produce zero, which empties rows the span misses
+				const __m256i mask	= _mm256_and_si256(
+					_mm256_sllv_epi32(ones, begin),
+					_mm256_srlv_epi32(ones, _mm256_sub_epi32(_mm256_set1_epi32(31), end)));
+
+				if (_mm256_testz_si256(mask, mask))
+					continue;
+
+				_mm256_store_si256((__m256i*)triangleMask, mask);
+#else
+				bool empty = true;
+
+				for (size_t row = 0; row < TileHeight; ++row)
+				{
+					const int32_t begin	= std::max(spanBegin[row] - tileLeft, 0);
+					const int32_t end	= std::min(spanEnd[row] - tileLeft, 31);
+
+					triangleMask[row] = (begin <= end) ?
+						(0xffffffffu >> (31 - (end - begin))) << begin : 0u;
+
+					empty &= (triangleMask[row] == 0);
+				}
+
+				if (empty)
+					continue;
+#endif
+
+				// Farthest depth of the triangle inside this tile, the plane's minimum over the tile/bounds overlap
+				const float left	= std::max(float(tileLeft), minX);
+				const float right	= std::min(float(tileLeft + TileWidth), maxX);
+				const float top		= std::max(rowTop, minY);
+				const float bottom	= std::min(rowTop + TileHeight, maxY);
+
+				const float cornerZ = std::min(
+					std::min(zdx * left + zdy * top,	zdx * right + zdy * top),
+					std::min(zdx * left + zdy * bottom,	zdx * right + zdy * bottom)) + z0;
+
+				_UpdateTile(tiles[tileY * tilesX + tileX], triangleMask, std::max(cornerZ, minZ));
+			}
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SoftwareOcclusionCuller::RasterizeOccluders(const OccluderInstance* occluders, const size_t count, ThreadManager* threads, iAllocator* temp)
+	{
+		if (!count)
+			return;
+
+		Vector<size_t> offsets{ temp, count + 1 };
+		Vector<size_t> triangleCounts{ temp, count };
+
+		size_t totalTriangles = 0;
+		for (size_t I = 0; I < count; ++I)
+		{
+			offsets.push_back(totalTriangles);
+			triangleCounts.push_back(0);
+			totalTriangles += occluders[I].mesh->indexCount / 3;
+		}
+
+		ScreenTriangle* triangles = (ScreenTriangle*)temp->_aligned_malloc(sizeof(ScreenTriangle) * std::max<size_t>(totalTriangles, 1));
+
+		auto setupOccluder = [&](const size_t I)
+		{
+			triangleCounts[I] = _SetupTriangles(occluders[I], triangles + offsets[I]);
+		};
+
+		// Every band walks all the triangles and only touches its own tiles, so bands never write the same tile
+		const uint32_t bandCount = threads ? std::min<uint32_t>(tilesY, threads->GetThreadCount() + 1) : 1;
+
+		auto rasterizeBand = [&](const size_t band)
+		{
+			const uint32_t rowBegin	= uint32_t(band * tilesY / bandCount);
+			const uint32_t rowEnd	= uint32_t((band + 1) * tilesY / bandCount);
+
+			for (size_t I = 0; I < count; ++I)
+				for (size_t J = 0; J < triangleCounts[I]; ++J)
+					_RasterizeTriangle(triangles[offsets[I] + J], rowBegin, rowEnd);
+		};
+
+		if (!threads)
+		{
+			for (size_t I = 0; I < count; ++I)
+				setupOccluder(I);
+
+			rasterizeBand(0);
+			temp->_aligned_free(triangles);
+
+			return;
+		}
+
+		auto runParallel = [&](auto& fn, const size_t workCount)
+		{
+			WorkBarrier barrier{ *threads, temp };
+
+			for (size_t I = 1; I < workCount; ++I)
+			{
+				auto& workItem = CreateWorkItem([&fn, I] { fn(I); }, temp);
+
+				barrier.AddWork(workItem);
+				PushToLocalQueue(workItem);
+			}
+
+			fn(0);
+			barrier.JoinLocal();
+		};
+
+		runParallel(setupOccluder, count);
+		runParallel(rasterizeBand, bandCount);
+
+		temp->_aligned_free(triangles);
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t SoftwareOcclusionCuller::GetRasterizeTempSize(const size_t occluderCount) const
+	{
+		size_t maxTriangles = 0;
+		for (const auto& occluder : registered)
+			maxTriangles = std::max<size_t>(maxTriangles, occluder.occluder.indexCount / 3);
+
+		const size_t count = std::min(occluderCount, registered.size());
+
+		// offsets, triangleCounts and the triangle buffer, each aligned allocation can waste up to 16 bytes
+		return
+			sizeof(size_t) * (count + 1) + 16 +
+			sizeof(size_t) * count + 16 +
+			sizeof(ScreenTriangle) * std::max<size_t>(count * maxTriangles, 1) + 16;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool SoftwareOcclusionCuller::_TestScreenRect(float minX, float maxX, float minY, float maxY, const float izMax) const
+	{
+		const int32_t right		= int32_t(tilesX * TileWidth) - 1;
+		const int32_t bottom	= int32_t(tilesY * TileHeight) - 1;
+
+		const int32_t pxMin = std::max(0,		int32_t(std::floor(minX)));
+		const int32_t pxMax = std::min(right,	int32_t(std::floor(maxX)));
+		const int32_t pyMin = std::max(0,		int32_t(std::floor(minY)));
+		const int32_t pyMax = std::min(bottom,	int32_t(std::floor(maxY)));
+
+		if (pxMin > pxMax || pyMin > pyMax)
+			return true; // Off screen, frustum culling already decided this
+
+		for (int32_t tileY = pyMin / TileHeight; tileY <= pyMax / int32_t(TileHeight); ++tileY)
+		{
+			for (int32_t tileX = pxMin / TileWidth; tileX <= pxMax / int32_t(TileWidth); ++tileX)
+			{
+				const Tile& tile = tiles[tileY * tilesX + tileX];
+
+				if (izMax < tile.zMin[0])
+					continue;
+
+				if (izMax >= tile.zMin[1])
+					return true;
+
+				// Behind the working layer, occluded only where the bounds stay inside its mask
+				const int32_t tileLeft	= tileX * TileWidth;
+				const int32_t tileTop	= tileY * TileHeight;
+				const int32_t begin		= std::max(pxMin - tileLeft, 0);
+				const int32_t end		= std::min(pxMax - tileLeft, 31);
+				const uint32_t rowMask	= (0xffffffffu >> (31 - (end - begin))) << begin;
+
+				for (int32_t row = std::max(pyMin - tileTop, 0); row <= std::min(pyMax - tileTop, int32_t(TileHeight) - 1); ++row)
+				{
+					if ((tile.mask[row] & rowMask) != rowMask)
+						return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool SoftwareOcclusionCuller::TestBox(const AABB& localBounds, const float4x4& WT) const
+	{
+		const auto	transform	= _GetViewTransform(WT);
+		const float	centerX		= (tilesX * TileWidth) / 2.0f;
+		const float	centerY		= (tilesY * TileHeight) / 2.0f;
+
+		float minX = FLT_MAX, maxX = -FLT_MAX;
+		float minY = FLT_MAX, maxY = -FLT_MAX;
+		float izMax = 0.0f;
+
+		for (size_t I = 0; I < 8; ++I)
+		{
+			const float3 corner = {
+				(I & 1) ? localBounds.max.x : localBounds.min.x,
+				(I & 2) ? localBounds.max.y : localBounds.min.y,
+				(I & 4) ? localBounds.max.z : localBounds.min.z };
+
+			const float3 v = transform * corner;
+			const float  w = -v.z;
+
+			if (w < nearPlane)
+				return true;
+
+			const float iz = 1.0f / w;
+			const float x  = centerX + v.x * scaleX * iz;
+			const float y  = centerY - v.y * scaleY * iz;
+
+			minX	= std::min(minX, x);
+			maxX	= std::max(maxX, x);
+			minY	= std::min(minY, y);
+			maxY	= std::max(maxY, y);
+			izMax	= std::max(izMax, iz);
+		}
+
+		return _TestScreenRect(minX, maxX, minY, maxY, izMax);
+	}
+
+
+	bool SoftwareOcclusionCuller::TestAABB(const AABB& worldBounds) const
+	{
+		return TestBox(worldBounds, float4x4::Identity());
+	}
+
+
+	/************************************************************************************************/
+
+
+	size_t SoftwareOcclusionCuller::GetCoveredPixelCount() const
+	{
+		size_t covered = 0;
+
+		for (size_t I = 0; I < tilesX * tilesY; ++I)
+		{
+			if (tiles[I].zMin[0] > 0.0f)
+			{
+				covered += TileWidth * TileHeight;
+				continue;
+			}
+
+			for (auto row : tiles[I].mask)
+			{
+				for (; row; row &= row - 1)
+					covered++;
+			}
+		}
+
+		return covered;
+	}
+
+
+}	/************************************************************************************************/
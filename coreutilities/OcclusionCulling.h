@@ -0,0 +1,180 @@
+/**********************************************************************
+
+Copyright (c) 2014-2019 Robert May
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+**********************************************************************/
+
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include "..\buildsettings.h"
+#include "..\coreutilities\containers.h"
+#include "..\coreutilities\intersection.h"
+#include "..\coreutilities\MathUtils.h"
+#include "..\coreutilities\memoryutilities.h"
+#include "..\coreutilities\ResourceHandles.h"
+
+
+namespace FlexKit
+{	/************************************************************************************************/
+
+
+	class ThreadManager;
+
+
+	// CPU side occluder geometry, normally a few triangles hugging the inside of the visual mesh.
+	// Occluders must never extend past the surface they stand in for, or they will hide visible geometry.
+	struct OccluderMesh
+	{
+		const float3*	vertices	= nullptr;
+		const uint32_t*	indices		= nullptr;
+		uint32_t		vertexCount	= 0;
+		uint32_t		indexCount	= 0;
+	};
+
+
+	struct OccluderInstance
+	{
+		const OccluderMesh*	mesh;
+		float4x4			WT; // As returned by GetWT
+	};
+
+
+	/************************************************************************************************/
+
+
+	// Masked software occlusion buffer, depth only and low resolution.
+	// The screen is split into 32x8 pixel tiles that store a 256 bit coverage mask and two depth layers
+	// instead of per pixel depth: a reference depth every pixel in the tile is at least as close as, and a
+	// working depth for the pixels set in the mask. Depth is stored as 1/w, larger is closer.
+	//
+	// Per frame: SetView, Clear, RasterizeOccluders, then TestBox/TestAABB on the candidates that survived
+	// frustum culling. Testing is read only and can be done from any number of threads.
+	class FLEXKITAPI SoftwareOcclusionCuller
+	{
+	public:
+		static const uint32_t TileWidth		= 32;
+		static const uint32_t TileHeight	= 8;
+
+		SoftwareOcclusionCuller(iAllocator* allocator, const uint2 WH = { 320, 192 });
+		~SoftwareOcclusionCuller();
+
+		SoftwareOcclusionCuller(const SoftwareOcclusionCuller&)				= delete;
+		SoftwareOcclusionCuller& operator = (const SoftwareOcclusionCuller&)	= delete;
+
+		// FOV is the full vertical angle, the camera looks down -Z
+		void SetView(const float3 position, const Quaternion orientation, const float FOV, const float aspectRatio, const float nearPlane);
+		void Clear();
+
+		// Instances are transformed in parallel, then the screen is split into bands of tile rows rasterized by different workers
+		void RasterizeOccluders(const OccluderInstance* occluders, const size_t count, ThreadManager* threads, iAllocator* temp);
+
+		// Temp memory RasterizeOccluders needs for up to occluderCount registered occluders, not counting work items
+		size_t GetRasterizeTempSize(const size_t occluderCount) const;
+
+		// Return true if the bounds are possibly visible
+		bool TestBox	(const AABB& localBounds, const float4x4& WT) const;
+		bool TestAABB	(const AABB& worldBounds) const;
+
+		// Occluder geometry is owned by the caller and looked up by the mesh it stands in for
+		void				RegisterOccluder	(const TriMeshHandle mesh, const OccluderMesh& occluder);
+		// Twelve triangle box owned by the culler, for meshes that fill their bounds like floors, walls and crates
+		void				RegisterBoxOccluder	(const TriMeshHandle mesh, const AABB& localBounds);
+		void				UnregisterOccluder	(const TriMeshHandle mesh);
+		const OccluderMesh*	FindOccluder		(const TriMeshHandle mesh) const;
+		float				GetOccluderRadius	(const TriMeshHandle mesh) const;
+
+		size_t	GetOccluderBudget() const					{ return occluderBudget; }
+		void	SetOccluderBudget(const size_t budget)		{ occluderBudget = budget; }
+
+		uint2	GetWH() const { return { tilesX * TileWidth, tilesY * TileHeight }; }
+
+		// Fully covered pixel count, for debugging and tests
+		size_t	GetCoveredPixelCount() const;
+
+	private:
+		struct alignas(32) Tile
+		{
+			uint32_t	mask[TileHeight];	// One row of the tile per entry
+			float		zMin[2];			// [0] reference layer, [1] working layer
+		};
+
+		struct ScreenTriangle
+		{
+			float x[3];
+			float y[3];
+			float iz[3];
+		};
+
+		struct ViewSpaceTransform
+		{
+			float m[3][4];
+
+			float3 operator * (const float3 p) const
+			{
+				return {
+					m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+					m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+					m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3] };
+			}
+		};
+
+		struct BoxOccluderGeometry
+		{
+			float3		vertices[8];
+			uint32_t	indices[36];
+		};
+
+		struct RegisteredOccluder
+		{
+			uint32_t				mesh;
+			OccluderMesh			occluder;
+			float					radius;
+			BoxOccluderGeometry*	box = nullptr; // Set if the culler owns the geometry
+		};
+
+		ViewSpaceTransform	_GetViewTransform	(const float4x4& WT) const;
+		size_t				_SetupTriangles		(const OccluderInstance& occluder, ScreenTriangle* out) const;
+		void				_RasterizeTriangle	(const ScreenTriangle& triangle, const uint32_t tileRowBegin, const uint32_t tileRowEnd);
+		bool				_TestScreenRect		(float minX, float maxX, float minY, float maxY, const float izMax) const;
+
+		static void			_UpdateTile			(Tile& tile, const uint32_t* triangleMask, const float triangleZ);
+
+		Tile*		tiles;
+		uint32_t	tilesX;
+		uint32_t	tilesY;
+
+		float3		viewPosition;
+		float		viewRotation[3][3];
+		float		nearPlane;
+		float		scaleX;
+		float		scaleY;
+
+		size_t		occluderBudget = 32;
+
+		Vector<RegisteredOccluder>	registered; // Sorted by mesh
+		iAllocator*					allocator;
+	};
+
+
+}	/************************************************************************************************/
+
+#endif
@@ -25,23 +25,15 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "Transforms.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 
 namespace FlexKit
 {
 	/************************************************************************************************/
 
 
-	size_t CalculateNodeBufferSize(size_t BufferSize)
-	{
-		size_t PerNodeFootPrint = sizeof(LT_Entry) + sizeof(WT_Entry) + sizeof(Node) + sizeof(uint16_t);
-		return (BufferSize - sizeof(SceneNodes)) / PerNodeFootPrint;
-	}
-
-	
-	/************************************************************************************************/
-
-
-	inline uint16_t	_SNHandleToIndex(NodeHandle Node) 
+	inline uint32_t	_SNHandleToIndex(NodeHandle Node) 
 	{ 
 		return SceneNodeTable.Indexes[Node.INDEX]; 
 	}
@@ -50,7 +42,7 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	inline void		_SNSetHandleIndex(NodeHandle Node, uint16_t index)
+	inline void		_SNSetHandleIndex(NodeHandle Node, uint32_t index)
 	{ 
 		SceneNodeTable.Indexes[Node.INDEX] = index; 
 	}
@@ -59,225 +51,364 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	void InitiateSceneNodeBuffer(byte* pmem, size_t MemSize)
+	template<typename TY>
+	TY* _SNReallocate(TY* current, const size_t copyCount, const size_t newCount, const size_t alignment = 0x10)
 	{
-		size_t NodeFootPrint = sizeof(SceneNodes::BOILERPLATE);
-		size_t NodeMax = (MemSize - sizeof(SceneNodes)) / NodeFootPrint  - 0x20;
+		auto allocator	= SceneNodeTable.allocator;
+		auto newBuffer	= (TY*)allocator->_aligned_malloc(sizeof(TY) * newCount, alignment);
 
-		SceneNodeTable.Nodes = (Node*)pmem;
-		{
-			const size_t aligment = 0x10;
-			auto Memory = pmem + NodeMax;
-			size_t alignoffset = (size_t)Memory % aligment;
-			if(alignoffset)
-				Memory += aligment - alignoffset;	// 16 Byte byte Align
-			SceneNodeTable.LT = (LT_Entry*)(Memory);
-			int c = 0; // Debug Point
-		}
+		FK_ASSERT(newBuffer != nullptr, "Failed to grow scene node table!");
+
+		if (current)
 		{
-			const size_t aligment = 0x40;
-			char* Memory = (char*)SceneNodeTable.LT + NodeMax;
-			size_t alignoffset = (size_t)Memory % aligment; // Cache Align
-			if(alignoffset)
-				Memory += aligment - alignoffset;
-			SceneNodeTable.WT = (WT_Entry*)(Memory);
-			int c = 0; // Debug Point
+			memcpy(newBuffer, current, sizeof(TY) * copyCount);
+			allocator->_aligned_free(current);
 		}
-		{
-			SceneNodeTable.Flags = (char*)(SceneNodeTable.WT + NodeMax);
-			for (size_t I = 0; I < NodeMax; ++I)
-				SceneNodeTable.Flags[I] = SceneNodes::FREE;
 
-			int c = 0; // Debug Point
-		}
-		{
-			SceneNodeTable.Indexes = (uint16_t*)(SceneNodeTable.Flags + NodeMax);
-			for (size_t I = 0; I < NodeMax; ++I)
-				SceneNodeTable.Indexes[I] = 0xffff;
+		return newBuffer;
+	}
+
+
+	/************************************************************************************************/
 
-			int c = 0; // Debug Point
-		}
 
-		for (size_t I = 0; I < NodeMax; ++I)
+	void ReserveSceneNodes(const size_t nodeCount)
+	{
+		const size_t previousMax	= SceneNodeTable.max;
+		const size_t used			= SceneNodeTable.used;
+
+		if (nodeCount <= previousMax)
+			return;
+
+		SceneNodeTable.Nodes		= _SNReallocate(SceneNodeTable.Nodes,			used,			nodeCount);
+		SceneNodeTable.LT			= _SNReallocate(SceneNodeTable.LT,				used,			nodeCount);
+		SceneNodeTable.WT			= _SNReallocate(SceneNodeTable.WT,				used,			nodeCount, 0x40); // Cache Align
+		SceneNodeTable.Flags		= _SNReallocate(SceneNodeTable.Flags,			used,			nodeCount);
+		SceneNodeTable.Indexes		= _SNReallocate(SceneNodeTable.Indexes,			previousMax,	nodeCount);
+		SceneNodeTable.Depth		= _SNReallocate(SceneNodeTable.Depth,			used,			nodeCount, 0x40);
+		SceneNodeTable.LevelOrder	= _SNReallocate(SceneNodeTable.LevelOrder,		0,				nodeCount, 0x40);
+		SceneNodeTable.LevelOffsets	= _SNReallocate(SceneNodeTable.LevelOffsets,	0,				nodeCount + 1, 0x40);
+		SceneNodeTable.LevelCount	= 0;
+		SceneNodeTable.HierarchyChanged = true;
+
+		for (size_t I = used; I < nodeCount; ++I)
 		{
-			SceneNodeTable.LT[I].R = DirectX::XMQuaternionIdentity();
-			SceneNodeTable.LT[I].S = DirectX::XMVectorSet(1, 1, 1, 1);
-			SceneNodeTable.LT[I].T = DirectX::XMVectorSet(0, 0, 0, 0);
+			SceneNodeTable.Flags[I]		= SceneNodes::FREE;
+			SceneNodeTable.Depth[I]		= 0;
+
+			SceneNodeTable.LT[I].R		= DirectX::XMQuaternionIdentity();
+			SceneNodeTable.LT[I].S		= DirectX::XMVectorSet(1, 1, 1, 1);
+			SceneNodeTable.LT[I].T		= DirectX::XMVectorSet(0, 0, 0, 0);
+			SceneNodeTable.WT[I].m4x4	= DirectX::XMMatrixIdentity();
 		}
 
-		for (size_t I = 0; I < NodeMax; ++I)
-			SceneNodeTable.WT[I].m4x4 = DirectX::XMMatrixIdentity();
+		for (size_t I = previousMax; I < nodeCount; ++I)
+			SceneNodeTable.Indexes[I] = InvalidNodeIndex;
 
-		SceneNodeTable.used		= 0;
-		SceneNodeTable.max		= NodeMax;
+		SceneNodeTable.max = nodeCount;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void PushAllChildren(size_t CurrentNode, Vector<size_t>& Out)
+	void InitiateSceneNodeTable(iAllocator* allocator, const size_t initialReservation)
 	{
-		for (size_t I = 1; I < SceneNodeTable.used; ++I)
-		{
-			auto ParentIndex = _SNHandleToIndex(SceneNodeTable.Nodes[I].Parent);
-			if(ParentIndex == CurrentNode)
-			{
-				Out.push_back(I);
-				PushAllChildren(I, Out);
-			}
-		}
+		SceneNodeTable.used			= 0;
+		SceneNodeTable.max			= 0;
+		SceneNodeTable.handles		= 0;
+		SceneNodeTable.LevelCount	= 0;
+		SceneNodeTable.allocator	= allocator;
+
+		SceneNodeTable.HierarchyChanged		= true;
+		SceneNodeTable.FreeNodeCount		= 0;
+		SceneNodeTable.Sorting.inProgress	= false;
+		SceneNodeTable.Sorting.targets		= Vector<uint32_t>{ allocator };
+
+		SceneNodeTable.Nodes		= nullptr;
+		SceneNodeTable.LT			= nullptr;
+		SceneNodeTable.WT			= nullptr;
+		SceneNodeTable.Flags		= nullptr;
+		SceneNodeTable.Indexes		= nullptr;
+		SceneNodeTable.Children		= nullptr;
+		SceneNodeTable.Depth		= nullptr;
+		SceneNodeTable.LevelOrder	= nullptr;
+		SceneNodeTable.LevelOffsets	= nullptr;
+
+		SceneNodeTable.FreeHandles	= Vector<uint32_t>{ allocator };
+		SceneNodeTable.FreeNodes	= Vector<uint32_t>{ allocator };
+
+		ReserveSceneNodes(initialReservation > 1 ? initialReservation : 2);
+
+		// Handle 0 is always the root
+		GetZeroedNode();
+		SceneNodeTable.Nodes[0].Parent = InvalidHandle_t;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void ReleaseSceneNodeTable()
+	{
+		auto allocator = SceneNodeTable.allocator;
+		if (!allocator)
+			return;
+
+		allocator->_aligned_free(SceneNodeTable.Nodes);
+		allocator->_aligned_free(SceneNodeTable.LT);
+		allocator->_aligned_free(SceneNodeTable.WT);
+		allocator->_aligned_free(SceneNodeTable.Flags);
+		allocator->_aligned_free(SceneNodeTable.Indexes);
+		allocator->_aligned_free(SceneNodeTable.Depth);
+		allocator->_aligned_free(SceneNodeTable.LevelOrder);
+		allocator->_aligned_free(SceneNodeTable.LevelOffsets);
+
+		SceneNodeTable.FreeHandles.Release();
+		SceneNodeTable.FreeNodes.Release();
+		SceneNodeTable.Sorting.targets.Release();
+		SceneNodeTable.Sorting.inProgress = false;
+
+		SceneNodeTable.used			= 0;
+		SceneNodeTable.max			= 0;
+		SceneNodeTable.handles		= 0;
+		SceneNodeTable.LevelCount	= 0;
+		SceneNodeTable.allocator	= nullptr;
+	}
+
+
+	/************************************************************************************************/
+
+
+	inline size_t _SNParentIndex(const size_t nodeIndex)
+	{
+		const NodeHandle parent = SceneNodeTable.Nodes[nodeIndex].Parent;
+		if (parent.INDEX == NodeHandle(InvalidHandle_t).INDEX)
+			return 0;
+
+		const size_t parentIndex = SceneNodeTable.Indexes[parent.INDEX];
+		return (parentIndex == InvalidNodeIndex) ? 0 : parentIndex; // Orphaned nodes are treated as children of root
 	}
 
-	void SwapNodeEntryies(size_t LHS, size_t RHS)
+
+	/************************************************************************************************/
+
+
+	size_t _SNBuildLevels();
+
+
+	/************************************************************************************************/
+
+
+	// Swaps two node slots and fixes up the handle table, free slots have no handle to fix
+	void _SNSwapEntries(const size_t lhs, const size_t rhs)
 	{
-		LT_Entry	Local_Temp = SceneNodeTable.LT[LHS];
-		WT_Entry	World_Temp = SceneNodeTable.WT[LHS];
-		Node		Node_Temp  = SceneNodeTable.Nodes[LHS];
-		char		Flags_Temp = SceneNodeTable.Flags[LHS];
+		std::swap(SceneNodeTable.LT[lhs],		SceneNodeTable.LT[rhs]);
+		std::swap(SceneNodeTable.WT[lhs],		SceneNodeTable.WT[rhs]);
+		std::swap(SceneNodeTable.Nodes[lhs],	SceneNodeTable.Nodes[rhs]);
+		std::swap(SceneNodeTable.Flags[lhs],	SceneNodeTable.Flags[rhs]);
+		std::swap(SceneNodeTable.Depth[lhs],	SceneNodeTable.Depth[rhs]);
 
-		SceneNodeTable.LT[LHS]		= SceneNodeTable.LT		[RHS];
-		SceneNodeTable.WT[LHS]		= SceneNodeTable.WT		[RHS];
-		SceneNodeTable.Nodes[LHS]	= SceneNodeTable.Nodes	[RHS];
-		SceneNodeTable.Flags[LHS]	= SceneNodeTable.Flags	[RHS];
+		if (!(SceneNodeTable.Flags[lhs] & SceneNodes::FREE))
+			_SNSetHandleIndex(SceneNodeTable.Nodes[lhs].TH, (uint32_t)lhs);
 
-		SceneNodeTable.LT[RHS]		= Local_Temp;
-		SceneNodeTable.WT[RHS]		= World_Temp;
-		SceneNodeTable.Nodes[RHS]	= Node_Temp;
-		SceneNodeTable.Flags[RHS]	= Flags_Temp;
+		if (!(SceneNodeTable.Flags[rhs] & SceneNodes::FREE))
+			_SNSetHandleIndex(SceneNodeTable.Nodes[rhs].TH, (uint32_t)rhs);
+
+		SceneNodeTable.HierarchyChanged = true;
 	}
 
-	size_t FindFreeIndex()
+
+	/************************************************************************************************/
+
+
+	// Captures the current depth order as a list of handles, nodes are then moved into place one slot at a time.
+	// Layout has no effect on the results of UpdateTransforms, so hierarchy changes while a sort is in progress
+	// only cost ordering quality, released nodes are skipped and nodes created afterwards end up in the tail.
+	void _SNBeginSort()
 	{
-		size_t FreeIndex = -1;
-		for (size_t I = SceneNodeTable.used - 1; I >= 0; ++I)
-		{
-			if (SceneNodeTable.Flags[I] & SceneNodes::FREE) {
-				FreeIndex = I;
-				break;
-			}
-		}
-		return FreeIndex;
+		auto& sort = SceneNodeTable.Sorting;
+
+		if (SceneNodeTable.HierarchyChanged)
+			_SNBuildLevels();
+
+		const size_t nodeCount = SceneNodeTable.LevelCount ? SceneNodeTable.LevelOffsets[SceneNodeTable.LevelCount] : 0;
+
+		sort.targets.clear();
+		sort.targets.reserve(nodeCount);
+
+		for (size_t itr = 0; itr < nodeCount; ++itr)
+			sort.targets.push_back(SceneNodeTable.Nodes[SceneNodeTable.LevelOrder[itr]].TH.INDEX);
+
+		sort.nextTarget	= 0;
+		sort.placed		= 0;
+		sort.scan		= 0;
+		sort.inProgress	= true;
+
+		// Free slots will get moved around, so new nodes are appended and the free list is rebuilt once the sort completes
+		SceneNodeTable.FreeNodes.clear();
 	}
 
-	void SortNodes(StackAllocator* Temp)
+
+	/************************************************************************************************/
+
+
+	// Runs up to stepCount moves, returns true once the table is sorted and compacted
+	bool _SNSortStep(size_t stepCount)
 	{
-		#ifdef _DEBUG
-			std::cout << "Node Usage Before\n";
-			for (size_t I = 0; I < SceneNodeTable.used; ++I)
-				if (SceneNodeTable.Flags[I] & SceneNodes::FREE)
-					std::cout << "Node: " << I << " Unused\n";
-				else
-					std::cout << "Node: " << I << " Used\n";
-		#endif
+		auto& sort = SceneNodeTable.Sorting;
 
-		// Find Order
-		if (SceneNodeTable.used > 1)
+		// Move each target into the next free position
+		while (sort.nextTarget < sort.targets.size() && stepCount)
 		{
-			size_t NewLength = SceneNodeTable.used;
-			Vector<size_t> Out{ *Temp, SceneNodeTable.used - 1 };
+			const uint32_t	handle	= sort.targets[sort.nextTarget++];
+			const uint32_t	index	= SceneNodeTable.Indexes[handle];
+
+			if (index == InvalidNodeIndex ||
+				index < sort.placed ||
+				SceneNodeTable.Nodes[index].TH.INDEX != handle ||
+				SceneNodeTable.Flags[index] & SceneNodes::FREE)
+				continue; // Released since the sort started
+
+			if (index != sort.placed)
+				_SNSwapEntries(index, sort.placed);
 
-			for (size_t I = 1; I < SceneNodeTable.used; ++I)// First Node Is Always Root
+			sort.placed++;
+			stepCount--;
+		}
+
+		// Compact nodes created since the sort started into the tail, everything in [placed, scan) is free
+		if (sort.scan < sort.placed)
+			sort.scan = sort.placed;
+
+		while (sort.nextTarget >= sort.targets.size() && sort.scan < SceneNodeTable.used && stepCount)
+		{
+			if (!(SceneNodeTable.Flags[sort.scan] & SceneNodes::FREE))
 			{
-				if (SceneNodeTable.Flags[I] & SceneNodes::FREE) {
-					size_t II = I + 1;
-					for (; II < SceneNodeTable.used; ++II)
-						if (!(SceneNodeTable.Flags[II] & SceneNodes::FREE))
-							break;
-					
-					SwapNodeEntryies(I, II);
-					SceneNodeTable.Indexes[I] = (uint16_t)I;
-					SceneNodeTable.Indexes[II]= (uint16_t)II;
-					NewLength--;
-					int x = 0;
-				}
-				if(SceneNodeTable.Nodes[I].Parent == NodeHandle(-1))
-					continue;
-
-				size_t ParentIndex = _SNHandleToIndex(SceneNodeTable.Nodes[I].Parent);
-				if (ParentIndex > I)
-				{					
-					SwapNodeEntryies(ParentIndex, I);
-					SceneNodeTable.Indexes[ParentIndex]	= (uint16_t)I;
-					SceneNodeTable.Indexes[I]			= (uint16_t)ParentIndex;
-				}
+				if (sort.scan != sort.placed)
+					_SNSwapEntries(sort.scan, sort.placed);
+
+				sort.placed++;
 			}
-			SceneNodeTable.used = NewLength + 1;
-#ifdef _DEBUG
-			std::cout << "Node Usage After\n";
-			for (size_t I = 0; I < SceneNodeTable.used; ++I)
-				if (SceneNodeTable.Flags[I] & SceneNodes::FREE)
-					std::cout << "Node: " << I << " Unused\n";
-				else
-					std::cout << "Node: " << I << " Used\n";
-#endif
+
+			sort.scan++;
+			stepCount--;
 		}
+
+		if (!stepCount)
+			return false;
+
+		// Only free slots remain past placed
+		SceneNodeTable.used = sort.placed;
+		SceneNodeTable.FreeNodes.clear();
+
+		for (size_t itr = 1; itr < SceneNodeTable.used; ++itr)
+			if (SceneNodeTable.Flags[itr] & SceneNodes::FREE)
+				SceneNodeTable.FreeNodes.push_back((uint32_t)itr); // Released after being placed
+
+		sort.targets.clear();
+		sort.inProgress						= false;
+		SceneNodeTable.HierarchyChanged		= true;
+
+		return true;
 	}
 
 
 	/************************************************************************************************/
 
-	// TODO: Search an optional Free List
-	NodeHandle GetNewNode()
+
+	void SortNodes()
+	{
+		_SNBeginSort();
+		_SNSortStep(-1);
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool SortNodesIncremental(const double budgetMS)
 	{
-		if (SceneNodeTable.max < SceneNodeTable.used)
-			FK_ASSERT(0);
+		using clock = std::chrono::high_resolution_clock;
 
-		uint16_t HandleIndex	= 0;
-        uint16_t NodeIndex		= 0;
+		const size_t	stepsPerCheck	= 256;
+		const auto		begin			= clock::now();
 
+		if (!SceneNodeTable.Sorting.inProgress)
+			_SNBeginSort();
+
+		do
 		{
-            uint16_t itr = 0;
-            uint16_t end = (uint16_t)SceneNodeTable.max;
-			for (; itr < end; ++itr)
-			{
-				if (SceneNodeTable.Indexes[itr] == 0xffff)
-					break;
-			}
-			NodeIndex = itr;
+			if (_SNSortStep(stepsPerCheck))
+				return true;
+		} while (std::chrono::duration<double, std::milli>(clock::now() - begin).count() < budgetMS);
 
-			itr = 0;
-			for (; itr < end; ++itr)
-			{
-				if (SceneNodeTable.Flags[itr] & SceneNodes::FREE) break;
-			}
+		return false;
+	}
 
-			HandleIndex = itr;
-		}
 
-		SceneNodeTable.Flags[NodeIndex] = SceneNodes::DIRTY;
-		auto node = NodeHandle(HandleIndex);
+	/************************************************************************************************/
 
-		SceneNodeTable.Indexes[HandleIndex] = NodeIndex;
-		SceneNodeTable.Nodes[node.INDEX].TH	= node;
-		SceneNodeTable.used++;
 
-		return node;
+	bool SortInProgress()
+	{
+		return SceneNodeTable.Sorting.inProgress;
 	}
 
 
 	/************************************************************************************************/
 
 
-	void SwapNodes(NodeHandle lhs, NodeHandle rhs)
+	NodeHandle GetNewNode()
 	{
-		auto lhs_Index = _SNHandleToIndex(lhs);
-		auto rhs_Index = _SNHandleToIndex(rhs);
-		SwapNodeEntryies(lhs_Index, rhs_Index);
+		uint32_t nodeIndex = 0;
+
+		while (SceneNodeTable.FreeNodes.size() &&
+			!(SceneNodeTable.Flags[SceneNodeTable.FreeNodes.back()] & SceneNodes::FREE)) // Moved by an in progress sort
+			SceneNodeTable.FreeNodes.pop_back();
+
+		if (SceneNodeTable.FreeNodes.size())
+			nodeIndex = SceneNodeTable.FreeNodes.pop_back();
+		else
+		{
+			if (SceneNodeTable.used >= SceneNodeTable.max)
+				ReserveSceneNodes(SceneNodeTable.max * 2);
+
+			nodeIndex = (uint32_t)SceneNodeTable.used++;
+		}
+
+		const uint32_t handleIndex = SceneNodeTable.FreeHandles.size() ? 
+			SceneNodeTable.FreeHandles.pop_back() :
+			(uint32_t)SceneNodeTable.handles++;
+
+		auto node = NodeHandle(handleIndex);
 
-		_SNSetHandleIndex(lhs, rhs_Index);
-		_SNSetHandleIndex(rhs, lhs_Index);
+		SceneNodeTable.Flags[nodeIndex]			= SceneNodes::DIRTY;
+		SceneNodeTable.Indexes[handleIndex]		= nodeIndex;
+		SceneNodeTable.Nodes[nodeIndex].TH		= node;
+		SceneNodeTable.Nodes[nodeIndex].Parent	= NodeHandle(0);
+		SceneNodeTable.HierarchyChanged			= true;
+
+		return node;
 	}
 
-	
+
 	/************************************************************************************************/
 
 
 	void ReleaseNode(NodeHandle handle)
 	{
-		SceneNodeTable.Flags[_SNHandleToIndex(handle)] = SceneNodes::FREE;
-		SceneNodeTable.Nodes[_SNHandleToIndex(handle)].Parent = NodeHandle(-1);
-		_SNSetHandleIndex(handle, -1);
+		const auto index = _SNHandleToIndex(handle);
+
+		SceneNodeTable.Flags[index]			= SceneNodes::FREE;
+		SceneNodeTable.Nodes[index].Parent	= InvalidHandle_t;
+		_SNSetHandleIndex(handle, InvalidNodeIndex);
+
+		SceneNodeTable.FreeHandles.push_back(handle.INDEX);
+		SceneNodeTable.HierarchyChanged = true;
+
+		if (!SceneNodeTable.Sorting.inProgress)
+			SceneNodeTable.FreeNodes.push_back(index);
 	}
 
 	
@@ -298,13 +429,10 @@ namespace FlexKit
 
 	void SetParentNode(NodeHandle parent, NodeHandle node)
 	{
-		auto ParentIndex	= _SNHandleToIndex(parent);
-		auto ChildIndex		= _SNHandleToIndex(node);
-
-		if (ChildIndex < ParentIndex)
-			SwapNodes(parent, node);
-
+		// Children no longer need to be after their parent, SortNodes restores the depth-ordered layout
 		SceneNodeTable.Nodes[SceneNodeTable.Indexes[node.INDEX]].Parent = parent;
+		SceneNodeTable.HierarchyChanged = true;
+
 		SetFlag(node, SceneNodes::DIRTY);
 	}
 
@@ -333,45 +461,51 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	void SetPositionW(NodeHandle node, float3 in) // Sets Position in World Space
+	// Index based versions of the setters, shared by the single node and batched calls
+
+	inline void _SNSetPositionW(const size_t index, const float3 in)
 	{
-#if 0
-		using DirectX::XMQuaternionConjugate;
-		using DirectX::XMQuaternionMultiply;
-		using DirectX::XMVectorSubtract;
+		auto& wt = SceneNodeTable.WT[index].m4x4;
+		wt.r[0].m128_f32[3] = in.x;
+		wt.r[1].m128_f32[3] = in.y;
+		wt.r[2].m128_f32[3] = in.z;
 
-		// Set New Local Position
-		LT_Entry Local;
-		WT_Entry Parent;
+		// WT is affine, Inverse(WT) * Translation(in) leaves in as the local position
+		auto& Local = SceneNodeTable.LT[index];
+		Local.T = DirectX::XMVectorSelect(Local.T, in.pfloats, DirectX::g_XMSelect1110);
 
-		// Gather
-		GetLocal(Nodes, node, &Local);
-		GetTransform(Nodes, GetParentNode(Nodes, node), &Parent);
+		SceneNodeTable.Flags[index] |= SceneNodes::DIRTY;
+	}
 
-		// Calculate
-		Local.T = XMVectorSubtract( Parent.World.T, in.pfloats );
-		SetLocal(Nodes, node, &Local);
-#else
-		DirectX::XMMATRIX wt;
-		GetTransform(node, &wt);
-		auto tmp =  DirectX::XMMatrixInverse(nullptr, wt) * DirectX::XMMatrixTranslation(in[0], in[1], in[2] );
-		float3 lPosition = float3( tmp.r[3].m128_f32[0], tmp.r[3].m128_f32[1], tmp.r[3].m128_f32[2] );
 
-		wt.r[0].m128_f32[3] = in.x;
-		wt.r[1].m128_f32[3] = in.y;
-		wt.r[2].m128_f32[3] = in.z;
+	inline void _SNSetOrientation(const size_t index, const Quaternion& in)
+	{
+		const DirectX::XMMATRIX parentWT = DirectX::XMMatrixTranspose(SceneNodeTable.WT[_SNParentIndex(index)].m4x4);
+		const Quaternion		parentQ  = FlexKit::Matrix2Quat(FlexKit::XMMatrixToFloat4x4(&parentWT)).Inverse();
 
-		SetWT(node, &wt);
-		// Set New Local Position
-		LT_Entry Local(GetLocal(node));
+		SceneNodeTable.LT[index].R		= DirectX::XMQuaternionMultiply(in, parentQ);
+		SceneNodeTable.Flags[index]		|= SceneNodes::DIRTY;
+	}
 
-		Local.T.m128_f32[0] = lPosition[0];
-		Local.T.m128_f32[1] = lPosition[1];
-		Local.T.m128_f32[2] = lPosition[2];
 
-		SetLocal	(node, &Local);
-		SetFlag		(node, SceneNodes::DIRTY);
-#endif
+	inline void _SNTranslateWorld(const size_t index, const float3 XYZ)
+	{
+		const auto MI	= DirectX::XMMatrixInverse(nullptr, SceneNodeTable.WT[_SNParentIndex(index)].m4x4);
+		const auto V	= DirectX::XMVector4Transform(XYZ.pfloats, MI);
+
+		auto& Local = SceneNodeTable.LT[index];
+		Local.T = DirectX::XMVectorSelect(Local.T, DirectX::XMVectorAdd(Local.T, V), DirectX::g_XMSelect1110);
+
+		SceneNodeTable.Flags[index] |= SceneNodes::DIRTY;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetPositionW(NodeHandle node, float3 in) // Sets Position in World Space
+	{
+		_SNSetPositionW(_SNHandleToIndex(node), in);
 	}
 
 
@@ -521,16 +655,7 @@ namespace FlexKit
 
 	void SetOrientation(NodeHandle node, Quaternion& in)
 	{
-		DirectX::XMMATRIX wt;
-		LT_Entry Local(GetLocal(node));
-		GetTransform(FlexKit::GetParentNode(node), &wt);
-
-		auto tmp2 = FlexKit::Matrix2Quat(FlexKit::XMMatrixToFloat4x4(&DirectX::XMMatrixTranspose(wt)));
-		tmp2 = tmp2.Inverse();
-
-		Local.R = DirectX::XMQuaternionMultiply(in, tmp2);
-		SetLocal(node, &Local);
-		SetFlag(node, SceneNodes::DIRTY);
+		_SNSetOrientation(_SNHandleToIndex(node), in);
 	}
 
 	
@@ -549,85 +674,189 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
-	bool UpdateTransforms()
+	// Groups all live nodes by hierarchy depth, returns the number of free nodes found
+	size_t _SNBuildLevels()
 	{
-		using DirectX::XMMatrixIdentity;
-		using DirectX::XMMatrixMultiply;
-		using DirectX::XMMatrixTranspose;
-		using DirectX::XMMatrixTranslationFromVector;
-		using DirectX::XMMatrixScalingFromVector;
-		using DirectX::XMMatrixRotationQuaternion;
+		const uint32_t	unknown		= 0xffffffff;
+		const size_t	end			= SceneNodeTable.used;
+		auto			Depth		= SceneNodeTable.Depth;
+		auto			Order		= SceneNodeTable.LevelOrder;
+		auto			Offsets		= SceneNodeTable.LevelOffsets;
 
-		SceneNodeTable.WT[0].SetToIdentity();// Making sure root is Identity 
-#if 0
-		for (size_t itr = 1; itr < Nodes->used; ++itr)// Skip Root
+		SceneNodeTable.HierarchyChanged = false;
+
+		if (!end)
+		{
+			SceneNodeTable.LevelCount		= 0;
+			SceneNodeTable.FreeNodeCount	= 0;
+			return 0;
+		}
+
+		for (size_t itr = 1; itr < end; ++itr)
+			Depth[itr] = unknown;
+
+		Depth[0] = 0;
+
+		size_t		freeNodes	= 0;
+		uint32_t	maxDepth	= 0;
+
+		for (size_t itr = 1; itr < end; ++itr)
 		{
-			if ( Nodes->Flags[itr]												| SceneNodes::DIRTY || 
-				 Nodes->Flags[_SNHandleToIndex(Nodes, Nodes->Nodes[itr].Parent)]| SceneNodes::DIRTY )
+			if (SceneNodeTable.Flags[itr] & SceneNodes::FREE)
 			{
-				Nodes->Flags[itr] = Nodes->Flags[itr] | SceneNodes::DIRTY; // To cause Further children to update
-				bool			  EnableScale = Nodes->Nodes[itr].Scaleflag;
-				FlexKit::WT_Entry Parent;
-				FlexKit::WT_Entry WOut;
-				FlexKit::LT_Entry LIn;
-
-				// Gather
-				GetTransform(Nodes, Nodes->Nodes[itr].Parent, &Parent);
-
-				WOut = Nodes->WT[itr];
-				LIn  = Nodes->LT[itr];
-
-				// Calculate
-				WOut.World.R = DirectX::XMQuaternionMultiply(LIn.R, Parent.World.R);
-				WOut.World.S = DirectX::XMVectorMultiply	(LIn.S, Parent.World.S);
-
-				LIn.T.m128_f32[3] = 0;// Should Always Be Zero
-				//if(EnableScale)	WOut.World.T = DirectX::XMVectorMultiply(Parent.World.S, LIn.T);
-				WOut.World.T = DirectX::XMQuaternionMultiply(DirectX::XMQuaternionConjugate(Parent.World.R), LIn.T);
-				WOut.World.T = DirectX::XMQuaternionMultiply(WOut.World.T, Parent.World.R);
-				WOut.World.T = DirectX::XMVectorAdd			(WOut.World.T, Parent.World.T);
-
-				// Write Results
-				Nodes->WT[itr] = WOut;
+				freeNodes++;
+				continue;
 			}
+
+			// Walk up until a node with a known depth is found, LevelOrder is used as scratch space here
+			size_t chainLength	= 0;
+			size_t nodeIndex	= itr;
+
+			while (Depth[nodeIndex] == unknown)
+			{
+				FK_ASSERT(chainLength < end, "Cycle in scene graph!");
+
+				Order[chainLength++]	= (uint32_t)nodeIndex;
+				nodeIndex				= _SNParentIndex(nodeIndex);
+			}
+
+			uint32_t depth = Depth[nodeIndex];
+			while (chainLength)
+				Depth[Order[--chainLength]] = ++depth;
+
+			maxDepth = depth > maxDepth ? depth : maxDepth;
 		}
-#else
-		for (size_t itr = 1; itr < SceneNodeTable.used; ++itr)
-			if (SceneNodeTable.Flags[itr] | SceneNodes::UPDATED && !(SceneNodeTable.Flags[itr] | SceneNodes::DIRTY))
-				SceneNodeTable.Flags[itr] ^= SceneNodes::CLEAR;
 
-		size_t Unused_Nodes = 0;;
-		for (size_t itr = 1; itr < SceneNodeTable.used; ++itr)
+		// Counting sort by depth, root is always the only node in level 0
+		const size_t levelCount = maxDepth + 1;
+		for (size_t itr = 0; itr <= levelCount; ++itr)
+			Offsets[itr] = 0;
+
+		Offsets[1] = 1;
+		for (size_t itr = 1; itr < end; ++itr)
+			if (!(SceneNodeTable.Flags[itr] & SceneNodes::FREE))
+				Offsets[Depth[itr] + 1]++;
+
+		for (size_t itr = 1; itr <= levelCount; ++itr)
+			Offsets[itr] += Offsets[itr - 1];
+
+		// Offsets are used as insertion cursors, leaving each one at the start of the next level
+		Order[Offsets[0]++] = 0;
+		for (size_t itr = 1; itr < end; ++itr)
+			if (!(SceneNodeTable.Flags[itr] & SceneNodes::FREE))
+				Order[Offsets[Depth[itr]]++] = (uint32_t)itr;
+
+		for (size_t itr = levelCount; itr > 0; --itr)
+			Offsets[itr] = Offsets[itr - 1];
+
+		Offsets[0] = 0;
+
+		SceneNodeTable.LevelCount		= levelCount;
+		SceneNodeTable.FreeNodeCount	= freeNodes;
+		return freeNodes;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Recomputes the world transforms of a stream of nodes that share the same depth.
+	// Parents are always one level up, so they are final by the time a level is processed.
+	void _UpdateTransformStream(const uint32_t* __restrict indices, const size_t count)
+	{
+		using namespace DirectX;
+
+		const char	updated		= SceneNodes::UPDATED;
+		const char	dirty		= SceneNodes::DIRTY;
+		const auto	Flags		= SceneNodeTable.Flags;
+		const auto	LT			= SceneNodeTable.LT;
+		const auto	WT			= SceneNodeTable.WT;
+
+		for (size_t itr = 0; itr < count; ++itr)
+		{
+			const size_t nodeIndex		= indices[itr];
+			const size_t parentIndex	= _SNParentIndex(nodeIndex);
+			const char	 flags			= Flags[nodeIndex];
+
+			if (!((flags & dirty) || (Flags[parentIndex] & updated)))
+			{
+				Flags[nodeIndex] = flags & ~updated;
+				continue;
+			}
+
+			const LT_Entry& local	= LT[nodeIndex];
+			const XMVECTOR	scale	= (flags & SceneNodes::SCALE) ? local.S : g_XMOne.v;
+
+			// Local = Rotation * Scale * Translation, composed directly instead of through three matrix multiplies
+			XMMATRIX localT = XMMatrixRotationQuaternion(local.R);
+			localT.r[0] = XMVectorMultiply(localT.r[0], scale);
+			localT.r[1] = XMVectorMultiply(localT.r[1], scale);
+			localT.r[2] = XMVectorMultiply(localT.r[2], scale);
+			localT.r[3] = XMVectorSelect(g_XMIdentityR3.v, local.T, g_XMSelect1110.v);
+
+			// World transforms are stored transposed, Transpose(L * Transpose(P)) == P * Transpose(L)
+			WT[nodeIndex].m4x4	= XMMatrixMultiply(WT[parentIndex].m4x4, XMMatrixTranspose(localT));
+			Flags[nodeIndex]	= (flags & ~dirty) | updated; // Propagates to children in the next level
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	bool UpdateTransforms(ThreadManager* threads, iAllocator* temp)
+	{
+		const size_t minChunkSize		= TransformUpdateChunkSize;
+		const size_t parallelThreshold	= minChunkSize * 2;
+
+		if (!SceneNodeTable.used)
+			return false;
+
+		SceneNodeTable.WT[0].SetToIdentity();// Making sure root is Identity 
+		SceneNodeTable.Flags[0] &= ~(SceneNodes::DIRTY | SceneNodes::UPDATED);
+
+		// Levels only change with the hierarchy, so they're reused across frames with only transform changes
+		if (SceneNodeTable.HierarchyChanged)
+			_SNBuildLevels();
+
+		const size_t freeNodes = SceneNodeTable.FreeNodeCount;
+
+		for (size_t level = 1; level < SceneNodeTable.LevelCount; ++level)
 		{
-			if (!(SceneNodeTable.Flags[itr] & SceneNodes::FREE)  &&
-				 (SceneNodeTable.Flags[itr] | SceneNodes::DIRTY) ||
-				SceneNodeTable.Flags[_SNHandleToIndex(SceneNodeTable.Nodes[itr].Parent)] | SceneNodes::UPDATED)
+			const uint32_t* begin	= SceneNodeTable.LevelOrder + SceneNodeTable.LevelOffsets[level];
+			const size_t	count	= SceneNodeTable.LevelOffsets[level + 1] - SceneNodeTable.LevelOffsets[level];
+
+			if (!threads || !temp || count < parallelThreshold)
 			{
-				SceneNodeTable.Flags[itr] ^= SceneNodes::DIRTY;
-				SceneNodeTable.Flags[itr] |= SceneNodes::UPDATED; // Propagates Dirty Status of Panret to Children to update
+				_UpdateTransformStream(begin, count);
+				continue;
+			}
 
-				DirectX::XMMATRIX LT = XMMatrixIdentity();
-				LT_Entry TRS = GetLocal(SceneNodeTable.Nodes[itr].TH);
+			// Levels are split across workers, next level can only start once this one is complete
+			const size_t workerCount	= threads->GetThreadCount() + 1;
+			const size_t chunkSize		= std::max(minChunkSize, count / (workerCount * 2));
 
-				bool sf = (SceneNodeTable.Flags[itr] & SceneNodes::StateFlags::SCALE) != 0;
-				LT =(	XMMatrixRotationQuaternion(TRS.R) *
-						XMMatrixScalingFromVector(sf ? TRS.S : float3(1.0f, 1.0f, 1.0f).pfloats)) *
-						XMMatrixTranslationFromVector(TRS.T);
+			WorkBarrier barrier{ *threads, temp };
+
+			for (size_t offset = chunkSize; offset < count; offset += chunkSize)
+			{
+				const size_t end = (offset + chunkSize < count) ? offset + chunkSize : count;
 
-				auto ParentIndex = _SNHandleToIndex(SceneNodeTable.Nodes[itr].Parent);
-				auto PT = SceneNodeTable.WT[ParentIndex].m4x4;
-				auto WT = XMMatrixTranspose(XMMatrixMultiply(LT, XMMatrixTranspose(PT)));
+				auto& workItem = CreateWorkItem(
+					[begin, offset, end]
+					{
+						_UpdateTransformStream(begin + offset, end - offset);
+					}, temp);
 
-				auto temp						= SceneNodeTable.WT[itr].m4x4;
-				SceneNodeTable.WT[itr].m4x4	= WT;
+				barrier.AddWork(workItem);
+				PushToLocalQueue(workItem);
 			}
 
-			Unused_Nodes += (SceneNodeTable.Flags[itr] & SceneNodes::FREE);
+			_UpdateTransformStream(begin, chunkSize);
+			barrier.JoinLocal();
 		}
-#endif
 
-		SceneNodeTable.WT[0].SetToIdentity();// Making sure root is Identity 
-		return ((float(Unused_Nodes) / float(SceneNodeTable.used)) > 0.25f);
+		return ((float(freeNodes) / float(SceneNodeTable.used)) > 0.25f);
 	}
 
 
@@ -659,18 +888,29 @@ namespace FlexKit
 	auto& QueueTransformUpdateTask(UpdateDispatcher& Dispatcher)
 	{
 		struct TransformUpdateData
-		{};
+		{
+			ThreadManager*	threads;
+			StackAllocator	taskMemory; // Work items for the parallel levels
+		};
 
 		auto& TransformUpdate = Dispatcher.Add<TransformUpdateData>(
             TransformComponentID,
 			[&](auto& Builder, TransformUpdateData& Data)
 			{
+				// Every work item covers at least TransformUpdateChunkSize nodes
+				const size_t taskMemorySize = KILOBYTE * 2 * (SceneNodeTable.used / TransformUpdateChunkSize + 16);
+				Data.taskMemory.Init((byte*)Dispatcher.allocator->malloc(taskMemorySize), taskMemorySize);
+				Data.threads = Dispatcher.threads;
+
 				Builder.SetDebugString("UpdateTransform");
 			},
 			[](auto& Data)
 			{
 				FK_LOG_9("Transform Update");
-				UpdateTransforms();
+
+				// Fragmented tables get sorted over several frames
+				if (UpdateTransforms(Data.threads, Data.taskMemory) || SortInProgress())
+					SortNodesIncremental(TransformSortBudgetMS);
 			});
 
 		return TransformUpdate;
@@ -731,12 +971,7 @@ namespace FlexKit
 
 	void TranslateWorld(NodeHandle Node, float3 XYZ)
 	{
-		XMMATRIX WT;
-		GetTransform(GetParentNode(Node), &WT);
-
-		auto MI = DirectX::XMMatrixInverse(nullptr, WT);
-		auto V	= DirectX::XMVector4Transform(XYZ.pfloats, MI);
-		TranslateLocal(Node, float3(V));
+		_SNTranslateWorld(_SNHandleToIndex(Node), XYZ);
 	}
 
 
@@ -797,5 +1032,115 @@ namespace FlexKit
 	}
 
 
+	/************************************************************************************************/
+
+
+	// Entries are reordered by node index, so the writes walk the node table front to back
+	template<typename TY>
+	void _SNSortByNodeIndex(TY* entries, const size_t count)
+	{
+		const auto Indexes = SceneNodeTable.Indexes;
+
+		std::sort(entries, entries + count,
+			[&](const TY& lhs, const TY& rhs)
+			{
+				return Indexes[lhs.node.INDEX] < Indexes[rhs.node.INDEX];
+			});
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetPositionsW(NodePosition* positions, const size_t count)
+	{
+		_SNSortByNodeIndex(positions, count);
+
+		for (size_t itr = 0; itr < count; ++itr)
+			_SNSetPositionW(SceneNodeTable.Indexes[positions[itr].node.INDEX], positions[itr].position);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetPositionsL(NodePosition* positions, const size_t count)
+	{
+		_SNSortByNodeIndex(positions, count);
+
+		auto LT		= SceneNodeTable.LT;
+		auto Flags	= SceneNodeTable.Flags;
+
+		for (size_t itr = 0; itr < count; ++itr)
+		{
+			const auto index = SceneNodeTable.Indexes[positions[itr].node.INDEX];
+
+			LT[index].T		= positions[itr].position;
+			Flags[index]	|= SceneNodes::DIRTY;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetOrientations(NodeOrientation* orientations, const size_t count)
+	{
+		_SNSortByNodeIndex(orientations, count);
+
+		for (size_t itr = 0; itr < count; ++itr)
+			_SNSetOrientation(SceneNodeTable.Indexes[orientations[itr].node.INDEX], orientations[itr].orientation);
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetOrientationsL(NodeOrientation* orientations, const size_t count)
+	{
+		_SNSortByNodeIndex(orientations, count);
+
+		auto LT		= SceneNodeTable.LT;
+		auto Flags	= SceneNodeTable.Flags;
+
+		for (size_t itr = 0; itr < count; ++itr)
+		{
+			const auto index = SceneNodeTable.Indexes[orientations[itr].node.INDEX];
+
+			LT[index].R		= orientations[itr].orientation;
+			Flags[index]	|= SceneNodes::DIRTY;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SetPosesW(NodePose* poses, const size_t count)
+	{
+		_SNSortByNodeIndex(poses, count);
+
+		for (size_t itr = 0; itr < count; ++itr)
+		{
+			const auto index = SceneNodeTable.Indexes[poses[itr].node.INDEX];
+
+			_SNSetPositionW		(index, poses[itr].position);
+			_SNSetOrientation	(index, poses[itr].orientation);
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void TranslateWorld(NodePosition* translations, const size_t count)
+	{
+		_SNSortByNodeIndex(translations, count);
+
+		for (size_t itr = 0; itr < count; ++itr)
+			_SNTranslateWorld(SceneNodeTable.Indexes[translations[itr].node.INDEX], translations[itr].position);
+	}
+
+
 	/************************************************************************************************/
 }
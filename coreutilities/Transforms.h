@@ -34,7 +34,9 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 namespace FlexKit
 {
-	const	size_t											NodeHandleSize = 16;
+	const	size_t											NodeHandleSize = 32;
+	const	size_t											TransformUpdateChunkSize = 1024; // Minimum number of nodes handed to a worker by UpdateTransforms
+	const	double											TransformSortBudgetMS = 0.5; // Per frame time given to SortNodesIncremental by the transform update task
 	typedef Handle_t<NodeHandleSize, GetCRCGUID(SCENENODE)>	NodeHandle;
 	typedef Handle_t<16, GetCRCGUID(TextureSet)>			TextureSetHandle;
 	typedef static_vector<NodeHandle, 32>					ChildrenVector;
@@ -92,28 +94,38 @@ namespace FlexKit
 			UPDATED = 0x08
 		};
 
-		size_t used;
-		size_t max;
+		size_t used;		// Node slots in use, including free slots not yet compacted by SortNodes
+		size_t max;			// Capacity, grows as nodes are requested
+		size_t handles;		// Handles ever issued, released handles are recycled through FreeHandles
 
 		Node*			Nodes;
 		LT_Entry*		LT;
 		WT_Entry*		WT;
 		char*			Flags;
 
-		uint16_t*		Indexes;
+		uint32_t*		Indexes;
 		ChildrenVector* Children;
 
+		Vector<uint32_t>	FreeHandles;
+		Vector<uint32_t>	FreeNodes;
+		iAllocator*			allocator;
 
-		#pragma pack(push, 1)
-		struct BOILERPLATE
+		// Depth ordering, rebuilt by UpdateTransforms
+		uint32_t*		Depth;
+		uint32_t*		LevelOrder;		// Node indices grouped by depth
+		uint32_t*		LevelOffsets;	// Level N is LevelOrder[LevelOffsets[N], LevelOffsets[N + 1])
+		size_t			LevelCount;
+		size_t			FreeNodeCount;
+		bool			HierarchyChanged; // Set on any change that invalidates the levels
+
+		struct
 		{
-			Node		N;
-			LT_Entry	LT;
-			WT_Entry	WT;
-			uint16_t	I;
-			char		State;
-		};
-		#pragma pack(pop)
+			Vector<uint32_t>	targets;	// Handles in depth order, captured when the sort starts
+			size_t				nextTarget;
+			size_t				placed;		// Slots [0, placed) are in their final order
+			size_t				scan;
+			bool				inProgress;
+		}Sorting;
 
 	}SceneNodeTable;
 
@@ -121,11 +133,17 @@ namespace FlexKit
 	/************************************************************************************************/
 	// TODO: add no except where applicable
 
-	FLEXKITAPI uint16_t	_SNHandleToIndex	(NodeHandle Node);
-	FLEXKITAPI void		_SNSetHandleIndex	(NodeHandle Node, uint16_t index);
+	const uint32_t InvalidNodeIndex = 0xffffffff;
 
-	FLEXKITAPI void			InitiateSceneNodeBuffer		( byte* pmem, size_t );
-	FLEXKITAPI void			SortNodes					( StackAllocator* Temp );
+	FLEXKITAPI uint32_t	_SNHandleToIndex	(NodeHandle Node);
+	FLEXKITAPI void		_SNSetHandleIndex	(NodeHandle Node, uint32_t index);
+
+	FLEXKITAPI void			InitiateSceneNodeTable		( iAllocator* allocator, size_t initialReservation = 4096 );
+	FLEXKITAPI void			ReleaseSceneNodeTable		();
+	FLEXKITAPI void			ReserveSceneNodes			( size_t nodeCount ); // Table must not grow while UpdateTransforms is running
+	FLEXKITAPI void			SortNodes					();								// Orders nodes by depth and compacts out free slots
+	FLEXKITAPI bool			SortNodesIncremental		( double budgetMS );			// Same as SortNodes, spread over several calls. Returns true once complete
+	FLEXKITAPI bool			SortInProgress				();
 	FLEXKITAPI void			ReleaseNode					( NodeHandle Node );
 
 	FLEXKITAPI float3		LocalToGlobal				( NodeHandle Node, float3 POS);
@@ -160,7 +178,35 @@ namespace FlexKit
 
 
 
-	FLEXKITAPI bool		UpdateTransforms();
+	struct NodePosition
+	{
+		NodeHandle	node;
+		float3		position;
+	};
+
+	struct NodeOrientation
+	{
+		NodeHandle	node;
+		Quaternion	orientation;
+	};
+
+	struct NodePose
+	{
+		NodeHandle	node;
+		float3		position;
+		Quaternion	orientation;
+	};
+
+	// Batched setters, same results as calling the single node versions on each entry. Entries are sorted by node index in place
+	FLEXKITAPI void			SetPositionsW				( NodePosition*		positions,		size_t count );
+	FLEXKITAPI void			SetPositionsL				( NodePosition*		positions,		size_t count );
+	FLEXKITAPI void			SetOrientations				( NodeOrientation*	orientations,	size_t count ); // Sets World Orientation
+	FLEXKITAPI void			SetOrientationsL			( NodeOrientation*	orientations,	size_t count );
+	FLEXKITAPI void			SetPosesW					( NodePose*			poses,			size_t count ); // SetPositionW and SetOrientation
+	FLEXKITAPI void			TranslateWorld				( NodePosition*		translations,	size_t count );
+
+
+	FLEXKITAPI bool		UpdateTransforms				( ThreadManager* threads = nullptr, iAllocator* temp = nullptr ); // Returns true when the table is fragmented enough to need a SortNodes
 	FLEXKITAPI auto&	QueueTransformUpdateTask	    ( UpdateDispatcher& Dispatcher );
 
 	FLEXKITAPI inline void Yaw							( NodeHandle Node,	float r );
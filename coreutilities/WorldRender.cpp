@@ -231,6 +231,67 @@ namespace FlexKit
     /************************************************************************************************/
 
 
+    ID3D12PipelineState* CreateGBufferInstancedPassPSO(RenderSystem* RS)
+    {
+        auto DrawRectVShader = LoadShader("ForwardInstanced_VS",    "ForwardInstanced_VS",  "vs_5_0",	"assets\\shaders\\forwardRender.hlsl");
+        auto DrawRectPShader = LoadShader("GBufferFill_PS",         "GBufferFill_PS",       "ps_5_0",	"assets\\shaders\\forwardRender.hlsl");
+
+        FINALLY
+         Release(&DrawRectVShader);
+         Release(&DrawRectPShader);
+        FINALLYOVER
+
+        // Per instance transforms are in slot 4, one float4x4 per instance
+        D3D12_INPUT_ELEMENT_DESC InputElements[] = {
+            { "POSITION",	0, DXGI_FORMAT::DXGI_FORMAT_R32G32B32_FLOAT,	0, 0,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "NORMAL",		0, DXGI_FORMAT::DXGI_FORMAT_R32G32B32_FLOAT,	1, 0,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "TANGENT",	0, DXGI_FORMAT::DXGI_FORMAT_R32G32B32_FLOAT,	2, 0,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "TEXCOORD",	0, DXGI_FORMAT::DXGI_FORMAT_R32G32_FLOAT,		3, 0,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+
+            { "INSTANCEWT",	0, DXGI_FORMAT::DXGI_FORMAT_R32G32B32A32_FLOAT,	4, 0,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "INSTANCEWT",	1, DXGI_FORMAT::DXGI_FORMAT_R32G32B32A32_FLOAT,	4, 16,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "INSTANCEWT",	2, DXGI_FORMAT::DXGI_FORMAT_R32G32B32A32_FLOAT,	4, 32,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+            { "INSTANCEWT",	3, DXGI_FORMAT::DXGI_FORMAT_R32G32B32A32_FLOAT,	4, 48,	D3D12_INPUT_CLASSIFICATION::D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        };
+
+
+        D3D12_RASTERIZER_DESC		Rast_Desc	= CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+        D3D12_DEPTH_STENCIL_DESC	Depth_Desc	= CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+        Depth_Desc.DepthFunc	= D3D12_COMPARISON_FUNC::D3D12_COMPARISON_FUNC_LESS;
+        Depth_Desc.DepthEnable	= true;
+
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC	PSO_Desc = {}; {
+            PSO_Desc.pRootSignature        = RS->Library.RS6CBVs4SRVs;
+            PSO_Desc.VS                    = DrawRectVShader;
+            PSO_Desc.PS                    = DrawRectPShader;
+            PSO_Desc.RasterizerState       = Rast_Desc;
+            PSO_Desc.BlendState            = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+            PSO_Desc.SampleMask            = UINT_MAX;
+            PSO_Desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE::D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+            PSO_Desc.NumRenderTargets      = 4;
+            PSO_Desc.RTVFormats[0]         = DXGI_FORMAT_R8G8B8A8_UNORM; // Albedo
+            PSO_Desc.RTVFormats[1]         = DXGI_FORMAT_R16G16B16A16_FLOAT; // Specular
+            PSO_Desc.RTVFormats[2]         = DXGI_FORMAT_R16G16B16A16_FLOAT; // Normal
+            PSO_Desc.RTVFormats[3]         = DXGI_FORMAT_R16G16B16A16_FLOAT; // Tangent
+            PSO_Desc.SampleDesc.Count      = 1;
+            PSO_Desc.SampleDesc.Quality    = 0;
+            PSO_Desc.DSVFormat             = DXGI_FORMAT_D32_FLOAT;
+            PSO_Desc.InputLayout           = { InputElements, sizeof(InputElements)/sizeof(*InputElements) };
+            PSO_Desc.DepthStencilState     = Depth_Desc;
+            PSO_Desc.BlendState.RenderTarget[0].BlendEnable = false;
+        }
+
+        ID3D12PipelineState* PSO = nullptr;
+        auto HR = RS->pDevice->CreateGraphicsPipelineState(&PSO_Desc, IID_PPV_ARGS(&PSO));
+        FK_ASSERT(SUCCEEDED(HR));
+
+        return PSO;
+    }
+
+
+    /************************************************************************************************/
+
+
     ID3D12PipelineState* CreateGBufferSkinnedPassPSO(RenderSystem* RS)
     {
         auto DrawRectVShader = LoadShader("ForwardSkinned_VS",  "ForwardSkinned_VS",    "vs_5_0",	"assets\\shaders\\forwardRender.hlsl");
@@ -822,7 +883,7 @@ namespace FlexKit
                     TriMesh* prevMesh = nullptr;
                     for (const auto& drawable : data.drawables)
                     {
-                        auto* const triMesh = GetMeshResource(drawable.D->MeshHandle);
+                        auto* const triMesh = GetMeshResource(drawable.Mesh);
                         if (triMesh != prevMesh)
                         {
                             prevMesh = triMesh;
@@ -1191,7 +1252,7 @@ namespace FlexKit
                 for (size_t itr = 0; itr < data.drawables.size(); ++itr)
                 {
                     auto& drawable = data.drawables[itr];
-                    TriMesh* triMesh = GetMeshResource(drawable.D->MeshHandle);
+                    TriMesh* triMesh = GetMeshResource(drawable.Mesh);
 
                     if (triMesh != prevMesh)
                     {
@@ -1220,6 +1281,66 @@ namespace FlexKit
     /************************************************************************************************/
 
 
+    LightClusterTask& GatherLightClusters(
+        UpdateDispatcher&		dispatcher,
+        CameraHandle			camera,
+        PointLightGatherTask&	lights,
+        UpdateTask&				cameras,
+        const uint3				dimensions,
+        iAllocator*				allocator)
+    {
+        return dispatcher.Add<LightClusterTaskData>(
+            [&](UpdateDispatcher::UpdateBuilder& builder, LightClusterTaskData& data)
+            {
+                builder.AddInput(lights);
+                builder.AddInput(cameras);
+                builder.SetDebugString("Light Clustering");
+
+                // Grid and the worst case index list, binning scratch, then the view space lights. The rest covers work items and alignment.
+                const size_t clusterCount	= size_t(dimensions[0]) * dimensions[1] * dimensions[2];
+                const size_t memorySize		=
+                    clusterCount * (sizeof(uint2) + sizeof(uint32_t) * LightClusterGrid::MaxLightsPerCluster) +
+                    GetLightClusterWorkingSize(dimensions, MaxClusteredLights) +
+                    MaxClusteredLights * sizeof(ClusterLight) +
+                    KILOBYTE * 64;
+
+                data.taskMemory.Init((byte*)allocator->malloc(memorySize), memorySize);
+                data.camera			= camera;
+                data.pointLights	= &lights.GetData().pointLights;
+                data.threads		= dispatcher.threads;
+                data.grid			= LightClusterGrid{ data.taskMemory };
+                data.grid.dimensions = dimensions;
+            },
+            [](LightClusterTaskData& data)
+            {
+                FK_LOG_9("Light Clustering");
+
+                auto&			camera				= CameraComponent::GetComponent().GetCamera(data.camera);
+                auto&			pointLights			= PointLightComponent::GetComponent();
+                const float3	cameraPosition		= GetPositionW(camera.Node);
+                const auto		inverseOrientation	= GetOrientation(camera.Node).Inverse();
+                const size_t	lightCount			= std::min(data.pointLights->size(), MaxClusteredLights);
+
+                auto* lights = (ClusterLight*)data.taskMemory._aligned_malloc(sizeof(ClusterLight) * lightCount);
+
+                for (size_t I = 0; I < lightCount; ++I)
+                {
+                    const auto& pointLight = pointLights[(*data.pointLights)[I]];
+
+                    lights[I].position	= inverseOrientation * (GetPositionW(pointLight.Position) - cameraPosition);
+                    lights[I].radius	= pointLight.R;
+                }
+
+                const LightClusterView view{ camera.FOV, camera.AspectRatio, camera.Near, camera.Far };
+
+                BuildLightClusters(data.grid, view, lights, lightCount, data.threads, data.taskMemory);
+            });
+    }
+
+
+    /************************************************************************************************/
+
+
     LightBufferUpdate& WorldRender::UpdateLightBuffers(
         UpdateDispatcher&		        dispatcher,
         FrameGraph&				        graph,
@@ -1228,7 +1349,8 @@ namespace FlexKit
         const SceneDescription&         sceneDescription,
         ReserveConstantBufferFunction   reserveCB,
         iAllocator*				        tempMemory, 
-        LighBufferDebugDraw*	        drawDebug)
+        LighBufferDebugDraw*	        drawDebug,
+        LightClusterTask*               clusters)
     {
         graph.Resources.AddUAVResource(lightLists,			0, graph.GetRenderSystem().GetObjectState(lightLists));
         graph.Resources.AddUAVResource(pointLightBuffer,	0, graph.GetRenderSystem().GetObjectState(pointLightBuffer));
@@ -1247,10 +1369,20 @@ namespace FlexKit
                 data.lightListObject	= builder.ReadWriteUAV(lightLists,		 DRS_UAV);
                 data.lightBufferObject	= builder.ReadWriteUAV(pointLightBuffer, DRS_Write);
                 data.camera				= camera;
-
+                data.clusters           = clusters;
 
                 builder.AddDataDependency(sceneDescription.lights);
                 builder.AddDataDependency(sceneDescription.cameras);
+
+                if (clusters)
+                {   // The light lists buffer holds the packed grid instead of per tile bit buckets
+                    const size_t packedSize = std::min(
+                        GetPackedLightClusterSize(clusters->GetData().grid.dimensions),
+                        sizeof(uint32_t) * lightMapWH.Product() * 32);
+
+                    data.clusterBuffer = ReserveUploadBuffer(renderSystem, packedSize);
+                    builder.AddDataDependency(*clusters);
+                }
             },
             [XY = lightMapWH](LightBufferUpdate& data, FrameResources& resources, Context& ctx, iAllocator& allocator)
             {
@@ -1286,6 +1418,21 @@ namespace FlexKit
                 MoveBuffer2UploadBuffer(data.lightBuffer, (byte*)data.pointLights.begin(), uploadSize);
                 ctx.CopyBuffer(data.lightBuffer, uploadSize, resources.WriteUAV(data.lightBufferObject, &ctx));
 
+                if (data.clusters)
+                {
+                    const size_t packedSize = PackLightClusters(
+                        data.clusters->GetData().grid,
+                        (uint32_t*)data.clusterBuffer.buffer,
+                        data.clusterBuffer.uploadSize);
+
+                    FK_ASSERT(packedSize, "Light cluster grid doesn't fit in the light list buffer!");
+
+                    if (packedSize)
+                        ctx.CopyBuffer(data.clusterBuffer, packedSize, resources.WriteUAV(data.lightListObject, &ctx));
+
+                    return;
+                }
+
                 DescriptorHeap descHeap;
                 descHeap.Init(ctx, resources.renderSystem.Library.ComputeSignature.GetDescHeap(0), &allocator);
                 descHeap.SetUAV(ctx, 1, resources.GetUAVBufferResource	(data.lightListObject));
@@ -1315,6 +1462,7 @@ namespace FlexKit
         GBuffer&                        gbuffer,
         ResourceHandle                  depthTarget,
         ReserveConstantBufferFunction   reserveCB,
+        ReserveVertexBufferFunction     reserveVB,
         iAllocator*                     allocator,
         ResourceHandle                  _DEBUGTexture)
     {
@@ -1327,7 +1475,8 @@ namespace FlexKit
                 gbuffer,
                 sceneDescription.PVS.GetData().solid,
                 sceneDescription.skinned.GetData().skinned,
-                reserveCB
+                reserveCB,
+                reserveVB
             },
             [&](FrameGraphNodeBuilder& builder, GBufferPass& data)
             {
@@ -1414,17 +1563,58 @@ namespace FlexKit
                 // submit draw calls
                 TriMesh* prevMesh = nullptr;
 
+                // Runs of the same mesh and material are drawn as one instanced draw, the per instance
+                // transforms go into a vertex buffer and the rest of the constants come from the first entry
+                DrawInstanceBatchList batches{ &allocator, data.pvs.size() };
+                BuildInstanceBatches(data.pvs.begin(), data.pvs.end(), batches);
+
+                const size_t instanceBufferSize = LayoutInstanceBuffer(batches);
+
+                VBPushBuffer instanceBuffer     = instanceBufferSize ? data.reserveVB(instanceBufferSize) : VBPushBuffer{};
+                float4x4*    instanceTransforms = (float4x4*)allocator.malloc(sizeof(float4x4) * data.pvs.size());
 
                 // unskinned models
-                for (auto& drawable : data.pvs)
+                for (const auto& batch : batches)
                 {
-                    const auto constants    = drawable.D->GetConstants();
-                    auto* triMesh           = GetMeshResource(drawable.D->MeshHandle);
+                    const PVEntry*  entries = data.pvs.begin() + batch.begin;
+                    auto*           triMesh = GetMeshResource(batch.mesh);
+
+                    if (batch.count > 1)
+                    {
+                        for (uint32_t I = 0; I < batch.count; I++)
+                            instanceTransforms[I] = entries[I].D->GetConstants().Transform;
+
+                        FK_ASSERT(instanceBuffer.GetOffset() == instanceBuffer.begin() + batch.instanceOffset);
+
+                        VertexBufferList instanceList;
+                        instanceList.push_back(VertexBufferDataSet(instanceTransforms, sizeof(float4x4) * batch.count, instanceBuffer));
+
+                        ctx.SetPipelineState(resources.GetPipelineState(GBUFFERPASS_INSTANCED));
+                        ctx.AddIndexBuffer(triMesh);
+                        ctx.AddVertexBuffers(
+                            triMesh,
+                            {
+                                VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_POSITION,
+                                VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_NORMAL,
+                                VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_TANGENT,
+                                VERTEXBUFFER_TYPE::VERTEXBUFFER_TYPE_UV,
+                            },
+                            &instanceList
+                        );
+
+                        ctx.SetGraphicsConstantBufferView(2, ConstantBufferDataSet(entries->D->GetConstants(), entityConstantBuffer));
+                        ctx.DrawIndexedInstanced(triMesh->IndexCount, 0, 0, batch.count, 0);
+
+                        // Instance slot is bound, force a rebind for the next single draw
+                        prevMesh = nullptr;
+                        continue;
+                    }
 
                     if (triMesh != prevMesh)
                     {
                         prevMesh = triMesh;
 
+                        ctx.SetPipelineState(resources.GetPipelineState(GBUFFERPASS));
                         ctx.AddIndexBuffer(triMesh);
                         ctx.AddVertexBuffers(
                             triMesh,
@@ -1437,6 +1627,7 @@ namespace FlexKit
                         );
                     }
 
+                    const auto constants = entries->D->GetConstants();
                     ctx.SetGraphicsConstantBufferView(2, ConstantBufferDataSet(constants, entityConstantBuffer));
                     ctx.DrawIndexed(triMesh->IndexCount);
                 }
@@ -1639,6 +1830,10 @@ namespace FlexKit
                 data.dispatchDims   = { lightMapWH[0], lightMapWH[1], 1 };
                 data.activeCamera   = scene.activeCamera;
                 data.WH             = lightMapWH * 10;
+                data.lightClusters  = scene.lightClusters;
+
+                if (scene.lightClusters)
+                    builder.AddDataDependency(*scene.lightClusters);
                 // Inputs
                 data.albedoObject         = builder.ReadShaderResource(scene.gbuffer.Albedo);
                 data.MRIAObject           = builder.ReadShaderResource(scene.gbuffer.MRIA);
@@ -1663,19 +1858,28 @@ namespace FlexKit
                     pushBuffer
                 };
 
+                // A slice count of zero has the shader read the light prepass's per tile bit buckets
                 struct LocalPassConstants
                 {
                     uint32_t    lightCount;
                     uint2       WH;
-                };
+                    uint32_t    clusterSlices   = 0;
+                    uint2       clusterTiles    = { 0, 0 };
+                    float       clusterNear     = 0.0f;
+                    float       clusterFar      = 0.0f;
+                }   localValues{ (uint32_t)data.pointLights.GetData().pointLights.size(), data.WH };
 
-                ConstantBufferDataSet localConstants{
-                    LocalPassConstants{
-                        (uint32_t)data.pointLights.GetData().pointLights.size(),
-                        data.WH
-                    },
-                    pushBuffer
-                };
+                if (data.lightClusters)
+                {
+                    const auto& grid = data.lightClusters->GetData().grid;
+
+                    localValues.clusterSlices   = grid.dimensions[2];
+                    localValues.clusterTiles    = { grid.dimensions[0], grid.dimensions[1] };
+                    localValues.clusterNear     = grid.nearPlane;
+                    localValues.clusterFar      = grid.farPlane;
+                }
+
+                ConstantBufferDataSet localConstants{ localValues, pushBuffer };
 
                 PointLightComponent& pointLights = PointLightComponent::GetComponent();
                 DescriptorHeap srvHeap;
@@ -39,6 +39,8 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "../graphicsutilities/CoreSceneObjects.h"
 #include "../graphicsutilities/AnimationComponents.h"
 #include "../coreutilities/GraphicScene.h"
+#include "../coreutilities/OcclusionCulling.h"
+#include "../coreutilities/ClusteredLighting.h"
 
 #include <d3dx12.h>
 
@@ -78,6 +80,7 @@ namespace FlexKit
 	static const PSOHandle FORWARDDRAW				   = PSOHandle(GetTypeGUID(FORWARDDRAW));
 	static const PSOHandle GBUFFERPASS                 = PSOHandle(GetTypeGUID(GBUFFERPASS));
 	static const PSOHandle GBUFFERPASS_SKINNED         = PSOHandle(GetTypeGUID(GBUFFERPASS_SKINNED));
+	static const PSOHandle GBUFFERPASS_INSTANCED       = PSOHandle(GetTypeGUID(GBUFFERPASS_INSTANCED));
 	static const PSOHandle SHADINGPASS                 = PSOHandle(GetTypeGUID(SHADINGPASS));
 	static const PSOHandle COMPUTETILEDSHADINGPASS     = PSOHandle(GetTypeGUID(COMPUTETILEDSHADINGPASS));
 	static const PSOHandle ENVIRONMENTPASS             = PSOHandle(GetTypeGUID(ENVIRONMENTPASS));
@@ -108,6 +111,7 @@ namespace FlexKit
 	ID3D12PipelineState* CreateLightPassPSO				    (RenderSystem* RS);
     ID3D12PipelineState* CreateGBufferPassPSO               (RenderSystem* RS);
     ID3D12PipelineState* CreateGBufferSkinnedPassPSO        (RenderSystem* RS);
+    ID3D12PipelineState* CreateGBufferInstancedPassPSO      (RenderSystem* RS);
     ID3D12PipelineState* CreateDeferredShadingPassPSO       (RenderSystem* RS);
     ID3D12PipelineState* CreateComputeTiledDeferredPSO      (RenderSystem* RS);
 
@@ -155,6 +159,36 @@ namespace FlexKit
 	};
 
 
+	// Matches the point light buffer limit in WorldRender::UpdateLightBuffers
+	const size_t MaxClusteredLights = 1024;
+
+
+	struct LightClusterTaskData
+	{
+		CameraHandle					camera;
+		const Vector<PointLightHandle>*	pointLights; // Light indices in the grid index this list
+		ThreadManager*					threads;
+		StackAllocator					taskMemory;
+		LightClusterGrid				grid;
+	};
+
+	using LightClusterTask = UpdateTaskTyped<LightClusterTaskData>;
+
+
+	// Bins the point lights into a froxel grid for the camera, pass it to UpdateLightBuffers and
+	// RenderPBR_ComputeDeferredTiledShade to shade with it in place of the light prepass
+	FLEXKITAPI LightClusterTask& GatherLightClusters(
+		UpdateDispatcher&		dispatcher,
+		CameraHandle			camera,
+		PointLightGatherTask&	lights,
+		UpdateTask&				cameras,
+		const uint3				dimensions,
+		iAllocator*				allocator);
+
+
+	/************************************************************************************************/
+
+
 	struct LighBufferCPUUpdate
 	{
 		struct visableLightEntry
@@ -194,6 +228,9 @@ namespace FlexKit
 
 		CameraHandle			camera;
 
+		LightClusterTask*		clusters = nullptr;	// Uploaded in place of the light prepass when set
+		UploadSegment			clusterBuffer;
+
 		CBPushBuffer			constants;
 		ResourceHandle			lightListBuffer;
 
@@ -363,6 +400,7 @@ namespace FlexKit
         const PosedDrawableList&    skinned;
 
         ReserveConstantBufferFunction reserveCB;
+        ReserveVertexBufferFunction   reserveVB;
 
         FrameResourceHandle AlbedoTargetObject;     // RGBA8
         FrameResourceHandle NormalTargetObject;     // RGBA16Float
@@ -446,6 +484,8 @@ namespace FlexKit
 
         CameraHandle            activeCamera;
         iAllocator*             allocator;
+
+        LightClusterTask*       lightClusters = nullptr; // Must match the one passed to UpdateLightBuffers
     };
 
 
@@ -460,6 +500,7 @@ namespace FlexKit
         uint3                       dispatchDims;
         uint2                       WH;
         CameraHandle                activeCamera;
+        LightClusterTask*           lightClusters = nullptr;
 
         FrameResourceHandle albedoObject;
         FrameResourceHandle MRIAObject;
@@ -482,9 +523,11 @@ namespace FlexKit
 	class FLEXKITAPI WorldRender
 	{
 	public:
+		// Memory has to live as long as the renderer, the occlusion culler keeps its buffers and occluders in it
 		WorldRender(iAllocator* Memory, RenderSystem& RS_IN, TextureStreamingEngine& IN_streamingEngine, const uint2 WH) :
 			renderSystem                { RS_IN                                                                                     },
 			OcclusionCulling	        { false																                        },
+			occlusionCuller		        { Memory																					},
 			lightLists			        { renderSystem.CreateUAVBufferResource(sizeof(uint32_t) * (WH / 10).Product() * 32)         },
 			pointLightBuffer	        { renderSystem.CreateUAVBufferResource(sizeof(GPUPointLight) * 1024)                        },
             tempBuffer                  { renderSystem.CreateUAVTextureResource(WH, DeviceFormat::R16G16B16A16_FLOAT)               },
@@ -499,6 +542,7 @@ namespace FlexKit
 
 			RS_IN.RegisterPSOLoader(GBUFFERPASS,			    { &RS_IN.Library.RS6CBVs4SRVs,      CreateGBufferPassPSO          });
 			RS_IN.RegisterPSOLoader(GBUFFERPASS_SKINNED,	    { &RS_IN.Library.RS6CBVs4SRVs,      CreateGBufferSkinnedPassPSO   });
+			RS_IN.RegisterPSOLoader(GBUFFERPASS_INSTANCED,	    { &RS_IN.Library.RS6CBVs4SRVs,      CreateGBufferInstancedPassPSO });
 
 			RS_IN.RegisterPSOLoader(SHADINGPASS,			    { &RS_IN.Library.RS6CBVs4SRVs,      CreateDeferredShadingPassPSO  });
             RS_IN.RegisterPSOLoader(ENVIRONMENTPASS,            { &RS_IN.Library.RS6CBVs4SRVs,      CreateEnvironmentPassPSO      });
@@ -511,6 +555,7 @@ namespace FlexKit
 
             RS_IN.QueuePSOLoad(GBUFFERPASS);
             RS_IN.QueuePSOLoad(GBUFFERPASS_SKINNED);
+            RS_IN.QueuePSOLoad(GBUFFERPASS_INSTANCED);
             RS_IN.QueuePSOLoad(DEPTHPREPASS);
             RS_IN.QueuePSOLoad(LIGHTPREPASS);
             RS_IN.QueuePSOLoad(FORWARDDRAW);
@@ -588,7 +633,8 @@ namespace FlexKit
                 const SceneDescription&         desc,
                 ReserveConstantBufferFunction   reserveCB,
                 iAllocator*                     tempMemory,
-                LighBufferDebugDraw*            drawDebug = nullptr);
+                LighBufferDebugDraw*            drawDebug   = nullptr,
+                LightClusterTask*               clusters    = nullptr);
 
 
         BackgroundEnvironmentPass& RenderPBR_IBL_Deferred(
@@ -630,6 +676,7 @@ namespace FlexKit
             GBuffer&                        gbuffer,
             ResourceHandle                  depthTarget,
             ReserveConstantBufferFunction   reserveCB,
+            ReserveVertexBufferFunction     reserveVB,
             iAllocator*                     allocator,
             ResourceHandle                  _DEBUGTexture);
 
@@ -656,6 +703,13 @@ namespace FlexKit
             ReserveConstantBufferFunction&          constantBufferAllocator,
             const ComputeTiledDeferredShadeDesc&    scene);
 
+
+        // Occluders can be registered while culling is disabled, pass GetActiveOcclusionCuller to GatherScene
+        void                        EnableOcclusionCulling(const bool enabled)  { OcclusionCulling = enabled; }
+        bool                        OcclusionCullingEnabled() const             { return OcclusionCulling; }
+        SoftwareOcclusionCuller&    GetOcclusionCuller()                        { return occlusionCuller; }
+        SoftwareOcclusionCuller*    GetActiveOcclusionCuller()                  { return OcclusionCulling ? &occlusionCuller : nullptr; }
+
 	private:
 		RenderSystem&			renderSystem;
 
@@ -667,6 +721,7 @@ namespace FlexKit
 
 		TextureStreamingEngine&	streamingEngine;
 		bool                    OcclusionCulling;
+		SoftwareOcclusionCuller	occlusionCuller;	// CPU
 	};
 
 
@@ -81,9 +81,31 @@ namespace FlexKit
         {
             return (min + max) / 2;
         }
+
+        bool Contains(const AABB& rhs) const
+        {
+            return
+                min.x <= rhs.min.x && min.y <= rhs.min.y && min.z <= rhs.min.z &&
+                max.x >= rhs.max.x && max.y >= rhs.max.y && max.z >= rhs.max.z;
+        }
+
+        float SurfaceArea() const
+        {
+            const auto span = max - min;
+            return 2.0f * (span.x * span.y + span.y * span.z + span.z * span.x);
+        }
     };
 
 
+    inline AABB operator + (const AABB& lhs, const AABB& rhs)
+    {
+        AABB out = lhs;
+        out += rhs;
+
+        return out;
+    }
+
+
 	typedef float4 BoundingSphere;
 
 	/************************************************************************************************/
@@ -126,6 +148,84 @@ namespace FlexKit
 
 	typedef Vector<Ray> RaySet;
 
+
+	/************************************************************************************************/
+
+
+	// Slab test, t is the distance along the ray to where it enters the box
+	inline bool Intersects(const Ray& ray, const AABB& aabb, float& t)
+	{
+		float tMin = 0.0f;
+		float tMax = inf;
+
+		for (size_t I = 0; I < 3; ++I)
+		{
+			const float invD	= 1.0f / ray.D[I];
+			float		t0		= (aabb.min[I] - ray.O[I]) * invD;
+			float		t1		= (aabb.max[I] - ray.O[I]) * invD;
+
+			if (invD < 0.0f)
+				std::swap(t0, t1);
+
+			tMin = t0 > tMin ? t0 : tMin;
+			tMax = t1 < tMax ? t1 : tMax;
+
+			if (tMax < tMin)
+				return false;
+		}
+
+		t = tMin;
+		return true;
+	}
+
+
+	// t is the distance along the ray to where it enters the sphere, zero if the origin is inside
+	inline bool Intersects(const Ray& ray, const BoundingSphere& sphere, float& t)
+	{
+		const float3	m = ray.O - sphere.xyz();
+		const float		b = m.dot(ray.D);
+		const float		c = m.dot(m) - sphere.w * sphere.w;
+
+		if (c > 0.0f && b > 0.0f)
+			return false;
+
+		const float discriminant = b * b - c;
+		if (discriminant < 0.0f)
+			return false;
+
+		t = std::max(-b - std::sqrt(discriminant), 0.0f);
+		return true;
+	}
+
+
+	// Moller-Trumbore, D doesn't need to be normalized. t is in multiples of D, back faces are hit too
+	inline bool IntersectsTriangle(const float3 O, const float3 D, const float3 v0, const float3 v1, const float3 v2, float& t)
+	{
+		const float3	e1	= v1 - v0;
+		const float3	e2	= v2 - v0;
+		const float3	p	= D.cross(e2);
+		const float		det	= e1.dot(p);
+
+		if (std::abs(det) < 1e-12f)
+			return false;
+
+		const float		invDet	= 1.0f / det;
+		const float3	s		= O - v0;
+		const float		u		= s.dot(p) * invDet;
+
+		if (u < 0.0f || u > 1.0f)
+			return false;
+
+		const float3	q = s.cross(e1);
+		const float		v = D.dot(q) * invDet;
+
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		t = e2.dot(q) * invDet;
+		return t >= 0.0f;
+	}
+
 	/************************************************************************************************/
 	// Intersection Distance from Origin to Plane Surface
 
@@ -211,6 +311,96 @@ namespace FlexKit
 	/************************************************************************************************/
 
 
+	// Tests count spheres given as SoA arrays against all six planes, bit I of visibilityMask[I / 32] is set if sphere I
+	// is inside or intersecting. Uses 8 wide AVX2 or 4 wide SSE kernels depending on the build settings, mask needs (count + 31) / 32 entries
+	FLEXKITAPI void CullSpheres(
+		const Frustum&				frustum,
+		const float* __restrict		x,
+		const float* __restrict		y,
+		const float* __restrict		z,
+		const float* __restrict		r,
+		const size_t				count,
+		uint32_t* __restrict		visibilityMask);
+
+	// The kernels CullSpheres picks from, all produce the same mask. The AVX2 one only exists in AVX2 builds
+	FLEXKITAPI void CullSpheres_Scalar	(const Frustum& frustum, const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict r, const size_t count, uint32_t* __restrict visibilityMask);
+	FLEXKITAPI void CullSpheres_SSE		(const Frustum& frustum, const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict r, const size_t count, uint32_t* __restrict visibilityMask);
+
+#if USING(AVX2)
+	FLEXKITAPI void CullSpheres_AVX2	(const Frustum& frustum, const float* __restrict x, const float* __restrict y, const float* __restrict z, const float* __restrict r, const size_t count, uint32_t* __restrict visibilityMask);
+#endif
+
+
+	/************************************************************************************************/
+
+
+	// Batches spheres up for CullSpheres, onVisible(item) is called for every sphere that passes when the batch is flushed
+	template<typename TY_ITEM, size_t BATCHSIZE = 256>
+	struct SphereCullBatch
+	{
+		static_assert(BATCHSIZE % 32 == 0, "Batch size must be a multiple of 32!");
+
+		SphereCullBatch(const Frustum& IN_frustum) :
+			frustum{ IN_frustum } {}
+
+		template<typename FN>
+		void Push(const BoundingSphere& BS, const TY_ITEM& item, FN&& onVisible)
+		{
+			x[count]		= BS.x;
+			y[count]		= BS.y;
+			z[count]		= BS.z;
+			r[count]		= BS.w;
+			items[count]	= item;
+
+			if (++count == BATCHSIZE)
+				Flush(onVisible);
+		}
+
+		template<typename FN>
+		void Flush(FN&& onVisible)
+		{
+			if (!count)
+				return;
+
+			CullSpheres(frustum, x, y, z, r, count, visibilityMask);
+
+			for (size_t I = 0; I < count; ++I)
+				if (visibilityMask[I / 32] & (1u << (I % 32)))
+					onVisible(items[I]);
+
+			count = 0;
+		}
+
+		const Frustum&	frustum;
+		size_t			count = 0;
+
+		alignas(32) float	x[BATCHSIZE];
+		alignas(32) float	y[BATCHSIZE];
+		alignas(32) float	z[BATCHSIZE];
+		alignas(32) float	r[BATCHSIZE];
+
+		TY_ITEM		items[BATCHSIZE];
+		uint32_t	visibilityMask[BATCHSIZE / 32];
+	};
+
+
+	/************************************************************************************************/
+
+
+	enum class FrustumIntersection
+	{
+		Outside,
+		Partial,
+		Inside
+	};
+
+	// Lets hierarchies accept or reject whole subtrees, Partial only means the box may intersect the frustum
+	FLEXKITAPI FrustumIntersection ClassifyAABBAgainstFrustum(const Frustum& frustum, const AABB& aabb);
+
+
+	/************************************************************************************************/
+
+
 	inline bool Intersects(const Frustum frustum, const AABB aabb)
 	{
 		int Result = 1;
@@ -261,6 +451,11 @@ namespace FlexKit
 		float2		BottomRight);
 
 
+	// Frustum covering one face of a cube map centered on position, faces are +X -X +Y -Y +Z -Z.
+	// The six faces together cover the sphere of the given radius, for culling point light shadow casters
+	FLEXKITAPI Frustum GetCubeFaceFrustum(const float3 position, const float radius, const uint32_t face);
+
+
 	/************************************************************************************************/
 
 }
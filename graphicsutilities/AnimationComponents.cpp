@@ -18,6 +18,10 @@ namespace FlexKit
 		const auto F			= GetFrustum(Camera);
 		const auto& Visibles	= SceneVisibilityComponent::GetComponent();
 
+        auto pushVisible = [&](const PosedDrawable& candidate) { out_skinned.push_back(candidate); };
+
+        SphereCullBatch<PosedDrawable> cullBatch{ F };
+
 		for(auto handle : SM->sceneEntities)
 		{
 			const auto potentialVisible = Visibles[handle];
@@ -25,23 +29,18 @@ namespace FlexKit
 			if(	potentialVisible.visable && 
 				potentialVisible.entity->hasView(DrawableComponent::GetComponentID()))
 			{
-				auto Ls	= GetLocalScale		(potentialVisible.node).x;
-				auto Pw	= GetPositionW		(potentialVisible.node);
-				auto Lq	= GetOrientation	(potentialVisible.node);
-				auto BS = BoundingSphere{ 
-					Lq * potentialVisible.boundingSphere.xyz() + Pw, 
-					Ls * potentialVisible.boundingSphere.w };
-
 				Apply(*potentialVisible.entity,
 					[&](DrawableView& drawView,
                         SkeletonView& skeleton)
 					{
                         auto& drawable = drawView.GetDrawable();
-						if (drawable.Skinned && CompareBSAgainstFrustum(&F, BS))
-                            out_skinned.push_back({ &drawable, &skeleton.GetPoseState() });
+						if (drawable.Skinned)
+                            cullBatch.Push(GetWorldBoundingSphere(potentialVisible), { &drawable, &skeleton.GetPoseState() }, pushVisible);
 					});
 			}
 		}
+
+        cullBatch.Flush(pushVisible);
     }
 
 
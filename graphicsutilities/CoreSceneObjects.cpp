@@ -25,35 +25,129 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "CoreSceneObjects.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace FlexKit
 {
 	/************************************************************************************************/
 
 
-	size_t CreateSortingID(bool Posed, bool Textured, size_t Depth)
+	// Non negative floats order the same as their bit patterns, the top 24 bits are kept
+	static uint64_t _QuantizeSortDepth(const float distanceSquared)
 	{
-		size_t DepthPart	= (Depth & 0x00ffffffffffff);
-		size_t PosedBit		= (size_t(Posed)	<< (Posed		? 63 : 0));
-		size_t TextureBit	= (size_t(Textured) << (Textured	? 62 : 0));
-		return DepthPart | PosedBit | TextureBit;
-			
+		const float	depth = distanceSquared > 0.0f ? distanceSquared : 0.0f;
+		uint32_t	bits;
+
+		memcpy(&bits, &depth, sizeof(bits));
+
+		return bits >> 7;
 	}
 
-	void SortPVS(PVS* PVS_, Camera* C)
+
+	uint64_t CreateSortingKey(const Drawable& drawable, const TriMeshHandle mesh, const float distanceSquared)
 	{
-		if(!PVS_->size())
+		const uint64_t posedBit		= uint64_t(drawable.Skinned)	<< 63;
+		const uint64_t textureBit	= uint64_t(drawable.Textured)	<< 62;
+		const uint64_t meshBits		= uint64_t(mesh.to_uint() & 0x3FFF) << 48;
+		const uint64_t depthBits	= _QuantizeSortDepth(distanceSquared) << SortKeyIndexBits;
+
+		return posedBit | textureBit | meshBits | depthBits;
+	}
+
+
+	uint64_t CreateTransparentSortingKey(const Drawable& drawable, const float distanceSquared)
+	{
+		const uint64_t drawLastBit	= uint64_t(drawable.DrawLast) << 63;
+		const uint64_t depthBits	= (0xFFFFFF - _QuantizeSortDepth(distanceSquared)) << SortKeyIndexBits;
+
+		return drawLastBit | depthBits;
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SortPVSByKeys(PVEntry* begin, PVEntry* end, uint64_t* keyScratch, PVEntry* entryScratch)
+	{
+		const size_t count = end - begin;
+
+		FK_ASSERT(count <= SortKeyIndexMask + 1, "Too many entries to sort by key!");
+
+		for (size_t I = 0; I < count; ++I)
+		{
+			keyScratch[I]	= (begin[I].SortID & ~SortKeyIndexMask) | I;
+			entryScratch[I]	= begin[I];
+		}
+
+		std::sort(keyScratch, keyScratch + count);
+
+		for (size_t I = 0; I < count; ++I)
+			begin[I] = entryScratch[keyScratch[I] & SortKeyIndexMask];
+	}
+
+
+	void SortPVSByKeys(PVS& pvs, iAllocator* temp)
+	{
+		if (pvs.size() < 2)
 			return;
 
-		auto CP = FlexKit::GetPositionW( C->Node );
-		for( auto& v : *PVS_ )
+		auto keys		= (uint64_t*)temp->_aligned_malloc(sizeof(uint64_t) * pvs.size());
+		auto entries	= (PVEntry*)temp->_aligned_malloc(sizeof(PVEntry) * pvs.size());
+
+		SortPVSByKeys(pvs.begin(), pvs.end(), keys, entries);
+
+		temp->_aligned_free(entries);
+		temp->_aligned_free(keys);
+	}
+
+
+	/************************************************************************************************/
+
+
+	uint32_t SelectDrawableLOD(const Drawable& drawable, const float screenSize)
+	{
+		if (!drawable.LODCount)
+			return 0;
+
+		const uint32_t	count	= drawable.LODCount;
+		uint32_t		lod		= std::min<uint32_t>(drawable.CurrentLOD, count - 1);
+
+		while (lod > 0 && screenSize >= drawable.LODs[lod - 1].minScreenSize * (1.0f + LODHysteresis))
+			--lod;
+
+		while (lod + 1 < count && screenSize < drawable.LODs[lod].minScreenSize * (1.0f - LODHysteresis))
+			++lod;
+
+		return lod;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Split out of SortPVS so ranges of a PVS can be keyed on different threads
+	void SetPVSSortIDs(PVEntry* begin, PVEntry* end, const float3 CP)
+	{
+		for(auto itr = begin; itr < end; ++itr)
 		{
-			auto E = v.D;
+			auto E = itr->D;
 			auto P = FlexKit::GetPositionW( E->Node );
 
-			auto Depth = (size_t)abs(float3(CP - P).magnitudesquared() * 10000);
-			auto SortID = CreateSortingID(false, E->Textured, Depth);
-			v.SortID = SortID;
+			itr->SortID = CreateSortingKey(*E, itr->Mesh, float3(CP - P).magnitudesquared());
 		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	void SortPVS(PVS* PVS_, Camera* C)
+	{
+		if(!PVS_->size())
+			return;
+
+		SetPVSSortIDs(PVS_->begin(), PVS_->end(), FlexKit::GetPositionW( C->Node ));
 		
 		std::sort( PVS_->begin(), PVS_->end(), []( PVEntry& R, PVEntry& L ) -> bool
 		{
@@ -75,13 +169,13 @@ namespace FlexKit
 		{
 			auto E = v.D;
 			auto P = FlexKit::GetPositionW( E->Node );
-			float D = float3( CP - P ).magnitudesquared() * ( E->DrawLast ? -1.0 : 1.0 );
-			v.SortID = D;
+
+			v.SortID = CreateTransparentSortingKey(*E, float3( CP - P ).magnitudesquared());
 		}
 
-		std::sort( PVS_->begin(), PVS_->end(), []( auto& R, auto& L ) -> bool
+		std::sort( PVS_->begin(), PVS_->end(), []( PVEntry& R, PVEntry& L ) -> bool
 		{
-			return ( (size_t)R > (size_t)L );
+			return ( (size_t)R.SortID < (size_t)L.SortID);
 		} );
 	}
 	
@@ -104,11 +104,21 @@ namespace FlexKit
 	struct PoseState;
 	struct TextureSet;
 
+	// A mesh and the smallest projected size it is drawn at, see SelectDrawableLOD
+	struct DrawableLOD
+	{
+		TriMeshHandle	mesh			= InvalidHandle_t;
+		float			minScreenSize	= 0.0f;
+	};
+
+
 	struct FLEXKITAPI Drawable
 	{
+		static const uint32_t MaxLODs = 4;
+
 		NodeHandle			Node				= InvalidHandle_t;	// 2
 		TriMeshHandle		Occluder			= InvalidHandle_t;	// 2
-		TriMeshHandle		MeshHandle			= InvalidHandle_t;	// 2
+		TriMeshHandle		MeshHandle			= InvalidHandle_t;	// 2 - highest detail mesh, gathers pick the drawn LOD into PVEntry::Mesh
 
 		bool					DrawLast		= false; // 1
 		bool					Transparent		= false; // 1
@@ -116,8 +126,12 @@ namespace FlexKit
 		bool					Dirty			= false; // 1
         bool                    Skinned         = false;
 		bool					Padding[1];		// 5
+		uint8_t					LODCount		= 0;
+		uint8_t					CurrentLOD		= 0;	// Last LOD picked, only touched by the gather picking LODs
 		char*					id;				// 8 - string ID, null terminated 
 
+		DrawableLOD				LODs[MaxLODs];	// Highest detail first, minScreenSize decreasing
+
 		struct MaterialProperties
 		{
             float3  albedo      = float3{1.0f, 1.0f, 1.0f};
@@ -158,12 +172,14 @@ namespace FlexKit
 	struct PVEntry
 	{
 		PVEntry() {}
-		PVEntry(Drawable& d) : OcclusionID(-1), D(&d){}
-		PVEntry(Drawable& d, size_t ID, size_t sortID) : OcclusionID(ID), D(&d), SortID(sortID) {}
+		PVEntry(Drawable& d) : OcclusionID(-1), D(&d), Mesh(d.MeshHandle) {}
+		PVEntry(Drawable& d, size_t ID, size_t sortID) : OcclusionID(ID), D(&d), SortID(sortID), Mesh(d.MeshHandle) {}
+		PVEntry(Drawable& d, size_t ID, size_t sortID, TriMeshHandle mesh) : OcclusionID(ID), D(&d), SortID(sortID), Mesh(mesh) {}
 
-		size_t		SortID;
-		size_t		OcclusionID;
-		Drawable*	D;
+		size_t			SortID;
+		size_t			OcclusionID;
+		Drawable*		D;
+		TriMeshHandle	Mesh; // Mesh to draw, D's LOD for the view it was gathered for
 
 		operator Drawable* ()	{ return D;			}
 		operator size_t ()		{ return SortID;	}
@@ -183,6 +199,134 @@ namespace FlexKit
 			pvs.push_back(PVEntry( e, pvs.size(), 0u));
 	}
 
+
+	// Pushes with a key from CreateSortingKey, so the PVS can be sorted without touching the drawables again
+	inline void PushPV(Drawable& e, PVS& pvs, const TriMeshHandle mesh, const uint64_t sortKey)
+	{
+		if (mesh != InvalidHandle_t)
+			pvs.push_back(PVEntry( e, pvs.size(), sortKey, mesh));
+	}
+
+
+	// 64 bit draw order keys, compared as integers. The low SortKeyIndexBits are left clear for SortPVSByKeys.
+	// Solid:		[63] posed | [62] textured | [61..48] mesh | [47..24] depth, front to back
+	// Transparent:	[63] draw last | [47..24] depth, back to front
+	const uint64_t SortKeyIndexBits	= 24;
+	const uint64_t SortKeyIndexMask	= (uint64_t(1) << SortKeyIndexBits) - 1;
+
+	FLEXKITAPI uint64_t CreateSortingKey				(const Drawable& drawable, const TriMeshHandle mesh, const float distanceSquared);
+	FLEXKITAPI uint64_t CreateTransparentSortingKey	(const Drawable& drawable, const float distanceSquared);
+
+	// Sorts entries by SortID alone, then moves each entry once into its sorted position.
+	// keyScratch and entryScratch need room for end - begin elements
+	FLEXKITAPI void SortPVSByKeys(PVEntry* begin, PVEntry* end, uint64_t* keyScratch, PVEntry* entryScratch);
+	FLEXKITAPI void SortPVSByKeys(PVS& pvs, iAllocator* temp);
+
+	// Run of PVS entries that can be drawn with a single instanced draw
+	struct DrawInstanceBatch
+	{
+		TriMeshHandle	mesh;
+		uint32_t		begin;			// Offset of the first entry in the PVS
+		uint32_t		count;
+		size_t			instanceOffset;	// Offset of the batch's transforms in the instance buffer, set by LayoutInstanceBuffer
+	};
+
+	using DrawInstanceBatchList = Vector<DrawInstanceBatch>;
+
+	// Longest run drawn by one instanced draw, longer runs are split into several batches
+	constexpr uint32_t MaxInstancesPerBatch = 512;
+
+	// VBPushBuffer::Push rounds every push up to this
+	constexpr size_t InstanceBufferAlignment = 256;
+
+
+	/************************************************************************************************/
+
+
+	// True if both share a mesh and material, and so can share a draw with only their transforms differing
+	inline bool CanInstanceTogether(const PVEntry& lhsEntry, const PVEntry& rhsEntry)
+	{
+		const Drawable& lhs = *lhsEntry.D;
+		const Drawable& rhs = *rhsEntry.D;
+
+		if (lhsEntry.Mesh	!= rhsEntry.Mesh	||
+			lhs.Textured	!= rhs.Textured		||
+			lhs.Transparent	!= rhs.Transparent	||
+			lhs.DrawLast	!= rhs.DrawLast		||
+			lhs.Skinned		|| rhs.Skinned)
+			return false;
+
+		const auto& L = lhs.MatProperties;
+		const auto& R = rhs.MatProperties;
+
+		return
+			L.albedo.x		== R.albedo.x		&&
+			L.albedo.y		== R.albedo.y		&&
+			L.albedo.z		== R.albedo.z		&&
+			L.kS			== R.kS				&&
+			L.IOR			== R.IOR			&&
+			L.roughness		== R.roughness		&&
+			L.anisotropic	== R.anisotropic	&&
+			L.metallic		== R.metallic;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Splits a PVS into runs of adjacent entries that can be instanced together, single entries get a batch of one.
+	// Sorting by key first puts equal meshes next to each other. Runs longer than maxInstances are split.
+	inline void BuildInstanceBatches(const PVEntry* begin, const PVEntry* end, DrawInstanceBatchList& out, const uint32_t maxInstances = MaxInstancesPerBatch)
+	{
+		FK_ASSERT(maxInstances > 0);
+
+		const uint32_t count = uint32_t(end - begin);
+
+		for (uint32_t I = 0; I < count;)
+		{
+			const PVEntry& first = begin[I];
+
+			uint32_t J = I + 1;
+			while (J < count && J - I < maxInstances && CanInstanceTogether(first, begin[J]))
+				++J;
+
+			out.push_back({ first.Mesh, I, J - I, 0 });
+			I = J;
+		}
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Gives every batch of more than one entry its offset in the instance buffer, in the order they get pushed.
+	// Returns the size to reserve. Batches of one are drawn without instance data and take no space.
+	inline size_t LayoutInstanceBuffer(DrawInstanceBatchList& batches)
+	{
+		size_t offset = 0;
+		for (auto& batch : batches)
+		{
+			batch.instanceOffset = offset;
+
+			if (batch.count > 1)
+				offset += (sizeof(float4x4) * batch.count + InstanceBufferAlignment - 1) & ~(InstanceBufferAlignment - 1);
+		}
+
+		return offset;
+	}
+
+
+	/************************************************************************************************/
+
+
+	// Projected sizes have to cross a threshold by this fraction before the LOD changes, stops popping at the boundary
+	constexpr float LODHysteresis = 0.1f;
+
+	// screenSize is the bounding sphere's radius over the half height of the view at its distance.
+	// LOD I is used while screenSize >= LODs[I].minScreenSize, CurrentLOD is the previous pick. Returns 0 without LODs.
+	FLEXKITAPI uint32_t SelectDrawableLOD(const Drawable& drawable, const float screenSize);
+
+	FLEXKITAPI void SetPVSSortIDs		(PVEntry* begin, PVEntry* end, const float3 cameraPosition);
 	FLEXKITAPI void SortPVS				(PVS* PVS_, Camera* C);
 	FLEXKITAPI void SortPVSTransparent	(PVS* PVS_, Camera* C);
 
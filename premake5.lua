@@ -244,4 +244,45 @@ project "Editor"
 		}
 		defines { "NDEBUG", "_CRT_SECURE_NO_WARNINGS" }
 		optimize "Full"
-		buildoptions { "/std:c++latest", "/MT"}
\ No newline at end of file
+		buildoptions { "/std:c++latest", "/MT"}
+
+project "TransformBenchmark"
+	kind "ConsoleApp"
+	language "C++"
+	targetdir "builds/%{cfg.buildcfg}"
+
+	basedir "TransformBenchmark"
+
+	includedirs { 
+		"coreutilities", 
+
+		"Dependencies/sdks",
+		"Dependencies/sdks/DirectX-Graphics-Samples/Libraries/D3DX12/"
+	}
+
+	architecture "x86_64"
+
+	vpaths { ["Headers/*"] = "**.h", ["Source/*"] = "**.cpp" }
+
+	files{
+		"TransformBenchmark/**.h", 
+		"TransformBenchmark/**.cpp", 
+		"coreutilities/*.h", 
+		"coreutilities/*.cpp" }
+
+-- Unity build, so only TransformBenchmark.cpp needs to be compiled
+	filter{"files:**.cpp"}
+		flags {"ExcludeFromBuild"}
+
+	filter{"files:TransformBenchmark/TransformBenchmark.cpp"}
+		removeflags{"ExcludeFromBuild"}
+
+	filter "configurations:Debug"
+		defines { "_DEBUG", "_CRT_SECURE_NO_WARNINGS" }
+		symbols "On"
+		buildoptions { "/std:c++latest", "/MTd" }
+
+	filter "configurations:Release"
+		defines { "NDEBUG", "_CRT_SECURE_NO_WARNINGS" }
+		optimize "Full"
+		buildoptions { "/std:c++latest", "/MT"}
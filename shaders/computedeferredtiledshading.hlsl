@@ -4,6 +4,10 @@ cbuffer ShadingConstants : register(b1)
 {
     int     LightCount;
     uint2   WH;
+    uint    ClusterSlices;  // 0 if lightBitBuckets holds the light prepass's per tile bit buckets
+    uint2   ClusterTiles;
+    float   ClusterNear;
+    float   ClusterFar;
 }
 
 Texture2D<float4> Albedo	: register(t0);
@@ -12,7 +16,7 @@ Texture2D<float4> Normal    : register(t2);
 Texture2D<float2> Tangent   : register(t3);
 Texture2D<float4> Depth	    : register(t4);
 
-StructuredBuffer<uint>	lightBitBuckets	: register(t5);
+StructuredBuffer<uint>	lightBitBuckets	: register(t5); // Or the packed light cluster grid, { offset, count } per cluster then the light indices
 ByteAddressBuffer       pointLights     : register(t6);
 
 struct PointLight
@@ -30,6 +34,27 @@ PointLight ReadPointLight(uint idx)
     return pointLight;
 }
 
+float3 ShadePointLight(PointLight light, float3 N, float3 worldPosition)
+{
+    const float3 L   = normalize(light.PositionR.xyz - worldPosition);
+    const float  Ld  = length(light.PositionR.xyz - worldPosition);
+    const float  Lr  = light.PositionR.w;
+    const float3 Lk  = light.KI.xyz;
+    const float  Li  = light.KI.w;
+    const float  La  = Li / pow(Ld, 2);
+
+    return Lk * dot(N, L) * La * saturate(1 - (pow(Ld, 10) / pow(Lr, 10)));
+}
+
+// Matches LightClusterGrid::GetSlice
+uint GetClusterSlice(float depth)
+{
+    if (depth <= ClusterNear)
+        return 0;
+
+    return min(uint(log(depth / ClusterNear) / log(ClusterFar / ClusterNear) * ClusterSlices), ClusterSlices - 1);
+}
+
 globallycoherent RWTexture2D<float4> output  : register(u0);
 
 groupshared float3 color[100];
@@ -55,25 +80,31 @@ void csmain(uint3 threadID : SV_GROUPTHREADID, uint3 groupID : SV_GROUPID)
     const float3 worldPosition  = V * depth * MaxZ + CameraPOS;
     
     float3 localColor = float3(0, 0, 0);
-    for(uint I = 0; I < LightCount / 32; I += 1) // 32 bits
+    if(ClusterSlices)
     {
-        const uint lightBitBucket = I;
-
-        for(uint II = 0; II < 4; II++) // increments 1 byte at a time
+        const float viewDepth   = -mul(View, float4(worldPosition, 1)).z;
+        const uint2 tile        = min(globalPixelID * ClusterTiles / WH, ClusterTiles - 1);
+        const uint  cluster     = tile.x + tile.y * ClusterTiles.x + GetClusterSlice(viewDepth) * ClusterTiles.x * ClusterTiles.y;
+        const uint  indexBase   = ClusterTiles.x * ClusterTiles.y * ClusterSlices * 2;
+        const uint  lightOffset = lightBitBuckets[cluster * 2 + 0];
+        const uint  clusterSize = lightBitBuckets[cluster * 2 + 1];
+
+        for(uint I = threadID.z; I < clusterSize; I += 8)
+            localColor += ShadePointLight(ReadPointLight(lightBitBuckets[indexBase + lightOffset + I]), N, worldPosition);
+    }
+    else
+    {
+        for(uint I = 0; I < LightCount / 32; I += 1) // 32 bits
         {
-            const uint threadZ          = threadID.z;
-            const uint bitMask          = 1 << (threadZ + II * 8);
-            const uint lightID          = (I * 32 + II * 8) + threadZ;
-            if(lightBitBuckets[offset + lightBitBucket] & bitMask)
+            const uint lightBitBucket = I;
+
+            for(uint II = 0; II < 4; II++) // increments 1 byte at a time
             {
-                PointLight light = ReadPointLight(lightID);
-                const float3 L   = normalize(light.PositionR.xyz - worldPosition);
-                const float  Ld  = length(light.PositionR.xyz - worldPosition);
-                const float  Lr  = light.PositionR.w;
-                const float3 Lk  = light.KI.xyz;
-                const float  Li  = light.KI.w;
-                const float  La  = Li / pow(Ld, 2);
-                localColor += Lk * dot(N, L) * La * saturate(1 - (pow(Ld, 10) / pow(Lr, 10)));
+                const uint threadZ          = threadID.z;
+                const uint bitMask          = 1 << (threadZ + II * 8);
+                const uint lightID          = (I * 32 + II * 8) + threadZ;
+                if(lightBitBuckets[offset + lightBitBucket] & bitMask)
+                    localColor += ShadePointLight(ReadPointLight(lightID), N, worldPosition);
             }
         }
     }
@@ -92,6 +92,30 @@ Forward_VS_OUT Forward_VS(Vertex In)
 }
 
 
+struct VertexInstanced
+{
+    float3   POS		: POSITION;
+    float3   Normal	    : NORMAL;
+    float3   Tangent	: Tangent;
+    float2   UV		    : TEXCOORD;
+    float4x4 InstanceWT : INSTANCEWT; // Same memory as LocalConstants.WT, so it arrives transposed
+};
+
+Forward_VS_OUT ForwardInstanced_VS(VertexInstanced In)
+{
+    const float4x4 instanceWT = transpose(In.InstanceWT);
+
+    Forward_VS_OUT Out;
+    Out.WPOS	= mul(instanceWT, float4(In.POS, 1));
+    Out.POS		= mul(PV, mul(instanceWT, float4(In.POS, 1)));
+    Out.Normal  = normalize(mul(instanceWT, float4(In.Normal, 0.0f)));
+    Out.Tangent = normalize(mul(instanceWT, float4(In.Tangent, 0.0f)));
+    Out.UV		= In.UV;
+
+    return Out;
+}
+
+
 struct VertexSkinned
 {
     float3 POS		: POSITION;